@@ -24,7 +24,7 @@
 
 #include "client/cl_types.h"
 
-#define CGAME_API_VERSION 1
+#define CGAME_API_VERSION 2
 
 // exposed to the client game by the engine
 typedef struct cg_import_s {
@@ -34,9 +34,9 @@ typedef struct cg_import_s {
 	void (*Warn_)(const char *func, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
 	void (*Error_)(const char *func, const char *fmt, ...) __attribute__((noreturn, format(printf, 2, 3)));
 
-	// zone memory management
-	void *(*Malloc)(size_t size, z_tag_t tag);
-	void *(*LinkMalloc)(size_t size, void *parent);
+	// zone memory management, accounted to the call site
+	void *(*Malloc_)(size_t size, z_tag_t tag, const char *site);
+	void *(*LinkMalloc_)(size_t size, void *parent, const char *site);
 	void (*Free)(void *p);
 	void (*FreeTag)(z_tag_t tag);
 
@@ -26,6 +26,12 @@
 #define Warn(...) Warn_(__func__, __VA_ARGS__)
 #define Error(...) Error_(__func__, __VA_ARGS__)
 
+// allocations are accounted to their call site
+#define Z_SITE __FILE__ ":" G_STRINGIFY(__LINE__)
+
+#define Malloc(size, tag) Malloc_(size, tag, Z_SITE)
+#define LinkMalloc(size, parent) LinkMalloc_(size, parent, Z_SITE)
+
 #include "cg_client.h"
 #include "cg_effect.h"
 #include "cg_emit.h"
@@ -119,8 +119,8 @@ void Cl_InitCgame(void) {
 	import.Warn_ = Com_Warn_;
 	import.Error_ = Cl_CgameError;
 
-	import.Malloc = Z_TagMalloc;
-	import.LinkMalloc = Z_LinkMalloc;
+	import.Malloc_ = Z_ModuleMalloc;
+	import.LinkMalloc_ = Z_ModuleLinkMalloc;
 	import.Free = Z_Free;
 	import.FreeTag = Z_FreeTag;
 
@@ -87,7 +87,7 @@ void Cl_SendCmd(void) {
 
 	if (cls.state == CL_CONNECTED) {
 		// send anything we have pending, or just don't timeout
-		if (cls.netchan.message.size || cls.real_time - cls.netchan.last_sent > 1000)
+		if (Netchan_NeedReliable(&cls.netchan) || cls.real_time - cls.netchan.last_sent > 1000)
 			Netchan_Transmit(&cls.netchan, 0, buf.data);
 		return;
 	}
@@ -107,8 +107,8 @@ void Cl_SendCmd(void) {
 	Msg_WriteByte(&buf, CL_CMD_MOVE);
 
 	// let the server know what the last frame we got was, so the next
-	// message can be delta compressed
-	if (!cl.frame.valid || (cls.demo_file && Fs_Tell(cls.demo_file) == 0))
+	// message can be delta compressed, unless the demo needs a keyframe
+	if (!cl.frame.valid || Cl_DemoKeyframePending())
 		Msg_WriteLong(&buf, -1); // no compression
 	else
 		Msg_WriteLong(&buf, cl.frame.server_frame);
@@ -21,6 +21,18 @@
 
 #include "cl_local.h"
 
+/*
+ * @brief Writes the specified message to the demo file, prefixed by its length.
+ * Keyframe messages are flagged so that they are skipped in normal playback.
+ */
+static void Cl_WriteDemoChunk(const size_buf_t *msg, _Bool keyframe) {
+	int32_t len;
+
+	len = LittleLong(msg->size | (keyframe ? DEMO_KEYFRAME : 0));
+	Fs_WriteStream(cls.demo_stream, &len, sizeof(len), 1);
+	Fs_WriteStream(cls.demo_stream, msg->data, msg->size, 1);
+}
+
 /*
  * @brief Writes server_data, config_strings, and baselines once a non-delta
  * compressed frame arrives from the server.
@@ -29,7 +41,6 @@ static void Cl_WriteDemoHeader(void) {
 	byte buffer[MAX_MSG_SIZE];
 	size_buf_t msg;
 	int32_t i;
-	int32_t len;
 	entity_state_t null_state;
 
 	// write out messages to hold the startup information
@@ -49,9 +60,7 @@ static void Cl_WriteDemoHeader(void) {
 	for (i = 0; i < MAX_CONFIG_STRINGS; i++) {
 		if (*cl.config_strings[i] != '\0') {
 			if (msg.size + strlen(cl.config_strings[i]) + 32 > msg.max_size) { // write it out
-				len = LittleLong(msg.size);
-				Fs_Write(cls.demo_file, &len, sizeof(len), 1);
-				Fs_Write(cls.demo_file, msg.data, msg.size, 1);
+				Cl_WriteDemoChunk(&msg, false);
 				msg.size = 0;
 			}
 
@@ -68,15 +77,14 @@ static void Cl_WriteDemoHeader(void) {
 			continue;
 
 		if (msg.size + 64 > msg.max_size) { // write it out
-			len = LittleLong(msg.size);
-			Fs_Write(cls.demo_file, &len, sizeof(len), 1);
-			Fs_Write(cls.demo_file, msg.data, msg.size, 1);
+			Cl_WriteDemoChunk(&msg, false);
 			msg.size = 0;
 		}
 
 		memset(&null_state, 0, sizeof(null_state));
 
 		Msg_WriteByte(&msg, SV_CMD_BASELINE);
+		Msg_WriteShort(&msg, i);
 		Msg_WriteDeltaEntity(&null_state, &cl.entities[i].baseline, &msg, true, true);
 	}
 
@@ -84,40 +92,103 @@ static void Cl_WriteDemoHeader(void) {
 	Msg_WriteString(&msg, "precache 0\n");
 
 	// write it to the demo file
+	Cl_WriteDemoChunk(&msg, false);
 
-	len = LittleLong(msg.size);
-	Fs_Write(cls.demo_file, &len, sizeof(len), 1);
-	Fs_Write(cls.demo_file, msg.data, msg.size, 1);
+	cls.demo_start = cl.frame.server_time;
 
 	Com_Debug("Demo started\n");
 	// the rest of the demo file will be individual frames
 }
 
 /*
- * @brief Dumps the current net message, prefixed by the length.
+ * @return The interval between keyframes, in milliseconds.
+ */
+static uint32_t Cl_DemoKeyframeInterval(void) {
+	return Clamp(cl_demo_keyframes->value, 1.0, 600.0) * 1000;
+}
+
+/*
+ * @brief Writes a keyframe ahead of the current message, which contains an
+ * uncompressed frame. The keyframe restores the config_strings, so that
+ * playback may seek to it. The players and general config_strings are
+ * cleared if unset, as they may have been set after the keyframe. The demo
+ * stream is flushed, so that playback may begin at the keyframe.
+ */
+static void Cl_WriteDemoKeyframe(void) {
+	byte buffer[MAX_MSG_SIZE];
+	size_buf_t msg;
+	demo_keyframe_t keyframe;
+	int32_t i;
+
+	keyframe.time = LittleLong(cl.frame.server_time - cls.demo_start);
+	keyframe.offset = LittleLong(Fs_FlushStream(cls.demo_stream));
+
+	g_array_append_val(cls.demo_keyframes, keyframe);
+
+	Sb_Init(&msg, buffer, sizeof(buffer));
+
+	for (i = 0; i < MAX_CONFIG_STRINGS; i++) {
+		if (*cl.config_strings[i] != '\0' || i >= CS_CLIENTS) {
+			if (msg.size + strlen(cl.config_strings[i]) + 32 > msg.max_size) {
+				Cl_WriteDemoChunk(&msg, true);
+				msg.size = 0;
+			}
+
+			Msg_WriteByte(&msg, SV_CMD_CONFIG_STRING);
+			Msg_WriteShort(&msg, i);
+			Msg_WriteString(&msg, cl.config_strings[i]);
+		}
+	}
+
+	Cl_WriteDemoChunk(&msg, true);
+
+	cls.demo_keyframe = cl.frame.server_time + Cl_DemoKeyframeInterval();
+}
+
+/*
+ * @return True if the demo being recorded is waiting on an uncompressed frame
+ * for its next keyframe.
+ */
+_Bool Cl_DemoKeyframePending(void) {
+
+	if (!cls.demo_file)
+		return false;
+
+	return !cls.demo_keyframes->len || cl.frame.server_time >= cls.demo_keyframe;
+}
+
+/*
+ * @brief Dumps the current net message, prefixed by the length. Messages
+ * received before the first uncompressed frame are discarded.
  */
 void Cl_WriteDemoMessage(void) {
-	int32_t len;
 
 	if (!cls.demo_file)
 		return;
 
-	// if we received an uncompressed frame, write the demo header
-	if (cl.frame.delta_frame < 1 && !Fs_Tell(cls.demo_file)) {
-		Cl_WriteDemoHeader();
+	// if we received an uncompressed frame, write the header and a keyframe
+	if (cl.frame.delta_frame < 1 && Cl_DemoKeyframePending()) {
+
+		if (!cls.demo_keyframes->len)
+			Cl_WriteDemoHeader();
+
+		Cl_WriteDemoKeyframe();
 	}
 
-	// the first eight bytes are just packet sequencing stuff
-	len = LittleLong(net_message.size - 8);
-	Fs_Write(cls.demo_file, &len, sizeof(len), 1);
-	Fs_Write(cls.demo_file, net_message.data + 8, len, 1);
+	if (!cls.demo_keyframes->len)
+		return;
+
+	// the packet sequencing has been stripped by Netchan_Process
+	Cl_WriteDemoChunk(&net_message, false);
 }
 
 /*
- * @brief Stop recording a demo
+ * @brief Stop recording a demo, writing the terminator and the index.
  */
 void Cl_Stop_f(void) {
+	demo_index_t index;
 	int32_t len = -1;
+	size_t in, out;
 
 	if (!cls.demo_file) {
 		Com_Print("Not recording a demo\n");
@@ -125,19 +196,46 @@ void Cl_Stop_f(void) {
 	}
 
 	// finish up
-	Fs_Write(cls.demo_file, &len, sizeof(len), 1);
+	Fs_WriteStream(cls.demo_stream, &len, sizeof(len), 1);
+
+	Fs_StreamStats(cls.demo_stream, &in, NULL);
+	Fs_CloseStream(cls.demo_stream);
+	cls.demo_stream = NULL;
+
+	out = Fs_Tell(cls.demo_file) - sizeof(demo_header_t);
+
+	if (cls.demo_keyframes->len) {
+		Fs_Write(cls.demo_file, cls.demo_keyframes->data, sizeof(demo_keyframe_t),
+				cls.demo_keyframes->len);
+	}
+
+	index.num_keyframes = LittleLong(cls.demo_keyframes->len);
+	index.magic = LittleLong(DEMO_INDEX_MAGIC);
+
+	Fs_Write(cls.demo_file, &index, sizeof(index), 1);
 	Fs_Close(cls.demo_file);
 
+	g_array_free(cls.demo_keyframes, true);
+	cls.demo_keyframes = NULL;
+
 	cls.demo_file = NULL;
-	Com_Print("Stopped demo\n");
+
+	if (in && out < in) {
+		Com_Print("Stopped demo, %u KB compressed to %u KB (%.1f%%)\n", (uint32_t) (in >> 10),
+				(uint32_t) (out >> 10), out * 100.0 / in);
+	} else {
+		Com_Print("Stopped demo, %u KB\n", (uint32_t) (out >> 10));
+	}
 }
 
 /*
  * @brief record <demo name>
  *
- * Begin recording a demo from the current frame until `stop` is issued.
+ * Begin recording a demo from the next uncompressed frame until `stop` is
+ * issued.
  */
 void Cl_Record_f(void) {
+	demo_header_t header;
 
 	if (Cmd_Argc() != 2) {
 		Com_Print("Usage: %s <demo name>\n", Cmd_Argv(0));
@@ -162,6 +260,19 @@ void Cl_Record_f(void) {
 		return;
 	}
 
+	cls.demo_stream = Fs_OpenStreamWrite(cls.demo_file, cl_demo_compress->integer);
+
+	const _Bool compressed = Fs_StreamCompressed(cls.demo_stream);
+
+	header.magic = LittleLong(DEMO_MAGIC);
+	header.version = LittleLong(DEMO_VERSION);
+	header.interval = LittleLong(Cl_DemoKeyframeInterval());
+	header.compression = LittleLong(compressed ? DEMO_COMPRESSION_DEFLATE : DEMO_COMPRESSION_NONE);
+
+	Fs_Write(cls.demo_file, &header, sizeof(header), 1);
+
+	cls.demo_keyframes = g_array_new(false, false, sizeof(demo_keyframe_t));
+
 	Com_Print("Recording to %s\n", cls.demo_filename);
 }
 
@@ -25,6 +25,7 @@
 #include "cl_types.h"
 
 #ifdef __CL_LOCAL_H__
+_Bool Cl_DemoKeyframePending(void);
 void Cl_WriteDemoMessage(void);
 void Cl_Record_f(void);
 void Cl_Stop_f(void);
@@ -65,6 +65,7 @@ static void Cl_ParseEntities(const cl_frame_t *old_frame, cl_frame_t *new_frame)
 	entity_state_t *old_state = NULL;
 	uint32_t old_index;
 	uint16_t old_number;
+	uint16_t last_number = 0;
 
 	new_frame->entity_state = cl.entity_state;
 	new_frame->num_entities = 0;
@@ -85,8 +86,7 @@ static void Cl_ParseEntities(const cl_frame_t *old_frame, cl_frame_t *new_frame)
 	}
 
 	while (true) {
-		const uint16_t number = Msg_ReadShort(&net_message);
-		const uint16_t bits = Msg_ReadShort(&net_message);
+		const uint16_t number = Msg_ReadEntityNumber(&net_message, last_number);
 
 		if (number >= MAX_EDICTS)
 			Com_Error(ERR_DROP, "Bad number: %i\n", number);
@@ -97,6 +97,9 @@ static void Cl_ParseEntities(const cl_frame_t *old_frame, cl_frame_t *new_frame)
 		if (!number)
 			break;
 
+		const uint16_t bits = Msg_ReadBits(&net_message, U_BITS);
+		last_number = number;
+
 		while (old_number < number) { // one or more entities from old_frame are unchanged
 
 			if (cl_show_net_messages->integer == 3)
@@ -184,90 +187,6 @@ static void Cl_ParseEntities(const cl_frame_t *old_frame, cl_frame_t *new_frame)
 	}
 }
 
-/*
- * @brief Parse the player_state_t for the current frame from the server, using delta
- * compression for all fields where possible.
- */
-static void Cl_ParsePlayerstate(const cl_frame_t *old_frame, cl_frame_t *new_frame) {
-	player_state_t *ps;
-	uint16_t pm_state_bits;
-	int32_t i;
-	uint32_t stat_bits;
-
-	ps = &new_frame->ps;
-
-	// copy old value before delta parsing
-	if (old_frame)
-		*ps = old_frame->ps;
-	else
-		// or start clean
-		memset(ps, 0, sizeof(*ps));
-
-	pm_state_bits = Msg_ReadShort(&net_message);
-
-	// parse the pm_state_t
-
-	if (pm_state_bits & PS_M_TYPE)
-		ps->pm_state.pm_type = Msg_ReadByte(&net_message);
-
-	if (cl.demo_server)
-		ps->pm_state.pm_type = PM_FREEZE;
-
-	if (pm_state_bits & PS_M_ORIGIN) {
-		ps->pm_state.origin[0] = Msg_ReadShort(&net_message);
-		ps->pm_state.origin[1] = Msg_ReadShort(&net_message);
-		ps->pm_state.origin[2] = Msg_ReadShort(&net_message);
-	}
-
-	if (pm_state_bits & PS_M_VELOCITY) {
-		ps->pm_state.velocity[0] = Msg_ReadShort(&net_message);
-		ps->pm_state.velocity[1] = Msg_ReadShort(&net_message);
-		ps->pm_state.velocity[2] = Msg_ReadShort(&net_message);
-	}
-
-	if (pm_state_bits & PS_M_FLAGS)
-		ps->pm_state.pm_flags = Msg_ReadShort(&net_message);
-
-	if (pm_state_bits & PS_M_TIME)
-		ps->pm_state.pm_time = Msg_ReadByte(&net_message);
-
-	if (pm_state_bits & PS_M_GRAVITY)
-		ps->pm_state.gravity = Msg_ReadShort(&net_message);
-
-	if (pm_state_bits & PS_M_VIEW_OFFSET) {
-		ps->pm_state.view_offset[0] = Msg_ReadShort(&net_message);
-		ps->pm_state.view_offset[1] = Msg_ReadShort(&net_message);
-		ps->pm_state.view_offset[2] = Msg_ReadShort(&net_message);
-	}
-
-	if (pm_state_bits & PS_M_VIEW_ANGLES) {
-		ps->pm_state.view_angles[0] = Msg_ReadShort(&net_message);
-		ps->pm_state.view_angles[1] = Msg_ReadShort(&net_message);
-		ps->pm_state.view_angles[2] = Msg_ReadShort(&net_message);
-	}
-
-	if (pm_state_bits & PS_M_KICK_ANGLES) {
-		ps->pm_state.kick_angles[0] = Msg_ReadShort(&net_message);
-		ps->pm_state.kick_angles[1] = Msg_ReadShort(&net_message);
-		ps->pm_state.kick_angles[2] = Msg_ReadShort(&net_message);
-	}
-
-	if (pm_state_bits & PS_M_DELTA_ANGLES) {
-		ps->pm_state.delta_angles[0] = Msg_ReadShort(&net_message);
-		ps->pm_state.delta_angles[1] = Msg_ReadShort(&net_message);
-		ps->pm_state.delta_angles[2] = Msg_ReadShort(&net_message);
-	}
-
-	// parse stats
-
-	stat_bits = Msg_ReadLong(&net_message);
-
-	for (i = 0; i < MAX_STATS; i++) {
-		if (stat_bits & (1 << i))
-			ps->stats[i] = Msg_ReadShort(&net_message);
-	}
-}
-
 /*
  * @brief
  */
@@ -306,7 +225,10 @@ void Cl_ParseFrame(void) {
 	len = Msg_ReadByte(&net_message); // read area_bits
 	Msg_ReadData(&net_message, &cl.frame.area_bits, len);
 
-	Cl_ParsePlayerstate(old_frame, &cl.frame);
+	Msg_ReadDeltaPlayerState(old_frame ? &old_frame->ps : NULL, &cl.frame.ps, &net_message);
+
+	if (cl.demo_server)
+		cl.frame.ps.pm_state.pm_type = PM_FREEZE;
 
 	Cl_ParseEntities(old_frame, &cl.frame);
 
@@ -23,6 +23,8 @@
 
 cvar_t *cl_async;
 cvar_t *cl_chat_sound;
+cvar_t *cl_demo_compress;
+cvar_t *cl_demo_keyframes;
 cvar_t *cl_draw_counters;
 cvar_t *cl_draw_net_graph;
 cvar_t *cl_ignore;
@@ -479,6 +481,10 @@ static void Cl_InitLocal(void) {
 	// register our variables
 	cl_async = Cvar_Get("cl_async", "0", CVAR_ARCHIVE, NULL);
 	cl_chat_sound = Cvar_Get("cl_chat_sound", "misc/chat", 0, NULL);
+	cl_demo_compress = Cvar_Get("cl_demo_compress", "6", CVAR_ARCHIVE,
+			"The compression level of recorded demos, 1 (fastest) to 9 (smallest), or 0 for none");
+	cl_demo_keyframes = Cvar_Get("cl_demo_keyframes", "10", CVAR_ARCHIVE,
+			"The interval, in seconds, between keyframes of recorded demos");
 	cl_draw_counters = Cvar_Get("cl_draw_counters", "1", CVAR_ARCHIVE, NULL);
 	cl_draw_net_graph = Cvar_Get("cl_draw_net_graph", "1", CVAR_ARCHIVE, NULL);
 	cl_ignore = Cvar_Get("cl_ignore", "", 0, NULL);
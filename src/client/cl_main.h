@@ -27,6 +27,8 @@
 // settings and preferences
 extern cvar_t *cl_async;
 extern cvar_t *cl_chat_sound;
+extern cvar_t *cl_demo_compress;
+extern cvar_t *cl_demo_keyframes;
 extern cvar_t *cl_draw_counters;
 extern cvar_t *cl_ignore;
 extern cvar_t *cl_max_fps;
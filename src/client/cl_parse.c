@@ -139,7 +139,11 @@ static void Cl_ParseBaseline(void) {
 	entity_state_t null_state;
 
 	const uint16_t number = Msg_ReadShort(&net_message);
-	const uint16_t bits = Msg_ReadShort(&net_message);
+	const uint16_t bits = Msg_ReadBits(&net_message, U_BITS);
+
+	if (number >= MAX_EDICTS) {
+		Com_Error(ERR_DROP, "Bad number: %i\n", number);
+	}
 
 	memset(&null_state, 0, sizeof(null_state));
 	state = &cl.entities[number].baseline;
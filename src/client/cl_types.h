@@ -269,6 +269,10 @@ typedef struct cl_static_s {
 
 	char demo_filename[MAX_OSPATH];
 	file_t *demo_file;
+	fs_stream_t *demo_stream; // the messages of the demo, compressed if enabled
+	GArray *demo_keyframes; // the index of the demo being recorded
+	uint32_t demo_start; // server time of the first frame recorded
+	uint32_t demo_keyframe; // server time at which the next keyframe is due
 
 	cl_server_info_t *servers; // list of servers from all sources
 	char *servers_text; // tabular data for servers menu
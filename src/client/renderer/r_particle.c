@@ -209,12 +209,30 @@ static void R_UpdateParticleState(void) {
 	AngleVectors(v, NULL, r_particle_state.splash_right[1], r_particle_state.splash_up[1]);
 }
 
+/*
+ * @brief Generates primitives for the sorted particles in [begin, end).
+ */
+static void R_UpdateParticles_(int32_t begin, int32_t end, void *data __attribute__((unused))) {
+	int32_t i;
+
+	const r_element_t *e = &r_particle_state.sorted_particles[begin];
+
+	for (i = begin; i < end; i++, e++) {
+
+		const r_particle_t *p = (const r_particle_t *) e->element;
+
+		R_ParticleVerts(p, &r_particle_state.verts[i * 3 * 4]);
+		R_ParticleTexcoords(p, &r_particle_state.texcoords[i * 2 * 4]);
+		R_ParticleColor(p, &r_particle_state.colors[i * 4 * 4]);
+	}
+}
+
 /*
  * @brief Updates all particle primitives for the current frame. This is
- * optionally run in a separate thread.
+ * optionally run in a separate thread, and primitive generation is itself
+ * spread across the job system.
  */
 void R_UpdateParticles(void *data __attribute__((unused))) {
-	int32_t i;
 
 	if (!r_view.num_particles)
 		return;
@@ -224,16 +242,7 @@ void R_UpdateParticles(void *data __attribute__((unused))) {
 	R_SortElements(r_particle_state.sorted_particles, r_view.num_particles);
 
 	// generate primitives for each particle in the sorted array
-	const r_element_t *e = r_particle_state.sorted_particles;
-
-	for (i = 0; i < r_view.num_particles; i++, e++) {
-
-		const r_particle_t *p = (const r_particle_t *) e->element;
-
-		R_ParticleVerts(p, &r_particle_state.verts[i * 3 * 4]);
-		R_ParticleTexcoords(p, &r_particle_state.texcoords[i * 2 * 4]);
-		R_ParticleColor(p, &r_particle_state.colors[i * 4 * 4]);
-	}
+	Thread_ParallelFor(r_view.num_particles, 256, R_UpdateParticles_, NULL);
 }
 
 /*
@@ -559,6 +559,14 @@ static void Cmd_Wait_f(void) {
 	cmd_state.wait = true;
 }
 
+/*
+ * @brief Prints managed memory statistics. Use "z_stats dump" for tab-separated
+ * values suitable for parsing.
+ */
+static void Cmd_ZStats_f(void) {
+	Z_Stats(!g_strcmp0(Cmd_Argv(1), "dump"));
+}
+
 /*
  * @brief Initializes the command subsystem.
  */
@@ -577,6 +585,7 @@ void Cmd_Init(void) {
 	Cmd_Add("wait", Cmd_Wait_f, 0, NULL);
 
 	Cmd_Add("z_size", Z_Size_f, CMD_SYSTEM, "Print zone allocation pool size");
+	Cmd_Add("z_stats", Cmd_ZStats_f, CMD_SYSTEM, "Print zone allocation statistics by tag and call site");
 
 	int32_t i;
 	for (i = 1; i < Com_Argc(); i++) {
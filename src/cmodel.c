@@ -19,7 +19,15 @@
  * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
  */
 
+#include <SDL/SDL_thread.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "cmd.h"
 #include "cmodel.h"
+#include "threads.h"
 
 typedef struct c_bsp_node_s {
 	c_bsp_plane_t *plane;
@@ -43,8 +51,16 @@ typedef struct c_bsp_brush_s {
 	int32_t contents;
 	int32_t num_sides;
 	int32_t first_brush_side;
+	int32_t first_brush_planes;
+	vec3_t mins, maxs; // from the axial sides, or infinite
 } c_bsp_brush_t;
 
+// the planes of four consecutive brush sides, for evaluating them at once
+typedef struct c_bsp_brush_planes_s {
+	vec_t normal[3][4];
+	vec_t dist[4];
+} c_bsp_brush_planes_t;
+
 typedef struct c_bsp_area_s {
 	int32_t num_area_portals;
 	int32_t first_area_portal;
@@ -52,73 +68,245 @@ typedef struct c_bsp_area_s {
 	int32_t flood_valid;
 } c_bsp_area_t;
 
-typedef struct c_bsp_s {
+// bounding box to bsp tree structure for tracing
+typedef struct c_bounding_box_s {
+	int32_t head_node;
+	c_bsp_plane_t *planes;
+	c_bsp_brush_t *brush;
+	c_bsp_leaf_t *leaf;
+} c_bounding_box_t;
+
+typedef struct c_vis_row_s {
+	int32_t key; // VIS_KEY, or -1 if unused
+	byte *data;
+
+	struct c_vis_row_s *prev, *next;
+} c_vis_row_t;
+
+typedef struct {
+	byte *block; // the managed allocation
+	byte *data; // the aligned rows
+	size_t row_size; // bytes per row, padded to VIS_ROW_ALIGN
+	size_t size; // total bytes allocated
+
+	_Bool resident; // true if every row is decompressed
+
+	c_vis_row_t *rows;
+	uint32_t num_rows;
+
+	int32_t *keys; // row index for each VIS_KEY, or -1
+	c_vis_row_t lru; // sentinel; lru.next is the most recently used
+
+	SDL_mutex *lock;
+
+	volatile uint32_t hits, misses;
+} c_vis_cache_t;
+
+/*
+ * A collision model. Each lump is allocated to the size of the map, plus the
+ * slots reserved for the box hull, and linked to the model itself.
+ */
+struct cm_bsp_s {
 	char name[MAX_QPATH];
+	int32_t file_size;
 	byte *base;
+	size_t size; // bytes allocated, excluding the visibility row cache
 
 	int32_t num_brush_sides;
-	c_bsp_brush_side_t brush_sides[MAX_BSP_BRUSH_SIDES];
+	c_bsp_brush_side_t *brush_sides; // num_brush_sides + 6
 
 	int32_t num_surfaces;
-	c_bsp_surface_t surfaces[MAX_BSP_TEXINFO];
+	c_bsp_surface_t *surfaces;
 
 	int32_t num_planes;
-	c_bsp_plane_t planes[MAX_BSP_PLANES + 6]; // extra for box hull
+	c_bsp_plane_t *planes; // num_planes + 12
 
 	int32_t num_nodes;
-	c_bsp_node_t nodes[MAX_BSP_NODES + 6]; // extra for box hull
+	c_bsp_node_t *nodes; // num_nodes + 6
 
 	int32_t num_leafs;
-	c_bsp_leaf_t leafs[MAX_BSP_LEAFS];
+	c_bsp_leaf_t *leafs; // num_leafs + 1
 	int32_t empty_leaf, solid_leaf;
 
 	int32_t num_leaf_brushes;
-	uint16_t leaf_brushes[MAX_BSP_LEAF_BRUSHES];
+	uint16_t *leaf_brushes; // num_leaf_brushes + 1
 
 	int32_t num_models;
-	c_model_t models[MAX_BSP_MODELS];
+	c_model_t *models;
 
 	int32_t num_brushes;
-	c_bsp_brush_t brushes[MAX_BSP_BRUSHES];
+	c_bsp_brush_t *brushes; // num_brushes + 1
+
+	int32_t num_brush_planes;
+	c_bsp_brush_planes_t *brush_planes; // padded to four sides per brush
 
 	int32_t num_visibility;
-	byte visibility[MAX_BSP_VISIBILITY];
+	byte *visibility;
+	d_bsp_vis_t *vis;
 
 	int32_t entity_string_len;
-	char entity_string[MAX_BSP_ENT_STRING];
+	char *entity_string;
 
 	int32_t num_areas;
-	c_bsp_area_t areas[MAX_BSP_AREAS];
+	c_bsp_area_t *areas; // num_areas + 1
 
 	int32_t num_area_portals;
-	d_bsp_area_portal_t area_portals[MAX_BSP_AREA_PORTALS];
+	d_bsp_area_portal_t *area_portals;
 
 	c_bsp_surface_t null_surface;
 
 	int32_t flood_valid;
 
-	_Bool portal_open[MAX_BSP_AREA_PORTALS];
-} c_bsp_t;
-
-static c_bsp_t c_bsp;
-static d_bsp_vis_t *c_vis = (d_bsp_vis_t *) c_bsp.visibility;
+	_Bool *portal_open; // num_area_portals + 1
+
+	c_bounding_box_t box;
+
+	c_vis_cache_t vis_cache;
+};
+
+// the footprint of the fixed-size collision model, for comparison
+#define CM_FIXED_SIZE ( \
+	MAX_BSP_BRUSH_SIDES * sizeof(c_bsp_brush_side_t) + \
+	MAX_BSP_TEXINFO * sizeof(c_bsp_surface_t) + \
+	(MAX_BSP_PLANES + 6) * sizeof(c_bsp_plane_t) + \
+	(MAX_BSP_NODES + 6) * sizeof(c_bsp_node_t) + \
+	MAX_BSP_LEAFS * sizeof(c_bsp_leaf_t) + \
+	MAX_BSP_LEAF_BRUSHES * sizeof(uint16_t) + \
+	MAX_BSP_MODELS * sizeof(c_model_t) + \
+	MAX_BSP_BRUSHES * sizeof(c_bsp_brush_t) + \
+	MAX_BSP_VISIBILITY + \
+	MAX_BSP_ENT_STRING + \
+	MAX_BSP_AREAS * sizeof(c_bsp_area_t) + \
+	MAX_BSP_AREA_PORTALS * (sizeof(d_bsp_area_portal_t) + sizeof(_Bool)))
+
+static c_bsp_leaf_t c_null_leafs[2];
+static c_model_t c_null_models[1];
+static c_bsp_area_t c_null_areas[2];
+static _Bool c_null_portal_open[1];
+static d_bsp_vis_t c_null_vis = { .num_clusters = 1 };
+
+// the model used when no map is loaded, and for demo playback
+static cm_bsp_t c_null_bsp = {
+	.num_leafs = 1,
+	.leafs = c_null_leafs,
+	.models = c_null_models,
+	.num_areas = 1,
+	.areas = c_null_areas,
+	.portal_open = c_null_portal_open,
+	.vis = &c_null_vis
+};
+
+// the map that Cm_LoadBsp loaded, which the Cm_* functions operate on
+static cm_bsp_t *c_map;
+
+// the model the calling thread selected instead, which its jobs inherit
+static __thread cm_bsp_t *c_bsp;
+
+// the model being loaded, which is freed if Com_Error interrupts loading it
+static cm_bsp_t *c_loading;
 
 static cvar_t *c_no_areas;
+static cvar_t *c_simd;
+static cvar_t *c_vis_cache;
+
+// traces against the map may be recorded, for replay by bench_cm_trace
+typedef struct {
+	cm_bsp_t *bsp;
+	file_t *file;
+	SDL_mutex *lock;
+} c_trace_recording_t;
+
+static c_trace_recording_t c_trace_recording;
+
+static void Cm_InitBoxHull(cm_bsp_t *bsp);
+static void Cm_InitBrushPlanes(cm_bsp_t *bsp);
+static void Cm_UpdateBrushPlanes(cm_bsp_t *bsp, c_bsp_brush_t *brush);
+static void Cm_StopTraceRecording(void);
+static void Cm_TraceRecord_f(void);
+static void Cm_InitVisCache(cm_bsp_t *bsp);
+static void Cm_FloodAreaConnections(cm_bsp_t *bsp);
+static void *Cm_GetThreadBsp(void);
+static void Cm_SetThreadBsp(void *bsp);
+
+/*
+ * @brief Returns the collision model the calling thread operates on.
+ */
+static inline cm_bsp_t *Cm_Selected(void) {
+
+	if (c_bsp)
+		return c_bsp;
+
+	return c_map ? c_map : &c_null_bsp;
+}
+
+/*
+ * Trace statistics are counted per thread, as traces run on the job pool, and
+ * summed by Cm_TraceStats while the pool is idle. The counts of each thread
+ * are linked once, and never freed, as they may outlive the thread.
+ */
+typedef struct c_trace_counts_s {
+	c_trace_stats_t stats;
+	struct c_trace_counts_s *next;
+} c_trace_counts_t;
+
+static c_trace_counts_t *c_trace_counts;
+static __thread c_trace_counts_t *c_thread_trace_counts;
+
+/*
+ * @brief Returns the trace statistics of the calling thread.
+ */
+static c_trace_stats_t *Cm_ThreadTraceStats(void) {
+
+	if (!c_thread_trace_counts) {
+		c_trace_counts_t *counts = g_new0(c_trace_counts_t, 1);
+
+		do {
+			counts->next = c_trace_counts;
+		} while (!__sync_bool_compare_and_swap(&c_trace_counts, counts->next, counts));
+
+		c_thread_trace_counts = counts;
+	}
+
+	return &c_thread_trace_counts->stats;
+}
+
+/*
+ * @brief Sums the trace statistics of all threads since the last call, and
+ * resets them. No other thread may be tracing.
+ */
+void Cm_TraceStats(c_trace_stats_t *stats) {
+	c_trace_counts_t *counts;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for (counts = c_trace_counts; counts; counts = counts->next) {
+		stats->traces += counts->stats.traces;
+		stats->brush_traces += counts->stats.brush_traces;
+		stats->brush_rejects += counts->stats.brush_rejects;
+		stats->point_contents += counts->stats.point_contents;
+
+		memset(&counts->stats, 0, sizeof(counts->stats));
+	}
+}
 
-static void Cm_InitBoxHull(void);
-static void Cm_FloodAreaConnections(void);
+/*
+ * @brief Allocates count elements of the specified size to the model.
+ */
+static void *Cm_Malloc(cm_bsp_t *bsp, size_t count, size_t size) {
 
-int32_t c_point_contents;
-int32_t c_traces, c_bsp_brush_traces;
+	bsp->size += count * size;
+
+	return Z_LinkMalloc(count * size, bsp);
+}
 
 /*
  * @brief
  */
-static void Cm_LoadSubmodels(const d_bsp_lump_t *l) {
+static void Cm_LoadSubmodels(cm_bsp_t *bsp, const d_bsp_lump_t *l) {
 	const d_bsp_model_t *in;
 	int32_t i, j, count;
 
-	in = (const void *) (c_bsp.base + l->file_ofs);
+	in = (const void *) (bsp->base + l->file_ofs);
 	if (l->file_len % sizeof(*in)) {
 		Com_Error(ERR_DROP, "Funny lump size\n");
 	}
@@ -131,10 +319,11 @@ static void Cm_LoadSubmodels(const d_bsp_lump_t *l) {
 		Com_Error(ERR_DROP, "Map has too many models\n");
 	}
 
-	c_bsp.num_models = count;
+	bsp->num_models = count;
+	bsp->models = Cm_Malloc(bsp, count, sizeof(c_model_t));
 
 	for (i = 0; i < count; i++, in++) {
-		c_model_t *out = &c_bsp.models[i];
+		c_model_t *out = &bsp->models[i];
 
 		for (j = 0; j < 3; j++) { // spread the mins / maxs by a pixel
 			out->mins[j] = LittleFloat(in->mins[j]) - 1;
@@ -148,12 +337,12 @@ static void Cm_LoadSubmodels(const d_bsp_lump_t *l) {
 /*
  * @brief
  */
-static void Cm_LoadSurfaces(const d_bsp_lump_t *l) {
+static void Cm_LoadSurfaces(cm_bsp_t *bsp, const d_bsp_lump_t *l) {
 	const d_bsp_texinfo_t *in;
 	c_bsp_surface_t *out;
 	int32_t i, count;
 
-	in = (const void *) (c_bsp.base + l->file_ofs);
+	in = (const void *) (bsp->base + l->file_ofs);
 	if (l->file_len % sizeof(*in)) {
 		Com_Error(ERR_DROP, "Funny lump size\n");
 		return;
@@ -165,8 +354,8 @@ static void Cm_LoadSurfaces(const d_bsp_lump_t *l) {
 	if (count > MAX_BSP_TEXINFO) {
 		Com_Error(ERR_DROP, "Map has too many surfaces\n");
 	}
-	c_bsp.num_surfaces = count;
-	out = c_bsp.surfaces;
+	bsp->num_surfaces = count;
+	out = bsp->surfaces = Cm_Malloc(bsp, count, sizeof(c_bsp_surface_t));
 
 	for (i = 0; i < count; i++, in++, out++) {
 		g_strlcpy(out->name, in->texture, sizeof(out->name));
@@ -178,13 +367,13 @@ static void Cm_LoadSurfaces(const d_bsp_lump_t *l) {
 /*
  * @brief
  */
-static void Cm_LoadNodes(const d_bsp_lump_t *l) {
+static void Cm_LoadNodes(cm_bsp_t *bsp, const d_bsp_lump_t *l) {
 	const d_bsp_node_t *in;
 	int32_t child;
 	c_bsp_node_t *out;
 	int32_t i, j, count;
 
-	in = (const void *) (c_bsp.base + l->file_ofs);
+	in = (const void *) (bsp->base + l->file_ofs);
 	if (l->file_len % sizeof(*in)) {
 		Com_Error(ERR_DROP, "Funny lump size\n");
 	}
@@ -197,12 +386,12 @@ static void Cm_LoadNodes(const d_bsp_lump_t *l) {
 		Com_Error(ERR_DROP, "Map has too many nodes\n");
 	}
 
-	out = c_bsp.nodes;
+	out = bsp->nodes = Cm_Malloc(bsp, count + 6, sizeof(c_bsp_node_t));
 
-	c_bsp.num_nodes = count;
+	bsp->num_nodes = count;
 
 	for (i = 0; i < count; i++, out++, in++) {
-		out->plane = c_bsp.planes + LittleLong(in->plane_num);
+		out->plane = bsp->planes + LittleLong(in->plane_num);
 		for (j = 0; j < 2; j++) {
 			child = LittleLong(in->children[j]);
 			out->children[j] = child;
@@ -213,12 +402,12 @@ static void Cm_LoadNodes(const d_bsp_lump_t *l) {
 /*
  * @brief
  */
-static void Cm_LoadBrushes(const d_bsp_lump_t *l) {
+static void Cm_LoadBrushes(cm_bsp_t *bsp, const d_bsp_lump_t *l) {
 	const d_bsp_brush_t *in;
 	c_bsp_brush_t *out;
 	int32_t i, count;
 
-	in = (const void *) (c_bsp.base + l->file_ofs);
+	in = (const void *) (bsp->base + l->file_ofs);
 	if (l->file_len % sizeof(*in)) {
 		Com_Error(ERR_DROP, "Funny lump size\n");
 	}
@@ -228,9 +417,9 @@ static void Cm_LoadBrushes(const d_bsp_lump_t *l) {
 		Com_Error(ERR_DROP, "Map has too many brushes\n");
 	}
 
-	out = c_bsp.brushes;
+	out = bsp->brushes = Cm_Malloc(bsp, count + 1, sizeof(c_bsp_brush_t));
 
-	c_bsp.num_brushes = count;
+	bsp->num_brushes = count;
 
 	for (i = 0; i < count; i++, out++, in++) {
 		out->first_brush_side = LittleLong(in->first_side);
@@ -242,13 +431,13 @@ static void Cm_LoadBrushes(const d_bsp_lump_t *l) {
 /*
  * @brief
  */
-static void Cm_LoadLeafs(const d_bsp_lump_t *l) {
+static void Cm_LoadLeafs(cm_bsp_t *bsp, const d_bsp_lump_t *l) {
 	int32_t i;
 	c_bsp_leaf_t *out;
 	const d_bsp_leaf_t *in;
 	int32_t count;
 
-	in = (const void *) (c_bsp.base + l->file_ofs);
+	in = (const void *) (bsp->base + l->file_ofs);
 	if (l->file_len % sizeof(*in)) {
 		Com_Error(ERR_DROP, "Funny lump size\n");
 	}
@@ -257,13 +446,12 @@ static void Cm_LoadLeafs(const d_bsp_lump_t *l) {
 	if (count < 1) {
 		Com_Error(ERR_DROP, "Map with no leafs\n");
 	}
-	// need to save space for box planes
-	if (count > MAX_BSP_PLANES) {
-		Com_Error(ERR_DROP, "Map has too many planes\n");
+	if (count > MAX_BSP_LEAFS) {
+		Com_Error(ERR_DROP, "Map has too many leafs\n");
 	}
 
-	out = c_bsp.leafs;
-	c_bsp.num_leafs = count;
+	out = bsp->leafs = Cm_Malloc(bsp, count + 1, sizeof(c_bsp_leaf_t));
+	bsp->num_leafs = count;
 
 	for (i = 0; i < count; i++, in++, out++) {
 		out->contents = LittleLong(in->contents);
@@ -273,31 +461,31 @@ static void Cm_LoadLeafs(const d_bsp_lump_t *l) {
 		out->num_leaf_brushes = LittleShort(in->num_leaf_brushes);
 	}
 
-	if (c_bsp.leafs[0].contents != CONTENTS_SOLID) {
+	if (bsp->leafs[0].contents != CONTENTS_SOLID) {
 		Com_Error(ERR_DROP, "Map leaf 0 is not CONTENTS_SOLID\n");
 	}
-	c_bsp.solid_leaf = 0;
-	c_bsp.empty_leaf = -1;
-	for (i = 1; i < c_bsp.num_leafs; i++) {
-		if (!c_bsp.leafs[i].contents) {
-			c_bsp.empty_leaf = i;
+	bsp->solid_leaf = 0;
+	bsp->empty_leaf = -1;
+	for (i = 1; i < bsp->num_leafs; i++) {
+		if (!bsp->leafs[i].contents) {
+			bsp->empty_leaf = i;
 			break;
 		}
 	}
-	if (c_bsp.empty_leaf == -1)
+	if (bsp->empty_leaf == -1)
 		Com_Error(ERR_DROP, "Map does not have an empty leaf\n");
 }
 
 /*
  * @brief
  */
-static void Cm_LoadPlanes(const d_bsp_lump_t *l) {
+static void Cm_LoadPlanes(cm_bsp_t *bsp, const d_bsp_lump_t *l) {
 	int32_t i, j;
 	c_bsp_plane_t *out;
 	const d_bsp_plane_t *in;
 	int32_t count;
 
-	in = (const void *) (c_bsp.base + l->file_ofs);
+	in = (const void *) (bsp->base + l->file_ofs);
 	if (l->file_len % sizeof(*in)) {
 		Com_Error(ERR_DROP, "Funny lump size\n");
 	}
@@ -311,8 +499,8 @@ static void Cm_LoadPlanes(const d_bsp_lump_t *l) {
 		Com_Error(ERR_DROP, "Map has too many planes\n");
 	}
 
-	out = c_bsp.planes;
-	c_bsp.num_planes = count;
+	out = bsp->planes = Cm_Malloc(bsp, count + 12, sizeof(c_bsp_plane_t));
+	bsp->num_planes = count;
 
 	for (i = 0; i < count; i++, in++, out++) {
 
@@ -329,13 +517,13 @@ static void Cm_LoadPlanes(const d_bsp_lump_t *l) {
 /*
  * @brief
  */
-static void Cm_LoadLeafBrushes(const d_bsp_lump_t *l) {
+static void Cm_LoadLeafBrushes(cm_bsp_t *bsp, const d_bsp_lump_t *l) {
 	int32_t i;
 	uint16_t *out;
 	const uint16_t *in;
 	int32_t count;
 
-	in = (const void *) (c_bsp.base + l->file_ofs);
+	in = (const void *) (bsp->base + l->file_ofs);
 	if (l->file_len % sizeof(*in)) {
 		Com_Error(ERR_DROP, "Funny lump size\n");
 	}
@@ -349,8 +537,8 @@ static void Cm_LoadLeafBrushes(const d_bsp_lump_t *l) {
 		Com_Error(ERR_DROP, "Map has too many leaf brushes\n");
 	}
 
-	out = c_bsp.leaf_brushes;
-	c_bsp.num_leaf_brushes = count;
+	out = bsp->leaf_brushes = Cm_Malloc(bsp, count + 1, sizeof(uint16_t));
+	bsp->num_leaf_brushes = count;
 
 	for (i = 0; i < count; i++, in++, out++)
 		*out = LittleShort(*in);
@@ -359,14 +547,14 @@ static void Cm_LoadLeafBrushes(const d_bsp_lump_t *l) {
 /*
  * @brief
  */
-static void Cm_LoadBrushSides(const d_bsp_lump_t *l) {
+static void Cm_LoadBrushSides(cm_bsp_t *bsp, const d_bsp_lump_t *l) {
 	int32_t i;
 	c_bsp_brush_side_t *out;
 	const d_bsp_brush_side_t *in;
 	int32_t count;
 	int32_t num;
 
-	in = (const void *) (c_bsp.base + l->file_ofs);
+	in = (const void *) (bsp->base + l->file_ofs);
 	if (l->file_len % sizeof(*in)) {
 		Com_Error(ERR_DROP, "Funny lump size\n");
 	}
@@ -377,30 +565,30 @@ static void Cm_LoadBrushSides(const d_bsp_lump_t *l) {
 		Com_Error(ERR_DROP, "Map has too many planes\n");
 	}
 
-	out = c_bsp.brush_sides;
-	c_bsp.num_brush_sides = count;
+	out = bsp->brush_sides = Cm_Malloc(bsp, count + 6, sizeof(c_bsp_brush_side_t));
+	bsp->num_brush_sides = count;
 
 	for (i = 0; i < count; i++, in++, out++) {
 		num = LittleShort(in->plane_num);
-		out->plane = &c_bsp.planes[num];
+		out->plane = &bsp->planes[num];
 		num = LittleShort(in->surf_num);
-		if (num >= c_bsp.num_surfaces) {
+		if (num >= bsp->num_surfaces) {
 			Com_Error(ERR_DROP, "Bad brush side surface index\n");
 		}
-		out->surface = &c_bsp.surfaces[num];
+		out->surface = &bsp->surfaces[num];
 	}
 }
 
 /*
  * @brief
  */
-static void Cm_LoadAreas(const d_bsp_lump_t *l) {
+static void Cm_LoadAreas(cm_bsp_t *bsp, const d_bsp_lump_t *l) {
 	int32_t i;
 	c_bsp_area_t *out;
 	const d_bsp_area_t *in;
 	int32_t count;
 
-	in = (const void *) (c_bsp.base + l->file_ofs);
+	in = (const void *) (bsp->base + l->file_ofs);
 	if (l->file_len % sizeof(*in)) {
 		Com_Error(ERR_DROP, "Funny lump size\n");
 	}
@@ -410,8 +598,8 @@ static void Cm_LoadAreas(const d_bsp_lump_t *l) {
 		Com_Error(ERR_DROP, "Map has too many areas\n");
 	}
 
-	out = c_bsp.areas;
-	c_bsp.num_areas = count;
+	out = bsp->areas = Cm_Malloc(bsp, count + 1, sizeof(c_bsp_area_t));
+	bsp->num_areas = count;
 
 	for (i = 0; i < count; i++, in++, out++) {
 		out->num_area_portals = LittleLong(in->num_area_portals);
@@ -424,24 +612,25 @@ static void Cm_LoadAreas(const d_bsp_lump_t *l) {
 /*
  * @brief
  */
-static void Cm_LoadAreaPortals(const d_bsp_lump_t *l) {
+static void Cm_LoadAreaPortals(cm_bsp_t *bsp, const d_bsp_lump_t *l) {
 	int32_t i;
 	d_bsp_area_portal_t *out;
 	const d_bsp_area_portal_t *in;
 	int32_t count;
 
-	in = (const void *) (c_bsp.base + l->file_ofs);
+	in = (const void *) (bsp->base + l->file_ofs);
 	if (l->file_len % sizeof(*in)) {
 		Com_Error(ERR_DROP, "Funny lump size\n");
 	}
 	count = l->file_len / sizeof(*in);
 
-	if (count > MAX_BSP_AREAS) {
-		Com_Error(ERR_DROP, "Map has too many areas\n");
+	if (count > MAX_BSP_AREA_PORTALS) {
+		Com_Error(ERR_DROP, "Map has too many area portals\n");
 	}
 
-	out = c_bsp.area_portals;
-	c_bsp.num_area_portals = count;
+	out = bsp->area_portals = Cm_Malloc(bsp, count, sizeof(d_bsp_area_portal_t));
+	bsp->portal_open = Cm_Malloc(bsp, count + 1, sizeof(_Bool));
+	bsp->num_area_portals = count;
 
 	for (i = 0; i < count; i++, in++, out++) {
 		out->portal_num = LittleLong(in->portal_num);
@@ -452,65 +641,107 @@ static void Cm_LoadAreaPortals(const d_bsp_lump_t *l) {
 /*
  * @brief
  */
-static void Cm_LoadVisibility(const d_bsp_lump_t *l) {
+static void Cm_LoadVisibility(cm_bsp_t *bsp, const d_bsp_lump_t *l) {
 	int32_t i;
 
-	c_bsp.num_visibility = l->file_len;
+	bsp->num_visibility = l->file_len;
 	if (l->file_len > MAX_BSP_VISIBILITY) {
 		Com_Error(ERR_DROP, "Map has too large visibility lump\n");
 	}
 
-	memcpy(c_bsp.visibility, c_bsp.base + l->file_ofs, l->file_len);
+	// the header is read even if the lump is empty
+	const size_t size = l->file_len > (int32_t) sizeof(d_bsp_vis_t) ? l->file_len : sizeof(d_bsp_vis_t);
+
+	bsp->visibility = Cm_Malloc(bsp, size, 1);
+	bsp->vis = (d_bsp_vis_t *) bsp->visibility;
+
+	memcpy(bsp->visibility, bsp->base + l->file_ofs, l->file_len);
 
-	c_vis->num_clusters = LittleLong(c_vis->num_clusters);
+	bsp->vis->num_clusters = LittleLong(bsp->vis->num_clusters);
 
-	for (i = 0; i < c_vis->num_clusters; i++) {
-		c_vis->bit_offsets[i][0] = LittleLong(c_vis->bit_offsets[i][0]);
-		c_vis->bit_offsets[i][1] = LittleLong(c_vis->bit_offsets[i][1]);
+	for (i = 0; i < bsp->vis->num_clusters; i++) {
+		bsp->vis->bit_offsets[i][0] = LittleLong(bsp->vis->bit_offsets[i][0]);
+		bsp->vis->bit_offsets[i][1] = LittleLong(bsp->vis->bit_offsets[i][1]);
 	}
 
 	// If we have no visibility data, pad the clusters so that Cm_DecompressVis
 	// produces correctly-sized rows. If we don't do this, non-VIS'ed maps will
 	// not produce any visible entities.
-	if (c_bsp.num_visibility == 0) {
-		c_vis->num_clusters = c_bsp.num_leafs;
+	if (bsp->num_visibility == 0) {
+		bsp->vis->num_clusters = bsp->num_leafs;
 	}
 }
 
 /*
  * @brief
  */
-static void Cm_LoadEntityString(const d_bsp_lump_t *l) {
+static void Cm_LoadEntityString(cm_bsp_t *bsp, const d_bsp_lump_t *l) {
 
-	c_bsp.entity_string_len = l->file_len;
+	bsp->entity_string_len = l->file_len;
 
 	if (l->file_len > MAX_BSP_ENT_STRING) {
 		Com_Error(ERR_DROP, "Map has too large entity lump\n");
 	}
 
-	memcpy(c_bsp.entity_string, c_bsp.base + l->file_ofs, l->file_len);
+	bsp->entity_string = Cm_Malloc(bsp, l->file_len + 1, 1);
+
+	memcpy(bsp->entity_string, bsp->base + l->file_ofs, l->file_len);
 }
 
 /*
- * @brief Loads in the BSP and all submodels for collision detection.
+ * @brief Registers the collision model's console variables and commands. This
+ * is called once at startup, before any model is loaded.
  */
-c_model_t *Cm_LoadBsp(const char *name, int32_t *size) {
-	d_bsp_header_t header;
-	void *buf;
-	uint32_t i;
+void Cm_Init(void) {
 
 	c_no_areas = Cvar_Get("c_no_areas", "0", 0, "Disable server-side visibility culling");
+	c_simd = Cvar_Get("c_simd", "1", 0, "Clip traces to several brush sides at once, if supported");
+	c_vis_cache = Cvar_Get("c_vis_cache", "16", CVAR_ARCHIVE,
+			"Memory budget for decompressed visibility rows, in megabytes");
 
-	memset(&c_bsp, 0, sizeof(c_bsp));
+	Cmd_Add("c_vis_stats", Cm_VisStats_f, CMD_SYSTEM, "Print visibility row cache statistics");
+	Cmd_Add("c_trace_record", Cm_TraceRecord_f, CMD_SYSTEM,
+			"Record the traces against the current map to the specified file, or stop recording");
+
+	Thread_Inherit(Cm_GetThreadBsp, Cm_SetThreadBsp);
+}
+
+/*
+ * @brief Frees the collision model whose loading was interrupted by Com_Error,
+ * along with its file. This is called on the error path, and before loading.
+ */
+void Cm_AbortLoad(void) {
 
-	// if we've been asked to load a demo, just clean up and return
+	if (!c_loading) {
+		return;
+	}
+
+	if (c_loading->base) {
+		Fs_Free(c_loading->base);
+	}
+
+	Cm_CloseBsp(c_loading);
+	c_loading = NULL;
+}
+
+/*
+ * @brief Loads a collision model from the named BSP, independent of the one
+ * the Cm_* functions operate on. Several may be loaded at once. If name is
+ * NULL, the static empty model is returned for demo playback.
+ */
+cm_bsp_t *Cm_OpenBsp(const char *name, int32_t *size) {
+	d_bsp_header_t header;
+	void *buf;
+	uint32_t i;
+
+	// if we've been asked to load a demo, there is nothing to load
 	if (!name) {
-		c_bsp.num_leafs = c_bsp.num_areas = 1;
-		c_vis->num_clusters = 1;
 		*size = 0;
-		return &c_bsp.models[0];
+		return &c_null_bsp;
 	}
 
+	Cm_AbortLoad();
+
 	// load the file
 	*size = Fs_Load(name, &buf);
 
@@ -518,6 +749,12 @@ c_model_t *Cm_LoadBsp(const char *name, int32_t *size) {
 		Com_Error(ERR_DROP, "Couldn't load %s\n", name);
 	}
 
+	cm_bsp_t *bsp = c_loading = Z_Malloc(sizeof(cm_bsp_t));
+	bsp->size = sizeof(cm_bsp_t);
+
+	bsp->file_size = *size;
+	bsp->base = (byte *) buf;
+
 	header = *(d_bsp_header_t *) buf;
 	for (i = 0; i < sizeof(d_bsp_header_t) / sizeof(int32_t); i++)
 		((int32_t *) &header)[i] = LittleLong(((int32_t *) &header)[i]);
@@ -526,37 +763,148 @@ c_model_t *Cm_LoadBsp(const char *name, int32_t *size) {
 		Com_Error(ERR_DROP, "%s has unsupported version: %d\n", name, header.version);
 	}
 
-	g_strlcpy(c_bsp.name, name, sizeof(c_bsp.name));
-
-	c_bsp.base = (byte *) buf;
+	g_strlcpy(bsp->name, name, sizeof(bsp->name));
 
 	// load into heap
-	Cm_LoadSurfaces(&header.lumps[BSP_LUMP_TEXINFO]);
-	Cm_LoadLeafs(&header.lumps[BSP_LUMP_LEAFS]);
-	Cm_LoadLeafBrushes(&header.lumps[BSP_LUMP_LEAF_BRUSHES]);
-	Cm_LoadPlanes(&header.lumps[BSP_LUMP_PLANES]);
-	Cm_LoadBrushes(&header.lumps[BSP_LUMP_BRUSHES]);
-	Cm_LoadBrushSides(&header.lumps[BSP_LUMP_BRUSH_SIDES]);
-	Cm_LoadSubmodels(&header.lumps[BSP_LUMP_MODELS]);
-	Cm_LoadNodes(&header.lumps[BSP_LUMP_NODES]);
-	Cm_LoadAreas(&header.lumps[BSP_LUMP_AREAS]);
-	Cm_LoadAreaPortals(&header.lumps[BSP_LUMP_AREA_PORTALS]);
-	Cm_LoadVisibility(&header.lumps[BSP_LUMP_VISIBILITY]);
-	Cm_LoadEntityString(&header.lumps[BSP_LUMP_ENTITIES]);
+	Cm_LoadSurfaces(bsp, &header.lumps[BSP_LUMP_TEXINFO]);
+	Cm_LoadLeafs(bsp, &header.lumps[BSP_LUMP_LEAFS]);
+	Cm_LoadLeafBrushes(bsp, &header.lumps[BSP_LUMP_LEAF_BRUSHES]);
+	Cm_LoadPlanes(bsp, &header.lumps[BSP_LUMP_PLANES]);
+	Cm_LoadBrushes(bsp, &header.lumps[BSP_LUMP_BRUSHES]);
+	Cm_LoadBrushSides(bsp, &header.lumps[BSP_LUMP_BRUSH_SIDES]);
+	Cm_LoadSubmodels(bsp, &header.lumps[BSP_LUMP_MODELS]);
+	Cm_LoadNodes(bsp, &header.lumps[BSP_LUMP_NODES]);
+	Cm_LoadAreas(bsp, &header.lumps[BSP_LUMP_AREAS]);
+	Cm_LoadAreaPortals(bsp, &header.lumps[BSP_LUMP_AREA_PORTALS]);
+	Cm_LoadVisibility(bsp, &header.lumps[BSP_LUMP_VISIBILITY]);
+	Cm_LoadEntityString(bsp, &header.lumps[BSP_LUMP_ENTITIES]);
 
 	Fs_Free(buf);
+	bsp->base = NULL;
+
+	Cm_InitBoxHull(bsp);
+
+	Cm_InitBrushPlanes(bsp);
 
-	Cm_InitBoxHull();
+	Cm_InitVisCache(bsp);
 
-	Cm_FloodAreaConnections();
+	Cm_FloodAreaConnections(bsp);
 
-	return &c_bsp.models[0];
+	c_loading = NULL;
+
+	Com_Debug("Loaded %s: %u KB resident, %u KB fixed-size\n", name, (uint32_t) (bsp->size >> 10),
+			(uint32_t) (CM_FIXED_SIZE >> 10));
+
+	return bsp;
+}
+
+/*
+ * @brief Frees the specified collision model. If the calling thread selected
+ * it, the thread reverts to the map loaded by Cm_LoadBsp, and if it is that
+ * map, every thread reverts to the empty model. No other thread may still
+ * have it selected.
+ */
+void Cm_CloseBsp(cm_bsp_t *bsp) {
+
+	if (!bsp || bsp == &c_null_bsp) {
+		return;
+	}
+
+	if (c_bsp == bsp) {
+		c_bsp = NULL;
+	}
+
+	if (c_map == bsp) {
+		c_map = NULL;
+	}
+
+	if (c_trace_recording.bsp == bsp) {
+		Cm_StopTraceRecording();
+	}
+
+	if (bsp->vis_cache.block) {
+		Z_Free(bsp->vis_cache.block);
+	}
+
+	if (bsp->vis_cache.lock) {
+		SDL_DestroyMutex(bsp->vis_cache.lock);
+	}
+
+	Z_Free(bsp);
+}
+
+/*
+ * @brief Returns the collision model the Cm_* functions operate on.
+ */
+cm_bsp_t *Cm_Bsp(void) {
+	cm_bsp_t *bsp = Cm_Selected();
+
+	return bsp == &c_null_bsp ? NULL : bsp;
+}
+
+/*
+ * @brief Selects the collision model the Cm_* functions operate on for the
+ * calling thread, and for the jobs it submits. If bsp is NULL, the thread
+ * reverts to the map loaded by Cm_LoadBsp. Other threads are not affected.
+ */
+void Cm_SetBsp(cm_bsp_t *bsp) {
+	c_bsp = bsp;
+}
+
+/*
+ * @brief Returns the calling thread's selection, for jobs to inherit.
+ */
+static void *Cm_GetThreadBsp(void) {
+	return c_bsp;
+}
+
+/*
+ * @brief Installs the selection a job inherited on the thread which runs it.
+ */
+static void Cm_SetThreadBsp(void *bsp) {
+	c_bsp = (cm_bsp_t *) bsp;
+}
+
+/*
+ * @brief Returns the bytes allocated to the specified collision model,
+ * including its visibility row cache.
+ */
+size_t Cm_BspSize(const cm_bsp_t *bsp) {
+	return bsp->size + bsp->vis_cache.size;
+}
+
+/*
+ * @brief Loads in the BSP and all submodels for collision detection, replacing
+ * the map previously loaded by this function. The Cm_* functions operate on it
+ * in every thread which has not selected another model with Cm_SetBsp, and the
+ * calling thread's selection is cleared. The server and client share this map,
+ * so reloading the current map only resets its area portals.
+ */
+c_model_t *Cm_LoadBsp(const char *name, int32_t *size) {
+
+	if (name && c_map && !g_strcmp0(c_map->name, name)) {
+		memset(c_map->portal_open, 0, (c_map->num_area_portals + 1) * sizeof(_Bool));
+		Cm_FloodAreaConnections(c_map);
+
+		c_bsp = NULL;
+
+		*size = c_map->file_size;
+		return &c_map->models[0];
+	}
+
+	Cm_CloseBsp(c_map);
+
+	c_map = Cm_OpenBsp(name, size);
+	c_bsp = NULL;
+
+	return &c_map->models[0];
 }
 
 /*
  * @brief
  */
 c_model_t *Cm_Model(const char *name) {
+	const cm_bsp_t *bsp = Cm_Selected();
 	int32_t num;
 
 	if (!name || name[0] != '*') {
@@ -565,106 +913,94 @@ c_model_t *Cm_Model(const char *name) {
 
 	num = atoi(name + 1);
 
-	if (num < 1 || num >= c_bsp.num_models) {
+	if (num < 1 || num >= bsp->num_models) {
 		Com_Error(ERR_DROP, "Bad number: %d\n", num);
 	}
 
-	return &c_bsp.models[num];
+	return &bsp->models[num];
 }
 
 /*
  * @brief
  */
 int32_t Cm_NumClusters(void) {
-	return c_vis->num_clusters;
+	return Cm_Selected()->vis->num_clusters;
 }
 
 /*
  * @brief
  */
 int32_t Cm_NumModels(void) {
-	return c_bsp.num_models;
+	return Cm_Selected()->num_models;
 }
 
 /*
  * @brief
  */
 char *Cm_EntityString(void) {
-	return c_bsp.entity_string;
+	return Cm_Selected()->entity_string;
 }
 
 /*
  * @brief
  */
 int32_t Cm_LeafContents(const int32_t leaf_num) {
+	const cm_bsp_t *bsp = Cm_Selected();
 
-	if (leaf_num < 0 || leaf_num >= c_bsp.num_leafs) {
+	if (leaf_num < 0 || leaf_num >= bsp->num_leafs) {
 		Com_Error(ERR_DROP, "Bad number: %d\n", leaf_num);
 	}
 
-	return c_bsp.leafs[leaf_num].contents;
+	return bsp->leafs[leaf_num].contents;
 }
 
 /*
  * @brief
  */
 int32_t Cm_LeafCluster(const int32_t leaf_num) {
+	const cm_bsp_t *bsp = Cm_Selected();
 
-	if (leaf_num < 0 || leaf_num >= c_bsp.num_leafs) {
+	if (leaf_num < 0 || leaf_num >= bsp->num_leafs) {
 		Com_Error(ERR_DROP, "Bad number: %d\n", leaf_num);
 	}
 
-	return c_bsp.leafs[leaf_num].cluster;
+	return bsp->leafs[leaf_num].cluster;
 }
 
 /*
  * @brief
  */
 int32_t Cm_LeafArea(const int32_t leaf_num) {
+	const cm_bsp_t *bsp = Cm_Selected();
 
-	if (leaf_num < 0 || leaf_num >= c_bsp.num_leafs) {
+	if (leaf_num < 0 || leaf_num >= bsp->num_leafs) {
 		Com_Error(ERR_DROP, "Bad number: %d\n", leaf_num);
 	}
 
-	return c_bsp.leafs[leaf_num].area;
+	return bsp->leafs[leaf_num].area;
 }
 
-// bounding box to bsp tree structure for tracing
-typedef struct c_bounding_box_s {
-	int32_t head_node;
-	c_bsp_plane_t *planes;
-	c_bsp_brush_t *brush;
-	c_bsp_leaf_t *leaf;
-} c_bounding_box_t;
-
-static c_bounding_box_t cm_box;
-
 /*
  * @brief Set up the planes and nodes so that the six floats of a bounding box
  * can just be stored out and get a proper clipping hull structure.
  */
-static void Cm_InitBoxHull(void) {
+static void Cm_InitBoxHull(cm_bsp_t *bsp) {
 	int32_t i;
 
-	cm_box.head_node = c_bsp.num_nodes;
-	cm_box.planes = &c_bsp.planes[c_bsp.num_planes];
-	if (c_bsp.num_nodes + 6 > MAX_BSP_NODES || c_bsp.num_brushes + 1 > MAX_BSP_BRUSHES
-			|| c_bsp.num_leaf_brushes + 1 > MAX_BSP_LEAF_BRUSHES || c_bsp.num_brush_sides + 6
-			> MAX_BSP_BRUSH_SIDES || c_bsp.num_planes + 12 > MAX_BSP_PLANES) {
-		Com_Error(ERR_DROP, "Not enough room for box tree\n");
-	}
+	bsp->box.head_node = bsp->num_nodes;
+	bsp->box.planes = &bsp->planes[bsp->num_planes];
 
-	cm_box.brush = &c_bsp.brushes[c_bsp.num_brushes];
-	cm_box.brush->num_sides = 6;
-	cm_box.brush->first_brush_side = c_bsp.num_brush_sides;
-	cm_box.brush->contents = CONTENTS_MONSTER;
+	bsp->box.brush = &bsp->brushes[bsp->num_brushes];
+	bsp->box.brush->num_sides = 6;
+	bsp->box.brush->first_brush_side = bsp->num_brush_sides;
+	bsp->box.brush->contents = CONTENTS_MONSTER;
 
-	cm_box.leaf = &c_bsp.leafs[c_bsp.num_leafs];
-	cm_box.leaf->contents = CONTENTS_MONSTER;
-	cm_box.leaf->first_leaf_brush = c_bsp.num_leaf_brushes;
-	cm_box.leaf->num_leaf_brushes = 1;
+	bsp->box.leaf = &bsp->leafs[bsp->num_leafs];
+	bsp->box.leaf->contents = CONTENTS_MONSTER;
+	bsp->box.leaf->first_leaf_brush = bsp->num_leaf_brushes;
+	bsp->box.leaf->num_leaf_brushes = 1;
 
-	c_bsp.leaf_brushes[c_bsp.num_leaf_brushes] = c_bsp.num_brushes;
+	bsp->leaf_brushes[bsp->num_leaf_brushes] = bsp->num_brushes;
 
 	for (i = 0; i < 6; i++) {
 		const int32_t side = i & 1;
@@ -673,27 +1009,27 @@ static void Cm_InitBoxHull(void) {
 		c_bsp_brush_side_t *s;
 
 		// brush sides
-		s = &c_bsp.brush_sides[c_bsp.num_brush_sides + i];
-		s->plane = c_bsp.planes + (c_bsp.num_planes + i * 2 + side);
-		s->surface = &c_bsp.null_surface;
+		s = &bsp->brush_sides[bsp->num_brush_sides + i];
+		s->plane = bsp->planes + (bsp->num_planes + i * 2 + side);
+		s->surface = &bsp->null_surface;
 
 		// nodes
-		c = &c_bsp.nodes[cm_box.head_node + i];
-		c->plane = c_bsp.planes + (c_bsp.num_planes + i * 2);
-		c->children[side] = -1 - c_bsp.empty_leaf;
+		c = &bsp->nodes[bsp->box.head_node + i];
+		c->plane = bsp->planes + (bsp->num_planes + i * 2);
+		c->children[side] = -1 - bsp->empty_leaf;
 		if (i != 5)
-			c->children[side ^ 1] = cm_box.head_node + i + 1;
+			c->children[side ^ 1] = bsp->box.head_node + i + 1;
 		else
-			c->children[side ^ 1] = -1 - c_bsp.num_leafs;
+			c->children[side ^ 1] = -1 - bsp->num_leafs;
 
 		// planes
-		p = &cm_box.planes[i * 2];
+		p = &bsp->box.planes[i * 2];
 		p->type = i >> 1;
 		p->sign_bits = 0;
 		VectorClear(p->normal);
 		p->normal[i >> 1] = 1;
 
-		p = &cm_box.planes[i * 2 + 1];
+		p = &bsp->box.planes[i * 2 + 1];
 		p->type = PLANE_ANYX + (i >> 1);
 		p->sign_bits = 0;
 		VectorClear(p->normal);
@@ -701,35 +1037,103 @@ static void Cm_InitBoxHull(void) {
 	}
 }
 
+/*
+ * @brief Copies the planes of the brush's sides to its brush planes, and
+ * bounds the brush by its axial sides. Unused sides of the last block face
+ * away from everything, so that they clip nothing.
+ */
+static void Cm_UpdateBrushPlanes(cm_bsp_t *bsp, c_bsp_brush_t *brush) {
+	int32_t i, j;
+
+	c_bsp_brush_planes_t *planes = &bsp->brush_planes[brush->first_brush_planes];
+
+	VectorSet(brush->mins, -INFINITY, -INFINITY, -INFINITY);
+	VectorSet(brush->maxs, INFINITY, INFINITY, INFINITY);
+
+	for (i = 0; i < ((brush->num_sides + 3) & ~3); i++) {
+		c_bsp_brush_planes_t *out = &planes[i >> 2];
+
+		if (i < brush->num_sides) {
+			const c_bsp_plane_t *plane = bsp->brush_sides[brush->first_brush_side + i].plane;
+
+			for (j = 0; j < 3; j++) {
+				out->normal[j][i & 3] = plane->normal[j];
+
+				if (plane->normal[j] == 1.0 && plane->dist < brush->maxs[j]) {
+					brush->maxs[j] = plane->dist;
+				} else if (plane->normal[j] == -1.0 && -plane->dist > brush->mins[j]) {
+					brush->mins[j] = -plane->dist;
+				}
+			}
+			out->dist[i & 3] = plane->dist;
+		} else {
+			for (j = 0; j < 3; j++) {
+				out->normal[j][i & 3] = 0.0;
+			}
+			out->dist[i & 3] = 1.0;
+		}
+	}
+}
+
+/*
+ * @brief Lays out the planes of each brush's sides contiguously, in blocks of
+ * four, including the box hull's brush.
+ */
+static void Cm_InitBrushPlanes(cm_bsp_t *bsp) {
+	int32_t i;
+
+	for (i = 0; i <= bsp->num_brushes; i++) {
+		c_bsp_brush_t *brush = &bsp->brushes[i];
+
+		if (brush->num_sides < 0 || brush->first_brush_side < 0 || brush->first_brush_side
+				+ brush->num_sides > bsp->num_brush_sides + 6) {
+			Com_Error(ERR_DROP, "Bad brush side index\n");
+		}
+
+		brush->first_brush_planes = bsp->num_brush_planes;
+		bsp->num_brush_planes += (brush->num_sides + 3) >> 2;
+	}
+
+	bsp->brush_planes = Cm_Malloc(bsp, bsp->num_brush_planes, sizeof(c_bsp_brush_planes_t));
+
+	for (i = 0; i <= bsp->num_brushes; i++) {
+		Cm_UpdateBrushPlanes(bsp, &bsp->brushes[i]);
+	}
+}
+
 /*
  * @brief To keep everything totally uniform, bounding boxes are turned into small
  * BSP trees instead of being compared directly.
  */
 int32_t Cm_HeadnodeForBox(const vec3_t mins, const vec3_t maxs) {
-	cm_box.planes[0].dist = maxs[0];
-	cm_box.planes[1].dist = -maxs[0];
-	cm_box.planes[2].dist = mins[0];
-	cm_box.planes[3].dist = -mins[0];
-	cm_box.planes[4].dist = maxs[1];
-	cm_box.planes[5].dist = -maxs[1];
-	cm_box.planes[6].dist = mins[1];
-	cm_box.planes[7].dist = -mins[1];
-	cm_box.planes[8].dist = maxs[2];
-	cm_box.planes[9].dist = -maxs[2];
-	cm_box.planes[10].dist = mins[2];
-	cm_box.planes[11].dist = -mins[2];
-
-	return cm_box.head_node;
+	cm_bsp_t *bsp = Cm_Selected();
+
+	bsp->box.planes[0].dist = maxs[0];
+	bsp->box.planes[1].dist = -maxs[0];
+	bsp->box.planes[2].dist = mins[0];
+	bsp->box.planes[3].dist = -mins[0];
+	bsp->box.planes[4].dist = maxs[1];
+	bsp->box.planes[5].dist = -maxs[1];
+	bsp->box.planes[6].dist = mins[1];
+	bsp->box.planes[7].dist = -mins[1];
+	bsp->box.planes[8].dist = maxs[2];
+	bsp->box.planes[9].dist = -maxs[2];
+	bsp->box.planes[10].dist = mins[2];
+	bsp->box.planes[11].dist = -mins[2];
+
+	Cm_UpdateBrushPlanes(bsp, bsp->box.brush);
+
+	return bsp->box.head_node;
 }
 
 /*
  * @brief
  */
-static int32_t Cm_PointLeafnum_r(const vec3_t p, int32_t num) {
+static int32_t Cm_PointLeafnum_r(const cm_bsp_t *bsp, const vec3_t p, int32_t num) {
 
 	while (num >= 0) {
 		vec_t d;
-		c_bsp_node_t *node = c_bsp.nodes + num;
+		c_bsp_node_t *node = bsp->nodes + num;
 		c_bsp_plane_t *plane = node->plane;
 
 		if (AXIAL(plane))
@@ -743,7 +1147,7 @@ static int32_t Cm_PointLeafnum_r(const vec3_t p, int32_t num) {
 			num = node->children[0];
 	}
 
-	c_point_contents++; // optimize counter, TOOD: atomic increment for thread-safety
+	Cm_ThreadTraceStats()->point_contents++; // optimize counter
 
 	return -1 - num;
 }
@@ -752,11 +1156,12 @@ static int32_t Cm_PointLeafnum_r(const vec3_t p, int32_t num) {
  * @brief
  */
 int32_t Cm_PointLeafnum(const vec3_t p) {
+	const cm_bsp_t *bsp = Cm_Selected();
 
-	if (!c_bsp.num_planes)
+	if (!bsp->num_planes)
 		return 0; // sound may call this without map loaded
 
-	return Cm_PointLeafnum_r(p, 0);
+	return Cm_PointLeafnum_r(bsp, p, 0);
 }
 
 /*
@@ -764,6 +1169,7 @@ int32_t Cm_PointLeafnum(const vec3_t p) {
  */
 
 typedef struct c_bsp_leaf_data_s {
+	const cm_bsp_t *bsp;
 	size_t len, max_len;
 	int32_t *list;
 	const vec_t *mins, *maxs;
@@ -784,7 +1190,7 @@ static void Cm_BoxLeafnums_r(int32_t node_num, c_bsp_leaf_data_t *data) {
 			return;
 		}
 
-		node = &c_bsp.nodes[node_num];
+		node = &data->bsp->nodes[node_num];
 		plane = node->plane;
 		s = BoxOnPlaneSide(data->mins, data->maxs, plane);
 		if (s == 1)
@@ -803,9 +1209,10 @@ static void Cm_BoxLeafnums_r(int32_t node_num, c_bsp_leaf_data_t *data) {
 /*
  * @brief
  */
-static int32_t Cm_BoxLeafnums_head_node(const vec3_t mins, const vec3_t maxs, int32_t *list,
-		size_t len, int32_t head_node, int32_t *top_node) {
+static int32_t Cm_BoxLeafnums_head_node(const cm_bsp_t *bsp, const vec3_t mins,
+		const vec3_t maxs, int32_t *list, size_t len, int32_t head_node, int32_t *top_node) {
 	c_bsp_leaf_data_t data;
+	data.bsp = bsp;
 	data.list = list;
 	data.len = 0;
 	data.max_len = len;
@@ -828,22 +1235,24 @@ static int32_t Cm_BoxLeafnums_head_node(const vec3_t mins, const vec3_t maxs, in
  */
 int32_t Cm_BoxLeafnums(const vec3_t mins, const vec3_t maxs, int32_t *list, size_t len,
 		int32_t *top_node) {
-	const int32_t head_node = c_bsp.models[0].head_node;
-	return Cm_BoxLeafnums_head_node(mins, maxs, list, len, head_node, top_node);
+	const cm_bsp_t *bsp = Cm_Selected();
+	const int32_t head_node = bsp->models[0].head_node;
+	return Cm_BoxLeafnums_head_node(bsp, mins, maxs, list, len, head_node, top_node);
 }
 
 /*
  * @brief
  */
 int32_t Cm_PointContents(const vec3_t p, int32_t head_node) {
+	const cm_bsp_t *bsp = Cm_Selected();
 	int32_t l;
 
-	if (!c_bsp.num_nodes) // map not loaded
+	if (!bsp->num_nodes) // map not loaded
 		return 0;
 
-	l = Cm_PointLeafnum_r(p, head_node);
+	l = Cm_PointLeafnum_r(bsp, p, head_node);
 
-	return c_bsp.leafs[l].contents;
+	return bsp->leafs[l].contents;
 }
 
 /*
@@ -852,6 +1261,7 @@ int32_t Cm_PointContents(const vec3_t p, int32_t head_node) {
  */
 int32_t Cm_TransformedPointContents(const vec3_t p, int32_t head_node, const vec3_t origin,
 		const vec3_t angles) {
+	const cm_bsp_t *bsp = Cm_Selected();
 	vec3_t p_l;
 	vec3_t temp;
 	vec3_t forward, right, up;
@@ -861,7 +1271,7 @@ int32_t Cm_TransformedPointContents(const vec3_t p, int32_t head_node, const vec
 	VectorSubtract(p, origin, p_l);
 
 	// rotate start and end into the models frame of reference
-	if (head_node != cm_box.head_node && (angles[0] || angles[1] || angles[2])) {
+	if (head_node != bsp->box.head_node && (angles[0] || angles[1] || angles[2])) {
 		AngleVectors(angles, forward, right, up);
 
 		VectorCopy(p_l, temp);
@@ -870,9 +1280,9 @@ int32_t Cm_TransformedPointContents(const vec3_t p, int32_t head_node, const vec
 		p_l[2] = DotProduct(temp, up);
 	}
 
-	l = Cm_PointLeafnum_r(p_l, head_node);
+	l = Cm_PointLeafnum_r(bsp, p_l, head_node);
 
-	return c_bsp.leafs[l].contents;
+	return bsp->leafs[l].contents;
 }
 
 /*
@@ -884,51 +1294,202 @@ int32_t Cm_TransformedPointContents(const vec3_t p, int32_t head_node, const vec
 // 1/32 epsilon to keep floating point happy
 #define DIST_EPSILON	(0.03125)
 
+// brushes further than this from the swept box can not clip it
+#define BRUSH_BOUNDS_EPSILON 1.0
+
 typedef struct {
+	const cm_bsp_t *bsp;
+
 	vec3_t start, end;
 	vec3_t mins, maxs;
 	vec3_t extents;
+	vec3_t abs_mins, abs_maxs; // the swept box, padded by BRUSH_BOUNDS_EPSILON
 
 	c_trace_t trace;
 	int32_t contents;
 	_Bool is_point; // optimized case
 
-	int32_t mailbox[16]; // used to avoid multiple intersection tests with brushes
+	uint32_t brush_generation; // used to avoid multiple intersection tests with brushes
 } c_trace_data_t;
 
+// the generation of the trace which last tested each brush, per thread
+static __thread uint32_t c_brush_generations[MAX_BSP_BRUSHES + 1];
+static __thread uint32_t c_brush_generation;
+
+/*
+ * @brief Returns a generation for the trace which no brush has yet been
+ * tested by on this thread.
+ */
+static uint32_t Cm_NextBrushGeneration(void) {
+
+	if (++c_brush_generation == 0) {
+		memset(c_brush_generations, 0, sizeof(c_brush_generations));
+		c_brush_generation = 1;
+	}
+
+	return c_brush_generation;
+}
+
 /*
  * @brief
  */
 static _Bool Cm_BrushAlreadyTested(int32_t brush_num, c_trace_data_t *data) {
-	int32_t hash = brush_num & 15;
-	_Bool skip = (data->mailbox[hash] == brush_num);
-	data->mailbox[hash] = brush_num;
-	return skip;
+
+	if (c_brush_generations[brush_num] == data->brush_generation)
+		return true;
+
+	c_brush_generations[brush_num] = data->brush_generation;
+	return false;
+}
+
+/*
+ * @brief Returns true if the brush's bounds do not intersect the swept box.
+ * Such brushes are separated from it by one of their axial sides, and can not
+ * clip it.
+ */
+static _Bool Cm_BrushOutsideTrace(const c_bsp_brush_t *brush, const c_trace_data_t *data) {
+	int32_t i;
+
+	for (i = 0; i < 3; i++) {
+		if (brush->mins[i] > data->abs_maxs[i] || brush->maxs[i] < data->abs_mins[i])
+			return true;
+	}
+
+	return false;
+}
+
+#if defined(__SSE__)
+
+/*
+ * @brief Returns the distances of the four brush planes, pushed out
+ * appropriately for mins / maxs unless this is a point trace.
+ */
+static inline __m128 Cm_PushBrushPlanes(const c_bsp_brush_planes_t *planes, const vec3_t mins,
+		const vec3_t maxs, const _Bool is_point) {
+
+	const __m128 dist = _mm_loadu_ps(planes->dist);
+
+	if (is_point) {
+		return dist;
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	__m128 ofs[3];
+	int32_t j;
+
+	for (j = 0; j < 3; j++) {
+		const __m128 normal = _mm_loadu_ps(planes->normal[j]);
+		const __m128 negative = _mm_cmplt_ps(normal, zero);
+
+		ofs[j] = _mm_or_ps(_mm_and_ps(negative, _mm_set1_ps(maxs[j])),
+				_mm_andnot_ps(negative, _mm_set1_ps(mins[j])));
+		ofs[j] = _mm_mul_ps(ofs[j], normal);
+	}
+
+	return _mm_sub_ps(dist, _mm_add_ps(_mm_add_ps(ofs[0], ofs[1]), ofs[2]));
+}
+
+/*
+ * @brief Returns the distances of the point in front of the four brush planes.
+ */
+static inline __m128 Cm_BrushPlaneDistances(const c_bsp_brush_planes_t *planes, const vec3_t p,
+		const __m128 dist) {
+
+	const __m128 x = _mm_mul_ps(_mm_set1_ps(p[0]), _mm_loadu_ps(planes->normal[0]));
+	const __m128 y = _mm_mul_ps(_mm_set1_ps(p[1]), _mm_loadu_ps(planes->normal[1]));
+	const __m128 z = _mm_mul_ps(_mm_set1_ps(p[2]), _mm_loadu_ps(planes->normal[2]));
+
+	return _mm_sub_ps(_mm_add_ps(_mm_add_ps(x, y), z), dist);
+}
+
+#endif
+
+/*
+ * @brief Accumulates the enter and leave fractions for a brush side which the
+ * trace crosses.
+ */
+static inline void Cm_ClipToBrushSide(const c_bsp_brush_side_t *side, const vec_t d1,
+		const vec_t d2, vec_t *enter_fraction, vec_t *leave_fraction,
+		const c_bsp_brush_side_t **lead_side) {
+
+	if (d1 > d2) { // enter
+		const vec_t f = (d1 - DIST_EPSILON) / (d1 - d2);
+		if (f > *enter_fraction) {
+			*enter_fraction = f;
+			*lead_side = side;
+		}
+	} else { // leave
+		const vec_t f = (d1 + DIST_EPSILON) / (d1 - d2);
+		if (f < *leave_fraction)
+			*leave_fraction = f;
+	}
 }
 
 /*
  * @brief Clips the bounded box to all brush sides for the given brush. Returns
  * true if the box was clipped, false otherwise.
  */
-static void Cm_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2, c_trace_t *trace,
-		c_bsp_leaf_t *leaf, c_bsp_brush_t *brush, _Bool is_point) {
+static void Cm_ClipBoxToBrush(const cm_bsp_t *bsp, vec3_t mins, vec3_t maxs, vec3_t p1,
+		vec3_t p2, c_trace_t *trace, c_bsp_leaf_t *leaf, c_bsp_brush_t *brush, _Bool is_point) {
 	int32_t i, j;
 
 	if (!brush->num_sides)
 		return;
 
-	c_bsp_brush_traces++;
+	Cm_ThreadTraceStats()->brush_traces++;
 
 	vec_t enter_fraction = -1.0;
 	vec_t leave_fraction = 1.0;
 
-	const c_bsp_plane_t *clip_plane = NULL;
-
 	_Bool end_outside = false, start_outside = false;
 	const c_bsp_brush_side_t *lead_side = NULL;
 
+	const c_bsp_brush_side_t *sides = &bsp->brush_sides[brush->first_brush_side];
+
+#if defined(__SSE__)
+	if (c_simd->integer) {
+		const c_bsp_brush_planes_t *planes = &bsp->brush_planes[brush->first_brush_planes];
+		const __m128 zero = _mm_setzero_ps();
+
+		for (i = 0; i < brush->num_sides; i += 4, planes++) {
+			const __m128 dist = Cm_PushBrushPlanes(planes, mins, maxs, is_point);
+
+			const __m128 d1 = Cm_BrushPlaneDistances(planes, p1, dist);
+			const __m128 d2 = Cm_BrushPlaneDistances(planes, p2, dist);
+
+			const int32_t front1 = _mm_movemask_ps(_mm_cmpgt_ps(d1, zero));
+			const int32_t front2 = _mm_movemask_ps(_mm_cmpgt_ps(d2, zero));
+
+			// if completely in front of any face, no intersection
+			if (front1 & _mm_movemask_ps(_mm_cmpge_ps(d2, d1)))
+				return;
+
+			if (front2)
+				end_outside = true; // end point is not in solid
+			if (front1)
+				start_outside = true;
+
+			// the sides which the trace crosses, in order
+			const int32_t crosses = front1 | front2;
+
+			if (crosses) {
+				vec_t d1s[4], d2s[4];
+
+				_mm_storeu_ps(d1s, d1);
+				_mm_storeu_ps(d2s, d2);
+
+				for (j = 0; j < 4; j++) {
+					if (crosses & (1 << j)) {
+						Cm_ClipToBrushSide(&sides[i + j], d1s[j], d2s[j], &enter_fraction,
+								&leave_fraction, &lead_side);
+					}
+				}
+			}
+		}
+	} else
+#endif
 	for (i = 0; i < brush->num_sides; i++) {
-		const c_bsp_brush_side_t *side = &c_bsp.brush_sides[brush->first_brush_side + i];
+		const c_bsp_brush_side_t *side = &sides[i];
 		const c_bsp_plane_t *plane = side->plane;
 		vec_t dist;
 
@@ -968,25 +1529,14 @@ static void Cm_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2, c_
 			continue;
 
 		// crosses face
-		if (d1 > d2) { // enter
-			const vec_t f = (d1 - DIST_EPSILON) / (d1 - d2);
-			if (f > enter_fraction) {
-				enter_fraction = f;
-				clip_plane = plane;
-				lead_side = side;
-			}
-		} else { // leave
-			const vec_t f = (d1 + DIST_EPSILON) / (d1 - d2);
-			if (f < leave_fraction)
-				leave_fraction = f;
-		}
+		Cm_ClipToBrushSide(side, d1, d2, &enter_fraction, &leave_fraction, &lead_side);
 	}
 
 	if (!start_outside) { // original point was inside brush
 		trace->start_solid = true;
 		if (!end_outside)
 			trace->all_solid = true;
-		trace->leaf_num = leaf - c_bsp.leafs;
+		trace->leaf_num = leaf - bsp->leafs;
 	}
 
 	if (enter_fraction < leave_fraction) { // pierced brush
@@ -994,10 +1544,10 @@ static void Cm_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2, c_
 			if (enter_fraction < 0.0)
 				enter_fraction = 0.0;
 			trace->fraction = enter_fraction;
-			trace->plane = *clip_plane;
+			trace->plane = *lead_side->plane;
 			trace->surface = lead_side->surface;
 			trace->contents = brush->contents;
-			trace->leaf_num = leaf - c_bsp.leafs;
+			trace->leaf_num = leaf - bsp->leafs;
 		}
 	}
 }
@@ -1005,15 +1555,30 @@ static void Cm_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2, c_
 /*
  * @brief
  */
-static void Cm_TestBoxInBrush(vec3_t mins, vec3_t maxs, vec3_t p1, c_trace_t *trace,
-		c_bsp_brush_t *brush) {
+static void Cm_TestBoxInBrush(const cm_bsp_t *bsp, vec3_t mins, vec3_t maxs, vec3_t p1,
+		c_trace_t *trace, c_bsp_brush_t *brush) {
 	int32_t i, j;
 
 	if (!brush->num_sides)
 		return;
 
+#if defined(__SSE__)
+	if (c_simd->integer) {
+		const c_bsp_brush_planes_t *planes = &bsp->brush_planes[brush->first_brush_planes];
+		const __m128 zero = _mm_setzero_ps();
+
+		for (i = 0; i < brush->num_sides; i += 4, planes++) {
+			const __m128 dist = Cm_PushBrushPlanes(planes, mins, maxs, false);
+			const __m128 d1 = Cm_BrushPlaneDistances(planes, p1, dist);
+
+			// if completely in front of any face, no intersection
+			if (_mm_movemask_ps(_mm_cmpgt_ps(d1, zero)))
+				return;
+		}
+	} else
+#endif
 	for (i = 0; i < brush->num_sides; i++) {
-		const c_bsp_brush_side_t *side = &c_bsp.brush_sides[brush->first_brush_side + i];
+		const c_bsp_brush_side_t *side = &bsp->brush_sides[brush->first_brush_side + i];
 		const c_bsp_plane_t *plane = side->plane;
 		vec3_t offset;
 
@@ -1052,15 +1617,15 @@ static void Cm_TraceToLeaf(int32_t leaf_num, c_trace_data_t *data) {
 	int32_t k;
 	c_bsp_leaf_t *leaf;
 
-	leaf = &c_bsp.leafs[leaf_num];
+	leaf = &data->bsp->leafs[leaf_num];
 
 	if (!(leaf->contents & data->contents))
 		return;
 
 	// trace line against all brushes in the leaf
 	for (k = 0; k < leaf->num_leaf_brushes; k++) {
-		const int32_t brush_num = c_bsp.leaf_brushes[leaf->first_leaf_brush + k];
-		c_bsp_brush_t *b = &c_bsp.brushes[brush_num];
+		const int32_t brush_num = data->bsp->leaf_brushes[leaf->first_leaf_brush + k];
+		c_bsp_brush_t *b = &data->bsp->brushes[brush_num];
 
 		if (Cm_BrushAlreadyTested(brush_num, data))
 			continue; // already checked this brush in another leaf
@@ -1068,8 +1633,13 @@ static void Cm_TraceToLeaf(int32_t leaf_num, c_trace_data_t *data) {
 		if (!(b->contents & data->contents))
 			continue;
 
-		Cm_ClipBoxToBrush(data->mins, data->maxs, data->start, data->end, &data->trace, leaf, b,
-				data->is_point);
+		if (Cm_BrushOutsideTrace(b, data)) {
+			Cm_ThreadTraceStats()->brush_rejects++;
+			continue;
+		}
+
+		Cm_ClipBoxToBrush(data->bsp, data->mins, data->maxs, data->start, data->end,
+				&data->trace, leaf, b, data->is_point);
 
 		if (data->trace.all_solid)
 			return;
@@ -1083,14 +1653,14 @@ static void Cm_TestInLeaf(int32_t leaf_num, c_trace_data_t *data) {
 	int32_t k;
 	c_bsp_leaf_t *leaf;
 
-	leaf = &c_bsp.leafs[leaf_num];
+	leaf = &data->bsp->leafs[leaf_num];
 	if (!(leaf->contents & data->contents))
 		return;
 
 	// trace line against all brushes in the leaf
 	for (k = 0; k < leaf->num_leaf_brushes; k++) {
-		const int32_t brush_num = c_bsp.leaf_brushes[leaf->first_leaf_brush + k];
-		c_bsp_brush_t *b = &c_bsp.brushes[brush_num];
+		const int32_t brush_num = data->bsp->leaf_brushes[leaf->first_leaf_brush + k];
+		c_bsp_brush_t *b = &data->bsp->brushes[brush_num];
 
 		if (Cm_BrushAlreadyTested(brush_num, data))
 			continue; // already checked this brush in another leaf
@@ -1098,7 +1668,12 @@ static void Cm_TestInLeaf(int32_t leaf_num, c_trace_data_t *data) {
 		if (!(b->contents & data->contents))
 			continue;
 
-		Cm_TestBoxInBrush(data->mins, data->maxs, data->start, &data->trace, b);
+		if (Cm_BrushOutsideTrace(b, data)) {
+			Cm_ThreadTraceStats()->brush_rejects++;
+			continue;
+		}
+
+		Cm_TestBoxInBrush(data->bsp, data->mins, data->maxs, data->start, &data->trace, b);
 
 		if (data->trace.all_solid)
 			return;
@@ -1130,7 +1705,7 @@ static void Cm_RecursiveHullCheck(int32_t num, vec_t p1f, vec_t p2f, const vec3_
 
 	// find the point distances to the seperating plane
 	// and the offset for the size of the box
-	node = c_bsp.nodes + num;
+	node = data->bsp->nodes + num;
 	plane = node->plane;
 
 	if (AXIAL(plane)) {
@@ -1200,32 +1775,73 @@ static void Cm_RecursiveHullCheck(int32_t num, vec_t p1f, vec_t p2f, const vec3_
 	Cm_RecursiveHullCheck(node->children[side ^ 1], midf, p2f, mid, p2, data);
 }
 
+/*
+ * @brief Records the trace, if it is against the map being recorded. Traces
+ * against the box hull are not recorded, as it is rebuilt for each entity.
+ */
+static void Cm_RecordTrace(const cm_bsp_t *bsp, const vec3_t start, const vec3_t end,
+		const vec3_t mins, const vec3_t maxs, int32_t head_node, int32_t brush_mask) {
+	c_trace_record_t record;
+
+	if (bsp != c_trace_recording.bsp || head_node < 0 || head_node >= bsp->num_nodes)
+		return;
+
+	VectorCopy(start, record.start);
+	VectorCopy(end, record.end);
+	VectorCopy(mins, record.mins);
+	VectorCopy(maxs, record.maxs);
+
+	record.head_node = head_node;
+	record.brush_mask = brush_mask;
+
+	SDL_mutexP(c_trace_recording.lock);
+
+	if (c_trace_recording.file) {
+		Fs_Write(c_trace_recording.file, &record, sizeof(record), 1);
+	}
+
+	SDL_mutexV(c_trace_recording.lock);
+}
+
 /*
  * @brief
  */
 c_trace_t Cm_BoxTrace(const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs,
 		int32_t head_node, int32_t brush_mask) {
+	cm_bsp_t *bsp = Cm_Selected();
 	int32_t i, point_leafs[1024];
 
 	c_trace_data_t data;
 
-	c_traces++; // for statistics
+	Cm_ThreadTraceStats()->traces++; // for statistics
 
 	// fill in a default trace
 	memset(&data.trace, 0, sizeof(data.trace));
 	data.trace.fraction = 1.0;
-	data.trace.surface = &c_bsp.null_surface;
+	data.trace.surface = &bsp->null_surface;
 
-	if (!c_bsp.num_nodes) // map not loaded
+	if (!bsp->num_nodes) // map not loaded
 		return data.trace;
 
-	memset(&data.mailbox, 0xffffffff, sizeof(data.mailbox));
+	if (c_trace_recording.file)
+		Cm_RecordTrace(bsp, start, end, mins, maxs, head_node, brush_mask);
+
+	data.bsp = bsp;
+	data.brush_generation = Cm_NextBrushGeneration();
 	data.contents = brush_mask;
 	VectorCopy(start, data.start);
 	VectorCopy(end, data.end);
 	VectorCopy(mins, data.mins);
 	VectorCopy(maxs, data.maxs);
 
+	for (i = 0; i < 3; i++) {
+		const vec_t lo = start[i] < end[i] ? start[i] : end[i];
+		const vec_t hi = start[i] < end[i] ? end[i] : start[i];
+
+		data.abs_mins[i] = lo + mins[i] - BRUSH_BOUNDS_EPSILON;
+		data.abs_maxs[i] = hi + maxs[i] + BRUSH_BOUNDS_EPSILON;
+	}
+
 	// check for position test special case
 	if (VectorCompare(start, end)) {
 		int32_t i, leafs;
@@ -1239,7 +1855,7 @@ c_trace_t Cm_BoxTrace(const vec3_t start, const vec3_t end, const vec3_t mins, c
 			c2[i] += 1.0;
 		}
 
-		leafs = Cm_BoxLeafnums_head_node(c1, c2, point_leafs,
+		leafs = Cm_BoxLeafnums_head_node(bsp, c1, c2, point_leafs,
 				sizeof(point_leafs) / sizeof(int32_t), head_node, &top_node); // NOTE: was * sizeof(int32_t)
 
 		for (i = 0; i < leafs; i++) {
@@ -1294,7 +1910,7 @@ c_trace_t Cm_TransformedBoxTrace(const vec3_t start, const vec3_t end, const vec
 	VectorSubtract(end, origin, end_l);
 
 	// rotate start and end into the models frame of reference
-	if (head_node != cm_box.head_node && (angles[0] || angles[1] || angles[2]))
+	if (head_node != Cm_Selected()->box.head_node && (angles[0] || angles[1] || angles[2]))
 		rotated = true;
 	else
 		rotated = false;
@@ -1334,6 +1950,72 @@ c_trace_t Cm_TransformedBoxTrace(const vec3_t start, const vec3_t end, const vec
 	return trace;
 }
 
+/*
+ * @brief Stops recording traces, closing the file.
+ */
+static void Cm_StopTraceRecording(void) {
+
+	if (!c_trace_recording.file)
+		return;
+
+	SDL_mutexP(c_trace_recording.lock);
+
+	Fs_Close(c_trace_recording.file);
+
+	c_trace_recording.file = NULL;
+	c_trace_recording.bsp = NULL;
+
+	SDL_mutexV(c_trace_recording.lock);
+
+	Com_Print("Stopped recording traces\n");
+}
+
+/*
+ * @brief Records the traces against the current map to the specified file,
+ * for replay by bench_cm_trace. Without arguments, stops recording.
+ */
+static void Cm_TraceRecord_f(void) {
+	cm_bsp_t *bsp = Cm_Selected();
+	c_trace_header_t header;
+
+	Cm_StopTraceRecording();
+
+	if (Cmd_Argc() < 2)
+		return;
+
+	if (!bsp->num_nodes) {
+		Com_Print("No map loaded\n");
+		return;
+	}
+
+	if (!c_trace_recording.lock) {
+		c_trace_recording.lock = SDL_CreateMutex();
+	}
+
+	file_t *file = Fs_OpenWrite(Cmd_Argv(1));
+
+	if (!file) {
+		Com_Warn("Failed to open %s: %s\n", Cmd_Argv(1), Fs_LastError());
+		return;
+	}
+
+	memset(&header, 0, sizeof(header));
+
+	header.magic = TRACE_RECORD_MAGIC;
+	g_strlcpy(header.map, bsp->name, sizeof(header.map));
+
+	Fs_Write(file, &header, sizeof(header), 1);
+
+	SDL_mutexP(c_trace_recording.lock);
+
+	c_trace_recording.bsp = bsp;
+	c_trace_recording.file = file;
+
+	SDL_mutexV(c_trace_recording.lock);
+
+	Com_Print("Recording traces against %s to %s\n", bsp->name, Cmd_Argv(1));
+}
+
 /*
  *
  * PVS / PHS
@@ -1343,15 +2025,15 @@ c_trace_t Cm_TransformedBoxTrace(const vec3_t start, const vec3_t end, const vec
 /*
  * @brief
  */
-static void Cm_DecompressVis(const byte *in, byte *out) {
+static void Cm_DecompressVis(cm_bsp_t *bsp, const byte *in, byte *out) {
 	int32_t c;
 	byte *out_p;
 	int32_t row;
 
-	row = (c_vis->num_clusters + 7) >> 3;
+	row = (bsp->vis->num_clusters + 7) >> 3;
 	out_p = out;
 
-	if (!in || !c_bsp.num_visibility) { // no vis info, so make all visible
+	if (!in || !bsp->num_visibility) { // no vis info, so make all visible
 		while (row) {
 			*out_p++ = 0xff;
 			row--;
@@ -1379,31 +2061,239 @@ static void Cm_DecompressVis(const byte *in, byte *out) {
 }
 
 /*
- * @brief
+ * Decompressed visibility rows are cached, as each is requested many times per
+ * frame. When the full PVS and PHS matrices fit within c_vis_cache, they are
+ * decompressed at load time and shared, read-only, by all threads. Otherwise,
+ * as many rows as fit are kept in least-recently-used order.
  */
-byte *Cm_ClusterPVS(const int32_t cluster) {
-	static byte pvs_row[MAX_BSP_LEAFS / 8];
 
-	if (cluster == -1)
-		memset(pvs_row, 0, (c_vis->num_clusters + 7) >> 3);
-	else
-		Cm_DecompressVis(c_bsp.visibility + c_vis->bit_offsets[cluster][DVIS_PVS], pvs_row);
+#define VIS_ROW_ALIGN 64 // rows begin on cache lines
+
+#define VIS_KEY(cluster, type) (((cluster) << 1) | (type))
 
-	return pvs_row;
+/*
+ * @brief Returns the compressed visibility row of the specified type for the
+ * cluster, or NULL if the map has no visibility.
+ */
+static const byte *Cm_VisData(const cm_bsp_t *bsp, const int32_t cluster, const int32_t type) {
+
+	if (!bsp->num_visibility) {
+		return NULL;
+	}
+
+	return bsp->visibility + bsp->vis->bit_offsets[cluster][type];
 }
 
 /*
- * @brief
+ * @brief Unlinks the row from the least-recently-used list.
+ */
+static void Cm_UnlinkVisRow(c_vis_row_t *row) {
+
+	row->prev->next = row->next;
+	row->next->prev = row->prev;
+}
+
+/*
+ * @brief Links the row as the most recently used.
+ */
+static void Cm_LinkVisRow(c_vis_cache_t *cache, c_vis_row_t *row) {
+
+	row->prev = &cache->lru;
+	row->next = cache->lru.next;
+
+	row->prev->next = row;
+	row->next->prev = row;
+}
+
+/*
+ * @brief Allocates the visibility row cache for the current map, within the
+ * c_vis_cache budget. If the full matrices fit, every row is decompressed now.
+ */
+static void Cm_InitVisCache(cm_bsp_t *bsp) {
+	c_vis_cache_t *cache = &bsp->vis_cache;
+	uint32_t i;
+
+	if (!cache->lock) {
+		cache->lock = SDL_CreateMutex();
+	}
+
+	if (cache->block) {
+		Z_Free(cache->block);
+	}
+
+	SDL_mutex *lock = cache->lock;
+	memset(cache, 0, sizeof(*cache));
+	cache->lock = lock;
+
+	cache->lru.prev = cache->lru.next = &cache->lru;
+
+	const uint32_t num_keys = bsp->vis->num_clusters << 1;
+
+	cache->row_size = (((bsp->vis->num_clusters + 7) >> 3) + VIS_ROW_ALIGN - 1) & ~(VIS_ROW_ALIGN - 1);
+
+	const size_t budget = c_vis_cache->value * 1024 * 1024;
+
+	if (num_keys * cache->row_size <= budget) {
+		cache->resident = true;
+		cache->num_rows = num_keys;
+	} else {
+		cache->num_rows = budget / cache->row_size;
+		if (cache->num_rows < 2) {
+			Com_Debug("Visibility row cache disabled\n");
+			return;
+		}
+	}
+
+	// callers may read up to MAX_BSP_LEAFS bits from any row, so pad the tail
+	cache->size = cache->num_rows * cache->row_size + (MAX_BSP_LEAFS >> 3) + VIS_ROW_ALIGN;
+
+	cache->block = Z_Malloc(cache->size);
+	cache->data = (byte *) (((uintptr_t) cache->block + VIS_ROW_ALIGN - 1) & ~(VIS_ROW_ALIGN - 1));
+
+	if (cache->resident) {
+		for (i = 0; i < num_keys; i++) {
+			byte *row = cache->data + i * cache->row_size;
+			Cm_DecompressVis(bsp, Cm_VisData(bsp, i >> 1, i & 1), row);
+		}
+
+		Com_Debug("Decompressed %u visibility rows (%u KB)\n", num_keys,
+				(uint32_t) (cache->size >> 10));
+		return;
+	}
+
+	cache->rows = Z_LinkMalloc(cache->num_rows * sizeof(c_vis_row_t), cache->block);
+	cache->keys = Z_LinkMalloc(num_keys * sizeof(int32_t), cache->block);
+
+	cache->size += cache->num_rows * sizeof(c_vis_row_t) + num_keys * sizeof(int32_t);
+
+	for (i = 0; i < num_keys; i++) {
+		cache->keys[i] = -1;
+	}
+
+	for (i = 0; i < cache->num_rows; i++) {
+		c_vis_row_t *row = &cache->rows[i];
+
+		row->key = -1;
+		row->data = cache->data + i * cache->row_size;
+
+		Cm_LinkVisRow(cache, row);
+	}
+
+	Com_Debug("Caching %u of %u visibility rows (%u KB)\n", cache->num_rows, num_keys,
+			(uint32_t) (cache->size >> 10));
+}
+
+/*
+ * @brief Resolves the decompressed visibility row of the specified type for
+ * the cluster. The returned row is either resident, or copied to out.
+ */
+static byte *Cm_ClusterVis(const int32_t cluster, const int32_t type, byte *out) {
+	cm_bsp_t *bsp = Cm_Selected();
+	c_vis_cache_t *cache = &bsp->vis_cache;
+	c_vis_row_t *row;
+
+	if (cluster == -1) {
+		memset(out, 0, (bsp->vis->num_clusters + 7) >> 3);
+		return out;
+	}
+
+	const int32_t key = VIS_KEY(cluster, type);
+
+	if (cache->resident) {
+		__sync_fetch_and_add(&cache->hits, 1);
+		return cache->data + key * cache->row_size;
+	}
+
+	if (cache->rows) {
+		SDL_mutexP(cache->lock);
+
+		if (cache->keys[key] != -1) {
+			row = &cache->rows[cache->keys[key]];
+
+			Cm_UnlinkVisRow(row);
+			Cm_LinkVisRow(cache, row);
+
+			memcpy(out, row->data, (bsp->vis->num_clusters + 7) >> 3);
+
+			cache->hits++;
+			SDL_mutexV(cache->lock);
+			return out;
+		}
+
+		cache->misses++;
+		SDL_mutexV(cache->lock);
+	}
+
+	// decompress without holding the lock, then insert it unless another thread has
+	Cm_DecompressVis(bsp, Cm_VisData(bsp, cluster, type), out);
+
+	if (cache->rows) {
+		SDL_mutexP(cache->lock);
+
+		if (cache->keys[key] == -1) {
+			row = cache->lru.prev;
+
+			if (row->key != -1) {
+				cache->keys[row->key] = -1;
+			}
+
+			row->key = key;
+			cache->keys[key] = row - cache->rows;
+
+			memcpy(row->data, out, (bsp->vis->num_clusters + 7) >> 3);
+
+			Cm_UnlinkVisRow(row);
+			Cm_LinkVisRow(cache, row);
+		}
+
+		SDL_mutexV(cache->lock);
+	}
+
+	return out;
+}
+
+/*
+ * @brief Returns the decompressed PVS row for the specified cluster. The row
+ * must not be modified. It is valid until the next call on the calling thread.
+ */
+byte *Cm_ClusterPVS(const int32_t cluster) {
+	static __thread byte pvs_row[MAX_BSP_LEAFS >> 3];
+
+	return Cm_ClusterVis(cluster, DVIS_PVS, pvs_row);
+}
+
+/*
+ * @brief Returns the decompressed PHS row for the specified cluster. The row
+ * must not be modified. It is valid until the next call on the calling thread.
  */
 byte *Cm_ClusterPHS(const int32_t cluster) {
-	static byte phs_row[MAX_BSP_LEAFS / 8];
+	static __thread byte phs_row[MAX_BSP_LEAFS >> 3];
 
-	if (cluster == -1)
-		memset(phs_row, 0, (c_vis->num_clusters + 7) >> 3);
-	else
-		Cm_DecompressVis(c_bsp.visibility + c_vis->bit_offsets[cluster][DVIS_PHS], phs_row);
+	return Cm_ClusterVis(cluster, DVIS_PHS, phs_row);
+}
+
+/*
+ * @brief Prints the memory use and hit rate of the visibility row cache.
+ */
+void Cm_VisStats_f(void) {
+	const cm_bsp_t *bsp = Cm_Selected();
+	const c_vis_cache_t *cache = &bsp->vis_cache;
+
+	const uint32_t lookups = cache->hits + cache->misses;
+	const vec_t rate = lookups ? cache->hits * 100.0 / lookups : 0.0;
+
+	if (cache->resident) {
+		Com_Print("Visibility: %u rows resident, %u KB\n", cache->num_rows,
+				(uint32_t) (cache->size >> 10));
+	} else if (cache->rows) {
+		Com_Print("Visibility: %u of %u rows cached, %u KB\n", cache->num_rows,
+				bsp->vis->num_clusters << 1, (uint32_t) (cache->size >> 10));
+	} else {
+		Com_Print("Visibility: not cached\n");
+	}
 
-	return phs_row;
+	Com_Print("  %u lookups, %u hits, %u misses (%.1f%% hit rate)\n", lookups, cache->hits,
+			cache->misses, rate);
 }
 
 /*
@@ -1415,24 +2305,24 @@ byte *Cm_ClusterPHS(const int32_t cluster) {
 /*
  * @brief Recurse over the area portals, marking adjacent ones as flooded.
  */
-static void Cm_FloodArea(c_bsp_area_t *area, int32_t flood_num) {
+static void Cm_FloodArea(cm_bsp_t *bsp, c_bsp_area_t *area, int32_t flood_num) {
 	const d_bsp_area_portal_t *p;
 	int32_t i;
 
-	if (area->flood_valid == c_bsp.flood_valid) {
+	if (area->flood_valid == bsp->flood_valid) {
 		if (area->flood_num == flood_num)
 			return;
 		Com_Error(ERR_DROP, "Reflooded\n");
 	}
 
 	area->flood_num = flood_num;
-	area->flood_valid = c_bsp.flood_valid;
+	area->flood_valid = bsp->flood_valid;
 
-	p = &c_bsp.area_portals[area->first_area_portal];
+	p = &bsp->area_portals[area->first_area_portal];
 
 	for (i = 0; i < area->num_area_portals; i++, p++) {
-		if (c_bsp.portal_open[p->portal_num]) {
-			Cm_FloodArea(&c_bsp.areas[p->other_area], flood_num);
+		if (bsp->portal_open[p->portal_num]) {
+			Cm_FloodArea(bsp, &bsp->areas[p->other_area], flood_num);
 		}
 	}
 }
@@ -1440,22 +2330,22 @@ static void Cm_FloodArea(c_bsp_area_t *area, int32_t flood_num) {
 /*
  * @brief
  */
-static void Cm_FloodAreaConnections(void) {
+static void Cm_FloodAreaConnections(cm_bsp_t *bsp) {
 	int32_t i;
 	int32_t flood_num;
 
 	// all current floods are now invalid
-	c_bsp.flood_valid++;
+	bsp->flood_valid++;
 	flood_num = 0;
 
 	// area 0 is not used
-	for (i = 1; i < c_bsp.num_areas; i++) {
-		c_bsp_area_t *area = &c_bsp.areas[i];
+	for (i = 1; i < bsp->num_areas; i++) {
+		c_bsp_area_t *area = &bsp->areas[i];
 
-		if (area->flood_valid == c_bsp.flood_valid)
+		if (area->flood_valid == bsp->flood_valid)
 			continue; // already flooded into
 
-		Cm_FloodArea(area, ++flood_num);
+		Cm_FloodArea(bsp, area, ++flood_num);
 	}
 }
 
@@ -1465,27 +2355,29 @@ static void Cm_FloodAreaConnections(void) {
  * will return the correct information.
  */
 void Cm_SetAreaPortalState(const int32_t portal_num, const _Bool open) {
-	if (portal_num > c_bsp.num_area_portals) {
+	cm_bsp_t *bsp = Cm_Selected();
+	if (portal_num > bsp->num_area_portals) {
 		Com_Error(ERR_DROP, "Portal %d > num_area_portals", portal_num);
 	}
 
-	c_bsp.portal_open[portal_num] = open;
-	Cm_FloodAreaConnections();
+	bsp->portal_open[portal_num] = open;
+	Cm_FloodAreaConnections(bsp);
 }
 
 /*
  * @brief Returns true if the specified areas are connected.
  */
 _Bool Cm_AreasConnected(int32_t area1, int32_t area2) {
+	const cm_bsp_t *bsp = Cm_Selected();
 
 	if (c_no_areas->value)
 		return true;
 
-	if (area1 > c_bsp.num_areas || area2 > c_bsp.num_areas) {
+	if (area1 > bsp->num_areas || area2 > bsp->num_areas) {
 		Com_Error(ERR_DROP, "Area %d > cm.num_areas\n", area1 > area2 ? area1 : area2);
 	}
 
-	if (c_bsp.areas[area1].flood_num == c_bsp.areas[area2].flood_num)
+	if (bsp->areas[area1].flood_num == bsp->areas[area2].flood_num)
 		return true;
 
 	return false;
@@ -1498,17 +2390,18 @@ _Bool Cm_AreasConnected(int32_t area1, int32_t area2) {
  * This is used by the client view to cull visibility.
  */
 int32_t Cm_WriteAreaBits(byte *buffer, const int32_t area) {
+	const cm_bsp_t *bsp = Cm_Selected();
 	int32_t i;
-	const int32_t bytes = (c_bsp.num_areas + 7) >> 3;
+	const int32_t bytes = (bsp->num_areas + 7) >> 3;
 
 	if (c_no_areas->value) { // for debugging, send everything
 		memset(buffer, 0xff, bytes);
 	} else {
-		const int32_t flood_num = c_bsp.areas[area].flood_num;
+		const int32_t flood_num = bsp->areas[area].flood_num;
 		memset(buffer, 0, bytes);
 
-		for (i = 0; i < c_bsp.num_areas; i++) {
-			if (c_bsp.areas[i].flood_num == flood_num || !area) {
+		for (i = 0; i < bsp->num_areas; i++) {
+			if (bsp->areas[i].flood_num == flood_num || !area) {
 				buffer[i >> 3] |= 1 << (i & 7);
 			}
 		}
@@ -1518,15 +2411,14 @@ int32_t Cm_WriteAreaBits(byte *buffer, const int32_t area) {
 }
 
 /*
- * @brief Returns true if any leaf under head_node has a cluster that
- * is potentially visible.
+ * @brief
  */
-_Bool Cm_HeadnodeVisible(const int32_t node_num, const byte *vis) {
+static _Bool Cm_HeadnodeVisible_(const cm_bsp_t *bsp, const int32_t node_num, const byte *vis) {
 	const c_bsp_node_t *node;
 
 	if (node_num < 0) { // at a leaf, check it
 		const int32_t leaf_num = -1 - node_num;
-		const int32_t cluster = c_bsp.leafs[leaf_num].cluster;
+		const int32_t cluster = bsp->leafs[leaf_num].cluster;
 
 		if (cluster == -1)
 			return false;
@@ -1537,10 +2429,18 @@ _Bool Cm_HeadnodeVisible(const int32_t node_num, const byte *vis) {
 		return false;
 	}
 
-	node = &c_bsp.nodes[node_num];
+	node = &bsp->nodes[node_num];
 
-	if (Cm_HeadnodeVisible(node->children[0], vis))
+	if (Cm_HeadnodeVisible_(bsp, node->children[0], vis))
 		return true;
 
-	return Cm_HeadnodeVisible(node->children[1], vis);
+	return Cm_HeadnodeVisible_(bsp, node->children[1], vis);
+}
+
+/*
+ * @brief Returns true if any leaf under head_node has a cluster that
+ * is potentially visible.
+ */
+_Bool Cm_HeadnodeVisible(const int32_t node_num, const byte *vis) {
+	return Cm_HeadnodeVisible_(Cm_Selected(), node_num, vis);
 }
@@ -25,6 +25,43 @@
 #include "cvar.h"
 #include "files.h"
 
+// traces recorded with c_trace_record, for replay by bench_cm_trace, are
+// written in native byte order following the header
+#define TRACE_RECORD_MAGIC (('T' << 24) + ('W' << 16) + ('2' << 8) + 'Q') // "Q2WT"
+
+typedef struct {
+	int32_t magic;
+	char map[MAX_QPATH];
+} c_trace_header_t;
+
+typedef struct {
+	vec3_t start, end;
+	vec3_t mins, maxs;
+	int32_t head_node;
+	int32_t brush_mask;
+} c_trace_record_t;
+
+// an instance of the collision model, allocated to the size of its map
+typedef struct cm_bsp_s cm_bsp_t;
+
+// trace statistics, summed over all threads by Cm_TraceStats
+typedef struct {
+	int32_t traces;
+	int32_t brush_traces; // brushes clipped
+	int32_t brush_rejects; // brushes outside of the trace's bounds
+	int32_t point_contents;
+} c_trace_stats_t;
+
+void Cm_Init(void);
+cm_bsp_t *Cm_OpenBsp(const char *name, int32_t *map_size);
+void Cm_AbortLoad(void);
+void Cm_CloseBsp(cm_bsp_t *bsp);
+cm_bsp_t *Cm_Bsp(void);
+void Cm_SetBsp(cm_bsp_t *bsp);
+size_t Cm_BspSize(const cm_bsp_t *bsp);
+
+// the functions below operate on the map loaded by Cm_LoadBsp, or the model
+// the calling thread selected with Cm_SetBsp
 c_model_t *Cm_LoadBsp(const char *name, int32_t *map_size);
 c_model_t *Cm_Model(const char *name); // *1, *2, etc
 
@@ -47,8 +84,11 @@ c_trace_t Cm_TransformedBoxTrace(const vec3_t start, const vec3_t end, const vec
 		const vec3_t maxs, int32_t head_node, int32_t brush_mask, const vec3_t origin,
 		const vec3_t angles);
 
+void Cm_TraceStats(c_trace_stats_t *stats);
+
 byte *Cm_ClusterPVS(const int32_t cluster);
 byte *Cm_ClusterPHS(const int32_t cluster);
+void Cm_VisStats_f(void);
 
 int32_t Cm_PointLeafnum(const vec3_t p);
 
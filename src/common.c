@@ -256,6 +256,28 @@ void Com_QuitSubsystem(uint32_t s) {
  * Handles byte ordering and avoids alignment errors.
  */
 
+/*
+ * @brief Writes the low bits of value, least significant first. Bits are
+ * packed into the last byte written until any other Msg_Write function
+ * begins a new byte.
+ */
+void Msg_WriteBits(size_buf_t *sb, uint32_t value, uint16_t bits) {
+
+	while (bits) {
+		if (sb->write_bit == 0) {
+			*(byte *) Sb_Alloc(sb, 1) = 0;
+		}
+
+		const uint16_t n = bits < 8 - sb->write_bit ? bits : 8 - sb->write_bit;
+
+		sb->data[sb->size - 1] |= (value & ((1 << n) - 1)) << sb->write_bit;
+		sb->write_bit = (sb->write_bit + n) & 7;
+
+		value >>= n;
+		bits -= n;
+	}
+}
+
 /*
  * @brief
  */
@@ -434,13 +456,106 @@ void Msg_ReadDir(size_buf_t *sb, vec3_t dir) {
 }
 
 /*
- * @brief Writes part of a packetentities message.
- * Can delta from either a baseline or a previous packet_entity
+ * Entity angles are quantized per axis: yaw, which is plainly visible on
+ * player models, keeps 12 bits, pitch a byte, and roll, which is only used
+ * for subtle effects, fewer still. The circle is divided into 1 << bits steps.
+ */
+static const uint16_t entity_angle_bits[3] = { 8, 12, 6 };
+
+/*
+ * @return The angle quantized to the nearest of 1 << bits steps.
+ */
+static int32_t Msg_QuantizeAngle(const vec_t v, const uint16_t bits) {
+	const int32_t steps = 1 << bits;
+	return (int32_t) floor(v * steps / 360.0 + 0.5) & (steps - 1);
+}
+
+/*
+ * @return The angle for the specified quantized value, which is signed.
+ */
+static vec_t Msg_UnquantizeAngle(const int32_t q, const uint16_t bits) {
+	const int32_t sign = 1 << (bits - 1);
+
+	return ((q ^ sign) - sign) * (360.0 / (1 << bits));
+}
+
+/*
+ * @return The coordinate quantized as by Msg_WriteCoord.
+ */
+static int32_t Msg_QuantizeCoord(const vec_t v) {
+	return (int16_t) (int32_t) (v * 8.0);
+}
+
+/*
+ * @brief Writes a quantized coordinate as a delta from another. Small deltas,
+ * which are by far the most common, are zigzag encoded in a few bits.
+ */
+static void Msg_WriteDeltaCoord(size_buf_t *sb, const int32_t from, const int32_t to) {
+	const int32_t delta = to - from;
+	const uint32_t zigzag = ((uint32_t) delta << 1) ^ (uint32_t) (delta >> 31);
+
+	if (delta == 0) {
+		Msg_WriteBits(sb, 0, 1);
+	} else if (zigzag < (1 << 6)) {
+		Msg_WriteBits(sb, 1, 2);
+		Msg_WriteBits(sb, zigzag, 6);
+	} else if (zigzag < (1 << 12)) {
+		Msg_WriteBits(sb, 3, 3);
+		Msg_WriteBits(sb, zigzag, 12);
+	} else {
+		Msg_WriteBits(sb, 7, 3);
+		Msg_WriteBits(sb, (uint16_t) to, 16);
+	}
+}
+
+/*
+ * @return The quantized coordinate read as a delta from another.
+ */
+static int32_t Msg_ReadDeltaCoord(size_buf_t *sb, const int32_t from) {
+	uint32_t zigzag;
+
+	if (!Msg_ReadBits(sb, 1))
+		return from;
+
+	if (!Msg_ReadBits(sb, 1))
+		zigzag = Msg_ReadBits(sb, 6);
+	else if (!Msg_ReadBits(sb, 1))
+		zigzag = Msg_ReadBits(sb, 12);
+	else
+		return (int16_t) Msg_ReadBits(sb, 16);
+
+	return from + (int32_t) ((zigzag >> 1) ^ -(zigzag & 1));
+}
+
+/*
+ * @brief Writes an entity number as a delta from the previous entity number in
+ * the message. Entities are written in ascending order, so most deltas are
+ * small. The end of the entity list is written as entity 0.
+ */
+void Msg_WriteEntityNumber(size_buf_t *sb, const uint16_t last, const uint16_t number) {
+	const int32_t delta = number - last;
+
+	if (delta == 1) {
+		Msg_WriteBits(sb, 1, 1);
+	} else if (delta > 1 && delta < 2 + (1 << 4)) {
+		Msg_WriteBits(sb, 2, 2);
+		Msg_WriteBits(sb, delta - 2, 4);
+	} else {
+		Msg_WriteBits(sb, 0, 2);
+		Msg_WriteBits(sb, number, ENTITY_NUMBER_BITS);
+	}
+}
+
+/*
+ * @brief Writes part of a packetentities message, after the entity number.
+ * Can delta from either a baseline or a previous packet_entity.
  */
 void Msg_WriteDeltaEntity(entity_state_t *from, entity_state_t *to, size_buf_t *msg, _Bool force,
 		_Bool is_new) {
-
+	int32_t from_origin[3], to_origin[3];
+	int32_t from_angles[3], to_angles[3];
 	uint16_t bits = 0;
+	int32_t i;
 
 	if (to->number <= 0) {
 		Com_Error(ERR_FATAL, "Unset entity number\n");
@@ -450,13 +565,21 @@ void Msg_WriteDeltaEntity(entity_state_t *from, entity_state_t *to, size_buf_t *
 		Com_Error(ERR_FATAL, "Entity number >= MAX_EDICTS\n");
 	}
 
-	if (!VectorCompare(to->origin, from->origin))
+	for (i = 0; i < 3; i++) {
+		from_origin[i] = Msg_QuantizeCoord(from->origin[i]);
+		to_origin[i] = Msg_QuantizeCoord(to->origin[i]);
+
+		from_angles[i] = Msg_QuantizeAngle(from->angles[i], entity_angle_bits[i]);
+		to_angles[i] = Msg_QuantizeAngle(to->angles[i], entity_angle_bits[i]);
+	}
+
+	if (memcmp(from_origin, to_origin, sizeof(to_origin)))
 		bits |= U_ORIGIN;
 
 	if (is_new || !VectorCompare(from->old_origin, to->old_origin))
 		bits |= U_OLD_ORIGIN;
 
-	if (!VectorCompare(to->angles, from->angles))
+	if (memcmp(from_angles, to_angles, sizeof(to_angles)))
 		bits |= U_ANGLES;
 
 	if (to->animation1 != from->animation1 || to->animation2 != from->animation2)
@@ -486,51 +609,210 @@ void Msg_WriteDeltaEntity(entity_state_t *from, entity_state_t *to, size_buf_t *
 
 	// write the message
 
-	Msg_WriteShort(msg, to->number);
-	Msg_WriteShort(msg, bits);
+	Msg_WriteBits(msg, bits, U_BITS);
 
-	if (bits & U_ORIGIN)
-		Msg_WritePos(msg, to->origin);
+	if (bits & U_ORIGIN) {
+		for (i = 0; i < 3; i++)
+			Msg_WriteDeltaCoord(msg, from_origin[i], to_origin[i]);
+	}
 
-	if (bits & U_OLD_ORIGIN)
-		Msg_WritePos(msg, to->old_origin);
+	if (bits & U_OLD_ORIGIN) { // usually very near to the origin
+		for (i = 0; i < 3; i++)
+			Msg_WriteDeltaCoord(msg, to_origin[i], Msg_QuantizeCoord(to->old_origin[i]));
+	}
 
-	if (bits & U_ANGLES)
-		Msg_WriteAngles(msg, to->angles);
+	if (bits & U_ANGLES) {
+		for (i = 0; i < 3; i++) {
+			if (to_angles[i] != from_angles[i]) {
+				Msg_WriteBits(msg, 1, 1);
+				Msg_WriteBits(msg, to_angles[i], entity_angle_bits[i]);
+			} else {
+				Msg_WriteBits(msg, 0, 1);
+			}
+		}
+	}
 
 	if (bits & U_ANIMATIONS) {
-		Msg_WriteByte(msg, to->animation1);
-		Msg_WriteByte(msg, to->animation2);
+		Msg_WriteBits(msg, to->animation1, 8);
+		Msg_WriteBits(msg, to->animation2, 8);
 	}
 
 	if (bits & U_EVENT)
-		Msg_WriteByte(msg, to->event);
+		Msg_WriteBits(msg, to->event, 8);
 
 	if (bits & U_EFFECTS)
-		Msg_WriteShort(msg, to->effects);
+		Msg_WriteBits(msg, to->effects, 16);
 
 	if (bits & U_MODELS) {
-		Msg_WriteByte(msg, to->model1);
-		Msg_WriteByte(msg, to->model2);
-		Msg_WriteByte(msg, to->model3);
-		Msg_WriteByte(msg, to->model4);
+		Msg_WriteBits(msg, to->model1, 8);
+		Msg_WriteBits(msg, to->model2, 8);
+		Msg_WriteBits(msg, to->model3, 8);
+		Msg_WriteBits(msg, to->model4, 8);
 	}
 
 	if (bits & U_CLIENT)
-		Msg_WriteByte(msg, to->client);
+		Msg_WriteBits(msg, to->client, 8);
 
 	if (bits & U_SOUND)
-		Msg_WriteByte(msg, to->sound);
+		Msg_WriteBits(msg, to->sound, 8);
 
 	if (bits & U_SOLID)
-		Msg_WriteShort(msg, to->solid);
+		Msg_WriteBits(msg, to->solid, 16);
 }
 
 /*
- * @brief
+ * @brief Writes the delta between the specified player states. A NULL from
+ * state writes every field which differs from zero.
+ */
+void Msg_WriteDeltaPlayerState(player_state_t *from, player_state_t *to, size_buf_t *msg) {
+	uint16_t pm_state_bits;
+	uint32_t stat_bits;
+	player_state_t *ps, *ops;
+	player_state_t dummy;
+	int32_t i;
+
+	ps = to;
+
+	if (!from) {
+		memset(&dummy, 0, sizeof(dummy));
+		ops = &dummy;
+	} else {
+		ops = from;
+	}
+
+	// determine what needs to be sent
+	pm_state_bits = 0;
+
+	if (ps->pm_state.pm_type != ops->pm_state.pm_type)
+		pm_state_bits |= PS_M_TYPE;
+
+	if (ps->pm_state.origin[0] != ops->pm_state.origin[0] || ps->pm_state.origin[1]
+			!= ops->pm_state.origin[1] || ps->pm_state.origin[2] != ops->pm_state.origin[2])
+		pm_state_bits |= PS_M_ORIGIN;
+
+	if (ps->pm_state.velocity[0] != ops->pm_state.velocity[0] || ps->pm_state.velocity[1]
+			!= ops->pm_state.velocity[1] || ps->pm_state.velocity[2] != ops->pm_state.velocity[2])
+		pm_state_bits |= PS_M_VELOCITY;
+
+	if (ps->pm_state.pm_flags != ops->pm_state.pm_flags)
+		pm_state_bits |= PS_M_FLAGS;
+
+	if (ps->pm_state.pm_time != ops->pm_state.pm_time)
+		pm_state_bits |= PS_M_TIME;
+
+	if (ps->pm_state.gravity != ops->pm_state.gravity)
+		pm_state_bits |= PS_M_GRAVITY;
+
+	if (ps->pm_state.view_offset[0] != ops->pm_state.view_offset[0] || ps->pm_state.view_offset[1]
+			!= ops->pm_state.view_offset[1] || ps->pm_state.view_offset[2]
+			!= ops->pm_state.view_offset[2])
+		pm_state_bits |= PS_M_VIEW_OFFSET;
+
+	if (ps->pm_state.view_angles[0] != ops->pm_state.view_angles[0] || ps->pm_state.view_angles[1]
+			!= ops->pm_state.view_angles[1] || ps->pm_state.view_angles[2]
+			!= ops->pm_state.view_angles[2])
+		pm_state_bits |= PS_M_VIEW_ANGLES;
+
+	if (ps->pm_state.kick_angles[0] != ops->pm_state.kick_angles[0] || ps->pm_state.kick_angles[1]
+			!= ops->pm_state.kick_angles[1] || ps->pm_state.kick_angles[2]
+			!= ops->pm_state.kick_angles[2])
+		pm_state_bits |= PS_M_KICK_ANGLES;
+
+	if (ps->pm_state.delta_angles[0] != ops->pm_state.delta_angles[0]
+			|| ps->pm_state.delta_angles[1] != ops->pm_state.delta_angles[1]
+			|| ps->pm_state.delta_angles[2] != ops->pm_state.delta_angles[2])
+		pm_state_bits |= PS_M_DELTA_ANGLES;
+
+	// write it
+	Msg_WriteShort(msg, pm_state_bits);
+
+	// write the pmove_state_t
+	if (pm_state_bits & PS_M_TYPE)
+		Msg_WriteByte(msg, ps->pm_state.pm_type);
+
+	if (pm_state_bits & PS_M_ORIGIN) {
+		Msg_WriteShort(msg, ps->pm_state.origin[0]);
+		Msg_WriteShort(msg, ps->pm_state.origin[1]);
+		Msg_WriteShort(msg, ps->pm_state.origin[2]);
+	}
+
+	if (pm_state_bits & PS_M_VELOCITY) {
+		Msg_WriteShort(msg, ps->pm_state.velocity[0]);
+		Msg_WriteShort(msg, ps->pm_state.velocity[1]);
+		Msg_WriteShort(msg, ps->pm_state.velocity[2]);
+	}
+
+	if (pm_state_bits & PS_M_FLAGS)
+		Msg_WriteShort(msg, ps->pm_state.pm_flags);
+
+	if (pm_state_bits & PS_M_TIME)
+		Msg_WriteByte(msg, ps->pm_state.pm_time);
+
+	if (pm_state_bits & PS_M_GRAVITY)
+		Msg_WriteShort(msg, ps->pm_state.gravity);
+
+	if (pm_state_bits & PS_M_VIEW_OFFSET) {
+		Msg_WriteShort(msg, ps->pm_state.view_offset[0]);
+		Msg_WriteShort(msg, ps->pm_state.view_offset[1]);
+		Msg_WriteShort(msg, ps->pm_state.view_offset[2]);
+	}
+
+	if (pm_state_bits & PS_M_VIEW_ANGLES) {
+		Msg_WriteShort(msg, ps->pm_state.view_angles[0]);
+		Msg_WriteShort(msg, ps->pm_state.view_angles[1]);
+		Msg_WriteShort(msg, ps->pm_state.view_angles[2]);
+	}
+
+	if (pm_state_bits & PS_M_KICK_ANGLES) {
+		Msg_WriteShort(msg, ps->pm_state.kick_angles[0]);
+		Msg_WriteShort(msg, ps->pm_state.kick_angles[1]);
+		Msg_WriteShort(msg, ps->pm_state.kick_angles[2]);
+	}
+
+	if (pm_state_bits & PS_M_DELTA_ANGLES) {
+		Msg_WriteShort(msg, ps->pm_state.delta_angles[0]);
+		Msg_WriteShort(msg, ps->pm_state.delta_angles[1]);
+		Msg_WriteShort(msg, ps->pm_state.delta_angles[2]);
+	}
+
+	// send stats
+	stat_bits = 0;
+
+	for (i = 0; i < MAX_STATS; i++) {
+		if (ps->stats[i] != ops->stats[i]) {
+			stat_bits |= 1 << i;
+		}
+	}
+
+	Msg_WriteLong(msg, stat_bits);
+
+	for (i = 0; i < MAX_STATS; i++) {
+		if (stat_bits & (1 << i)) {
+			Msg_WriteShort(msg, ps->stats[i]);
+		}
+	}
+}
+
+/*
+ * @return The entity number read as a delta from the previous entity number.
+ */
+uint16_t Msg_ReadEntityNumber(size_buf_t *sb, const uint16_t last) {
+
+	if (Msg_ReadBits(sb, 1))
+		return last + 1;
+
+	if (Msg_ReadBits(sb, 1))
+		return last + 2 + Msg_ReadBits(sb, 4);
+
+	return Msg_ReadBits(sb, ENTITY_NUMBER_BITS);
+}
+
+/*
+ * @brief Reads the fields of an entity delta, after the entity number and bits.
  */
 void Msg_ReadDeltaEntity(entity_state_t *from, entity_state_t *to, size_buf_t *msg,
 		uint16_t number, uint16_t bits) {
+	int32_t i;
 
 	// set everything to the state we are delta'ing from
 	*to = *from;
@@ -540,43 +822,138 @@ void Msg_ReadDeltaEntity(entity_state_t *from, entity_state_t *to, size_buf_t *m
 
 	to->number = number;
 
-	if (bits & U_ORIGIN)
-		Msg_ReadPos(msg, to->origin);
+	if (bits & U_ORIGIN) {
+		for (i = 0; i < 3; i++) {
+			const int32_t q = Msg_ReadDeltaCoord(msg, Msg_QuantizeCoord(from->origin[i]));
+			to->origin[i] = q * (1.0 / 8.0);
+		}
+	}
 
-	if (bits & U_OLD_ORIGIN)
-		Msg_ReadPos(msg, to->old_origin);
+	if (bits & U_OLD_ORIGIN) {
+		for (i = 0; i < 3; i++) {
+			const int32_t q = Msg_ReadDeltaCoord(msg, Msg_QuantizeCoord(to->origin[i]));
+			to->old_origin[i] = q * (1.0 / 8.0);
+		}
+	}
 
-	if (bits & U_ANGLES)
-		Msg_ReadAngles(msg, to->angles);
+	if (bits & U_ANGLES) {
+		for (i = 0; i < 3; i++) {
+			if (Msg_ReadBits(msg, 1)) {
+				const int32_t q = Msg_ReadBits(msg, entity_angle_bits[i]);
+				to->angles[i] = Msg_UnquantizeAngle(q, entity_angle_bits[i]);
+			}
+		}
+	}
 
 	if (bits & U_ANIMATIONS) {
-		to->animation1 = Msg_ReadByte(msg);
-		to->animation2 = Msg_ReadByte(msg);
+		to->animation1 = Msg_ReadBits(msg, 8);
+		to->animation2 = Msg_ReadBits(msg, 8);
 	}
 
 	if (bits & U_EVENT)
-		to->event = Msg_ReadByte(msg);
+		to->event = Msg_ReadBits(msg, 8);
 	else
 		to->event = 0;
 
 	if (bits & U_EFFECTS)
-		to->effects = Msg_ReadShort(msg);
+		to->effects = Msg_ReadBits(msg, 16);
 
 	if (bits & U_MODELS) {
-		to->model1 = Msg_ReadByte(msg);
-		to->model2 = Msg_ReadByte(msg);
-		to->model3 = Msg_ReadByte(msg);
-		to->model4 = Msg_ReadByte(msg);
+		to->model1 = Msg_ReadBits(msg, 8);
+		to->model2 = Msg_ReadBits(msg, 8);
+		to->model3 = Msg_ReadBits(msg, 8);
+		to->model4 = Msg_ReadBits(msg, 8);
 	}
 
 	if (bits & U_CLIENT)
-		to->client = Msg_ReadByte(msg);
+		to->client = Msg_ReadBits(msg, 8);
 
 	if (bits & U_SOUND)
-		to->sound = Msg_ReadByte(msg);
+		to->sound = Msg_ReadBits(msg, 8);
 
 	if (bits & U_SOLID)
-		to->solid = Msg_ReadShort(msg);
+		to->solid = Msg_ReadBits(msg, 16);
+}
+
+/*
+ * @brief Reads the delta from the specified player state, which may be NULL
+ * for a delta from zero.
+ */
+void Msg_ReadDeltaPlayerState(const player_state_t *from, player_state_t *to, size_buf_t *msg) {
+	player_state_t *ps;
+	uint16_t pm_state_bits;
+	int32_t i;
+	uint32_t stat_bits;
+
+	ps = to;
+
+	// copy old value before delta parsing
+	if (from)
+		*ps = *from;
+	else
+		// or start clean
+		memset(ps, 0, sizeof(*ps));
+
+	pm_state_bits = Msg_ReadShort(msg);
+
+	// parse the pm_state_t
+
+	if (pm_state_bits & PS_M_TYPE)
+		ps->pm_state.pm_type = Msg_ReadByte(msg);
+
+	if (pm_state_bits & PS_M_ORIGIN) {
+		ps->pm_state.origin[0] = Msg_ReadShort(msg);
+		ps->pm_state.origin[1] = Msg_ReadShort(msg);
+		ps->pm_state.origin[2] = Msg_ReadShort(msg);
+	}
+
+	if (pm_state_bits & PS_M_VELOCITY) {
+		ps->pm_state.velocity[0] = Msg_ReadShort(msg);
+		ps->pm_state.velocity[1] = Msg_ReadShort(msg);
+		ps->pm_state.velocity[2] = Msg_ReadShort(msg);
+	}
+
+	if (pm_state_bits & PS_M_FLAGS)
+		ps->pm_state.pm_flags = Msg_ReadShort(msg);
+
+	if (pm_state_bits & PS_M_TIME)
+		ps->pm_state.pm_time = Msg_ReadByte(msg);
+
+	if (pm_state_bits & PS_M_GRAVITY)
+		ps->pm_state.gravity = Msg_ReadShort(msg);
+
+	if (pm_state_bits & PS_M_VIEW_OFFSET) {
+		ps->pm_state.view_offset[0] = Msg_ReadShort(msg);
+		ps->pm_state.view_offset[1] = Msg_ReadShort(msg);
+		ps->pm_state.view_offset[2] = Msg_ReadShort(msg);
+	}
+
+	if (pm_state_bits & PS_M_VIEW_ANGLES) {
+		ps->pm_state.view_angles[0] = Msg_ReadShort(msg);
+		ps->pm_state.view_angles[1] = Msg_ReadShort(msg);
+		ps->pm_state.view_angles[2] = Msg_ReadShort(msg);
+	}
+
+	if (pm_state_bits & PS_M_KICK_ANGLES) {
+		ps->pm_state.kick_angles[0] = Msg_ReadShort(msg);
+		ps->pm_state.kick_angles[1] = Msg_ReadShort(msg);
+		ps->pm_state.kick_angles[2] = Msg_ReadShort(msg);
+	}
+
+	if (pm_state_bits & PS_M_DELTA_ANGLES) {
+		ps->pm_state.delta_angles[0] = Msg_ReadShort(msg);
+		ps->pm_state.delta_angles[1] = Msg_ReadShort(msg);
+		ps->pm_state.delta_angles[2] = Msg_ReadShort(msg);
+	}
+
+	// parse stats
+
+	stat_bits = Msg_ReadLong(msg);
+
+	for (i = 0; i < MAX_STATS; i++) {
+		if (stat_bits & (1 << i))
+			ps->stats[i] = Msg_ReadShort(msg);
+	}
 }
 
 /*
@@ -584,6 +961,33 @@ void Msg_ReadDeltaEntity(entity_state_t *from, entity_state_t *to, size_buf_t *m
  */
 void Msg_BeginReading(size_buf_t *msg) {
 	msg->read = 0;
+	msg->read_bit = 0;
+}
+
+/*
+ * @brief Reads bits as written by Msg_WriteBits. Any other Msg_Read function
+ * resumes reading at the next whole byte.
+ */
+uint32_t Msg_ReadBits(size_buf_t *sb, uint16_t bits) {
+	uint32_t value = 0;
+	uint16_t shift = 0;
+
+	while (bits) {
+		if (sb->read_bit == 0) {
+			sb->read++;
+		}
+
+		const byte b = sb->read > sb->size ? 0 : sb->data[sb->read - 1];
+		const uint16_t n = bits < 8 - sb->read_bit ? bits : 8 - sb->read_bit;
+
+		value |= ((b >> sb->read_bit) & ((1 << n) - 1)) << shift;
+		sb->read_bit = (sb->read_bit + n) & 7;
+
+		shift += n;
+		bits -= n;
+	}
+
+	return value;
 }
 
 /*
@@ -603,6 +1007,8 @@ void Msg_ReadData(size_buf_t *sb, void *data, size_t len) {
 int32_t Msg_ReadChar(size_buf_t *sb) {
 	int32_t c;
 
+	sb->read_bit = 0;
+
 	if (sb->read + 1 > sb->size)
 		c = -1;
 	else
@@ -618,6 +1024,8 @@ int32_t Msg_ReadChar(size_buf_t *sb) {
 int32_t Msg_ReadByte(size_buf_t *sb) {
 	int32_t c;
 
+	sb->read_bit = 0;
+
 	if (sb->read + 1 > sb->size)
 		c = -1;
 	else
@@ -633,6 +1041,8 @@ int32_t Msg_ReadByte(size_buf_t *sb) {
 int32_t Msg_ReadShort(size_buf_t *sb) {
 	int32_t c;
 
+	sb->read_bit = 0;
+
 	if (sb->read + 2 > sb->size)
 		c = -1;
 	else
@@ -649,6 +1059,8 @@ int32_t Msg_ReadShort(size_buf_t *sb) {
 int32_t Msg_ReadLong(size_buf_t *sb) {
 	int32_t c;
 
+	sb->read_bit = 0;
+
 	if (sb->read + 4 > sb->size)
 		c = -1;
 	else
@@ -784,6 +1196,7 @@ void Sb_Init(size_buf_t *buf, byte *data, size_t length) {
  */
 void Sb_Clear(size_buf_t *buf) {
 	buf->size = 0;
+	buf->write_bit = 0;
 	buf->overflowed = false;
 }
 
@@ -809,6 +1222,7 @@ void *Sb_Alloc(size_buf_t *buf, size_t length) {
 
 	data = buf->data + buf->size;
 	buf->size += length;
+	buf->write_bit = 0;
 
 	return data;
 }
@@ -40,6 +40,8 @@ typedef struct size_buf_s {
 	size_t max_size;
 	size_t size;
 	size_t read;
+	uint8_t write_bit; // bits used in the last byte written, or 0 if aligned
+	uint8_t read_bit; // bits consumed from the last byte read, or 0 if aligned
 } size_buf_t;
 
 void Sb_Init(size_buf_t *buf, byte *data, size_t length);
@@ -48,6 +50,7 @@ void *Sb_Alloc(size_buf_t *buf, size_t length);
 void Sb_Write(size_buf_t *buf, const void *data, size_t len);
 void Sb_Print(size_buf_t *buf, const char *data);
 
+void Msg_WriteBits(size_buf_t *sb, uint32_t value, uint16_t bits);
 void Msg_WriteData(size_buf_t *sb, const void *data, size_t len);
 void Msg_WriteChar(size_buf_t *sb, const int32_t c);
 void Msg_WriteByte(size_buf_t *sb, const int32_t c);
@@ -59,11 +62,14 @@ void Msg_WritePos(size_buf_t *sb, const vec3_t pos);
 void Msg_WriteAngle(size_buf_t *sb, const vec_t f);
 void Msg_WriteAngles(size_buf_t *sb, const vec3_t angles);
 void Msg_WriteDeltaUsercmd(size_buf_t *sb, struct user_cmd_s *from, struct user_cmd_s *cmd);
+void Msg_WriteEntityNumber(size_buf_t *sb, const uint16_t last, const uint16_t number);
 void Msg_WriteDeltaEntity(entity_state_t *from, entity_state_t *to, size_buf_t *msg, _Bool force,
-		_Bool newentity);
+		_Bool is_new);
+void Msg_WriteDeltaPlayerState(player_state_t *from, player_state_t *to, size_buf_t *msg);
 void Msg_WriteDir(size_buf_t *sb, const vec3_t dir);
 
 void Msg_BeginReading(size_buf_t *sb);
+uint32_t Msg_ReadBits(size_buf_t *sb, uint16_t bits);
 void Msg_ReadData(size_buf_t *sb, void *data, size_t len);
 int32_t Msg_ReadChar(size_buf_t *sb);
 int32_t Msg_ReadByte(size_buf_t *sb);
@@ -76,8 +82,10 @@ void Msg_ReadPos(size_buf_t *sb, vec3_t pos);
 vec_t Msg_ReadAngle(size_buf_t *sb);
 void Msg_ReadAngles(size_buf_t *sb, vec3_t angles);
 void Msg_ReadDeltaUsercmd(size_buf_t *sb, struct user_cmd_s *from, struct user_cmd_s *cmd);
-void Msg_ReadDeltaEntity(entity_state_t *from, entity_state_t *to, size_buf_t *msg, uint16_t bits,
-		uint16_t number);
+uint16_t Msg_ReadEntityNumber(size_buf_t *sb, const uint16_t last);
+void Msg_ReadDeltaEntity(entity_state_t *from, entity_state_t *to, size_buf_t *msg, uint16_t number,
+		uint16_t bits);
+void Msg_ReadDeltaPlayerState(const player_state_t *from, player_state_t *to, size_buf_t *msg);
 void Msg_ReadDir(size_buf_t *sb, vec3_t vector);
 
 /*
@@ -86,7 +94,8 @@ void Msg_ReadDir(size_buf_t *sb, vec3_t vector);
 
  */
 
-#define PROTOCOL 1001 // change this when netcode changes
+#define PROTOCOL 1002 // change this when netcode changes
+#define PROTOCOL_LEGACY 1001 // byte aligned entity deltas, upgraded by demo_index
 #define IP_MASTER "67.228.69.114" // tastyspleen.net
 #define PORT_MASTER	1996 // some good years
 #define PORT_CLIENT	1997
@@ -106,6 +115,52 @@ void Msg_ReadDir(size_buf_t *sb, vec3_t vector);
 // disallow dangerous file downloads from both sides
 #define IS_INVALID_DOWNLOAD(f) (!*f || *f == '/' || strstr(f, "..") || strchr(f, ' '))
 
+// demo files begin with a header, followed by length prefixed messages, and are
+// terminated by a length of -1. Keyframe messages restore the full state of
+// the client, and are sent only after seeking. The index of keyframes follows
+// the terminator, and the index footer ends the file. Legacy demos have no
+// header, and begin with the length of their first message. Only those of the
+// current protocol play; demo_index upgrades those of PROTOCOL_LEGACY. Compressed
+// demos deflate the messages and the terminator, flushing the stream at each
+// keyframe so that playback may begin there. Version 1 headers have no
+// compression field.
+#define DEMO_MAGIC (('D' << 24) + ('W' << 16) + ('2' << 8) + 'Q') // "Q2WD"
+#define DEMO_INDEX_MAGIC (('X' << 24) + ('D' << 16) + ('N' << 8) + 'I') // "INDX"
+#define DEMO_VERSION 2
+
+#define DEMO_KEYFRAME 0x40000000 // set in the length of keyframe messages
+
+// multi-view demos are recorded by the server, and share the layout of demo
+// files. The messages ahead of the first keyframe hold the server data, config
+// strings and baselines. Every later message but keyframes begins with a view
+// of the whole world: the frame number, the frame it is delta'd from, the delta
+// of every entity, and then each player's number plus one, the delta of its
+// state from the previous frame, and its area bits, terminated by 0. Commands
+// multicast during the frame follow. Frames after keyframes delta from -1.
+#define DEMO_MULTI_VIEW_MAGIC (('M' << 24) + ('W' << 16) + ('2' << 8) + 'Q') // "Q2WM"
+
+typedef enum {
+	DEMO_COMPRESSION_NONE,
+	DEMO_COMPRESSION_DEFLATE
+} demo_compression_t;
+
+typedef struct {
+	int32_t magic;
+	int32_t version;
+	int32_t interval; // milliseconds between keyframes
+	int32_t compression;
+} demo_header_t;
+
+typedef struct {
+	int32_t time; // milliseconds since the first frame of the demo
+	int32_t offset; // of the first keyframe message
+} demo_keyframe_t;
+
+typedef struct {
+	int32_t num_keyframes; // preceding the footer
+	int32_t magic;
+} demo_index_t;
+
 // player_state_t communication
 
 #define PS_M_TYPE			(1<<0)
@@ -136,9 +191,9 @@ void Msg_ReadDir(size_buf_t *sb, vec3_t vector);
 
 // entity_state_t communication
 
-// This bit mask is packed into a int16_t for each entity_state_t per frame.
+// This bit mask is packed into U_BITS bits for each entity_state_t per frame.
 // It describes which fields must be read to successfully parse the delta-
-// compression.
+// compression. Entity numbers are packed as deltas from the previous entity.
 #define U_ORIGIN		(1<<0)
 #define U_OLD_ORIGIN	(1<<1) // used by lightning
 #define U_ANGLES		(1<<2)
@@ -150,6 +205,9 @@ void Msg_ReadDir(size_buf_t *sb, vec3_t vector);
 #define U_SOUND			(1<<8) // looped sounds
 #define U_SOLID			(1<<9)
 #define U_REMOVE		(1<<10) // remove this entity, don't add it
+#define U_BITS			11
+
+#define ENTITY_NUMBER_BITS 10 // enough for MAX_EDICTS
 #define NUM_APPROXIMATE_NORMALS 162
 extern const vec3_t approximate_normals[NUM_APPROXIMATE_NORMALS];
 
@@ -24,7 +24,12 @@
 
 #include "filesystem.h"
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #define FS_FILE_BUFFER (1024 * 1024 * 2)
+#define FS_STREAM_BUFFER (1024 * 64)
 // #define FS_LOAD_DEBUG // track Fs_Load / Fs_Free
 
 typedef struct fs_state_s {
@@ -151,6 +156,14 @@ int64_t Fs_Print(file_t *file, const char *fmt, ...) {
 	return Fs_Write(file, string, 1, strlen(string));
 }
 
+/*
+ * @return The length of the specified file in bytes, or -1 if it can not be
+ * determined.
+ */
+int64_t Fs_FileLength(file_t *file) {
+	return PHYSFS_fileLength((PHYSFS_File *) file);
+}
+
 /*
  * @brief Reads from the specified file.
  *
@@ -209,6 +222,308 @@ int64_t Fs_Write(file_t *file, void *buffer, size_t size, size_t count) {
 	return PHYSFS_write((PHYSFS_File *) file, buffer, size, count);
 }
 
+/*
+ * Streams are written as raw deflate data, without the zlib header, so that
+ * reading may begin at any flush point. Streams which are not compressed
+ * simply pass through to the file.
+ */
+struct fs_stream_s {
+	file_t *file;
+	_Bool write;
+	_Bool compressed;
+	size_t in, out; // total bytes passed through the stream, and to the file
+#ifdef HAVE_ZLIB
+	z_stream z;
+#endif
+	byte buffer[FS_STREAM_BUFFER]; // compressed data, pending write or read
+};
+
+/*
+ * @brief Opens a stream to read the specified file from its current offset.
+ *
+ * @return The stream, or NULL if it is compressed and zlib is not available.
+ */
+fs_stream_t *Fs_OpenStreamRead(file_t *file, _Bool compressed) {
+
+#ifndef HAVE_ZLIB
+	if (compressed) {
+		Com_Warn("Compressed streams are not supported\n");
+		return NULL;
+	}
+#endif
+
+	fs_stream_t *stream = Z_Malloc(sizeof(*stream));
+
+	stream->file = file;
+	stream->compressed = compressed;
+
+#ifdef HAVE_ZLIB
+	if (compressed && inflateInit2(&stream->z, -MAX_WBITS) != Z_OK) {
+		Com_Warn("%s\n", stream->z.msg);
+		Z_Free(stream);
+		return NULL;
+	}
+#endif
+
+	return stream;
+}
+
+/*
+ * @brief Opens a stream to write the specified file from its current offset,
+ * at the specified compression level. Level 0 disables compression, as does
+ * building without zlib.
+ */
+fs_stream_t *Fs_OpenStreamWrite(file_t *file, int32_t level) {
+
+	fs_stream_t *stream = Z_Malloc(sizeof(*stream));
+
+	stream->file = file;
+	stream->write = true;
+
+#ifdef HAVE_ZLIB
+	if (level > 0) {
+		level = Clamp(level, Z_BEST_SPEED, Z_BEST_COMPRESSION);
+
+		if (deflateInit2(&stream->z, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY)
+				== Z_OK) {
+			stream->compressed = true;
+		} else {
+			Com_Warn("%s\n", stream->z.msg);
+		}
+	}
+#else
+	if (level > 0) {
+		Com_Debug("Compressed streams are not supported\n");
+	}
+#endif
+
+	return stream;
+}
+
+#ifdef HAVE_ZLIB
+
+/*
+ * @brief Deflates the pending input of the stream with the given flush mode,
+ * writing the compressed data to the file as the buffer fills.
+ *
+ * @return True on success, false on failure.
+ */
+static _Bool Fs_DeflateStream(fs_stream_t *stream, int32_t flush) {
+	z_stream *z = &stream->z;
+
+	do {
+		z->next_out = stream->buffer;
+		z->avail_out = sizeof(stream->buffer);
+
+		const int32_t err = deflate(z, flush);
+
+		if (err == Z_STREAM_ERROR) {
+			Com_Warn("%s\n", z->msg ? z->msg : "Failed to deflate");
+			return false;
+		}
+
+		const size_t len = sizeof(stream->buffer) - z->avail_out;
+
+		if (len && Fs_Write(stream->file, stream->buffer, 1, len) != (int64_t) len)
+			return false;
+
+		stream->out += len;
+
+		if (err == Z_STREAM_END)
+			break;
+
+	} while (z->avail_in || z->avail_out == 0);
+
+	return true;
+}
+
+#endif
+
+/*
+ * @brief Reads from the specified stream, inflating it if compressed.
+ *
+ * @return The number of objects read, or -1 on failure.
+ */
+int64_t Fs_ReadStream(fs_stream_t *stream, void *buffer, size_t size, size_t count) {
+
+	if (!size || !count)
+		return 0;
+
+	if (!stream->compressed) {
+		const int64_t n = Fs_Read(stream->file, buffer, size, count);
+
+		if (n > 0) {
+			stream->in += n * size;
+			stream->out += n * size;
+		}
+
+		return n;
+	}
+
+#ifdef HAVE_ZLIB
+	z_stream *z = &stream->z;
+
+	z->next_out = buffer;
+	z->avail_out = size * count;
+
+	while (z->avail_out) {
+
+		if (z->avail_in == 0) {
+			const int64_t len = Fs_Read(stream->file, stream->buffer, 1, sizeof(stream->buffer));
+
+			if (len <= 0)
+				break;
+
+			z->next_in = stream->buffer;
+			z->avail_in = len;
+
+			stream->out += len;
+		}
+
+		const int32_t err = inflate(z, Z_NO_FLUSH);
+
+		if (err == Z_STREAM_END)
+			break;
+
+		if (err != Z_OK) {
+			Com_Warn("%s\n", z->msg ? z->msg : "Failed to inflate");
+			return -1;
+		}
+	}
+
+	const size_t len = size * count - z->avail_out;
+	stream->in += len;
+
+	return len / size;
+#else
+	return -1;
+#endif
+}
+
+/*
+ * @brief Writes to the specified stream, deflating it if compressed.
+ *
+ * @return The number of objects written, or -1 on failure.
+ */
+int64_t Fs_WriteStream(fs_stream_t *stream, void *buffer, size_t size, size_t count) {
+
+	if (!size || !count)
+		return 0;
+
+	if (!stream->compressed) {
+		const int64_t n = Fs_Write(stream->file, buffer, size, count);
+
+		if (n > 0) {
+			stream->in += n * size;
+			stream->out += n * size;
+		}
+
+		return n;
+	}
+
+#ifdef HAVE_ZLIB
+	stream->z.next_in = buffer;
+	stream->z.avail_in = size * count;
+
+	if (!Fs_DeflateStream(stream, Z_NO_FLUSH))
+		return -1;
+
+	stream->in += size * count;
+	return count;
+#else
+	return -1;
+#endif
+}
+
+/*
+ * @brief Writes a flush point to the specified stream: all data written so far
+ * is flushed to the file, and the data that follows may be read without it.
+ *
+ * @return The file offset of the flush point, or -1 on failure.
+ */
+int64_t Fs_FlushStream(fs_stream_t *stream) {
+
+#ifdef HAVE_ZLIB
+	if (stream->compressed) {
+		stream->z.avail_in = 0;
+
+		if (!Fs_DeflateStream(stream, Z_FULL_FLUSH))
+			return -1;
+	}
+#endif
+
+	return Fs_Tell(stream->file);
+}
+
+/*
+ * @brief Seeks the specified stream to a flush point, as returned by
+ * Fs_FlushStream when it was written.
+ *
+ * @return True on success, false on failure.
+ */
+_Bool Fs_SeekStream(fs_stream_t *stream, size_t offset) {
+
+	if (!Fs_Seek(stream->file, offset))
+		return false;
+
+#ifdef HAVE_ZLIB
+	if (stream->compressed) {
+		stream->z.avail_in = 0;
+
+		if (inflateReset(&stream->z) != Z_OK)
+			return false;
+	}
+#endif
+
+	return true;
+}
+
+/*
+ * @return True if the specified stream is compressed, false otherwise.
+ */
+_Bool Fs_StreamCompressed(const fs_stream_t *stream) {
+	return stream->compressed;
+}
+
+/*
+ * @brief Retrieves the total number of bytes passed through the stream, and
+ * written to or read from the file.
+ */
+void Fs_StreamStats(const fs_stream_t *stream, size_t *in, size_t *out) {
+
+	if (in)
+		*in = stream->in;
+
+	if (out)
+		*out = stream->out;
+}
+
+/*
+ * @brief Closes the specified stream, finishing it if written. The file itself
+ * remains open, positioned after the stream if written.
+ *
+ * @return True on success, false on failure.
+ */
+_Bool Fs_CloseStream(fs_stream_t *stream) {
+	_Bool ok = true;
+
+#ifdef HAVE_ZLIB
+	if (stream->compressed) {
+		if (stream->write) {
+			stream->z.avail_in = 0;
+
+			ok = Fs_DeflateStream(stream, Z_FINISH);
+			deflateEnd(&stream->z);
+		} else {
+			inflateEnd(&stream->z);
+		}
+	}
+#endif
+
+	Z_Free(stream);
+	return ok;
+}
+
 /*
  * @brief Loads the specified file into the given buffer, which is automatically
  * allocated if non-NULL. Returns the file length, or -1 if it is unable to be
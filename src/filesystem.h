@@ -30,12 +30,19 @@ typedef struct {
 	void *opaque;
 } file_t;
 
+/*
+ * Streams compress the data written to a file, if zlib is available, and may
+ * be read again from the flush points written to them.
+ */
+typedef struct fs_stream_s fs_stream_t;
+
 typedef void (*FsEnumerateFunc)(const char *path, void *data);
 
 _Bool Fs_Close(file_t *file);
 _Bool Fs_Eof(file_t *file);
 _Bool Fs_Exists(const char *filename);
 _Bool Fs_Flush(file_t *file);
+int64_t Fs_FileLength(file_t *file);
 const char *Fs_LastError(void);
 _Bool Fs_Mkdir(const char *dir);
 file_t *Fs_OpenAppend(const char *filename);
@@ -47,6 +54,15 @@ _Bool Fs_ReadLine(file_t *file, char *buffer, size_t len);
 _Bool Fs_Seek(file_t *file, size_t offset);
 int64_t Fs_Tell(file_t *file);
 int64_t Fs_Write(file_t *file, void *buffer, size_t size, size_t count);
+fs_stream_t *Fs_OpenStreamRead(file_t *file, _Bool compressed);
+fs_stream_t *Fs_OpenStreamWrite(file_t *file, int32_t level);
+int64_t Fs_ReadStream(fs_stream_t *stream, void *buffer, size_t size, size_t count);
+int64_t Fs_WriteStream(fs_stream_t *stream, void *buffer, size_t size, size_t count);
+int64_t Fs_FlushStream(fs_stream_t *stream);
+_Bool Fs_SeekStream(fs_stream_t *stream, size_t offset);
+_Bool Fs_StreamCompressed(const fs_stream_t *stream);
+void Fs_StreamStats(const fs_stream_t *stream, size_t *in, size_t *out);
+_Bool Fs_CloseStream(fs_stream_t *stream);
 int64_t Fs_Load(const char *filename, void **buffer);
 void Fs_Free(void *buffer);
 _Bool Fs_Rename(const char *source, const char *dest);
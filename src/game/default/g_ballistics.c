@@ -227,59 +227,107 @@ void G_BlasterProjectile(g_edict_t *ent, vec3_t start, vec3_t dir, int32_t speed
 }
 
 /*
- * @brief
+ * @brief Resolves the spread end point of a bullet fired from start.
  */
-void G_BulletProjectile(g_edict_t *ent, vec3_t start, vec3_t aimdir, int32_t damage,
-		int32_t knockback, int32_t hspread, int32_t vspread, int32_t mod) {
-	c_trace_t tr;
+static void G_BulletEnd(const vec3_t start, const vec3_t aimdir, int32_t hspread,
+		int32_t vspread, vec3_t end) {
 	vec3_t dir;
 	vec3_t forward, right, up;
-	vec3_t end;
 	vec_t r;
 	vec_t u;
 
-	tr = gi.Trace(ent->s.origin, NULL, NULL, start, ent, MASK_SHOT);
-	if (tr.fraction == 1.0) {
-		VectorAngles(aimdir, dir);
-		AngleVectors(dir, forward, right, up);
+	VectorAngles(aimdir, dir);
+	AngleVectors(dir, forward, right, up);
 
-		r = Randomc() * hspread;
-		u = Randomc() * vspread;
-		VectorMA(start, 8192.0, forward, end);
-		VectorMA(end, r, right, end);
-		VectorMA(end, u, up, end);
+	r = Randomc() * hspread;
+	u = Randomc() * vspread;
+	VectorMA(start, 8192.0, forward, end);
+	VectorMA(end, r, right, end);
+	VectorMA(end, u, up, end);
+}
 
-		tr = gi.Trace(start, NULL, NULL, end, ent, MASK_SHOT);
-	}
+/*
+ * @brief Applies damage and effects for a bullet which produced the given trace.
+ */
+static void G_BulletImpact(g_edict_t *ent, vec3_t start, vec3_t aimdir, c_trace_t *tr,
+		int32_t damage, int32_t knockback, int32_t mod) {
 
 	// send trails and marks
-	if (tr.fraction < 1.0) {
+	if (tr->fraction < 1.0) {
 
-		if (tr.ent->locals.take_damage) { // bleed and damage the enemy
-			G_Damage(tr.ent, ent, ent, aimdir, tr.end, tr.plane.normal, damage, knockback,
+		if (tr->ent->locals.take_damage) { // bleed and damage the enemy
+			G_Damage(tr->ent, ent, ent, aimdir, tr->end, tr->plane.normal, damage, knockback,
 					DAMAGE_BULLET, mod);
 		} else { // leave an impact mark on the wall
-			if (G_IsStructural(tr.ent, tr.surface)) {
-				G_BulletMark(tr.end, &tr.plane, tr.surface);
+			if (G_IsStructural(tr->ent, tr->surface)) {
+				G_BulletMark(tr->end, &tr->plane, tr->surface);
 			}
 		}
 
-		G_Tracer(start, tr.end);
+		G_Tracer(start, tr->end);
 
-		if ((gi.PointContents(start) & MASK_WATER) || (gi.PointContents(tr.end) & MASK_WATER))
-			G_BubbleTrail(start, &tr);
+		if ((gi.PointContents(start) & MASK_WATER) || (gi.PointContents(tr->end) & MASK_WATER))
+			G_BubbleTrail(start, tr);
 	}
 }
 
 /*
  * @brief
  */
+void G_BulletProjectile(g_edict_t *ent, vec3_t start, vec3_t aimdir, int32_t damage,
+		int32_t knockback, int32_t hspread, int32_t vspread, int32_t mod) {
+	c_trace_t tr;
+	vec3_t end;
+
+	tr = gi.Trace(ent->s.origin, NULL, NULL, start, ent, MASK_SHOT);
+	if (tr.fraction == 1.0) {
+		G_BulletEnd(start, aimdir, hspread, vspread, end);
+
+		tr = gi.Trace(start, NULL, NULL, end, ent, MASK_SHOT);
+	}
+
+	G_BulletImpact(ent, start, aimdir, &tr, damage, knockback, mod);
+}
+
+#define MAX_SHOTGUN_PELLETS 32
+
+/*
+ * @brief Fires count bullets at once. The pellets are traced in batches of up
+ * to MAX_SHOTGUN_PELLETS, and so those in a batch all see the world as it was
+ * before any of them hit.
+ */
 void G_ShotgunProjectiles(g_edict_t *ent, vec3_t start, vec3_t dir, int32_t damage,
 		int32_t knockback, int32_t hspread, int32_t vspread, int32_t count, int32_t mod) {
-	int32_t i;
+	g_trace_t traces[MAX_SHOTGUN_PELLETS];
+	int32_t i, j;
 
-	for (i = 0; i < count; i++)
-		G_BulletProjectile(ent, start, dir, damage, knockback, hspread, vspread, mod);
+	c_trace_t tr = gi.Trace(ent->s.origin, NULL, NULL, start, ent, MASK_SHOT);
+	if (tr.fraction < 1.0) { // the muzzle is obstructed
+		for (i = 0; i < count; i++) {
+			G_BulletImpact(ent, start, dir, &tr, damage, knockback, mod);
+		}
+		return;
+	}
+
+	for (i = 0; i < count; i += MAX_SHOTGUN_PELLETS) {
+		const int32_t num_pellets = count - i < MAX_SHOTGUN_PELLETS ? count - i : MAX_SHOTGUN_PELLETS;
+
+		memset(traces, 0, sizeof(g_trace_t) * num_pellets);
+
+		for (j = 0; j < num_pellets; j++) {
+			VectorCopy(start, traces[j].start);
+			G_BulletEnd(start, dir, hspread, vspread, traces[j].end);
+
+			traces[j].skip = ent;
+			traces[j].mask = MASK_SHOT;
+		}
+
+		gi.TraceBatch(traces, num_pellets);
+
+		for (j = 0; j < num_pellets; j++) {
+			G_BulletImpact(ent, start, dir, &traces[j].trace, damage, knockback, mod);
+		}
+	}
 }
 
 /*
@@ -38,64 +38,6 @@ _Bool G_OnSameTeam(const g_edict_t *ent1, const g_edict_t *ent2) {
 	return ent1->client->locals.persistent.team == ent2->client->locals.persistent.team;
 }
 
-/*
- * @brief Returns true if the inflictor can directly damage the target. Used for
- * explosions and melee attacks.
- */
-_Bool G_CanDamage(g_edict_t *targ, g_edict_t *inflictor) {
-	vec3_t dest;
-	c_trace_t trace;
-
-	// bmodels need special checking because their origin is 0,0,0
-	if (targ->locals.move_type == MOVE_TYPE_PUSH) {
-		VectorAdd(targ->abs_mins, targ->abs_maxs, dest);
-		VectorScale(dest, 0.5, dest);
-		trace
-				= gi.Trace(inflictor->s.origin, vec3_origin, vec3_origin, dest, inflictor,
-						MASK_SOLID);
-		if (trace.fraction == 1.0)
-			return true;
-		if (trace.ent == targ)
-			return true;
-		return false;
-	}
-
-	trace = gi.Trace(inflictor->s.origin, vec3_origin, vec3_origin, targ->s.origin, inflictor,
-			MASK_SOLID);
-	if (trace.fraction == 1.0)
-		return true;
-
-	VectorCopy(targ->s.origin, dest);
-	dest[0] += 15.0;
-	dest[1] += 15.0;
-	trace = gi.Trace(inflictor->s.origin, vec3_origin, vec3_origin, dest, inflictor, MASK_SOLID);
-	if (trace.fraction == 1.0)
-		return true;
-
-	VectorCopy(targ->s.origin, dest);
-	dest[0] += 15.0;
-	dest[1] -= 15.0;
-	trace = gi.Trace(inflictor->s.origin, vec3_origin, vec3_origin, dest, inflictor, MASK_SOLID);
-	if (trace.fraction == 1.0)
-		return true;
-
-	VectorCopy(targ->s.origin, dest);
-	dest[0] -= 15.0;
-	dest[1] += 15.0;
-	trace = gi.Trace(inflictor->s.origin, vec3_origin, vec3_origin, dest, inflictor, MASK_SOLID);
-	if (trace.fraction == 1.0)
-		return true;
-
-	VectorCopy(targ->s.origin, dest);
-	dest[0] -= 15.0;
-	dest[1] -= 15.0;
-	trace = gi.Trace(inflictor->s.origin, vec3_origin, vec3_origin, dest, inflictor, MASK_SOLID);
-	if (trace.fraction == 1.0)
-		return true;
-
-	return false;
-}
-
 /*
  * @brief
  */
@@ -312,45 +254,157 @@ void G_Damage(g_edict_t *targ, g_edict_t *inflictor, g_edict_t *attacker, vec3_t
 	}
 }
 
+#define MAX_RADIUS_DAMAGE 32
+
 /*
- * @brief
+ * @brief Resolves whether the inflictor can directly damage each of the
+ * specified targets, with batched traces: first toward their centers, and then
+ * toward the corners of those which are obstructed.
+ */
+static void G_CanDamageBatch(g_edict_t *inflictor, g_edict_t **targs, _Bool *can_damage,
+		size_t count) {
+	static const vec_t corners[4][2] = { { 15.0, 15.0 }, { 15.0, -15.0 }, { -15.0, 15.0 }, {
+			-15.0, -15.0 } };
+	g_trace_t traces[MAX_RADIUS_DAMAGE * 4];
+	size_t i, j, num_traces;
+
+	memset(traces, 0, sizeof(g_trace_t) * count);
+
+	for (i = 0; i < count; i++) {
+		g_trace_t *tr = &traces[i];
+
+		VectorCopy(inflictor->s.origin, tr->start);
+
+		// bmodels need special checking because their origin is 0,0,0
+		if (targs[i]->locals.move_type == MOVE_TYPE_PUSH) {
+			VectorAdd(targs[i]->abs_mins, targs[i]->abs_maxs, tr->end);
+			VectorScale(tr->end, 0.5, tr->end);
+		} else {
+			VectorCopy(targs[i]->s.origin, tr->end);
+		}
+
+		tr->skip = inflictor;
+		tr->mask = MASK_SOLID;
+	}
+
+	gi.TraceBatch(traces, count);
+
+	for (i = 0, num_traces = 0; i < count; i++) {
+		const c_trace_t *tr = &traces[i].trace;
+
+		can_damage[i] = tr->fraction == 1.0;
+
+		if (targs[i]->locals.move_type == MOVE_TYPE_PUSH) {
+			can_damage[i] |= tr->ent == targs[i];
+		} else if (!can_damage[i]) {
+			num_traces += 4;
+		}
+	}
+
+	if (!num_traces)
+		return;
+
+	memset(traces, 0, sizeof(g_trace_t) * num_traces);
+
+	for (i = 0, num_traces = 0; i < count; i++) {
+
+		if (can_damage[i] || targs[i]->locals.move_type == MOVE_TYPE_PUSH)
+			continue;
+
+		for (j = 0; j < 4; j++) {
+			g_trace_t *tr = &traces[num_traces++];
+
+			VectorCopy(inflictor->s.origin, tr->start);
+
+			VectorCopy(targs[i]->s.origin, tr->end);
+			tr->end[0] += corners[j][0];
+			tr->end[1] += corners[j][1];
+
+			tr->skip = inflictor;
+			tr->mask = MASK_SOLID;
+		}
+	}
+
+	gi.TraceBatch(traces, num_traces);
+
+	for (i = 0, num_traces = 0; i < count; i++) {
+
+		if (can_damage[i] || targs[i]->locals.move_type == MOVE_TYPE_PUSH)
+			continue;
+
+		for (j = 0; j < 4; j++) {
+			if (traces[num_traces++].trace.fraction == 1.0)
+				can_damage[i] = true;
+		}
+	}
+}
+
+/*
+ * @brief Damages all entities within radius of the inflictor that it can see.
+ * Visibility is resolved for up to MAX_RADIUS_DAMAGE entities at a time
+ * before any of them are damaged.
  */
 void G_RadiusDamage(g_edict_t *inflictor, g_edict_t *attacker, g_edict_t *ignore, int32_t damage,
 		int32_t knockback, vec_t radius, int32_t mod) {
+	g_edict_t *ents[MAX_RADIUS_DAMAGE];
+	vec3_t dirs[MAX_RADIUS_DAMAGE];
+	vec_t dmg[MAX_RADIUS_DAMAGE], kick[MAX_RADIUS_DAMAGE];
+	_Bool can_damage[MAX_RADIUS_DAMAGE];
 	g_edict_t *ent;
 	vec_t d, k, dist;
 	vec3_t dir;
+	size_t i, count;
 
 	ent = NULL;
+	count = 0;
 
-	while ((ent = G_FindRadius(ent, inflictor->s.origin, radius)) != NULL) {
+	do {
+		ent = G_FindRadius(ent, inflictor->s.origin, radius);
 
-		if (ent == ignore)
-			continue;
+		if (ent) {
 
-		if (!ent->locals.take_damage)
-			continue;
+			if (ent == ignore)
+				continue;
 
-		VectorSubtract(ent->s.origin, inflictor->s.origin, dir);
-		dist = VectorNormalize(dir);
+			if (!ent->locals.take_damage)
+				continue;
 
-		d = damage - 0.5 * dist;
-		k = knockback - 0.5 * dist;
+			VectorSubtract(ent->s.origin, inflictor->s.origin, dir);
+			dist = VectorNormalize(dir);
 
-		if (d <= 0 && k <= 0) // too far away to be damaged
-			continue;
+			d = damage - 0.5 * dist;
+			k = knockback - 0.5 * dist;
 
-		if (ent == attacker) { // reduce self damage
-			if (mod == MOD_BFG_BLAST)
-				d = d * 0.25;
-			else
-				d = d * 0.5;
+			if (d <= 0 && k <= 0) // too far away to be damaged
+				continue;
+
+			if (ent == attacker) { // reduce self damage
+				if (mod == MOD_BFG_BLAST)
+					d = d * 0.25;
+				else
+					d = d * 0.5;
+			}
+
+			ents[count] = ent;
+			VectorCopy(dir, dirs[count]);
+			dmg[count] = d;
+			kick[count] = k;
+
+			if (++count < MAX_RADIUS_DAMAGE)
+				continue;
 		}
 
-		if (!G_CanDamage(ent, inflictor))
-			continue;
+		G_CanDamageBatch(inflictor, ents, can_damage, count);
 
-		G_Damage(ent, inflictor, attacker, dir, ent->s.origin, vec3_origin, (int32_t) d, (int32_t) k,
-				DAMAGE_RADIUS, mod);
-	}
+		for (i = 0; i < count; i++) {
+
+			if (!can_damage[i] || !ents[i]->in_use)
+				continue;
+
+			G_Damage(ents[i], inflictor, attacker, dirs[i], ents[i]->s.origin, vec3_origin,
+					(int32_t) dmg[i], (int32_t) kick[i], DAMAGE_RADIUS, mod);
+		}
+
+		count = 0;
+	} while (ent);
 }
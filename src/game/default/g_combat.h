@@ -25,7 +25,6 @@
 #include "g_types.h"
 
 #ifdef __GAME_LOCAL_H__
-_Bool G_CanDamage(g_edict_t *targ, g_edict_t *inflictor);
 void G_Damage(g_edict_t *targ, g_edict_t *inflictor, g_edict_t *attacker, vec3_t dir,
 		vec3_t point, vec3_t normal, int16_t damage, int16_t knockback, int32_t dflags, int32_t mod);
 _Bool G_OnSameTeam(const g_edict_t *ent1, const g_edict_t *ent2);
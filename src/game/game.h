@@ -24,7 +24,7 @@
 
 #include "shared.h"
 
-#define GAME_API_VERSION 1
+#define GAME_API_VERSION 3
 
 // edict->sv_flags
 #define SVF_NO_CLIENT 1  // don't send entity to clients
@@ -108,6 +108,18 @@ struct g_edict_s {
 	g_edict_locals_t locals; // game-local data members
 };
 
+/*
+ * @brief A single request, and its result, for the batched trace interface.
+ */
+typedef struct {
+	vec3_t start, end;
+	vec3_t mins, maxs; // zero for point traces
+	const g_edict_t *skip;
+	int32_t mask;
+
+	c_trace_t trace; // the result
+} g_trace_t;
+
 // functions provided by the main engine
 typedef struct {
 
@@ -120,9 +132,9 @@ typedef struct {
 	void (*Warn_)(const char *func, const char *fmr, ...) __attribute__((format(printf, 2, 3)));
 	void (*Error_)(const char *func, const char *fmt, ...) __attribute__((noreturn, format(printf, 2, 3)));
 
-	// zone memory management
-	void *(*Malloc)(size_t size, z_tag_t tag);
-	void *(*LinkMalloc)(size_t size, void *parent);
+	// zone memory management, accounted to the call site
+	void *(*Malloc_)(size_t size, z_tag_t tag, const char *site);
+	void *(*LinkMalloc_)(size_t size, void *parent, const char *site);
 	void (*Free)(void *p);
 	void (*FreeTag)(z_tag_t tag);
 
@@ -157,6 +169,7 @@ typedef struct {
 	// collision detection
 	c_trace_t (*Trace)(const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end,
 			const g_edict_t *passent, const int32_t mask);
+	void (*TraceBatch)(g_trace_t *traces, const size_t count);
 	int32_t (*PointContents)(const vec3_t point);
 	_Bool (*inPVS)(const vec3_t p1, const vec3_t p2);
 	_Bool (*inPHS)(const vec3_t p1, const vec3_t p2);
@@ -76,6 +76,8 @@ static void Error(err_t err, const char *msg) {
 	switch (err) {
 		case ERR_NONE:
 		case ERR_DROP:
+			Cm_AbortLoad();
+
 			Sv_Shutdown(msg);
 
 #ifdef BUILD_CLIENT
@@ -220,14 +222,14 @@ static void Shutdown(const char *msg) {
  * @brief
  */
 static void Frame(uint32_t msec) {
-	extern int32_t c_traces, c_bsp_brush_traces;
-	extern int32_t c_point_contents;
 	extern cvar_t *threads;
 
 	if (show_trace->value) {
-		Com_Print("%4i traces (%4i clips), %4i points\n", c_traces, c_bsp_brush_traces,
-				c_point_contents);
-		c_traces = c_bsp_brush_traces = c_point_contents = 0;
+		c_trace_stats_t stats;
+		Cm_TraceStats(&stats);
+
+		Com_Print("%4i traces (%4i clips, %4i rejects), %4i points\n", stats.traces,
+				stats.brush_traces, stats.brush_rejects, stats.point_contents);
 	}
 
 	Cbuf_Execute();
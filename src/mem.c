@@ -26,22 +26,177 @@
 #define Z_MAGIC 0x69
 typedef byte z_magic_t;
 
+#define Z_BLOCK_ARENA	0x1 // bump allocated from a tag arena, never free'd directly
+#define Z_BLOCK_PARENT	0x2 // registered with its arena as having linked children
+
+/*
+ * @brief Allocation statistics, kept per tag and per call site. Counters are
+ * updated atomically so that accounting never requires a lock.
+ */
+typedef struct {
+	const char *name;
+	volatile size_t size; // live user bytes
+	volatile size_t peak;
+	volatile uint64_t counts; // live allocations (low), allocations since startup (high)
+	uint32_t sampled; // total at the previous report, for rate
+} z_stats_t;
+
+#define Z_STATS_ALLOC (((uint64_t) 1 << 32) | 1)
+
+#define Z_StatsCount(s) ((uint32_t) (s)->counts)
+#define Z_StatsTotal(s) ((uint32_t) ((s)->counts >> 32))
+
 typedef struct z_block_s {
 	z_magic_t magic;
+	byte flags;
 	z_tag_t tag; // for group free
 	struct z_block_s *parent;
-	GList *children;
+	struct z_block_s *child; // the first child
+	struct z_block_s *prev, *next; // siblings
+	z_stats_t *site; // the call site which allocated this block
 	size_t size;
-} z_block_t;
+} __attribute__((aligned(16))) z_block_t;
+
+#define Z_TAG_COUNT (Z_TAG_CGAME_LEVEL + 1)
+
+static const char *z_tag_names[Z_TAG_COUNT] = {
+	"default",
+	"server",
+	"ai",
+	"game",
+	"game_level",
+	"client",
+	"renderer",
+	"sound",
+	"ui",
+	"cgame",
+	"cgame_level"
+};
+
+#define Z_SITES 4096 // must be a power of two
+
+#define Z_ARENA_ALIGN 16
+#define Z_ARENA_CHUNK_SIZE (1024 * 1024)
+
+#define Z_Align(s) (((s) + (Z_ARENA_ALIGN - 1)) & ~((size_t) Z_ARENA_ALIGN - 1))
+
+/*
+ * @brief Arena chunks are owned by the thread which acquired them, so that
+ * bump allocation never contends. The chunk header is followed by its data.
+ */
+typedef struct z_chunk_s {
+	struct z_chunk_s *next;
+	size_t size; // usable bytes
+	size_t used;
+} z_chunk_t;
+
+#define Z_ChunkData(c) ((byte *) (c) + Z_Align(sizeof(z_chunk_t)))
+
+typedef struct {
+	_Bool enabled;
+	volatile uint32_t generation; // incremented each time the arena is freed
+	z_chunk_t *chunks;
+	GSList *parents; // blocks with linked (heap) children
+	SDL_mutex *lock;
+} z_arena_t;
+
+/*
+ * @brief Each thread bump allocates from its own chunk per tag. The cached
+ * chunk is only valid while its generation matches that of the arena.
+ */
+typedef struct {
+	z_chunk_t *chunk;
+	uint32_t generation;
+} z_arena_cache_t;
+
+static __thread z_arena_cache_t z_arena_cache[Z_TAG_COUNT];
 
 typedef struct {
 	GHashTable *blocks;
-	size_t size;
 	SDL_mutex *lock;
+
+	z_arena_t arenas[Z_TAG_COUNT];
+
+	z_stats_t tags[Z_TAG_COUNT];
+	z_stats_t sites[Z_SITES]; // open addressed by call site
+	z_stats_t other_sites; // in case the sites table is exhausted
+
+	GHashTable *module_sites; // call sites copied from the game modules
+
+	gint64 sample_time; // of the previous report, for rate
 } z_state_t;
 
 static z_state_t z_state;
 
+/*
+ * @brief Resolves the statistics for the specified call site. Sites are
+ * string literals, so they are keyed by address and claimed without locking.
+ */
+static z_stats_t *Z_SiteStats(const char *site) {
+
+	const uint32_t hash = (uint32_t) (((uintptr_t) site) >> 3) * 2654435761u;
+	uint32_t i;
+
+	for (i = 0; i < Z_SITES; i++) {
+		z_stats_t *s = &z_state.sites[(hash + i) & (Z_SITES - 1)];
+
+		if (s->name == site)
+			return s;
+
+		if (s->name == NULL) {
+			if (__sync_bool_compare_and_swap(&s->name, NULL, site) || s->name == site)
+				return s;
+		}
+	}
+
+	return &z_state.other_sites;
+}
+
+/*
+ * @brief Resolves a call site in the game or client game module. The module
+ * may be unloaded while its allocations are still accounted, so the site is
+ * copied once, and keeps its statistics when the module is reloaded.
+ */
+static const char *Z_ModuleSite(const char *site) {
+
+	SDL_mutexP(z_state.lock);
+
+	char *s = g_hash_table_lookup(z_state.module_sites, site);
+	if (!s) {
+		s = g_strdup(site);
+		g_hash_table_insert(z_state.module_sites, s, s);
+	}
+
+	SDL_mutexV(z_state.lock);
+
+	return s;
+}
+
+/*
+ * @brief Accounts for an allocation of size bytes.
+ */
+static void Z_StatsAlloc(z_stats_t *s, size_t size) {
+
+	const size_t live = __sync_add_and_fetch(&s->size, size);
+
+	__sync_fetch_and_add(&s->counts, Z_STATS_ALLOC);
+
+	size_t peak;
+	while (live > (peak = s->peak)) {
+		if (__sync_bool_compare_and_swap(&s->peak, peak, live))
+			break;
+	}
+}
+
+/*
+ * @brief Accounts for the release of size bytes.
+ */
+static void Z_StatsFree(z_stats_t *s, size_t size) {
+
+	__sync_fetch_and_sub(&s->size, size);
+	__sync_fetch_and_sub(&s->counts, 1);
+}
+
 /*
  * @brief Throws a fatal error if the specified memory block is non-NULL but
  * not owned by the memory subsystem.
@@ -60,20 +215,64 @@ static z_block_t *Z_CheckMagic(void *p) {
 	return z;
 }
 
+/*
+ * @brief Inserts the block at the head of its parent's children.
+ */
+static void Z_LinkChild(z_block_t *z, z_block_t *parent) {
+
+	z->parent = parent;
+	z->prev = NULL;
+	z->next = parent->child;
+
+	if (parent->child) {
+		parent->child->prev = z;
+	}
+
+	parent->child = z;
+}
+
+/*
+ * @brief Removes the block from its parent's children in constant time.
+ */
+static void Z_UnlinkChild(z_block_t *z) {
+
+	if (z->prev) {
+		z->prev->next = z->next;
+	} else {
+		z->parent->child = z->next;
+	}
+
+	if (z->next) {
+		z->next->prev = z->prev;
+	}
+
+	z->parent = z->prev = z->next = NULL;
+}
+
 /*
  * @brief Recursively frees linked managed memory.
  */
 static void Z_Free_(z_block_t *z) {
 
 	// recurse down the tree, freeing children
-	if (z->children) {
-		g_list_free_full(z->children, (GDestroyNotify) Z_Free_);
+	z_block_t *c = z->child;
+	while (c) {
+		z_block_t *next = c->next;
+		Z_Free_(c);
+		c = next;
 	}
 
+	z->child = NULL;
+
 	// decrement the pool size and free the memory
-	z_state.size -= z->size;
+	Z_StatsFree(&z_state.tags[z->tag], z->size);
+	Z_StatsFree(z->site, z->size);
 
-	free(z);
+	if (z->flags & Z_BLOCK_ARENA) {
+		z->magic = 0; // reclaimed by Z_FreeTag, but catch double frees
+	} else {
+		free(z);
+	}
 }
 
 /*
@@ -86,8 +285,8 @@ void Z_Free(void *p) {
 	SDL_mutexP(z_state.lock);
 
 	if (z->parent) {
-		z->parent->children = g_list_remove(z->parent->children, z);
-	} else {
+		Z_UnlinkChild(z);
+	} else if (!(z->flags & Z_BLOCK_ARENA)) {
 		g_hash_table_remove(z_state.blocks, (gconstpointer) z);
 	}
 
@@ -97,7 +296,121 @@ void Z_Free(void *p) {
 }
 
 /*
- * @brief Free all managed items allocated with the specified tag.
+ * @brief Releases the statistics of the live blocks in a chunk. This is a
+ * sequential pass over the block headers only.
+ */
+static void Z_ChunkStatsFree(z_chunk_t *chunk) {
+	size_t used = 0;
+
+	while (used < chunk->used) {
+		const size_t offset = Z_Align(used + sizeof(z_block_t));
+		z_block_t *z = ((z_block_t *) (Z_ChunkData(chunk) + offset)) - 1;
+
+		if (z->magic == Z_MAGIC) {
+			Z_StatsFree(&z_state.tags[z->tag], z->size);
+			Z_StatsFree(z->site, z->size);
+		}
+
+		used = offset + z->size;
+	}
+}
+
+/*
+ * @brief Releases the specified arena's chunks wholesale. Any heap allocations
+ * linked to arena blocks are freed first. The caller must hold z_state.lock.
+ */
+static void Z_FreeArena(z_arena_t *arena) {
+	GSList *p;
+
+	for (p = arena->parents; p; p = p->next) {
+		z_block_t *z = (z_block_t *) p->data;
+
+		z_block_t *c = z->child;
+		while (c) {
+			z_block_t *next = c->next;
+			Z_Free_(c);
+			c = next;
+		}
+
+		z->child = NULL;
+	}
+
+	g_slist_free(arena->parents);
+	arena->parents = NULL;
+
+	SDL_mutexP(arena->lock);
+
+	// invalidate every thread's cached chunk before releasing them
+	arena->generation++;
+
+	z_chunk_t *c = arena->chunks;
+	while (c) {
+		z_chunk_t *next = c->next;
+		Z_ChunkStatsFree(c);
+		free(c);
+		c = next;
+	}
+
+	arena->chunks = NULL;
+
+	SDL_mutexV(arena->lock);
+}
+
+/*
+ * @brief Compares call site statistics by live size, descending.
+ */
+static gint Z_StatsCmp(gconstpointer a, gconstpointer b) {
+	const size_t sa = ((const z_stats_t *) a)->size;
+	const size_t sb = ((const z_stats_t *) b)->size;
+
+	return sa < sb ? 1 : sa > sb ? -1 : 0;
+}
+
+/*
+ * @return A list of the call sites with live allocations, largest first.
+ */
+static GList *Z_LiveSites(void) {
+	GList *sites = NULL;
+	int32_t i;
+
+	for (i = 0; i < Z_SITES; i++) {
+		if (Z_StatsCount(&z_state.sites[i])) {
+			sites = g_list_prepend(sites, &z_state.sites[i]);
+		}
+	}
+
+	if (Z_StatsCount(&z_state.other_sites)) {
+		sites = g_list_prepend(sites, &z_state.other_sites);
+	}
+
+	return g_list_sort(sites, Z_StatsCmp);
+}
+
+/*
+ * @brief Prints the call sites which still hold managed memory. This is run
+ * when all managed memory is freed at shutdown.
+ */
+static void Z_LeakReport(void) {
+
+	GList *sites = Z_LiveSites();
+
+	if (sites) {
+		Com_Print("Managed memory leaked at shutdown:\n");
+
+		const GList *s;
+		for (s = sites; s; s = s->next) {
+			const z_stats_t *stats = (const z_stats_t *) s->data;
+			Com_Print("  %8zu bytes in %6u blocks at %s\n", stats->size, Z_StatsCount(stats),
+					stats->name);
+		}
+
+		g_list_free(sites);
+	}
+}
+
+/*
+ * @brief Free all managed items allocated with the specified tag. Tags using
+ * an arena must not be allocated from concurrently while they are freed.
  */
 void Z_FreeTag(z_tag_t tag) {
 	GHashTableIter it;
@@ -105,6 +418,10 @@ void Z_FreeTag(z_tag_t tag) {
 
 	SDL_mutexP(z_state.lock);
 
+	if (tag == Z_TAG_ALL) {
+		Z_LeakReport();
+	}
+
 	g_hash_table_iter_init(&it, z_state.blocks);
 
 	while (g_hash_table_iter_next(&it, &key, &value)) {
@@ -116,9 +433,113 @@ void Z_FreeTag(z_tag_t tag) {
 		}
 	}
 
+	int32_t i;
+	for (i = 0; i < Z_TAG_COUNT; i++) {
+		if (tag == Z_TAG_ALL || tag == (z_tag_t) i) {
+			Z_FreeArena(&z_state.arenas[i]);
+		}
+	}
+
 	SDL_mutexV(z_state.lock);
 }
 
+/*
+ * @brief Allocates a new chunk of at least size bytes for the given arena.
+ */
+static z_chunk_t *Z_ArenaChunk(z_arena_t *arena, size_t size) {
+	z_chunk_t *chunk;
+
+	const size_t s = Z_Align(sizeof(z_chunk_t)) + size;
+
+	if (!(chunk = calloc(s, 1))) {
+		Com_Error(ERR_FATAL, "Failed to allocate %zu bytes\n", s);
+	}
+
+	chunk->size = size;
+
+	SDL_mutexP(arena->lock);
+
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+
+	SDL_mutexV(arena->lock);
+
+	return chunk;
+}
+
+/*
+ * @brief Bumps a block of size bytes from the specified chunk, such that the
+ * memory following the block header is aligned.
+ *
+ * @return The block, or NULL if the chunk is exhausted.
+ */
+static z_block_t *Z_ChunkMalloc(z_chunk_t *chunk, size_t size) {
+
+	const size_t offset = Z_Align(chunk->used + sizeof(z_block_t));
+
+	if (offset + size > chunk->size)
+		return NULL;
+
+	chunk->used = offset + size;
+
+	return ((z_block_t *) (Z_ChunkData(chunk) + offset)) - 1;
+}
+
+/*
+ * @brief Allocates a block from the arena for the specified tag. The calling
+ * thread's cached chunk is used whenever possible, so that the arena lock is
+ * only taken to acquire new chunks.
+ */
+static z_block_t *Z_ArenaMalloc(size_t size, z_tag_t tag, const char *site) {
+	z_arena_t *arena = &z_state.arenas[tag];
+	z_arena_cache_t *cache = &z_arena_cache[tag];
+	z_block_t *z = NULL;
+
+	const uint32_t generation = arena->generation;
+
+	if (cache->chunk && cache->generation == generation) {
+		z = Z_ChunkMalloc(cache->chunk, size);
+	}
+
+	if (!z) {
+		const size_t s = Z_Align(sizeof(z_block_t)) + size;
+
+		if (s > Z_ARENA_CHUNK_SIZE / 4) { // large blocks get a dedicated chunk
+			z = Z_ChunkMalloc(Z_ArenaChunk(arena, s), size);
+		} else {
+			cache->chunk = Z_ArenaChunk(arena, Z_ARENA_CHUNK_SIZE);
+			cache->generation = generation;
+
+			z = Z_ChunkMalloc(cache->chunk, size);
+		}
+	}
+
+	z->magic = Z_MAGIC;
+	z->flags = Z_BLOCK_ARENA;
+	z->tag = tag;
+	z->site = Z_SiteStats(site);
+	z->size = size;
+
+	Z_StatsAlloc(&z_state.tags[tag], size);
+	Z_StatsAlloc(z->site, size);
+
+	return z;
+}
+
+/*
+ * @brief Registers an arena block as the parent of linked heap allocations,
+ * so that they are released with the arena. The caller must hold z_state.lock.
+ */
+static void Z_ArenaParent(z_block_t *z) {
+
+	if ((z->flags & Z_BLOCK_ARENA) && !(z->flags & Z_BLOCK_PARENT)) {
+		z_arena_t *arena = &z_state.arenas[z->tag];
+
+		arena->parents = g_slist_prepend(arena->parents, z);
+		z->flags |= Z_BLOCK_PARENT;
+	}
+}
+
 /*
  * @brief Performs the grunt work of allocating a z_block_t and inserting it
  * into the managed memory structures. Note that parent should be a pointer to
@@ -127,12 +548,22 @@ void Z_FreeTag(z_tag_t tag) {
  * @param size The number of bytes to allocate.
  * @param tag The tag to allocate with (e.g. Z_TAG_DEFAULT).
  * @param parent The parent to link this allocation to.
+ * @param site The call site, for accounting.
  *
  * @return A block of managed memory initialized to 0x0.
  */
-static void *Z_Malloc_(size_t size, z_tag_t tag, void *parent) {
+static void *Z_Allocate(size_t size, z_tag_t tag, void *parent, const char *site) {
 	z_block_t *z, *p = Z_CheckMagic(parent);
 
+	if (tag == Z_TAG_ALL) {
+		Com_Error(ERR_FATAL, "Invalid tag for %s\n", site);
+	}
+
+	// unlinked allocations for arena tags are simply bumped
+	if (!p && z_state.arenas[tag].enabled) {
+		return (void *) (Z_ArenaMalloc(size, tag, site) + 1);
+	}
+
 	// allocate the block plus the desired size
 	const size_t s = size + sizeof(z_block_t);
 
@@ -142,20 +573,22 @@ static void *Z_Malloc_(size_t size, z_tag_t tag, void *parent) {
 
 	z->magic = Z_MAGIC;
 	z->tag = tag;
-	z->parent = p;
+	z->site = Z_SiteStats(site);
 	z->size = size;
 
+	Z_StatsAlloc(&z_state.tags[tag], size);
+	Z_StatsAlloc(z->site, size);
+
 	// insert it into the managed memory structures
 	SDL_mutexP(z_state.lock);
 
-	if (z->parent) {
-		z->parent->children = g_list_prepend(z->parent->children, z);
+	if (p) {
+		Z_ArenaParent(p);
+		Z_LinkChild(z, p);
 	} else {
 		g_hash_table_insert(z_state.blocks, z, z);
 	}
 
-	z_state.size += size;
-
 	SDL_mutexV(z_state.lock);
 
 	// return the address in front of the block
@@ -168,11 +601,12 @@ static void *Z_Malloc_(size_t size, z_tag_t tag, void *parent) {
  * @param size The number of bytes to allocate.
  * @param tag Tags allow related objects to be freed in bulk e.g. when a
  * subsystem quits.
+ * @param site The call site, for accounting.
  *
  * @return A block of managed memory initialized to 0x0.
  */
-void *Z_TagMalloc(size_t size, z_tag_t tag) {
-	return Z_Malloc_(size, tag, NULL);
+void *Z_TagMalloc_(size_t size, z_tag_t tag, const char *site) {
+	return Z_Allocate(size, tag, NULL, site);
 }
 
 /*
@@ -182,21 +616,26 @@ void *Z_TagMalloc(size_t size, z_tag_t tag) {
  * @param parent The parent block previously allocated through Z_Malloc /
  * Z_TagMalloc. The returned block will automatically be released when the
  * parent is freed through Z_Free.
+ * @param site The call site, for accounting.
  *
  * @return A block of managed memory initialized to 0x0.
  */
-void *Z_LinkMalloc(size_t size, void *parent) {
-	return Z_Malloc_(size, Z_TAG_DEFAULT, parent);
+void *Z_LinkMalloc_(size_t size, void *parent, const char *site) {
+	return Z_Allocate(size, Z_TAG_DEFAULT, parent, site);
 }
 
 /*
- * @brief Allocates a block of managed memory. All managed memory is freed when
- * the game exits, but may be explicitly freed with Z_Free.
- *
- * @return A block of memory initialized to 0x0.
+ * @brief Z_TagMalloc for the game and client game modules.
  */
-void *Z_Malloc(size_t size) {
-	return Z_Malloc_(size, Z_TAG_DEFAULT, NULL);
+void *Z_ModuleMalloc(size_t size, z_tag_t tag, const char *site) {
+	return Z_Allocate(size, tag, NULL, Z_ModuleSite(site));
+}
+
+/*
+ * @brief Z_LinkMalloc for the game and client game modules.
+ */
+void *Z_ModuleLinkMalloc(size_t size, void *parent, const char *site) {
+	return Z_Allocate(size, Z_TAG_DEFAULT, parent, Z_ModuleSite(site));
 }
 
 /*
@@ -212,27 +651,56 @@ void *Z_Link(void *child, void *parent) {
 	z_block_t *c = Z_CheckMagic(child);
 	z_block_t *p = Z_CheckMagic(parent);
 
+	if (c->flags & Z_BLOCK_ARENA) {
+		Com_Error(ERR_FATAL, "Arena allocation %p can not be linked\n", child);
+	}
+
 	SDL_mutexP(z_state.lock);
 
 	if (c->parent) {
-		c->parent->children = g_list_remove(c->parent->children, c);
+		Z_UnlinkChild(c);
 	} else {
 		g_hash_table_remove(z_state.blocks, c);
 	}
 
-	c->parent = p;
-	p->children = g_list_prepend(p->children, c);
+	Z_ArenaParent(p);
+	Z_LinkChild(c, p);
 
 	SDL_mutexV(z_state.lock);
 
 	return child;
 }
 
+/*
+ * @brief Enables or disables arena allocation for the specified tag. In arena
+ * mode, allocations are bump allocated from per-thread chunks and Z_FreeTag
+ * releases the chunks wholesale. Individually freeing an arena block releases
+ * its children, but its memory is only reclaimed by Z_FreeTag.
+ */
+void Z_TagArena(z_tag_t tag, _Bool enabled) {
+
+	if (tag == Z_TAG_ALL) {
+		int32_t i;
+		for (i = 0; i < Z_TAG_COUNT; i++) {
+			z_state.arenas[i].enabled = enabled;
+		}
+	} else {
+		z_state.arenas[tag].enabled = enabled;
+	}
+}
+
 /*
  * @return The current size (user bytes) of the zone allocation pool.
  */
 size_t Z_Size(void) {
-	return z_state.size;
+	size_t size = 0;
+
+	int32_t i;
+	for (i = 0; i < Z_TAG_COUNT; i++) {
+		size += z_state.tags[i].size;
+	}
+
+	return size;
 }
 
 /*
@@ -242,13 +710,69 @@ void Z_Size_f(void) {
 	Com_Print("%.2fMB\n", (vec_t) (Z_Size() / (1024.0 * 1024.0)));
 }
 
+/*
+ * @brief Prints a single row of statistics, updating its rate sample.
+ */
+static void Z_PrintStats(z_stats_t *s, const char *kind, vec_t seconds, _Bool dump) {
+
+	const uint32_t total = Z_StatsTotal(s);
+	const vec_t rate = seconds > 0.0 ? (total - s->sampled) / seconds : 0.0;
+
+	s->sampled = total;
+
+	if (dump) {
+		Com_Print("%s\t%s\t%zu\t%zu\t%u\t%u\t%.1f\n", kind, s->name, s->size, s->peak,
+				Z_StatsCount(s), total, rate);
+	} else {
+		Com_Print("%10.2f %10.2f %8u %8.1f  %s\n", s->size / 1024.0, s->peak / 1024.0,
+				Z_StatsCount(s), rate, s->name);
+	}
+}
+
+/*
+ * @brief Prints allocation statistics per tag and per call site: live and
+ * peak bytes, live allocations, and allocations per second since the previous
+ * report. If dump is true, tab-separated values are printed instead.
+ */
+void Z_Stats(_Bool dump) {
+	int32_t i;
+
+	const gint64 now = g_get_monotonic_time();
+	const vec_t seconds = z_state.sample_time ? (now - z_state.sample_time) / 1000000.0 : 0.0;
+
+	z_state.sample_time = now;
+
+	if (dump) {
+		Com_Print("kind\tname\tsize\tpeak\tcount\ttotal\trate\n");
+	} else {
+		Com_Print("%10s %10s %8s %8s  %s\n", "Live KB", "Peak KB", "Count", "Rate", "Tag");
+	}
+
+	for (i = 0; i < Z_TAG_COUNT; i++) {
+		Z_PrintStats(&z_state.tags[i], "tag", seconds, dump);
+	}
+
+	if (!dump) {
+		Com_Print("%10s %10s %8s %8s  %s\n", "Live KB", "Peak KB", "Count", "Rate", "Site");
+	}
+
+	GList *sites = Z_LiveSites();
+
+	GList *s;
+	for (s = sites; s; s = s->next) {
+		Z_PrintStats((z_stats_t *) s->data, "site", seconds, dump);
+	}
+
+	g_list_free(sites);
+}
+
 /*
  * @brief Allocates and returns a copy of the specified string.
  */
-char *Z_CopyString(const char *in) {
+char *Z_CopyString_(const char *in, const char *site) {
 	char *out;
 
-	out = Z_Malloc(strlen(in) + 1);
+	out = Z_TagMalloc_(strlen(in) + 1, Z_TAG_DEFAULT, site);
 	strcpy(out, in);
 
 	return out;
@@ -263,8 +787,21 @@ void Z_Init(void) {
 	memset(&z_state, 0, sizeof(z_state));
 
 	z_state.blocks = g_hash_table_new(g_direct_hash, g_direct_equal);
+	z_state.module_sites = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
 	z_state.lock = SDL_CreateMutex();
+
+	int32_t i;
+	for (i = 0; i < Z_TAG_COUNT; i++) {
+		z_state.arenas[i].lock = SDL_CreateMutex();
+		z_state.tags[i].name = z_tag_names[i];
+	}
+
+	z_state.other_sites.name = "(other)";
+
+	// level allocations are only ever released in bulk
+	Z_TagArena(Z_TAG_GAME_LEVEL, true);
+	Z_TagArena(Z_TAG_CGAME_LEVEL, true);
 }
 
 /*
@@ -276,6 +813,12 @@ void Z_Shutdown(void) {
 	Z_FreeTag(Z_TAG_ALL);
 
 	g_hash_table_destroy(z_state.blocks);
+	g_hash_table_destroy(z_state.module_sites);
+
+	int32_t i;
+	for (i = 0; i < Z_TAG_COUNT; i++) {
+		SDL_DestroyMutex(z_state.arenas[i].lock);
+	}
 
 	SDL_DestroyMutex(z_state.lock);
 }
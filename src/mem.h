@@ -26,14 +26,25 @@
 
 void Z_Free(void *p);
 void Z_FreeTag(z_tag_t tag);
-void *Z_TagMalloc(size_t size, z_tag_t tag);
-void *Z_LinkMalloc(size_t size, void *parent);
-void *Z_Malloc(size_t size);
+void *Z_TagMalloc_(size_t size, z_tag_t tag, const char *site);
+void *Z_LinkMalloc_(size_t size, void *parent, const char *site);
+void *Z_ModuleMalloc(size_t size, z_tag_t tag, const char *site);
+void *Z_ModuleLinkMalloc(size_t size, void *parent, const char *site);
 void *Z_Link(void *parent, void *child);
+void Z_TagArena(z_tag_t tag, _Bool enabled);
 size_t Z_Size(void);
 void Z_Size_f(void);
-char *Z_CopyString(const char *in);
+void Z_Stats(_Bool dump);
+char *Z_CopyString_(const char *in, const char *site);
 void Z_Init(void);
 void Z_Shutdown(void);
 
+// allocations are accounted to their call site
+#define Z_SITE __FILE__ ":" G_STRINGIFY(__LINE__)
+
+#define Z_TagMalloc(size, tag) Z_TagMalloc_(size, tag, Z_SITE)
+#define Z_LinkMalloc(size, parent) Z_LinkMalloc_(size, parent, Z_SITE)
+#define Z_Malloc(size) Z_TagMalloc_(size, Z_TAG_DEFAULT, Z_SITE)
+#define Z_CopyString(in) Z_CopyString_(in, Z_SITE)
+
 #endif /* __MEM_H__ */
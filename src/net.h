@@ -47,6 +47,10 @@ void Net_Config(net_src_t source, _Bool up);
 
 _Bool Net_GetPacket(net_src_t source, net_addr_t *from, size_buf_t *message);
 void Net_SendPacket(net_src_t source, size_t length, void *data, net_addr_t to);
+void Net_BeginBatch(net_src_t source);
+void Net_FlushBatch(net_src_t source);
+
+extern uint32_t net_packet_time; // Sys_Milliseconds when the last packet arrived
 
 _Bool Net_CompareNetaddr(net_addr_t a, net_addr_t b);
 _Bool Net_CompareClientNetaddr(net_addr_t a, net_addr_t b);
@@ -55,6 +59,29 @@ char *Net_NetaddrToString(net_addr_t a);
 _Bool Net_StringToNetaddr(const char *s, net_addr_t *a);
 void Net_Sleep(uint32_t msec);
 
+/*
+ * The reliable stream is carried in fragments, several of which may be in
+ * flight at once, and which are acknowledged selectively. See net_chan.c.
+ */
+#define NETCHAN_FRAGMENT_SIZE 512
+#define NETCHAN_FRAGMENT_HEADER 4 // sequence and size
+#define NETCHAN_WINDOW 32 // fragments in flight, and the width of the selective ack
+#define NETCHAN_ACK_SIZE 7 // fragment acknowledgement and count, ahead of any fragments
+#define MAX_RELIABLE_SIZE 0x8000 // the largest reliable message
+
+// received packets are rewritten to hold their completed reliable messages
+#define MAX_NET_MESSAGE_SIZE (MAX_RELIABLE_SIZE + NETCHAN_WINDOW * NETCHAN_FRAGMENT_SIZE + MAX_MSG_SIZE)
+
+typedef struct {
+	uint32_t sequence;
+	uint32_t sent_sequence; // the packet which last carried this fragment, or 0
+	uint32_t sent_time;
+	uint16_t size;
+	_Bool last; // this fragment completes a reliable message
+	_Bool acknowledged; // or received, for incoming fragments
+	byte data[NETCHAN_FRAGMENT_SIZE];
+} net_fragment_t;
+
 typedef struct {
 	_Bool fatal_error;
 
@@ -72,26 +99,33 @@ typedef struct {
 	// sequencing variables
 	uint32_t incoming_sequence;
 	uint32_t incoming_acknowledged;
-	uint32_t incoming_reliable_acknowledged; // single bit
-
-	uint32_t incoming_reliable_sequence; // single bit, maintained local
 
 	uint32_t outgoing_sequence;
-	uint32_t reliable_sequence; // single bit
-	uint32_t last_reliable_sequence; // sequence number of last send
 
-	// reliable staging and holding areas
+	// reliable staging area, drained into fragments as the window allows
 	size_buf_t message; // writing buffer to send to server
-	byte message_buffer[MAX_MSG_SIZE - 16]; // leave space for header
+	byte message_buffer[MAX_RELIABLE_SIZE];
+	size_t message_sent; // staged bytes which have been fragmented
+	size_t message_end; // the end of the reliable message being fragmented
+
+	// fragments awaiting acknowledgement
+	net_fragment_t outgoing_fragments[NETCHAN_WINDOW];
+	uint32_t outgoing_fragment_base; // the oldest unacknowledged fragment
+	uint32_t outgoing_fragment_sequence; // the next fragment to be created
+
+	// fragments received out of order, held until they can be delivered
+	net_fragment_t incoming_fragments[NETCHAN_WINDOW];
+	uint32_t incoming_fragment_sequence; // the next fragment to be delivered
+	_Bool ack_pending; // fragments were received since the last acknowledgement
 
-	// message is copied to this buffer when it is first transfered
+	// the reliable message being reassembled
 	size_t reliable_size;
-	byte reliable_buffer[MAX_MSG_SIZE - 16]; // un-acked reliable message
+	byte reliable_buffer[MAX_RELIABLE_SIZE + NETCHAN_WINDOW * NETCHAN_FRAGMENT_SIZE];
 } net_chan_t;
 
 extern net_addr_t net_from;
 extern size_buf_t net_message;
-extern byte net_message_buffer[MAX_MSG_SIZE];
+extern byte net_message_buffer[MAX_NET_MESSAGE_SIZE];
 
 void Netchan_Init(void);
 void Netchan_Setup(net_src_t source, net_chan_t *chan, net_addr_t addr, byte qport);
@@ -99,7 +133,7 @@ void Netchan_Transmit(net_chan_t *chan, size_t size, byte *data);
 void Netchan_OutOfBand(int32_t net_socket, net_addr_t addr, size_t size, byte *data);
 void Netchan_OutOfBandPrint(int32_t net_socket, net_addr_t addr, const char *format, ...) __attribute__((format(printf, 3, 4)));
 _Bool Netchan_Process(net_chan_t *chan, size_buf_t *msg);
-_Bool Netchan_CanReliable(net_chan_t *chan);
-_Bool Netchan_NeedReliable(net_chan_t *chan);
+_Bool Netchan_CanReliable(const net_chan_t *chan);
+_Bool Netchan_NeedReliable(const net_chan_t *chan);
 
 #endif /* __NET_H__ */
@@ -26,38 +26,57 @@
  * packet header
  * -------------
  * 31	sequence
- * 1	does this message contain a reliable payload
+ * 1	does this message contain a reliable section
  * 31	acknowledge sequence
- * 1	acknowledge receipt of even/odd message
+ * 1	unused
  * 8	qport
  *
- * The remote connection never knows if it missed a reliable message, the
- * local side detects that it has been dropped by seeing a sequence acknowledge
- * higher than the last reliable sequence, but without the correct even/odd
- * bit for the reliable set.
+ * reliable section
+ * ----------------
+ * 16	next expected fragment
+ * 32	selective acknowledgement of the fragments following it
+ * 8	fragment count
+ * 	for each fragment:
+ * 16	fragment sequence
+ * 15	fragment size
+ * 1	does this fragment complete a reliable message
+ * 	fragment data
  *
- * If the sender notices that a reliable message has been dropped, it will be
- * retransmitted. It will not be retransmitted again until a message after
- * the retransmit has been acknowledged and the reliable still failed to get theve.
+ * The reliable message can be added to at any time by doing
+ * Msg_Write*(&netchan->message, <data>). Each call to Netchan_Transmit marks
+ * the end of a reliable message: the staged data is cut into fragments of
+ * NETCHAN_FRAGMENT_SIZE, of which up to NETCHAN_WINDOW may be in flight at
+ * once. A large reliable message, such as the config strings of a level or a
+ * stretch of a download, therefore costs one round trip rather than one per
+ * packet.
  *
- * if the sequence number is -1, the packet should be handled without a netcon
+ * The receiver acknowledges the next fragment it expects, and which of the
+ * fragments after it have arrived out of order. A fragment is resent when a
+ * packet sent after it has been acknowledged without the fragment, or when it
+ * has gone unacknowledged for NETCHAN_RESEND_TIME. Only the fragments which
+ * were lost are resent.
  *
- * The reliable message can be added to at any time by doing
- * Msg_Write*(&netchan->message, <data>).
+ * Fragments are delivered in order, and only whole reliable messages are
+ * delivered. Netchan_Process rewrites the packet so that it holds the
+ * delivered reliable messages followed by the unreliable message. To the
+ * receiver, there is no distinction between the reliable and unreliable parts
+ * of the message, they are just processed out as a single larger message.
  *
- * If the message buffer is overflowed, either by a single message, or by
- * multiple frames worth piling up while the last reliable transmit goes
- * unacknowledged, the netchan signals a fatal error.
+ * If the staging buffer is overflowed, either by a single message, or by
+ * multiple frames worth piling up while the window is full, the netchan
+ * signals a fatal error.
  *
- * Reliable messages are always placed first in a packet, then the unreliable
- * message is included if there is sufficient room.
+ * Reliable fragments are always placed first in a packet, then the unreliable
+ * message is included if there is sufficient room. At least one due fragment
+ * is sent with every packet, further fragments only if they fit alongside the
+ * unreliable message. Any fragments still due are sent in a short burst of
+ * packets which carry no unreliable message.
  *
- * To the receiver, there is no distinction between the reliable and unreliable
- * parts of the message, they are just processed out as a single larger message.
+ * if the sequence number is -1, the packet should be handled without a netcon
  *
  * Illogical packet sequence numbers cause the packet to be dropped, but do
  * not kill the connection. This, combined with the tight window of valid
- * reliable acknowledgement numbers provides protection against malicious
+ * fragment acknowledgement numbers provides protection against malicious
  * address spoofing.
  *
  * The qport field is a workaround for bad address translating routers that
@@ -69,17 +88,19 @@
  *
  * If there is no information that needs to be transfered on a given frame,
  * such as during the connection stage while waiting for the client to load,
- * then a packet only needs to be delivered if there is something in the
- * unacknowledged reliable
+ * then a packet only needs to be delivered if Netchan_NeedReliable.
  */
 
+#define NETCHAN_RESEND_TIME 1000 // milliseconds before an unacknowledged fragment is resent
+#define NETCHAN_BURST (NETCHAN_WINDOW / 2) // packets per transmit, enough for the window
+
 cvar_t *net_showpackets;
 cvar_t *net_showdrop;
 cvar_t *net_qport;
 
 net_addr_t net_from;
 size_buf_t net_message;
-byte net_message_buffer[MAX_MSG_SIZE];
+byte net_message_buffer[MAX_NET_MESSAGE_SIZE];
 
 /*
  * @brief
@@ -146,70 +167,163 @@ void Netchan_Setup(net_src_t source, net_chan_t *chan, net_addr_t addr, byte qpo
 }
 
 /*
- * @brief Returns true if the last reliable message has acked.
+ * @brief Returns true if all reliable data has been acknowledged.
  */
-_Bool Netchan_CanReliable(net_chan_t *chan) {
-	if (chan->reliable_size)
+_Bool Netchan_CanReliable(const net_chan_t *chan) {
+
+	if (chan->message.size)
+		return false; // not yet fragmented
+
+	if (chan->outgoing_fragment_base != chan->outgoing_fragment_sequence)
 		return false; // waiting for ack
+
 	return true;
 }
 
 /*
- * @brief
+ * @brief Returns true if the specified outgoing fragment should be (re)sent.
  */
-_Bool Netchan_NeedReliable(net_chan_t *chan) {
-	_Bool send_reliable;
+static _Bool Netchan_FragmentDue(const net_chan_t *chan, const net_fragment_t *frag) {
 
-	// if the remote side dropped the last reliable message, resend it
-	send_reliable = false;
+	if (frag->acknowledged)
+		return false;
+
+	if (!frag->sent_sequence)
+		return true;
 
-	if (chan->incoming_acknowledged > chan->last_reliable_sequence
-			&& chan->incoming_reliable_acknowledged != chan->reliable_sequence)
-		send_reliable = true;
+	// a later packet was acknowledged, but this fragment was not
+	if (chan->incoming_acknowledged >= frag->sent_sequence)
+		return true;
 
-	// if the reliable transmit buffer is empty, copy the current message out
-	if (!chan->reliable_size && chan->message.size) {
-		send_reliable = true;
+	return quake2world.time - frag->sent_time > NETCHAN_RESEND_TIME;
+}
+
+/*
+ * @brief Returns true if any outgoing fragment should be (re)sent.
+ */
+static _Bool Netchan_FragmentsDue(const net_chan_t *chan) {
+	uint32_t i;
+
+	for (i = chan->outgoing_fragment_base; i != chan->outgoing_fragment_sequence; i++) {
+		if (Netchan_FragmentDue(chan, &chan->outgoing_fragments[i % NETCHAN_WINDOW]))
+			return true;
 	}
 
-	return send_reliable;
+	return false;
 }
 
 /*
- * @brief Tries to send an unreliable message to a connection, and handles the
- * transmission / retransmission of the reliable messages.
- *
- * A 0 size will still generate a packet and deal with the reliable messages.
+ * @brief Returns true if the next packet must carry a reliable section, either
+ * to send fragments or to acknowledge them.
  */
-void Netchan_Transmit(net_chan_t *chan, size_t size, byte *data) {
-	size_buf_t send;
-	byte send_buffer[MAX_MSG_SIZE];
-	_Bool send_reliable;
-	uint32_t w1, w2;
+_Bool Netchan_NeedReliable(const net_chan_t *chan) {
 
-	// check for message overflow
-	if (chan->message.overflowed) {
-		chan->fatal_error = true;
-		Com_Print("%s:Outgoing message overflow\n", Net_NetaddrToString(chan->remote_address));
-		return;
+	if (chan->ack_pending)
+		return true;
+
+	if (chan->message.size > chan->message_sent) {
+		if (chan->outgoing_fragment_sequence - chan->outgoing_fragment_base < NETCHAN_WINDOW)
+			return true;
 	}
 
-	send_reliable = Netchan_NeedReliable(chan);
+	return Netchan_FragmentsDue(chan);
+}
+
+/*
+ * @brief Cuts the staged reliable messages into fragments, as far as the
+ * window allows. A message boundary is recorded each time the previous
+ * message has been fully fragmented, and the staging buffer is compacted.
+ */
+static void Netchan_Fragment(net_chan_t *chan) {
+	size_buf_t *msg = &chan->message;
+
+	if (chan->message_sent == chan->message_end)
+		chan->message_end = msg->size;
+
+	while (chan->message_sent < chan->message_end) {
+
+		if (chan->outgoing_fragment_sequence - chan->outgoing_fragment_base == NETCHAN_WINDOW)
+			break;
 
-	if (!chan->reliable_size && chan->message.size) {
-		memcpy(chan->reliable_buffer, chan->message_buffer, chan->message.size);
-		chan->reliable_size = chan->message.size;
-		chan->message.size = 0;
-		chan->reliable_sequence ^= 1;
+		const uint32_t sequence = chan->outgoing_fragment_sequence++;
+		net_fragment_t *frag = &chan->outgoing_fragments[sequence % NETCHAN_WINDOW];
+
+		const size_t remaining = chan->message_end - chan->message_sent;
+
+		frag->sequence = sequence;
+		frag->sent_sequence = 0;
+		frag->size = remaining < NETCHAN_FRAGMENT_SIZE ? remaining : NETCHAN_FRAGMENT_SIZE;
+		frag->last = frag->size == remaining;
+		frag->acknowledged = false;
+
+		memcpy(frag->data, msg->data + chan->message_sent, frag->size);
+		chan->message_sent += frag->size;
 	}
 
-	// write the packet header
+	if (chan->message_sent == chan->message_end) {
+		memmove(msg->data, msg->data + chan->message_end, msg->size - chan->message_end);
+		msg->size -= chan->message_end;
+
+		chan->message_sent = chan->message_end = 0;
+	}
+}
+
+/*
+ * @brief Returns the selective acknowledgement of the incoming fragments
+ * following the next expected fragment.
+ */
+static uint32_t Netchan_AckBits(const net_chan_t *chan) {
+	uint32_t i, bits = 0;
+
+	for (i = 0; i < NETCHAN_WINDOW - 1; i++) {
+		const uint32_t sequence = chan->incoming_fragment_sequence + 1 + i;
+		const net_fragment_t *frag = &chan->incoming_fragments[sequence % NETCHAN_WINDOW];
+
+		if (frag->acknowledged && frag->sequence == sequence)
+			bits |= 1 << i;
+	}
+
+	return bits;
+}
+
+/*
+ * @brief Writes and sends a single packet, with as many due fragments as will
+ * fit alongside the unreliable message, but at least one.
+ */
+static void Netchan_TransmitPacket(net_chan_t *chan, size_t size, byte *data) {
+	net_fragment_t *fragments[NETCHAN_WINDOW];
+	size_buf_t send;
+	byte send_buffer[MAX_MSG_SIZE];
+	uint32_t i, w1, w2, num_fragments = 0;
+
 	Sb_Init(&send, send_buffer, sizeof(send_buffer));
 
+	size_t reliable_size = 8 + NETCHAN_ACK_SIZE;
+	if (chan->source == NS_CLIENT)
+		reliable_size++;
+
+	for (i = chan->outgoing_fragment_base; i != chan->outgoing_fragment_sequence; i++) {
+		net_fragment_t *frag = &chan->outgoing_fragments[i % NETCHAN_WINDOW];
+
+		if (!Netchan_FragmentDue(chan, frag))
+			continue;
+
+		const size_t frag_size = NETCHAN_FRAGMENT_HEADER + frag->size;
+
+		if (num_fragments && reliable_size + frag_size + size > send.max_size)
+			break;
+
+		fragments[num_fragments++] = frag;
+		reliable_size += frag_size;
+	}
+
+	const _Bool send_reliable = num_fragments || chan->ack_pending;
+
+	// write the packet header
 	w1 = (chan->outgoing_sequence & ~(1 << 31)) | (send_reliable << 31);
-	w2 = (chan->incoming_sequence & ~(1 << 31)) | (chan->incoming_reliable_sequence << 31);
+	w2 = (chan->incoming_sequence & ~(1 << 31));
 
-	chan->outgoing_sequence++;
+	const uint32_t sequence = chan->outgoing_sequence++;
 	chan->last_sent = quake2world.time;
 
 	Msg_WriteLong(&send, w1);
@@ -219,10 +333,24 @@ void Netchan_Transmit(net_chan_t *chan, size_t size, byte *data) {
 	if (chan->source == NS_CLIENT)
 		Msg_WriteByte(&send, chan->qport);
 
-	// copy the reliable message to the packet first
+	// copy the reliable section to the packet first
 	if (send_reliable) {
-		Sb_Write(&send, chan->reliable_buffer, chan->reliable_size);
-		chan->last_reliable_sequence = chan->outgoing_sequence;
+		Msg_WriteShort(&send, chan->incoming_fragment_sequence);
+		Msg_WriteLong(&send, Netchan_AckBits(chan));
+		Msg_WriteByte(&send, num_fragments);
+
+		for (i = 0; i < num_fragments; i++) {
+			net_fragment_t *frag = fragments[i];
+
+			Msg_WriteShort(&send, frag->sequence);
+			Msg_WriteShort(&send, frag->size | (frag->last ? 0x8000 : 0));
+			Sb_Write(&send, frag->data, frag->size);
+
+			frag->sent_sequence = sequence;
+			frag->sent_time = quake2world.time;
+		}
+
+		chan->ack_pending = false;
 	}
 
 	// add the unreliable part if space is available
@@ -236,23 +364,156 @@ void Netchan_Transmit(net_chan_t *chan, size_t size, byte *data) {
 
 	if (net_showpackets->value) {
 		if (send_reliable)
-			Com_Print("send %zu : s=%i reliable=%i ack=%i rack=%i\n", send.size,
-					chan->outgoing_sequence - 1, chan->reliable_sequence, chan->incoming_sequence,
-					chan->incoming_reliable_sequence);
+			Com_Print("send %zu : s=%i fragments=%u window=%u ack=%i fack=%u\n", send.size,
+					sequence, num_fragments,
+					chan->outgoing_fragment_sequence - chan->outgoing_fragment_base,
+					chan->incoming_sequence, chan->incoming_fragment_sequence);
 		else
-			Com_Print("send %zu : s=%i ack=%i rack=%i\n", send.size,
-					chan->outgoing_sequence - 1, chan->incoming_sequence,
-					chan->incoming_reliable_sequence);
+			Com_Print("send %zu : s=%i ack=%i\n", send.size, sequence, chan->incoming_sequence);
 	}
 }
 
 /*
- * @brief Called when the current net_message is from remote_address
- * modifies net_message so that it points to the packet payload
+ * @brief Tries to send an unreliable message to a connection, and handles the
+ * transmission / retransmission of the reliable fragments. If more fragments
+ * are due than fit in one packet, up to NETCHAN_BURST packets are sent, so
+ * that a full window is delivered in one round trip rather than one frame at
+ * a time.
+ *
+ * A 0 size will still generate a packet and deal with the reliable messages.
+ */
+void Netchan_Transmit(net_chan_t *chan, size_t size, byte *data) {
+	uint32_t i;
+
+	// check for message overflow
+	if (chan->message.overflowed) {
+		chan->fatal_error = true;
+		Com_Print("%s:Outgoing message overflow\n", Net_NetaddrToString(chan->remote_address));
+		return;
+	}
+
+	Netchan_Fragment(chan);
+
+	Netchan_TransmitPacket(chan, size, data);
+
+	for (i = 1; i < NETCHAN_BURST && Netchan_FragmentsDue(chan); i++) {
+		Netchan_TransmitPacket(chan, 0, NULL);
+	}
+}
+
+/*
+ * @brief Marks the outgoing fragments acknowledged by the remote side, and
+ * advances the window past them.
+ */
+static void Netchan_Acknowledge(net_chan_t *chan, uint16_t ack, uint32_t ack_bits) {
+	uint32_t i;
+
+	const uint32_t base = chan->outgoing_fragment_base;
+	const int16_t delta = (int16_t) (ack - (uint16_t) base);
+
+	if (delta < 0 || (uint32_t) delta > chan->outgoing_fragment_sequence - base)
+		return; // stale or bogus
+
+	const uint32_t expected = base + delta;
+
+	for (i = base; i != chan->outgoing_fragment_sequence; i++) {
+		net_fragment_t *frag = &chan->outgoing_fragments[i % NETCHAN_WINDOW];
+
+		if (i < expected || (i > expected && (ack_bits & (1 << (i - expected - 1)))))
+			frag->acknowledged = true;
+	}
+
+	while (chan->outgoing_fragment_base != chan->outgoing_fragment_sequence) {
+		if (!chan->outgoing_fragments[chan->outgoing_fragment_base % NETCHAN_WINDOW].acknowledged)
+			break;
+		chan->outgoing_fragment_base++;
+	}
+}
+
+/*
+ * @brief Reads the reliable section of the current packet, storing its
+ * fragments and reassembling them in order. Returns the size of the completed
+ * reliable messages, which are left at the head of the reassembly buffer, or
+ * -1 if the section is malformed.
+ */
+static ssize_t Netchan_ProcessReliable(net_chan_t *chan, size_buf_t *msg) {
+	net_fragment_t *frag;
+	int32_t i;
+
+	const uint16_t ack = Msg_ReadShort(msg);
+	const uint32_t ack_bits = Msg_ReadLong(msg);
+	const int32_t num_fragments = Msg_ReadByte(msg);
+
+	if (msg->read > msg->size)
+		return -1;
+
+	Netchan_Acknowledge(chan, ack, ack_bits);
+
+	for (i = 0; i < num_fragments; i++) {
+		const uint16_t seq = Msg_ReadShort(msg);
+		const uint16_t bits = Msg_ReadShort(msg);
+
+		const uint16_t size = bits & 0x7fff;
+
+		if (msg->read > msg->size || size > NETCHAN_FRAGMENT_SIZE || msg->read + size > msg->size)
+			return -1;
+
+		const int16_t delta = (int16_t) (seq - (uint16_t) chan->incoming_fragment_sequence);
+		const uint32_t sequence = chan->incoming_fragment_sequence + delta;
+
+		// fragments behind the window are duplicates, but must still be acknowledged
+		if (delta >= 0 && delta < NETCHAN_WINDOW) {
+			frag = &chan->incoming_fragments[sequence % NETCHAN_WINDOW];
+
+			if (!frag->acknowledged) {
+				frag->sequence = sequence;
+				frag->size = size;
+				frag->last = bits & 0x8000;
+				frag->acknowledged = true;
+
+				memcpy(frag->data, msg->data + msg->read, size);
+			}
+		}
+
+		msg->read += size;
+		chan->ack_pending = true;
+	}
+
+	// append the fragments which are now in order to the reassembly buffer
+	ssize_t complete = 0;
+
+	while (true) {
+		frag = &chan->incoming_fragments[chan->incoming_fragment_sequence % NETCHAN_WINDOW];
+
+		if (!frag->acknowledged || frag->sequence != chan->incoming_fragment_sequence)
+			break;
+
+		if (chan->reliable_size + frag->size > sizeof(chan->reliable_buffer)) {
+			Com_Warn("%s: Reliable message overflow\n", Net_NetaddrToString(chan->remote_address));
+			return -1;
+		}
+
+		memcpy(chan->reliable_buffer + chan->reliable_size, frag->data, frag->size);
+		chan->reliable_size += frag->size;
+
+		if (frag->last)
+			complete = chan->reliable_size;
+
+		frag->acknowledged = false;
+		chan->incoming_fragment_sequence++;
+	}
+
+	return complete;
+}
+
+/*
+ * @brief Called when the current net_message is from remote_address. Modifies
+ * net_message so that it holds only the packet payload: the completed reliable
+ * messages, followed by the unreliable message.
  */
 _Bool Netchan_Process(net_chan_t *chan, size_buf_t *msg) {
-	uint32_t sequence, sequence_ack;
-	uint32_t reliable_ack, reliable_message;
+	uint32_t sequence, sequence_ack, reliable_message;
+	ssize_t reliable_size = 0;
 
 	// get sequence numbers
 	Msg_BeginReading(msg);
@@ -265,18 +526,13 @@ _Bool Netchan_Process(net_chan_t *chan, size_buf_t *msg) {
 		Msg_ReadByte(msg);
 
 	reliable_message = sequence >> 31;
-	reliable_ack = sequence_ack >> 31;
 
 	sequence &= ~(1 << 31);
 	sequence_ack &= ~(1 << 31);
 
 	if (net_showpackets->value) {
-		if (reliable_message)
-			Com_Print("recv %zu : s=%i reliable=%i ack=%i rack=%i\n", msg->size, sequence,
-					chan->incoming_reliable_sequence ^ 1, sequence_ack, reliable_ack);
-		else
-			Com_Print("recv %zu : s=%i ack=%i rack=%i\n", msg->size, sequence,
-					sequence_ack, reliable_ack);
+		Com_Print("recv %zu : s=%i reliable=%i ack=%i fack=%u\n", msg->size, sequence,
+				reliable_message, sequence_ack, chan->outgoing_fragment_base);
 	}
 
 	// discard stale or duplicated packets
@@ -295,22 +551,40 @@ _Bool Netchan_Process(net_chan_t *chan, size_buf_t *msg) {
 					chan->dropped, sequence);
 	}
 
-	// if the current outgoing reliable message has been acknowledged
-	// clear the buffer to make way for the next
-	if (reliable_ack == chan->reliable_sequence)
-		chan->reliable_size = 0; // it has been received
-
-	// if this message contains a reliable message, bump incoming_reliable_sequence
 	chan->incoming_sequence = sequence;
 	chan->incoming_acknowledged = sequence_ack;
-	chan->incoming_reliable_acknowledged = reliable_ack;
+
 	if (reliable_message) {
-		chan->incoming_reliable_sequence ^= 1;
+		if ((reliable_size = Netchan_ProcessReliable(chan, msg)) == -1) {
+			if (net_showdrop->value)
+				Com_Print("%s:Malformed packet %i\n", Net_NetaddrToString(chan->remote_address),
+						sequence);
+			return false;
+		}
 	}
 
+	// rewrite the message as the delivered reliable data and the unreliable data
+	if (msg->read > msg->size)
+		msg->read = msg->size;
+
+	const size_t unreliable_size = msg->size - msg->read;
+
+	if (reliable_size + unreliable_size > msg->max_size) {
+		Com_Warn("%s: Packet %i too large\n", Net_NetaddrToString(chan->remote_address), sequence);
+		return false;
+	}
+
+	memmove(msg->data + reliable_size, msg->data + msg->read, unreliable_size);
+	memcpy(msg->data, chan->reliable_buffer, reliable_size);
+
+	msg->size = reliable_size + unreliable_size;
+	msg->read = 0;
+
+	chan->reliable_size -= reliable_size;
+	memmove(chan->reliable_buffer, chan->reliable_buffer + reliable_size, chan->reliable_size);
+
 	// the message can now be read from the current message pointer
 	chan->last_received = quake2world.time;
 
 	return true;
 }
-
@@ -19,7 +19,11 @@
  * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
  */
 
+#include <SDL/SDL_thread.h>
+
+#include "cmd.h"
 #include "net.h"
+#include "sys.h"
 
 #include <errno.h>
 #include <sys/time.h>
@@ -37,13 +41,14 @@
 #include <netdb.h>
 #include <sys/ioctl.h>
 #include <sys/uio.h>
+#include <unistd.h>
 #define Net_GetError() errno
 #define Net_CloseSocket close
 #endif
 
 static net_addr_t net_local_addr = { NA_LOCAL, { 127, 0, 0, 1 }, 0 };
 
-#define MAX_LOOPBACK 4
+#define MAX_LOOPBACK 64 // must be a power of two, and hold a burst of reliable fragments
 
 typedef struct {
 	byte data[MAX_MSG_SIZE];
@@ -58,8 +63,165 @@ typedef struct {
 static loopback_t loopbacks[2];
 static int32_t ip_sockets[2];
 
+#define NET_BATCH 64 // datagrams per batched system call
+
+/*
+ * Datagrams are received, and optionally sent, in batches, so that a single
+ * system call moves many of them where recvmmsg and sendmmsg are available.
+ */
+typedef struct {
+	byte data[NET_BATCH][MAX_MSG_SIZE];
+	size_t size[NET_BATCH];
+	struct sockaddr_in addr[NET_BATCH];
+
+	uint32_t count; // datagrams received or queued
+	uint32_t index; // next received datagram to return
+	uint32_t time; // Sys_Milliseconds when the batch was received
+
+	_Bool queue; // true if sends are being queued
+} net_batch_t;
+
+static net_batch_t net_recv[2];
+static net_batch_t net_send[2];
+
+/*
+ * The network thread, when enabled, services the server socket independently
+ * of the server frame. Received datagrams are timestamped and handed to the
+ * main thread through a single-producer, single-consumer ring. Outgoing
+ * datagrams are handed back to the network thread through another.
+ */
+
+#define NET_RING_SIZE 512 // must be a power of two
+
+typedef struct {
+	byte data[MAX_MSG_SIZE];
+	size_t size;
+	struct sockaddr_in addr;
+	uint32_t time; // Sys_Milliseconds when received or queued
+	gint64 stamp; // g_get_monotonic_time when received or queued
+} net_packet_t;
+
+typedef struct {
+	net_packet_t *packets;
+	volatile uint32_t head; // advanced only by the producer
+	volatile uint32_t tail; // advanced only by the consumer
+
+	uint32_t peak, dropped; // maintained by the producer
+	uint32_t count; // maintained by the consumer
+	uint64_t latency, max_latency; // microseconds queued, maintained by the consumer
+} net_ring_t;
+
+typedef struct {
+	SDL_Thread *thread;
+	SDL_sem *arrival; // posted once when the main thread's sleep is interrupted
+	int32_t wake[2]; // pipe to wake the network thread for sends
+
+	volatile _Bool shutdown;
+	volatile _Bool sleeping; // cleared by whichever thread ends the sleep
+
+	net_ring_t in, out;
+
+	// a warning raised on the network thread, for the main thread to print
+	const char *warning_func;
+	char warning[MAX_STRING_CHARS];
+	volatile uint32_t warnings; // advanced only by the network thread
+	volatile uint32_t warnings_printed; // advanced only by the main thread
+} net_thread_t;
+
+static net_thread_t net_thread_state;
+
+static __thread _Bool net_in_thread; // true on the network thread
+
+/*
+ * The network simulator delays, drops, duplicates and reorders outgoing
+ * datagrams, on the loopback as well as on the sockets, so that the netcode
+ * may be exercised under poor conditions on a single machine. Held datagrams
+ * are released by Net_GetPacket, in order of their release time.
+ */
+
+#define NET_SIM_MAX_PACKETS 1024
+#define NET_SIM_REORDER_DELAY 50 // milliseconds a reordered datagram is held back
+
+typedef struct {
+	net_src_t source;
+	net_addr_t to;
+	uint32_t time; // Sys_Milliseconds when the datagram is released
+	size_t size;
+	byte data[MAX_MSG_SIZE];
+} net_sim_packet_t;
+
+typedef struct {
+	GList *packets; // held datagrams, in order of release
+	uint32_t count;
+
+	uint32_t last_time[2]; // the latest release time of each source, by net_src_t
+
+	uint32_t sent, lost, duplicated, reordered, overflowed;
+} net_sim_t;
+
+static net_sim_t net_sim;
+
+static void Net_SimRelease(void);
+
+uint32_t net_packet_time;
+
 static cvar_t *net_ip;
 static cvar_t *net_port;
+static cvar_t *net_thread;
+
+static cvar_t *net_sim_latency;
+static cvar_t *net_sim_jitter;
+static cvar_t *net_sim_loss;
+static cvar_t *net_sim_duplicate;
+static cvar_t *net_sim_reorder;
+
+/*
+ * @brief Warns of an error. Com_Warn is not safe to call from the network
+ * thread, so its warnings are instead held for Net_PrintThreadWarning. Only
+ * one is held at a time, and any raised before it is printed are discarded.
+ */
+static void Net_Warn_(const char *func, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+#define Net_Warn(...) Net_Warn_(__func__, __VA_ARGS__)
+
+static void Net_Warn_(const char *func, const char *fmt, ...) {
+	net_thread_t *t = &net_thread_state;
+	char msg[MAX_STRING_CHARS];
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, args);
+	va_end(args);
+
+	if (!net_in_thread) {
+		Com_Warn_(func, "%s", msg);
+		return;
+	}
+
+	if (t->warnings != t->warnings_printed)
+		return;
+
+	t->warning_func = func;
+	g_strlcpy(t->warning, msg, sizeof(t->warning));
+
+	__sync_synchronize();
+	t->warnings++;
+}
+
+/*
+ * @brief Prints the warning held by the network thread, if any.
+ */
+static void Net_PrintThreadWarning(void) {
+	net_thread_t *t = &net_thread_state;
+
+	if (t->warnings == t->warnings_printed)
+		return;
+
+	__sync_synchronize();
+	Com_Warn_(t->warning_func, "%s", t->warning);
+
+	__sync_synchronize();
+	t->warnings_printed = t->warnings;
+}
 
 /*
  * @brief
@@ -224,6 +386,8 @@ static _Bool Net_GetLocalPacket(net_src_t source, net_addr_t *from, size_buf_t *
 	memcpy(message->data, loop->msgs[i].data, loop->msgs[i].size);
 	message->size = loop->msgs[i].size;
 	*from = net_local_addr;
+
+	net_packet_time = Sys_Milliseconds();
 	return true;
 }
 
@@ -244,27 +408,55 @@ static void Net_SendLocalPacket(net_src_t source, size_t length, void *data) {
 }
 
 /*
- * @brief
+ * @brief Receives as many pending datagrams as will fit in the batch.
+ *
+ * @return True if at least one datagram was received.
  */
-_Bool Net_GetPacket(net_src_t source, net_addr_t *from, size_buf_t *message) {
-	ssize_t ret;
+static _Bool Net_ReceiveBatch(net_src_t source) {
+	net_batch_t *batch = &net_recv[source];
 	int32_t err;
-	struct sockaddr_in from_addr;
-	socklen_t from_len;
-	char *s;
 
-	if (Net_GetLocalPacket(source, from, message))
-		return true;
+	batch->count = batch->index = 0;
+	batch->time = Sys_Milliseconds();
 
-	if (!ip_sockets[source])
-		return false;
+#if defined(HAVE_RECVMMSG)
+	struct mmsghdr msgs[NET_BATCH];
+	struct iovec iov[NET_BATCH];
+	uint32_t i;
 
-	from_len = sizeof(from_addr);
+	memset(msgs, 0, sizeof(msgs));
 
-	ret = recvfrom(ip_sockets[source], (void *) message->data, message->max_size, 0,
-			(struct sockaddr *) &from_addr, &from_len);
+	for (i = 0; i < NET_BATCH; i++) {
+		iov[i].iov_base = batch->data[i];
+		iov[i].iov_len = sizeof(batch->data[i]);
 
-	Net_SockaddrToNetaddr(&from_addr, from);
+		msgs[i].msg_hdr.msg_name = &batch->addr[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(batch->addr[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	const int32_t ret = recvmmsg(ip_sockets[source], msgs, NET_BATCH, MSG_DONTWAIT, NULL);
+
+	if (ret > 0) {
+		for (i = 0; i < (uint32_t) ret; i++) {
+			batch->size[i] = msgs[i].msg_len;
+		}
+		batch->count = ret;
+		return true;
+	}
+#else
+	socklen_t from_len = sizeof(batch->addr[0]);
+
+	const ssize_t ret = recvfrom(ip_sockets[source], (void *) batch->data[0],
+			sizeof(batch->data[0]), 0, (struct sockaddr *) &batch->addr[0], &from_len);
+
+	if (ret >= 0) {
+		batch->size[0] = ret;
+		batch->count = 1;
+		return true;
+	}
+#endif
 
 	if (ret == -1) {
 		err = Net_GetError();
@@ -272,25 +464,410 @@ _Bool Net_GetPacket(net_src_t source, net_addr_t *from, size_buf_t *message) {
 		if (err == EWOULDBLOCK || err == ECONNREFUSED)
 			return false; // not terribly abnormal
 
-		s = source == NS_SERVER ? "server" : "client";
-		Com_Warn("%s: %s from %s\n", s, Net_ErrorString(),
-				Net_NetaddrToString(*from));
-		return false;
+		Net_Warn("%s: %s\n", source == NS_SERVER ? "server" : "client", Net_ErrorString());
 	}
 
-	if (ret == ((ssize_t) message->max_size)) {
-		Com_Warn("Oversized packet from %s\n", Net_NetaddrToString(*from));
+	return false;
+}
+
+/*
+ * @brief Publishes the slot returned by Net_RingWrite.
+ */
+static void Net_RingPush(net_ring_t *ring) {
+
+	__sync_synchronize();
+	ring->head++;
+}
+
+/*
+ * @return The next free slot in the ring, or NULL if the ring is full.
+ */
+static net_packet_t *Net_RingWrite(net_ring_t *ring) {
+	const uint32_t depth = ring->head - ring->tail;
+
+	if (depth == NET_RING_SIZE) {
+		ring->dropped++;
+		return NULL;
+	}
+
+	if (depth + 1 > ring->peak)
+		ring->peak = depth + 1;
+
+	return &ring->packets[ring->head & (NET_RING_SIZE - 1)];
+}
+
+/*
+ * @return The oldest packet in the ring, or NULL if the ring is empty.
+ */
+static net_packet_t *Net_RingRead(net_ring_t *ring) {
+
+	if (ring->tail == ring->head)
+		return NULL;
+
+	__sync_synchronize();
+
+	net_packet_t *packet = &ring->packets[ring->tail & (NET_RING_SIZE - 1)];
+
+	const uint64_t latency = g_get_monotonic_time() - packet->stamp;
+
+	ring->latency += latency;
+	if (latency > ring->max_latency)
+		ring->max_latency = latency;
+
+	ring->count++;
+	return packet;
+}
+
+/*
+ * @brief Releases the packet returned by Net_RingRead.
+ */
+static void Net_RingPop(net_ring_t *ring) {
+
+	__sync_synchronize();
+	ring->tail++;
+}
+
+/*
+ * @brief Returns the next datagram for the specified source, from the loopback
+ * or from the most recently received batch. If the network thread is running,
+ * server datagrams are instead taken from its ring.
+ */
+_Bool Net_GetPacket(net_src_t source, net_addr_t *from, size_buf_t *message) {
+	net_batch_t *batch = &net_recv[source];
+	net_packet_t *packet;
+
+	if (net_sim.packets)
+		Net_SimRelease();
+
+	if (Net_GetLocalPacket(source, from, message))
+		return true;
+
+	if (!ip_sockets[source])
+		return false;
+
+	if (source == NS_SERVER && net_thread_state.thread) {
+		Net_PrintThreadWarning();
+
+		while ((packet = Net_RingRead(&net_thread_state.in))) {
+
+			Net_SockaddrToNetaddr(&packet->addr, from);
+
+			if (packet->size >= message->max_size) {
+				Com_Warn("Oversized packet from %s\n", Net_NetaddrToString(*from));
+				Net_RingPop(&net_thread_state.in);
+				continue;
+			}
+
+			memcpy(message->data, packet->data, packet->size);
+			message->size = (uint32_t) packet->size;
+
+			net_packet_time = packet->time;
+
+			Net_RingPop(&net_thread_state.in);
+			return true;
+		}
+
 		return false;
 	}
 
-	message->size = (uint32_t) ret;
-	return true;
+	while (true) {
+
+		if (batch->index == batch->count) {
+			if (!Net_ReceiveBatch(source))
+				return false;
+		}
+
+		const uint32_t i = batch->index++;
+
+		Net_SockaddrToNetaddr(&batch->addr[i], from);
+
+		if (batch->size[i] >= message->max_size) {
+			Com_Warn("Oversized packet from %s\n", Net_NetaddrToString(*from));
+			continue;
+		}
+
+		memcpy(message->data, batch->data[i], batch->size[i]);
+		message->size = (uint32_t) batch->size[i];
+
+		net_packet_time = batch->time;
+		return true;
+	}
 }
 
 /*
- * @brief
+ * @brief Transmits all datagrams queued for the specified source.
  */
-void Net_SendPacket(net_src_t source, size_t size, void *data, net_addr_t to) {
+static void Net_SendBatch(net_src_t source) {
+	net_batch_t *batch = &net_send[source];
+	net_addr_t to;
+	uint32_t i;
+
+	if (!batch->count)
+		return;
+
+#if defined(HAVE_SENDMMSG)
+	struct mmsghdr msgs[NET_BATCH];
+	struct iovec iov[NET_BATCH];
+
+	memset(msgs, 0, sizeof(msgs));
+
+	for (i = 0; i < batch->count; i++) {
+		iov[i].iov_base = batch->data[i];
+		iov[i].iov_len = batch->size[i];
+
+		msgs[i].msg_hdr.msg_name = &batch->addr[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(batch->addr[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	i = 0;
+	while (i < batch->count) {
+		const int32_t ret = sendmmsg(ip_sockets[source], msgs + i, batch->count - i, 0);
+
+		if (ret == -1) { // the datagram at i failed, skip it
+			Net_SockaddrToNetaddr(&batch->addr[i], &to);
+			Net_Warn("%s to %s.\n", Net_ErrorString(), Net_NetaddrToString(to));
+			i++;
+		} else {
+			i += ret;
+		}
+	}
+#else
+	for (i = 0; i < batch->count; i++) {
+		const ssize_t ret = sendto(ip_sockets[source], (void *) batch->data[i], batch->size[i], 0,
+				(struct sockaddr *) &batch->addr[i], sizeof(batch->addr[i]));
+
+		if (ret == -1) {
+			Net_SockaddrToNetaddr(&batch->addr[i], &to);
+			Net_Warn("%s to %s.\n", Net_ErrorString(), Net_NetaddrToString(to));
+		}
+	}
+#endif
+
+	batch->count = 0;
+}
+
+#ifndef _WIN32
+
+/*
+ * @brief Wakes the network thread to transmit queued datagrams.
+ */
+static void Net_WakeThread(void) {
+	const byte b = 0;
+
+	if (write(net_thread_state.wake[1], &b, 1) == -1 && errno != EAGAIN) {
+		Com_Warn("%s\n", Net_ErrorString());
+	}
+}
+
+/*
+ * @brief Drains the server socket into the incoming ring. If the main thread
+ * is sleeping on the empty ring, it is woken once the ring is not empty.
+ */
+static void Net_ThreadReceive(void) {
+	net_thread_t *t = &net_thread_state;
+	const net_batch_t *batch = &net_recv[NS_SERVER];
+	net_packet_t *packet;
+	uint32_t i;
+
+	const uint32_t head = t->in.head;
+
+	while (Net_ReceiveBatch(NS_SERVER)) {
+
+		const gint64 stamp = g_get_monotonic_time();
+
+		for (i = 0; i < batch->count; i++) {
+
+			if (!(packet = Net_RingWrite(&t->in))) {
+				t->in.dropped += batch->count - i - 1;
+				break;
+			}
+
+			memcpy(packet->data, batch->data[i], batch->size[i]);
+			packet->size = batch->size[i];
+			packet->addr = batch->addr[i];
+			packet->time = batch->time;
+			packet->stamp = stamp;
+
+			Net_RingPush(&t->in);
+		}
+	}
+
+	if (t->in.head == head)
+		return;
+
+	__sync_synchronize();
+
+	if (t->sleeping && __sync_bool_compare_and_swap(&t->sleeping, true, false))
+		SDL_SemPost(t->arrival);
+}
+
+/*
+ * @brief Transmits the outgoing ring.
+ */
+static void Net_ThreadSend(void) {
+	net_thread_t *t = &net_thread_state;
+	net_batch_t *batch = &net_send[NS_SERVER];
+	net_packet_t *packet;
+
+	while ((packet = Net_RingRead(&t->out))) {
+
+		if (batch->count == NET_BATCH)
+			Net_SendBatch(NS_SERVER);
+
+		memcpy(batch->data[batch->count], packet->data, packet->size);
+		batch->size[batch->count] = packet->size;
+		batch->addr[batch->count] = packet->addr;
+
+		batch->count++;
+
+		Net_RingPop(&t->out);
+	}
+
+	Net_SendBatch(NS_SERVER);
+}
+
+/*
+ * @brief The network thread services the server socket until shutdown.
+ */
+static int32_t Net_Thread(void *data __attribute__((unused))) {
+	net_thread_t *t = &net_thread_state;
+	struct timeval timeout;
+	fd_set fdset;
+	byte buf[64];
+
+	const int32_t sock = ip_sockets[NS_SERVER];
+	const int32_t max_fd = sock > t->wake[0] ? sock : t->wake[0];
+
+	net_in_thread = true;
+
+	while (!t->shutdown) {
+
+		FD_ZERO(&fdset);
+		FD_SET(sock, &fdset);
+		FD_SET(t->wake[0], &fdset);
+
+		timeout.tv_sec = 0;
+		timeout.tv_usec = 100000;
+
+		if (select(max_fd + 1, &fdset, NULL, NULL, &timeout) == -1) {
+			if (errno != EINTR)
+				Net_Warn("%s\n", Net_ErrorString());
+			continue;
+		}
+
+		if (FD_ISSET(t->wake[0], &fdset)) {
+			while (read(t->wake[0], buf, sizeof(buf)) > 0)
+				;
+		}
+
+		if (FD_ISSET(sock, &fdset)) {
+			Net_ThreadReceive();
+		}
+
+		Net_ThreadSend();
+	}
+
+	return 0;
+}
+
+/*
+ * @brief Starts the network thread for the server socket.
+ */
+static void Net_StartThread(void) {
+	net_thread_t *t = &net_thread_state;
+	int32_t i, on = 1;
+
+	memset(t, 0, sizeof(*t));
+
+	if (pipe(t->wake) == -1) {
+		Com_Warn("Failed to create pipe: %s\n", Net_ErrorString());
+		return;
+	}
+
+	for (i = 0; i < 2; i++) {
+		if (ioctl(t->wake[i], FIONBIO, (char *) &on) == -1) {
+			Com_Warn("Call ioctl: %s\n", Net_ErrorString());
+		}
+	}
+
+	t->in.packets = Z_Malloc(sizeof(net_packet_t) * NET_RING_SIZE);
+	t->out.packets = Z_Malloc(sizeof(net_packet_t) * NET_RING_SIZE);
+
+	t->arrival = SDL_CreateSemaphore(0);
+
+	t->thread = SDL_CreateThread(Net_Thread, NULL);
+}
+
+/*
+ * @brief Stops the network thread, discarding any datagrams it holds.
+ */
+static void Net_StopThread(void) {
+	net_thread_t *t = &net_thread_state;
+
+	if (!t->thread)
+		return;
+
+	t->shutdown = true;
+	Net_WakeThread();
+
+	SDL_WaitThread(t->thread, NULL);
+
+	Net_PrintThreadWarning();
+
+	close(t->wake[0]);
+	close(t->wake[1]);
+
+	SDL_DestroySemaphore(t->arrival);
+
+	Z_Free(t->in.packets);
+	Z_Free(t->out.packets);
+
+	memset(t, 0, sizeof(*t));
+}
+
+#else
+
+static void Net_WakeThread(void) {
+}
+
+static void Net_StartThread(void) {
+	Com_Warn("The network thread is not supported on this platform\n");
+}
+
+static void Net_StopThread(void) {
+}
+
+#endif
+
+/*
+ * @brief Queues a datagram for the network thread to transmit.
+ */
+static void Net_SendThreadPacket(net_src_t source, size_t size, void *data,
+		const struct sockaddr_in *to) {
+
+	net_packet_t *packet = Net_RingWrite(&net_thread_state.out);
+
+	if (packet) {
+		memcpy(packet->data, data, size);
+		packet->size = size;
+		packet->addr = *to;
+		packet->time = Sys_Milliseconds();
+		packet->stamp = g_get_monotonic_time();
+
+		Net_RingPush(&net_thread_state.out);
+	}
+
+	if (!net_send[source].queue)
+		Net_WakeThread();
+}
+
+/*
+ * @brief Sends a datagram, or queues it if a batch has been started for the
+ * source. Loopback datagrams are always delivered immediately.
+ */
+static void Net_TransmitPacket(net_src_t source, size_t size, void *data, net_addr_t to) {
 	struct sockaddr_in to_addr;
 	int32_t sock, ret;
 
@@ -314,22 +891,210 @@ void Net_SendPacket(net_src_t source, size_t size, void *data, net_addr_t to) {
 
 	Net_NetAddrToSockaddr(&to, &to_addr);
 
+	if (source == NS_SERVER && net_thread_state.thread && size <= MAX_MSG_SIZE) {
+		Net_SendThreadPacket(source, size, data, &to_addr);
+		return;
+	}
+
+	net_batch_t *batch = &net_send[source];
+
+	if (batch->queue && size <= MAX_MSG_SIZE) {
+
+		if (batch->count == NET_BATCH)
+			Net_SendBatch(source);
+
+		memcpy(batch->data[batch->count], data, size);
+		batch->size[batch->count] = size;
+		batch->addr[batch->count] = to_addr;
+
+		batch->count++;
+		return;
+	}
+
 	ret = sendto(sock, data, size, 0, (struct sockaddr *) &to_addr, sizeof(to_addr));
 
 	if (ret == -1)
 		Com_Warn("%s to %s.\n", Net_ErrorString(), Net_NetaddrToString(to));
 }
 
+/*
+ * @brief Returns true if any of the network simulator's conditions are set.
+ */
+static _Bool Net_SimActive(void) {
+
+	if (net_sim_latency->value || net_sim_jitter->value)
+		return true;
+
+	if (net_sim_loss->value || net_sim_duplicate->value || net_sim_reorder->value)
+		return true;
+
+	return false;
+}
+
+/*
+ * @brief Holds a copy of the datagram until the specified time.
+ */
+static void Net_SimHold(net_src_t source, size_t size, const void *data, net_addr_t to,
+		uint32_t time) {
+
+	if (net_sim.count == NET_SIM_MAX_PACKETS || size > MAX_MSG_SIZE) {
+		net_sim.overflowed++;
+		return;
+	}
+
+	net_sim_packet_t *packet = Z_Malloc(sizeof(*packet));
+
+	packet->source = source;
+	packet->to = to;
+	packet->time = time;
+	packet->size = size;
+
+	memcpy(packet->data, data, size);
+
+	// insert after any datagrams released at the same time, preserving order
+	GList *next = net_sim.packets;
+
+	while (next && ((const net_sim_packet_t *) next->data)->time <= packet->time)
+		next = next->next;
+
+	net_sim.packets = g_list_insert_before(net_sim.packets, next, packet);
+	net_sim.count++;
+}
+
+/*
+ * @brief Applies the simulated network conditions to an outgoing datagram.
+ *
+ * @return True if the datagram was consumed, false if it should be sent.
+ */
+static _Bool Net_Simulate(net_src_t source, size_t size, void *data, net_addr_t to) {
+	uint16_t i, copies = 1;
+
+	if (to.type == NA_IP_BROADCAST || !Net_SimActive())
+		return false;
+
+	net_sim.sent++;
+
+	if (Randomf() * 100.0 < net_sim_loss->value) {
+		net_sim.lost++;
+		return true;
+	}
+
+	if (Randomf() * 100.0 < net_sim_duplicate->value) {
+		net_sim.duplicated++;
+		copies++;
+	}
+
+	for (i = 0; i < copies; i++) {
+		const uint32_t now = Sys_Milliseconds();
+		uint32_t time = now + net_sim_latency->integer + Randomf() * net_sim_jitter->value;
+
+		// jitter alone does not overtake datagrams already held
+		if ((int32_t) (net_sim.last_time[source] - time) > 0)
+			time = net_sim.last_time[source];
+
+		if (Randomf() * 100.0 < net_sim_reorder->value) {
+			net_sim.reordered++;
+			time += NET_SIM_REORDER_DELAY;
+		} else {
+			net_sim.last_time[source] = time;
+		}
+
+		if (time != now)
+			Net_SimHold(source, size, data, to, time);
+		else
+			Net_TransmitPacket(source, size, data, to);
+	}
+
+	return true;
+}
+
+/*
+ * @brief Transmits the held datagrams whose time has come.
+ */
+static void Net_SimRelease(void) {
+
+	const uint32_t now = Sys_Milliseconds();
+
+	while (net_sim.packets) {
+		net_sim_packet_t *packet = net_sim.packets->data;
+
+		if ((int32_t) (packet->time - now) > 0)
+			break;
+
+		net_sim.packets = g_list_delete_link(net_sim.packets, net_sim.packets);
+		net_sim.count--;
+
+		Net_TransmitPacket(packet->source, packet->size, packet->data, packet->to);
+
+		Z_Free(packet);
+	}
+}
+
+/*
+ * @brief Sends a datagram, subject to the network simulator.
+ */
+void Net_SendPacket(net_src_t source, size_t size, void *data, net_addr_t to) {
+
+	if (Net_Simulate(source, size, data, to))
+		return;
+
+	Net_TransmitPacket(source, size, data, to);
+}
+
+/*
+ * @brief Begins queuing datagrams sent from the specified source, so that they
+ * may be transmitted together by Net_FlushBatch.
+ */
+void Net_BeginBatch(net_src_t source) {
+	net_send[source].queue = true;
+}
+
+/*
+ * @brief Transmits all datagrams queued since Net_BeginBatch, and resumes
+ * sending datagrams immediately.
+ */
+void Net_FlushBatch(net_src_t source) {
+
+	if (source == NS_SERVER && net_thread_state.thread) {
+		net_send[source].queue = false;
+		Net_WakeThread();
+		return;
+	}
+
+	if (ip_sockets[source])
+		Net_SendBatch(source);
+
+	net_send[source].count = 0;
+	net_send[source].queue = false;
+}
+
 /*
  * @brief Sleeps for msec or until server socket is ready.
  */
 void Net_Sleep(uint32_t msec) {
+	net_thread_t *t = &net_thread_state;
 	struct timeval timeout;
 	fd_set fdset;
 
 	if (!ip_sockets[NS_SERVER] || !dedicated->value)
 		return; // we're not a server, simply return
 
+	if (t->thread) { // wait for the network thread to receive something
+		_Bool woken = false;
+
+		t->sleeping = true;
+		__sync_synchronize();
+
+		if (t->in.tail == t->in.head)
+			woken = SDL_SemWaitTimeout(t->arrival, msec) == 0;
+
+		// if the network thread ended the sleep, consume its post
+		if (!__sync_bool_compare_and_swap(&t->sleeping, true, false) && !woken)
+			SDL_SemWait(t->arrival);
+
+		return;
+	}
+
 	FD_ZERO(&fdset);
 	FD_SET(ip_sockets[NS_SERVER], &fdset); // network socket
 	timeout.tv_sec = msec / 1000;
@@ -390,16 +1155,63 @@ void Net_Config(net_src_t source, _Bool up) {
 	}
 
 	if (up) { // open the socket
-		if (!ip_sockets[source])
+		if (!ip_sockets[source]) {
 			ip_sockets[source] = Net_Socket(net_ip->string, p);
+
+			if (source == NS_SERVER && ip_sockets[source] && net_thread->integer)
+				Net_StartThread();
+		}
 		return;
 	}
 
-	// or close it
+	if (source == NS_SERVER)
+		Net_StopThread();
+
+	// or close it, discarding any batched datagrams
 	if (ip_sockets[source])
 		Net_CloseSocket(ip_sockets[source]);
 
 	ip_sockets[source] = 0;
+
+	net_recv[source].count = net_recv[source].index = 0;
+	net_send[source].count = 0;
+}
+
+/*
+ * @brief Prints the statistics of a network thread ring.
+ */
+static void Net_RingStats(const char *name, const net_ring_t *ring) {
+
+	const vec_t avg = ring->count ? ring->latency / (vec_t) ring->count / 1000.0 : 0.0;
+
+	Com_Print("  %s: %u packets, %u dropped, depth %u (peak %u), latency %.2fms avg, %.2fms max\n",
+			name, ring->count, ring->dropped, ring->head - ring->tail, ring->peak, avg,
+			ring->max_latency / 1000.0);
+}
+
+/*
+ * @brief Prints queue depth and latency statistics for the network thread,
+ * and the effects of the network simulator.
+ */
+static void Net_Stats_f(void) {
+	const net_thread_t *t = &net_thread_state;
+
+	if (t->thread) {
+		Com_Print("Network thread:\n");
+
+		Net_RingStats("received", &t->in);
+		Net_RingStats("sent", &t->out);
+	} else {
+		Com_Print("Network thread is not running\n");
+	}
+
+	if (net_sim.sent) {
+		Com_Print("Network simulator:\n");
+
+		Com_Print("  %u datagrams, %u lost, %u duplicated, %u reordered, %u held, %u overflowed\n",
+				net_sim.sent, net_sim.lost, net_sim.duplicated, net_sim.reordered, net_sim.count,
+				net_sim.overflowed);
+	}
 }
 
 /*
@@ -417,6 +1229,21 @@ void Net_Init(void) {
 
 	net_port = Cvar_Get("net_port", va("%i", PORT_SERVER), CVAR_NO_SET, NULL);
 	net_ip = Cvar_Get("net_ip", "localhost", CVAR_NO_SET, NULL);
+	net_thread = Cvar_Get("net_thread", "0", CVAR_ARCHIVE,
+			"Service the server socket from a dedicated network thread");
+
+	net_sim_latency = Cvar_Get("net_sim_latency", "0", 0,
+			"Simulated latency of outgoing datagrams, in milliseconds");
+	net_sim_jitter = Cvar_Get("net_sim_jitter", "0", 0,
+			"Simulated random variation in latency, in milliseconds");
+	net_sim_loss = Cvar_Get("net_sim_loss", "0", 0,
+			"Simulated percentage of outgoing datagrams lost");
+	net_sim_duplicate = Cvar_Get("net_sim_duplicate", "0", 0,
+			"Simulated percentage of outgoing datagrams duplicated");
+	net_sim_reorder = Cvar_Get("net_sim_reorder", "0", 0,
+			"Simulated percentage of outgoing datagrams held back behind later ones");
+
+	Cmd_Add("net_stats", Net_Stats_f, CMD_SYSTEM, "Print network thread and simulator statistics");
 }
 
 /*
@@ -427,6 +1254,9 @@ void Net_Shutdown(void) {
 	Net_Config(NS_CLIENT, false); // close client socket
 	Net_Config(NS_SERVER, false); // and server socket
 
+	g_list_free_full(net_sim.packets, Z_Free);
+	memset(&net_sim, 0, sizeof(net_sim));
+
 #ifdef _WIN32
 	WSACleanup();
 #endif
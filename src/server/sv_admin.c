@@ -134,6 +134,32 @@ static void Sv_Demo_f(void) {
 	Sv_InitServer(Cmd_Argv(1), SV_ACTIVE_DEMO);
 }
 
+/*
+ * @brief Seeks the current demo to the specified time, in seconds.
+ */
+static void Sv_DemoSeek_f(void) {
+
+	if (Cmd_Argc() != 2) {
+		Com_Print("Usage: %s <seconds>\n", Cmd_Argv(0));
+		return;
+	}
+
+	if (sv.state != SV_ACTIVE_DEMO) {
+		Com_Print("No demo is playing\n");
+		return;
+	}
+
+	const vec_t seconds = atof(Cmd_Argv(1));
+	const int32_t time = Sv_SeekDemo(seconds > 0.0 ? seconds * 1000 : 0);
+
+	if (time == -1) {
+		Com_Print("%s is not indexed, use demo_index to upgrade it\n", sv.name);
+		return;
+	}
+
+	Com_Print("Seeking to %d:%02d\n", time / 60000, (time / 1000) % 60);
+}
+
 /*
  * @brief Creates a server for the specified map.
  */
@@ -184,8 +210,8 @@ static void Sv_Status_f(void) {
 	}
 
 	Com_Print("map: %s\n", sv.name);
-	Com_Print("num ping name            lastmsg address               qport \n");
-	Com_Print("--- ---- --------------- ------- --------------------- ------\n");
+	Com_Print("num ping name            lastmsg frame address               qport \n");
+	Com_Print("--- ---- --------------- ------- ----- --------------------- ------\n");
 	for (i = 0, cl = svs.clients; i < sv_max_clients->integer; i++, cl++) {
 
 		if (cl->state == SV_CLIENT_FREE)
@@ -207,6 +233,9 @@ static void Sv_Status_f(void) {
 
 		Com_Print("%7i ", svs.real_time - cl->last_message);
 
+		// microseconds spent building and encoding the last frame
+		Com_Print("%5u ", cl->frame_build_time < 99999 ? cl->frame_build_time : 99999);
+
 		s = Net_NetaddrToString(cl->netchan.remote_address);
 		Com_Print("%s", s);
 		l = 22 - strlen(s);
@@ -217,6 +246,11 @@ static void Sv_Status_f(void) {
 
 		Com_Print("\n");
 	}
+
+	if (svs.connectionless_drops) {
+		Com_Print("%u connectionless packets dropped by sv_connectionless_rate\n",
+				svs.connectionless_drops);
+	}
 }
 
 /*
@@ -358,9 +392,14 @@ void Sv_InitCommands(void) {
 	Cmd_Add("status", Sv_Status_f, CMD_SERVER, "Print server status information");
 	Cmd_Add("server_info", Sv_ServerInfo_f, CMD_SERVER, "Print server info settings");
 	Cmd_Add("user_info", Sv_UserInfo_f, CMD_SERVER, "Print information for a given user");
+	Cmd_Add("sv_delta_stats", Sv_DeltaStats_f, CMD_SERVER, "Print delta encoding cache statistics");
 
 	Cmd_Add("demo", Sv_Demo_f, CMD_SERVER, "Start playback of the specified demo file");
+	Cmd_Add("demo_seek", Sv_DemoSeek_f, CMD_SERVER, "Seek the current demo to the specified time");
 	Cmd_Add("map", Sv_Map_f, CMD_SERVER, "Start a server for the specified map");
+	Cmd_Add("mvd_record", Sv_RecordMultiView_f, CMD_SERVER,
+			"Record a multi-view demo of the current level");
+	Cmd_Add("mvd_stop", Sv_StopMultiView_f, CMD_SERVER, "Stop recording a multi-view demo");
 
 	Cmd_Add("set_master", Sv_SetMaster_f, CMD_SERVER,
 			"Set the master server(s) for the dedicated server");
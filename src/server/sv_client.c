@@ -88,7 +88,7 @@ static void Sv_ConfigStrings_f(void) {
 	}
 
 	// write a packet full of data
-	while (sv_client->netchan.message.size < MAX_MSG_SIZE / 2 && start < MAX_CONFIG_STRINGS) {
+	while (sv_client->netchan.message.size < sv_client->netchan.message.max_size / 2 && start < MAX_CONFIG_STRINGS) {
 		if (sv.config_strings[start][0]) {
 			Msg_WriteByte(&sv_client->netchan.message, SV_CMD_CONFIG_STRING);
 			Msg_WriteShort(&sv_client->netchan.message, start);
@@ -135,10 +135,11 @@ static void Sv_Baselines_f(void) {
 	memset(&nullstate, 0, sizeof(nullstate));
 
 	// write a packet full of data
-	while (sv_client->netchan.message.size < MAX_MSG_SIZE / 2 && start < MAX_EDICTS) {
+	while (sv_client->netchan.message.size < sv_client->netchan.message.max_size / 2 && start < MAX_EDICTS) {
 		base = &sv.baselines[start];
 		if (base->model1 || base->sound || base->effects) {
 			Msg_WriteByte(&sv_client->netchan.message, SV_CMD_BASELINE);
+			Msg_WriteShort(&sv_client->netchan.message, base->number);
 			Msg_WriteDeltaEntity(&nullstate, base, &sv_client->netchan.message, true, true);
 		}
 		start++;
@@ -186,8 +187,12 @@ static void Sv_Begin_f(void) {
 	Cbuf_InsertFromDefer();
 }
 
+#define DOWNLOAD_CHUNK_SIZE 1024
+#define DOWNLOAD_CHUNKS 16 // in flight at once, enough to fill the reliable window
+
 /*
- * @brief
+ * @brief Sends the next chunk of the current download. The client requests a
+ * chunk for each one it receives, so the number in flight remains constant.
  */
 static void Sv_NextDownload_f(void) {
 	byte buf[MAX_MSG_SIZE];
@@ -200,19 +205,23 @@ static void Sv_NextDownload_f(void) {
 
 	Sb_Init(&msg, buf, sizeof(buf));
 
-	int32_t len = Clamp(download->size - download->count, 0, 1024);
+	const int32_t len = Clamp(download->size - download->count, 0, DOWNLOAD_CHUNK_SIZE);
+	const byte *data = download->buffer + download->count;
+
+	download->count += len;
 
 	Msg_WriteByte(&msg, SV_CMD_DOWNLOAD);
 	Msg_WriteShort(&msg, len);
 
-	int32_t percent = download->count * 100 / (Clamp(download->size, 1, download->size));
-	Msg_WriteByte(&msg, percent);
+	// the final chunk must report 100, or the client will wait for another
+	if (download->count == download->size)
+		Msg_WriteByte(&msg, 100);
+	else
+		Msg_WriteByte(&msg, download->count * 100 / download->size);
 
-	Sb_Write(&msg, download->buffer + download->count, len);
+	Sb_Write(&msg, data, len);
 	Sb_Write(&sv_client->netchan.message, msg.data, msg.size);
 
-	download->count += len;
-
 	if (download->count == download->size) {
 		Com_Debug("Finished download to %s\n", Sv_NetaddrToString(sv_client));
 
@@ -290,7 +299,12 @@ static void Sv_Download_f(void) {
 		}
 	}
 
-	Sv_NextDownload_f();
+	// fill the pipeline, so that the download is not paced by the round trip
+	int32_t i;
+	for (i = 0; i < DOWNLOAD_CHUNKS; i++) {
+		Sv_NextDownload_f();
+	}
+
 	Com_Debug("Downloading %s to %s\n", filename, sv_client->name);
 }
 
@@ -429,10 +443,11 @@ void Sv_ParseClientMessage(sv_client_t *cl) {
 				last_frame = Msg_ReadLong(&net_message);
 				if (last_frame != cl->last_frame) {
 					cl->last_frame = last_frame;
-					if (cl->last_frame > -1) {
+					if (cl->last_frame > -1) { // measured from the packet's arrival
+						const uint32_t sent = cl->frames[cl->last_frame & UPDATE_MASK].sent_time;
+
 						cl->frame_latency[cl->last_frame & (CLIENT_LATENCY_COUNTS - 1)]
-								= svs.real_time
-										- cl->frames[cl->last_frame & UPDATE_MASK].sent_time;
+								= cl->last_message > sent ? cl->last_message - sent : 0;
 					}
 				}
 
@@ -0,0 +1,450 @@
+/*
+ * Copyright(c) 1997-2001 Id Software, Inc.
+ * Copyright(c) 2002 The Quakeforge Project.
+ * Copyright(c) 2006 Quake2World.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "sv_local.h"
+
+/*
+ * Multi-view demos record the whole world once per server frame: every entity
+ * considered for client frames, and the state of every player, so that
+ * playback may follow any one of them. See DEMO_MULTI_VIEW_MAGIC for their
+ * layout.
+ *
+ * Messages are encoded on the main thread, and then queued for the writer
+ * thread, which compresses them and writes them out. So recording never waits
+ * on the filesystem.
+ */
+typedef struct {
+	int32_t length; // the size of the data, with DEMO_KEYFRAME for keyframes
+	int32_t time; // the time of the keyframe this message begins, or -1
+	byte data[];
+} sv_demo_message_t;
+
+typedef struct {
+	entity_state_t entities[MAX_EDICTS];
+	uint16_t num_entities;
+
+	player_state_t players[MAX_CLIENTS];
+	_Bool present[MAX_CLIENTS]; // players in game when the frame was written
+} sv_demo_frame_t;
+
+typedef struct {
+	char filename[MAX_QPATH];
+	file_t *file;
+	fs_stream_t *stream;
+
+	GArray *keyframes; // appended to by the writer thread
+
+	SDL_Thread *thread;
+	SDL_mutex *lock;
+	SDL_cond *cond;
+	GQueue *queue; // messages pending for the writer thread
+	_Bool shutdown;
+
+	uint32_t start_time; // sv.time when recording began
+	uint32_t next_keyframe;
+	int32_t last_frame; // the frame the next is delta'd from, or -1
+
+	sv_demo_frame_t frames[2];
+	uint16_t current; // the frame being written
+
+	size_buf_t events; // multicast during the current frame
+	byte events_buffer[MAX_NET_MESSAGE_SIZE];
+} sv_demo_t;
+
+static sv_demo_t sv_demo;
+
+/*
+ * @return The interval between keyframes, in milliseconds.
+ */
+static uint32_t Sv_MultiViewKeyframeInterval(void) {
+	return Clamp(sv_demo_keyframes->value, 1.0, 600.0) * 1000;
+}
+
+/*
+ * @brief Writes the queued messages to the demo file until recording stops,
+ * marking the start of each keyframe in the index.
+ */
+static int32_t Sv_MultiViewThread(void *data __attribute__((unused))) {
+	sv_demo_t *d = &sv_demo;
+	sv_demo_message_t *msg;
+
+	while (true) {
+
+		SDL_LockMutex(d->lock);
+
+		while (g_queue_is_empty(d->queue) && !d->shutdown)
+			SDL_CondWait(d->cond, d->lock);
+
+		msg = g_queue_pop_head(d->queue);
+
+		SDL_UnlockMutex(d->lock);
+
+		if (!msg) // stopped, and every message is written
+			break;
+
+		if (msg->time != -1) {
+			demo_keyframe_t keyframe;
+
+			keyframe.time = LittleLong(msg->time);
+			keyframe.offset = LittleLong(Fs_FlushStream(d->stream));
+
+			g_array_append_val(d->keyframes, keyframe);
+		}
+
+		int32_t length = LittleLong(msg->length);
+
+		Fs_WriteStream(d->stream, &length, sizeof(length), 1);
+		Fs_WriteStream(d->stream, msg->data, msg->length & ~DEMO_KEYFRAME, 1);
+
+		Z_Free(msg);
+	}
+
+	return 0;
+}
+
+/*
+ * @brief Queues the message for the writer thread. The time is that of the
+ * keyframe which the message begins, or -1.
+ */
+static void Sv_QueueMultiView(const size_buf_t *msg, _Bool keyframe, int32_t time) {
+	sv_demo_t *d = &sv_demo;
+
+	sv_demo_message_t *m = Z_Malloc(sizeof(*m) + msg->size);
+
+	m->length = msg->size | (keyframe ? DEMO_KEYFRAME : 0);
+	m->time = time;
+
+	memcpy(m->data, msg->data, msg->size);
+
+	SDL_LockMutex(d->lock);
+
+	g_queue_push_tail(d->queue, m);
+	SDL_CondSignal(d->cond);
+
+	SDL_UnlockMutex(d->lock);
+}
+
+/*
+ * @brief Writes the server data, config_strings and baselines, as the client
+ * would receive them on connecting.
+ */
+static void Sv_WriteMultiViewHeader(void) {
+	byte buffer[MAX_MSG_SIZE];
+	size_buf_t msg;
+	entity_state_t null_state;
+	int32_t i;
+
+	Sb_Init(&msg, buffer, sizeof(buffer));
+
+	Msg_WriteByte(&msg, SV_CMD_SERVER_DATA);
+	Msg_WriteLong(&msg, PROTOCOL);
+	Msg_WriteLong(&msg, svs.spawn_count);
+	Msg_WriteLong(&msg, svs.frame_rate);
+	Msg_WriteByte(&msg, 1); // demo_server byte
+	Msg_WriteString(&msg, Cvar_GetString("game"));
+	Msg_WriteShort(&msg, -1); // the player is chosen on playback
+	Msg_WriteString(&msg, sv.config_strings[CS_NAME]);
+
+	for (i = 0; i < MAX_CONFIG_STRINGS; i++) {
+		if (*sv.config_strings[i] != '\0') {
+			if (msg.size + strlen(sv.config_strings[i]) + 32 > msg.max_size) {
+				Sv_QueueMultiView(&msg, false, -1);
+				msg.size = 0;
+			}
+
+			Msg_WriteByte(&msg, SV_CMD_CONFIG_STRING);
+			Msg_WriteShort(&msg, i);
+			Msg_WriteString(&msg, sv.config_strings[i]);
+		}
+	}
+
+	memset(&null_state, 0, sizeof(null_state));
+
+	for (i = 0; i < MAX_EDICTS; i++) {
+		entity_state_t *base = &sv.baselines[i];
+
+		if (!base->model1 && !base->sound && !base->effects)
+			continue;
+
+		if (msg.size + 64 > msg.max_size) {
+			Sv_QueueMultiView(&msg, false, -1);
+			msg.size = 0;
+		}
+
+		Msg_WriteByte(&msg, SV_CMD_BASELINE);
+		Msg_WriteShort(&msg, base->number);
+		Msg_WriteDeltaEntity(&null_state, base, &msg, true, true);
+	}
+
+	Msg_WriteByte(&msg, SV_CMD_CBUF_TEXT);
+	Msg_WriteString(&msg, "precache 0\n");
+
+	Sv_QueueMultiView(&msg, false, -1);
+}
+
+/*
+ * @brief Writes a keyframe, which restores the config_strings, so that
+ * playback may seek to it. The next frame is written without delta
+ * compression.
+ */
+static void Sv_WriteMultiViewKeyframe(void) {
+	sv_demo_t *d = &sv_demo;
+	byte buffer[MAX_MSG_SIZE];
+	size_buf_t msg;
+	int32_t i;
+
+	int32_t time = sv.time - d->start_time;
+
+	Sb_Init(&msg, buffer, sizeof(buffer));
+
+	for (i = 0; i < MAX_CONFIG_STRINGS; i++) {
+		if (*sv.config_strings[i] != '\0' || i >= CS_CLIENTS) {
+			if (msg.size + strlen(sv.config_strings[i]) + 32 > msg.max_size) {
+				Sv_QueueMultiView(&msg, true, time);
+				msg.size = 0;
+				time = -1;
+			}
+
+			Msg_WriteByte(&msg, SV_CMD_CONFIG_STRING);
+			Msg_WriteShort(&msg, i);
+			Msg_WriteString(&msg, sv.config_strings[i]);
+		}
+	}
+
+	Sv_QueueMultiView(&msg, true, time);
+
+	d->next_keyframe = sv.time + Sv_MultiViewKeyframeInterval();
+	d->last_frame = -1;
+}
+
+/*
+ * @return The buffer to which commands multicast during the current frame are
+ * appended, or NULL if a multi-view demo is not being recorded.
+ */
+size_buf_t *Sv_MultiViewEvents(void) {
+	return sv_demo.file ? &sv_demo.events : NULL;
+}
+
+/*
+ * @brief Writes the current server frame to the multi-view demo, if one is
+ * being recorded: every entity in the world, and the state and area bits of
+ * every player, followed by the commands multicast during the frame.
+ */
+void Sv_WriteMultiViewFrame(void) {
+	static byte buffer[MAX_NET_MESSAGE_SIZE];
+	sv_demo_t *d = &sv_demo;
+	byte area_bits[MAX_BSP_AREAS >> 3];
+	size_buf_t msg;
+	int32_t i;
+
+	if (!d->file || sv.state != SV_ACTIVE_GAME)
+		return;
+
+	if (sv.time >= d->next_keyframe)
+		Sv_WriteMultiViewKeyframe();
+
+	sv_demo_frame_t *frame = &d->frames[d->current];
+	sv_demo_frame_t *from = d->last_frame == -1 ? NULL : &d->frames[d->current ^ 1];
+
+	Sb_Init(&msg, buffer, sizeof(buffer));
+	msg.allow_overflow = true;
+
+	Msg_WriteLong(&msg, sv.frame_num);
+	Msg_WriteLong(&msg, d->last_frame); // what we are delta'ing from
+
+	frame->num_entities = Sv_BuildWorldEntities(frame->entities);
+
+	Sv_WriteWorldEntities(from ? from->entities : NULL, from ? from->num_entities : 0,
+			frame->entities, frame->num_entities, &msg);
+
+	for (i = 0; i < sv_max_clients->integer; i++) {
+		sv_client_t *cl = &svs.clients[i];
+
+		frame->present[i] = cl->state == SV_CLIENT_ACTIVE && cl->edict->client;
+
+		if (!frame->present[i])
+			continue;
+
+		frame->players[i] = cl->edict->client->ps;
+
+		player_state_t *ps = from && from->present[i] ? &from->players[i] : NULL;
+
+		Msg_WriteShort(&msg, i + 1);
+		Msg_WriteDeltaPlayerState(ps, &frame->players[i], &msg);
+
+		Sv_ClientView(cl);
+
+		const int32_t area_bytes = Cm_WriteAreaBits(area_bits, cl->view_area);
+
+		Msg_WriteByte(&msg, area_bytes);
+		Msg_WriteData(&msg, area_bits, area_bytes);
+	}
+
+	Msg_WriteShort(&msg, 0); // end of players
+
+	if (!d->events.overflowed)
+		Sb_Write(&msg, d->events.data, d->events.size);
+
+	Sb_Clear(&d->events);
+
+	if (msg.overflowed) { // the next frame must not delta from this one
+		Com_Warn("Frame %u overflowed\n", sv.frame_num);
+		d->next_keyframe = sv.time;
+		return;
+	}
+
+	Sv_QueueMultiView(&msg, false, -1);
+
+	d->last_frame = sv.frame_num;
+	d->current ^= 1;
+}
+
+/*
+ * @brief Stops recording the multi-view demo, if one is being recorded. The
+ * writer thread drains its queue, and then the terminator and the index are
+ * written.
+ */
+void Sv_StopMultiView(void) {
+	sv_demo_t *d = &sv_demo;
+	demo_index_t index;
+	int32_t len = -1;
+	size_t in;
+
+	if (!d->file)
+		return;
+
+	SDL_LockMutex(d->lock);
+
+	d->shutdown = true;
+	SDL_CondSignal(d->cond);
+
+	SDL_UnlockMutex(d->lock);
+
+	SDL_WaitThread(d->thread, NULL);
+
+	SDL_DestroyCond(d->cond);
+	SDL_DestroyMutex(d->lock);
+
+	g_queue_free(d->queue);
+
+	Fs_WriteStream(d->stream, &len, sizeof(len), 1);
+
+	Fs_StreamStats(d->stream, &in, NULL);
+	Fs_CloseStream(d->stream);
+
+	const size_t out = Fs_Tell(d->file) - sizeof(demo_header_t);
+
+	if (d->keyframes->len) {
+		Fs_Write(d->file, d->keyframes->data, sizeof(demo_keyframe_t), d->keyframes->len);
+	}
+
+	index.num_keyframes = LittleLong(d->keyframes->len);
+	index.magic = LittleLong(DEMO_INDEX_MAGIC);
+
+	Fs_Write(d->file, &index, sizeof(index), 1);
+	Fs_Close(d->file);
+
+	g_array_free(d->keyframes, true);
+
+	if (in && out < in) {
+		Com_Print("Stopped %s, %u KB compressed to %u KB (%.1f%%)\n", d->filename,
+				(uint32_t) (in >> 10), (uint32_t) (out >> 10), out * 100.0 / in);
+	} else {
+		Com_Print("Stopped %s, %u KB\n", d->filename, (uint32_t) (out >> 10));
+	}
+
+	memset(d, 0, sizeof(*d));
+}
+
+/*
+ * @brief mvd_record <demo name>
+ *
+ * Begin recording a multi-view demo of the current level until `mvd_stop` is
+ * issued, or the level changes.
+ */
+void Sv_RecordMultiView_f(void) {
+	sv_demo_t *d = &sv_demo;
+	demo_header_t header;
+
+	if (Cmd_Argc() != 2) {
+		Com_Print("Usage: %s <demo name>\n", Cmd_Argv(0));
+		return;
+	}
+
+	if (d->file) {
+		Com_Print("Already recording %s\n", d->filename);
+		return;
+	}
+
+	if (sv.state != SV_ACTIVE_GAME) {
+		Com_Print("No game in progress\n");
+		return;
+	}
+
+	g_snprintf(d->filename, sizeof(d->filename), "demos/%s.mvd", Cmd_Argv(1));
+
+	if (!(d->file = Fs_OpenWrite(d->filename))) {
+		Com_Warn("Couldn't open %s\n", d->filename);
+		return;
+	}
+
+	d->stream = Fs_OpenStreamWrite(d->file, sv_demo_compress->integer);
+
+	const _Bool compressed = Fs_StreamCompressed(d->stream);
+
+	header.magic = LittleLong(DEMO_MULTI_VIEW_MAGIC);
+	header.version = LittleLong(DEMO_VERSION);
+	header.interval = LittleLong(Sv_MultiViewKeyframeInterval());
+	header.compression = LittleLong(compressed ? DEMO_COMPRESSION_DEFLATE : DEMO_COMPRESSION_NONE);
+
+	Fs_Write(d->file, &header, sizeof(header), 1);
+
+	d->keyframes = g_array_new(false, false, sizeof(demo_keyframe_t));
+
+	d->queue = g_queue_new();
+	d->lock = SDL_CreateMutex();
+	d->cond = SDL_CreateCond();
+
+	d->thread = SDL_CreateThread(Sv_MultiViewThread, NULL);
+
+	d->start_time = d->next_keyframe = sv.time;
+	d->last_frame = -1;
+
+	Sb_Init(&d->events, d->events_buffer, sizeof(d->events_buffer));
+	d->events.allow_overflow = true;
+
+	Sv_WriteMultiViewHeader();
+
+	Com_Print("Recording to %s\n", d->filename);
+}
+
+/*
+ * @brief mvd_stop
+ */
+void Sv_StopMultiView_f(void) {
+
+	if (!sv_demo.file) {
+		Com_Print("Not recording a multi-view demo\n");
+		return;
+	}
+
+	Sv_StopMultiView();
+}
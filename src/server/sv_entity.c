@@ -22,22 +22,274 @@
 #include "sv_local.h"
 
 /*
- * @brief Writes a delta update of an entity_state_t list to the message.
+ * Clients which acknowledged the same frame receive identical deltas for the
+ * entities they have in common. The delta cache holds each entity's encoding
+ * for the current frame, keyed by entity number and the frame it is delta'd
+ * from, so that it is encoded once and then appended by every other client.
+ * Deltas are bit-packed, so encodings are held as runs of bits.
+ * Entity states differ between clients in their solid, which is cleared for a
+ * client's own missiles, and in the state held for entities whose updates
+ * were deferred under rate (see Sv_EmitEntities). So the state the delta is
+ * from is matched in full, along with the solid of the state it is to.
+ *
+ * Frames are written in parallel, so entries are claimed and published with
+ * atomic operations. A client which finds an entry still being written simply
+ * encodes the delta itself.
+ */
+#define DELTA_CACHE_BITS 12
+#define DELTA_CACHE_SLOTS (1 << DELTA_CACHE_BITS)
+#define DELTA_CACHE_PROBES 16
+#define DELTA_CACHE_SIZE 0x40000
+
+typedef struct {
+	uint64_t key; // from frame and entity number, or 0 if unclaimed
+	const entity_state_t *from; // the claiming client's state
+	uint16_t to_solid;
+	uint32_t offset;
+	uint32_t bits; // the length of the encoding, which may be empty
+	volatile _Bool ready; // set once the encoding has been published
+} sv_delta_entry_t;
+
+typedef struct {
+	uint32_t hits, misses;
+	uint32_t bits_encoded, bits_shared;
+} sv_delta_counts_t;
+
+typedef struct {
+	sv_delta_entry_t entries[DELTA_CACHE_SLOTS];
+	byte data[DELTA_CACHE_SIZE];
+	uint32_t size;
+
+	sv_delta_counts_t frame; // accumulated as the current frame is written
+	sv_delta_counts_t last_frame;
+	sv_delta_counts_t total;
+} sv_delta_cache_t;
+
+static sv_delta_cache_t sv_delta_cache;
+
+/*
+ * @brief Adds the specified counts to the accumulator.
+ */
+static void Sv_AddDeltaCounts(sv_delta_counts_t *to, const sv_delta_counts_t *from) {
+
+	to->hits += from->hits;
+	to->misses += from->misses;
+	to->bits_encoded += from->bits_encoded;
+	to->bits_shared += from->bits_shared;
+}
+
+/*
+ * @brief Clears the delta cache. This must be called once per frame, before
+ * any client frames are written.
+ */
+void Sv_ResetDeltaCache(void) {
+	sv_delta_cache_t *cache = &sv_delta_cache;
+
+	cache->last_frame = cache->frame;
+	Sv_AddDeltaCounts(&cache->total, &cache->frame);
+
+	memset(&cache->frame, 0, sizeof(cache->frame));
+	memset(cache->entries, 0, sizeof(cache->entries));
+
+	cache->size = 0;
+}
+
+/*
+ * @brief Appends the specified run of bits to the message.
+ */
+static void Sv_WriteBitData(size_buf_t *msg, const byte *data, uint32_t bits) {
+
+	for (; bits >= 8; bits -= 8) {
+		Msg_WriteBits(msg, *data++, 8);
+	}
+
+	if (bits) {
+		Msg_WriteBits(msg, *data, bits);
+	}
+}
+
+/*
+ * @brief Encodes the delta between the specified entity states, or fetches
+ * the cached encoding if another client has already encoded it. The from
+ * frame is 0 for deltas from the baseline, or the frame number plus one.
+ * Returns the length of the encoding in bits, which may be empty.
+ */
+static uint32_t Sv_EncodeDeltaEntity(entity_state_t *from, entity_state_t *to,
+		const uint32_t from_frame, _Bool force, _Bool is_new, byte *buffer, size_t size,
+		const byte **data, sv_delta_counts_t *counts) {
+	sv_delta_cache_t *cache = &sv_delta_cache;
+	sv_delta_entry_t *entry = NULL;
+	uint32_t i, bits;
+
+	const uint64_t key = ((uint64_t) from_frame << 16) | to->number;
+	const uint32_t hash = (to->number * 0x9e3779b1) ^ (from_frame * 0x85ebca6b);
+
+	for (i = 0; i < DELTA_CACHE_PROBES; i++) {
+		sv_delta_entry_t *e = &cache->entries[((hash >> (32 - DELTA_CACHE_BITS)) + i)
+				& (DELTA_CACHE_SLOTS - 1)];
+
+		if (e->key == 0 && __sync_bool_compare_and_swap(&e->key, 0, key)) {
+			e->from = from;
+			e->to_solid = to->solid;
+			entry = e;
+			break;
+		}
+
+		if (e->key == key) {
+			if (!e->ready) // still being written
+				break;
+
+			__sync_synchronize();
+
+			if (e->to_solid == to->solid && (e->from == from || !memcmp(e->from, from,
+					sizeof(*from)))) {
+				*data = cache->data + e->offset;
+
+				counts->hits++;
+				counts->bits_shared += e->bits;
+				return e->bits;
+			}
+		}
+	}
+
+	size_buf_t delta;
+
+	Sb_Init(&delta, buffer, size);
+	Msg_WriteDeltaEntity(from, to, &delta, force, is_new);
+
+	*data = buffer;
+	bits = delta.size * 8 - (delta.write_bit ? 8 - delta.write_bit : 0);
+
+	counts->misses++;
+	counts->bits_encoded += bits;
+
+	if (entry) {
+		const uint32_t offset = __sync_fetch_and_add(&cache->size, delta.size);
+
+		if (offset + delta.size <= DELTA_CACHE_SIZE) { // otherwise leave it unpublished
+			memcpy(cache->data + offset, buffer, delta.size);
+
+			entry->offset = offset;
+			entry->bits = bits;
+
+			__sync_synchronize();
+			entry->ready = true;
+		}
+	}
+
+	return bits;
+}
+
+/*
+ * @brief Prints delta cache statistics for the last frame and in total.
+ */
+void Sv_DeltaStats_f(void) {
+	const sv_delta_counts_t *counts[] = { &sv_delta_cache.last_frame, &sv_delta_cache.total };
+	const char *names[] = { "Last frame", "Total" };
+	size_t i;
+
+	for (i = 0; i < G_N_ELEMENTS(counts); i++) {
+		const sv_delta_counts_t *c = counts[i];
+		const uint32_t lookups = c->hits + c->misses;
+
+		Com_Print("%s: %u hits, %u misses (%.1f%% hit rate), %u bytes encoded, %u bytes shared\n",
+				names[i], c->hits, c->misses, lookups ? c->hits * 100.0 / lookups : 0.0,
+				c->bits_encoded >> 3, c->bits_shared >> 3);
+	}
+}
+
+/*
+ * Entity updates are scheduled by priority. Every frame, each entity visible
+ * to a client accumulates priority by its distance and relevance to that
+ * client (see Sv_BuildClientFrame). When a frame is written, updates are
+ * admitted in order of priority until the client's byte budget is spent, and
+ * the priority of each entity the client is then current with is reset.
+ *
+ * Updates which do not fit are deferred: the frame retains the state the
+ * client already has, or omits the entity altogether if it is new to the
+ * client, so that later frames delta from what the client actually holds.
+ * Removals and the client's own entity are always sent.
+ */
+typedef struct {
+	entity_state_t *from; // NULL for new entities
+	entity_state_t *to; // NULL for removals
+	const byte *data;
+	uint32_t bits;
+	vec_t priority;
+	_Bool send;
+} sv_entity_update_t;
+
+#define UPDATE_NUMBER_BITS (ENTITY_NUMBER_BITS + 2) // the longest entity number encoding
+
+/*
+ * @brief Admits the pending updates in order of priority, while they fit
+ * within the specified number of bits.
+ */
+static void Sv_ScheduleEntities(sv_entity_update_t *updates, uint16_t num_updates,
+		int32_t budget) {
+	sv_entity_update_t *pending[MAX_PACKET_ENTITIES * 2];
+	uint16_t i, j, num_pending = 0;
+
+	for (i = 0; i < num_updates; i++) {
+		sv_entity_update_t *u = &updates[i];
+
+		if (u->send)
+			continue;
+
+		// insertion sort, there are never more than a few dozen
+		for (j = num_pending; j > 0 && pending[j - 1]->priority < u->priority; j--) {
+			pending[j] = pending[j - 1];
+		}
+
+		pending[j] = u;
+		num_pending++;
+	}
+
+	for (i = 0; i < num_pending; i++) {
+		const int32_t cost = pending[i]->bits + UPDATE_NUMBER_BITS;
+
+		if (cost <= budget) {
+			pending[i]->send = true;
+			budget -= cost;
+		}
+	}
+}
+
+/*
+ * @brief Writes a delta update of an entity_state_t list to the message,
+ * within the client's frame budget. The from frame is the number of the frame
+ * being delta'd from, or -1. Deferred updates are reverted in the frame.
  */
-static void Sv_EmitEntities(sv_frame_t *from, sv_frame_t *to, size_buf_t *msg) {
+static void Sv_EmitEntities(sv_client_t *client, sv_frame_t *from, const int32_t from_frame,
+		sv_frame_t *to, size_buf_t *msg) {
+	sv_entity_update_t updates[MAX_PACKET_ENTITIES * 2];
+	byte buffers[MAX_PACKET_ENTITIES][64];
 	entity_state_t *old_ent = NULL, *new_ent = NULL;
 	uint32_t old_index, new_index;
 	uint16_t old_num, new_num;
 	uint16_t from_num_entities;
+	uint16_t i, num_updates = 0;
+	uint16_t last_number = 0;
+	sv_delta_counts_t counts;
+
+	memset(&counts, 0, sizeof(counts));
 
 	if (!from)
 		from_num_entities = 0;
 	else
 		from_num_entities = from->num_entities;
 
+	const uint16_t client_num = NUM_FOR_EDICT(client->edict);
+
+	// the end of entities, which follows, and the events, which are appended
+	int32_t budget = ((int32_t) client->frame_budget - (int32_t) msg->size
+			- (int32_t) client->events_size) * 8 - ENTITY_NUMBER_BITS - 2;
+
 	new_index = 0;
 	old_index = 0;
 	while (new_index < to->num_entities || old_index < from_num_entities) {
+		sv_entity_update_t *u = &updates[num_updates++];
+
 		if (new_index >= to->num_entities)
 			new_num = 0xffff;
 		else {
@@ -52,164 +304,83 @@ static void Sv_EmitEntities(sv_frame_t *from, sv_frame_t *to, size_buf_t *msg) {
 			old_num = old_ent->number;
 		}
 
+		memset(u, 0, sizeof(*u));
+
 		if (new_num == old_num) { // delta update from old position
-			Msg_WriteDeltaEntity(old_ent, new_ent, msg, false,
-					new_ent->number <= sv_max_clients->integer);
+			u->from = old_ent;
+			u->to = new_ent;
+			u->bits = Sv_EncodeDeltaEntity(old_ent, new_ent, from_frame + 1, false,
+					new_ent->number <= sv_max_clients->integer, buffers[new_index],
+					sizeof(buffers[new_index]), &u->data, &counts);
 			old_index++;
 			new_index++;
-			continue;
-		}
-
-		if (new_num < old_num) { // this is a new entity, send it from the baseline
-			Msg_WriteDeltaEntity(&sv.baselines[new_num], new_ent, msg, true, true);
+		} else if (new_num < old_num) { // this is a new entity, send it from the baseline
+			u->to = new_ent;
+			u->bits = Sv_EncodeDeltaEntity(&sv.baselines[new_num], new_ent, 0, true, true,
+					buffers[new_index], sizeof(buffers[new_index]), &u->data, &counts);
 			new_index++;
-			continue;
-		}
-
-		if (new_num > old_num) { // the old entity isn't present in the new message
-			const int16_t bits = U_REMOVE;
-
-			Msg_WriteShort(msg, old_num);
-			Msg_WriteShort(msg, bits);
-
+		} else { // the old entity isn't present in the new message
+			u->from = old_ent;
+			u->bits = U_BITS;
 			old_index++;
-			continue;
 		}
-	}
 
-	Msg_WriteLong(msg, 0); // end of entities
-}
-
-/*
- * @brief
- */
-static void Sv_WritePlayerstate(sv_frame_t *from, sv_frame_t *to, size_buf_t *msg) {
-	uint16_t pm_state_bits;
-	uint32_t stat_bits;
-	player_state_t *ps, *ops;
-	player_state_t dummy;
-	int32_t i;
-
-	ps = &to->ps;
-
-	if (!from) {
-		memset(&dummy, 0, sizeof(dummy));
-		ops = &dummy;
-	} else {
-		ops = &from->ps;
+		// removals, unchanged entities and our own entity are always sent
+		if (!u->to || !u->bits || u->to->number == client_num) {
+			u->send = true;
+			budget -= u->bits ? u->bits + UPDATE_NUMBER_BITS : 0;
+		} else {
+			u->priority = client->entity_priority[u->to->number];
+		}
 	}
 
-	// determine what needs to be sent
-	pm_state_bits = 0;
-
-	if (ps->pm_state.pm_type != ops->pm_state.pm_type)
-		pm_state_bits |= PS_M_TYPE;
-
-	if (ps->pm_state.origin[0] != ops->pm_state.origin[0] || ps->pm_state.origin[1]
-			!= ops->pm_state.origin[1] || ps->pm_state.origin[2] != ops->pm_state.origin[2])
-		pm_state_bits |= PS_M_ORIGIN;
-
-	if (ps->pm_state.velocity[0] != ops->pm_state.velocity[0] || ps->pm_state.velocity[1]
-			!= ops->pm_state.velocity[1] || ps->pm_state.velocity[2] != ops->pm_state.velocity[2])
-		pm_state_bits |= PS_M_VELOCITY;
+	Sv_ScheduleEntities(updates, num_updates, budget);
 
-	if (ps->pm_state.pm_flags != ops->pm_state.pm_flags)
-		pm_state_bits |= PS_M_FLAGS;
-
-	if (ps->pm_state.pm_time != ops->pm_state.pm_time)
-		pm_state_bits |= PS_M_TIME;
-
-	if (ps->pm_state.gravity != ops->pm_state.gravity)
-		pm_state_bits |= PS_M_GRAVITY;
-
-	if (ps->pm_state.view_offset[0] != ops->pm_state.view_offset[0] || ps->pm_state.view_offset[1]
-			!= ops->pm_state.view_offset[1] || ps->pm_state.view_offset[2]
-			!= ops->pm_state.view_offset[2])
-		pm_state_bits |= PS_M_VIEW_OFFSET;
-
-	if (ps->pm_state.view_angles[0] != ops->pm_state.view_angles[0] || ps->pm_state.view_angles[1]
-			!= ops->pm_state.view_angles[1] || ps->pm_state.view_angles[2]
-			!= ops->pm_state.view_angles[2])
-		pm_state_bits |= PS_M_VIEW_ANGLES;
-
-	if (ps->pm_state.kick_angles[0] != ops->pm_state.kick_angles[0] || ps->pm_state.kick_angles[1]
-			!= ops->pm_state.kick_angles[1] || ps->pm_state.kick_angles[2]
-			!= ops->pm_state.kick_angles[2])
-		pm_state_bits |= PS_M_KICK_ANGLES;
-
-	if (ps->pm_state.delta_angles[0] != ops->pm_state.delta_angles[0]
-			|| ps->pm_state.delta_angles[1] != ops->pm_state.delta_angles[1]
-			|| ps->pm_state.delta_angles[2] != ops->pm_state.delta_angles[2])
-		pm_state_bits |= PS_M_DELTA_ANGLES;
-
-	// write it
-	Msg_WriteShort(msg, pm_state_bits);
+	// write the admitted updates, and compact the frame to what the client holds
+	new_index = 0;
 
-	// write the pmove_state_t
-	if (pm_state_bits & PS_M_TYPE)
-		Msg_WriteByte(msg, ps->pm_state.pm_type);
+	for (i = 0; i < num_updates; i++) {
+		const sv_entity_update_t *u = &updates[i];
 
-	if (pm_state_bits & PS_M_ORIGIN) {
-		Msg_WriteShort(msg, ps->pm_state.origin[0]);
-		Msg_WriteShort(msg, ps->pm_state.origin[1]);
-		Msg_WriteShort(msg, ps->pm_state.origin[2]);
-	}
+		if (!u->to) {
+			Msg_WriteEntityNumber(msg, last_number, u->from->number);
+			Msg_WriteBits(msg, U_REMOVE, U_BITS);
 
-	if (pm_state_bits & PS_M_VELOCITY) {
-		Msg_WriteShort(msg, ps->pm_state.velocity[0]);
-		Msg_WriteShort(msg, ps->pm_state.velocity[1]);
-		Msg_WriteShort(msg, ps->pm_state.velocity[2]);
-	}
-
-	if (pm_state_bits & PS_M_FLAGS)
-		Msg_WriteShort(msg, ps->pm_state.pm_flags);
+			last_number = u->from->number;
+			continue;
+		}
 
-	if (pm_state_bits & PS_M_TIME)
-		Msg_WriteByte(msg, ps->pm_state.pm_time);
+		if (u->send) {
+			if (u->bits) {
+				Msg_WriteEntityNumber(msg, last_number, u->to->number);
+				Sv_WriteBitData(msg, u->data, u->bits);
 
-	if (pm_state_bits & PS_M_GRAVITY)
-		Msg_WriteShort(msg, ps->pm_state.gravity);
+				last_number = u->to->number;
+			}
 
-	if (pm_state_bits & PS_M_VIEW_OFFSET) {
-		Msg_WriteShort(msg, ps->pm_state.view_offset[0]);
-		Msg_WriteShort(msg, ps->pm_state.view_offset[1]);
-		Msg_WriteShort(msg, ps->pm_state.view_offset[2]);
-	}
+			client->entity_priority[u->to->number] = 0.0;
+		} else if (u->from) {
+			*u->to = *u->from;
+		} else {
+			continue;
+		}
 
-	if (pm_state_bits & PS_M_VIEW_ANGLES) {
-		Msg_WriteShort(msg, ps->pm_state.view_angles[0]);
-		Msg_WriteShort(msg, ps->pm_state.view_angles[1]);
-		Msg_WriteShort(msg, ps->pm_state.view_angles[2]);
-	}
+		entity_state_t *s = &svs.entity_states[(to->first_entity + new_index) % svs.num_entity_states];
 
-	if (pm_state_bits & PS_M_KICK_ANGLES) {
-		Msg_WriteShort(msg, ps->pm_state.kick_angles[0]);
-		Msg_WriteShort(msg, ps->pm_state.kick_angles[1]);
-		Msg_WriteShort(msg, ps->pm_state.kick_angles[2]);
-	}
+		if (s != u->to)
+			*s = *u->to;
 
-	if (pm_state_bits & PS_M_DELTA_ANGLES) {
-		Msg_WriteShort(msg, ps->pm_state.delta_angles[0]);
-		Msg_WriteShort(msg, ps->pm_state.delta_angles[1]);
-		Msg_WriteShort(msg, ps->pm_state.delta_angles[2]);
+		new_index++;
 	}
 
-	// send stats
-	stat_bits = 0;
+	to->num_entities = new_index;
 
-	for (i = 0; i < MAX_STATS; i++) {
-		if (ps->stats[i] != ops->stats[i]) {
-			stat_bits |= 1 << i;
-		}
-	}
+	Msg_WriteEntityNumber(msg, last_number, 0); // end of entities
 
-	Msg_WriteLong(msg, stat_bits);
-
-	for (i = 0; i < MAX_STATS; i++) {
-		if (stat_bits & (1 << i)) {
-			Msg_WriteShort(msg, ps->stats[i]);
-		}
-	}
+	__sync_fetch_and_add(&sv_delta_cache.frame.hits, counts.hits);
+	__sync_fetch_and_add(&sv_delta_cache.frame.misses, counts.misses);
+	__sync_fetch_and_add(&sv_delta_cache.frame.bits_encoded, counts.bits_encoded);
+	__sync_fetch_and_add(&sv_delta_cache.frame.bits_shared, counts.bits_shared);
 }
 
 /*
@@ -247,19 +418,73 @@ void Sv_WriteFrame(sv_client_t *client, size_buf_t *msg) {
 	Msg_WriteData(msg, frame->area_bits, frame->area_bytes);
 
 	// delta encode the playerstate
-	Sv_WritePlayerstate(old_frame, frame, msg);
+	Msg_WriteDeltaPlayerState(old_frame ? &old_frame->ps : NULL, &frame->ps, msg);
 
 	// delta encode the entities
-	Sv_EmitEntities(old_frame, frame, msg);
+	Sv_EmitEntities(client, old_frame, last_frame, frame, msg);
+}
+
+/*
+ * @brief Writes a delta update of one set of world entities to another, as for
+ * a client frame, but without culling or a budget. Both sets are ordered by
+ * entity number. This is used by multi-view demos, which hold every entity.
+ */
+void Sv_WriteWorldEntities(entity_state_t *from, uint16_t from_num_entities, entity_state_t *to,
+		uint16_t to_num_entities, size_buf_t *msg) {
+	uint16_t old_index = 0, new_index = 0;
+	uint16_t old_num, new_num;
+	uint16_t last_number = 0;
+	byte buffer[64];
+
+	while (new_index < to_num_entities || old_index < from_num_entities) {
+		entity_state_t *old_ent = &from[old_index], *new_ent = &to[new_index];
+
+		new_num = new_index < to_num_entities ? new_ent->number : 0xffff;
+		old_num = old_index < from_num_entities ? old_ent->number : 0xffff;
+
+		if (new_num > old_num) { // the old entity isn't present in the new set
+			Msg_WriteEntityNumber(msg, last_number, old_num);
+			Msg_WriteBits(msg, U_REMOVE, U_BITS);
+
+			last_number = old_num;
+			old_index++;
+			continue;
+		}
+
+		size_buf_t delta;
+		Sb_Init(&delta, buffer, sizeof(buffer));
+
+		if (new_num == old_num) { // delta update from old position
+			Msg_WriteDeltaEntity(old_ent, new_ent, &delta, false,
+					new_num <= sv_max_clients->integer);
+			old_index++;
+		} else { // this is a new entity, send it from the baseline
+			Msg_WriteDeltaEntity(&sv.baselines[new_num], new_ent, &delta, true, true);
+		}
+
+		new_index++;
+
+		if (delta.size) {
+			const uint32_t bits = delta.size * 8 - (delta.write_bit ? 8 - delta.write_bit : 0);
+
+			Msg_WriteEntityNumber(msg, last_number, new_num);
+			Sv_WriteBitData(msg, buffer, bits);
+
+			last_number = new_num;
+		}
+	}
+
+	Msg_WriteEntityNumber(msg, last_number, 0); // end of entities
 }
 
 /*
  * @brief Resolve the visibility data for the bounding box around the client. The
  * bounding box provides some leniency because the client's actual view origin
- * is likely slightly different than what we think it is.
+ * is likely slightly different than what we think it is. The returned row is
+ * local to the calling thread, as frames are built in parallel.
  */
 static byte *Sv_ClientPVS(const vec3_t org) {
-	static byte pvs[MAX_BSP_LEAFS >> 3];
+	static __thread byte pvs[MAX_BSP_LEAFS >> 3];
 	int32_t leafs[64];
 	int32_t i, j, count;
 	int32_t longs;
@@ -299,11 +524,273 @@ static byte *Sv_ClientPVS(const vec3_t org) {
 	return pvs;
 }
 
+/*
+ * The cluster index lists, for each cluster, the entities which touch it. It is
+ * built once per frame, so that each client's visible entities are gathered from
+ * the clusters in its PVS and PHS, rather than by testing every entity for every
+ * client. Entities with sounds or events are culled by the PHS, and are kept in
+ * a separate set of lists from those culled by the PVS.
+ */
+typedef struct {
+	byte occupied[MAX_BSP_LEAFS >> 3]; // clusters with at least one entity
+	uint16_t offsets[MAX_BSP_LEAFS]; // end of each cluster's run of entities
+	uint16_t entities[MAX_EDICTS * MAX_ENT_CLUSTERS];
+} sv_cluster_entities_t;
+
+typedef struct {
+	sv_cluster_entities_t pvs;
+	sv_cluster_entities_t phs;
+
+	uint16_t head_node_entities[MAX_EDICTS]; // entities which must be tested individually
+	uint16_t num_head_node_entities;
+
+	int32_t num_clusters;
+} sv_cluster_index_t;
+
+static sv_cluster_index_t sv_cluster_index;
+
+/*
+ * @return True if the entity should be considered for client frames at all.
+ */
+static _Bool Sv_IsClientEntity(const g_edict_t *ent) {
+
+	// ignore ents that are local to the server
+	if (ent->sv_flags & SVF_NO_CLIENT)
+		return false;
+
+	// ignore ents without visible models unless they have an effect
+	if (!ent->s.model1 && !ent->s.effects && !ent->s.sound && !ent->s.event)
+		return false;
+
+	return true;
+}
+
+/*
+ * @return The cluster lists by which the specified entity is culled.
+ */
+static sv_cluster_entities_t *Sv_ClusterEntities(const g_edict_t *ent) {
+	return ent->s.sound || ent->s.event ? &sv_cluster_index.phs : &sv_cluster_index.pvs;
+}
+
+/*
+ * @brief Builds the cluster index from the clusters resolved by Sv_LinkEdict.
+ * This must be called once per frame, before any client frames are built.
+ */
+void Sv_BuildClusterIndex(void) {
+	sv_cluster_index_t *index = &sv_cluster_index;
+	sv_cluster_entities_t *lists;
+	uint16_t pvs_offset, phs_offset;
+	uint32_t e;
+	int32_t i;
+
+	index->num_clusters = Cm_NumClusters();
+	index->num_head_node_entities = 0;
+
+	memset(index->pvs.occupied, 0, (index->num_clusters + 7) >> 3);
+	memset(index->pvs.offsets, 0, sizeof(uint16_t) * index->num_clusters);
+
+	memset(index->phs.occupied, 0, (index->num_clusters + 7) >> 3);
+	memset(index->phs.offsets, 0, sizeof(uint16_t) * index->num_clusters);
+
+	// count the entities in each cluster
+	for (e = 1; e < svs.game->num_edicts; e++) {
+		g_edict_t *ent = EDICT_FOR_NUM(e);
+
+		if (!Sv_IsClientEntity(ent))
+			continue;
+
+		// ensure entity numbers are valid before frames reference them
+		if (ent->s.number != e) {
+			Com_Warn("Fixing entity number: %d -> %d\n", ent->s.number, e);
+			ent->s.number = e;
+		}
+
+		if (ent->num_clusters == -1) { // too many leafs, go by head_node
+			index->head_node_entities[index->num_head_node_entities++] = e;
+			continue;
+		}
+
+		lists = Sv_ClusterEntities(ent);
+
+		for (i = 0; i < ent->num_clusters; i++) {
+			const int32_t c = ent->clusters[i];
+
+			lists->occupied[c >> 3] |= 1 << (c & 7);
+			lists->offsets[c]++;
+		}
+	}
+
+	// convert the counts to starting offsets
+	pvs_offset = phs_offset = 0;
+
+	for (i = 0; i < index->num_clusters; i++) {
+		uint16_t count;
+
+		count = index->pvs.offsets[i];
+		index->pvs.offsets[i] = pvs_offset;
+		pvs_offset += count;
+
+		count = index->phs.offsets[i];
+		index->phs.offsets[i] = phs_offset;
+		phs_offset += count;
+	}
+
+	// and populate the runs, leaving each offset at the end of its run
+	for (e = 1; e < svs.game->num_edicts; e++) {
+		const g_edict_t *ent = EDICT_FOR_NUM(e);
+
+		if (ent->num_clusters == -1 || !Sv_IsClientEntity(ent))
+			continue;
+
+		lists = Sv_ClusterEntities(ent);
+
+		for (i = 0; i < ent->num_clusters; i++) {
+			lists->entities[lists->offsets[ent->clusters[i]]++] = e;
+		}
+	}
+}
+
+/*
+ * @brief Marks the entities touching any cluster in the visibility row. Only
+ * clusters which are both visible and occupied are visited.
+ */
+static void Sv_MarkClusterEntities(const sv_cluster_entities_t *lists, const byte *vis,
+		uint32_t *visible) {
+	int32_t i, j;
+
+	const int32_t num_clusters = sv_cluster_index.num_clusters;
+
+	for (i = 0; i < num_clusters; i += 8) {
+		uint32_t bits = vis[i >> 3] & lists->occupied[i >> 3];
+
+		while (bits) {
+			const int32_t c = i + __builtin_ctz(bits);
+			bits &= bits - 1;
+
+			const int32_t end = lists->offsets[c];
+
+			for (j = c ? lists->offsets[c - 1] : 0; j < end; j++) {
+				const uint16_t e = lists->entities[j];
+				visible[e >> 5] |= 1u << (e & 31);
+			}
+		}
+	}
+}
+
+/*
+ * @brief Marks the entities potentially visible or audible to the client.
+ */
+static void Sv_MarkVisibleEntities(const byte *pvs, const byte *phs, uint32_t *visible) {
+	const sv_cluster_index_t *index = &sv_cluster_index;
+	int32_t i;
+
+	Sv_MarkClusterEntities(&index->pvs, pvs, visible);
+	Sv_MarkClusterEntities(&index->phs, phs, visible);
+
+	for (i = 0; i < index->num_head_node_entities; i++) {
+		const uint16_t e = index->head_node_entities[i];
+		const g_edict_t *ent = EDICT_FOR_NUM(e);
+
+		const byte *vis_data = ent->s.sound || ent->s.event ? phs : pvs;
+
+		if (Cm_HeadnodeVisible(ent->head_node, vis_data)) {
+			visible[e >> 5] |= 1u << (e & 31);
+		}
+	}
+}
+
+#define PRIORITY_DISTANCE 512.0 // entities this far away accrue half the priority of adjacent ones
+
+/*
+ * @brief Returns the priority the entity accrues for the client each frame,
+ * by its distance from the client's view and its relevance: other players and
+ * entities with events are favoured, as their updates are most noticeable.
+ */
+static vec_t Sv_EntityPriority(const g_edict_t *ent, const vec3_t org) {
+	vec3_t center, delta;
+
+	VectorAdd(ent->abs_mins, ent->abs_maxs, center);
+	VectorScale(center, 0.5, center);
+
+	VectorSubtract(center, org, delta);
+
+	vec_t priority = PRIORITY_DISTANCE / (PRIORITY_DISTANCE + VectorLength(delta));
+
+	if (ent->client)
+		priority *= 2.0;
+
+	if (ent->s.event)
+		priority *= 4.0;
+
+	return priority;
+}
+
+/*
+ * @brief Descending order of priority, for qsort.
+ */
+static int32_t Sv_ComparePriorities(const void *a, const void *b) {
+	const vec_t pa = *(const vec_t *) a, pb = *(const vec_t *) b;
+
+	return pa < pb ? 1 : pa > pb ? -1 : 0;
+}
+
+/*
+ * @brief Culls the entity list to the MAX_PACKET_ENTITIES with the most
+ * accumulated priority, always including the client's own entity. Culled
+ * entities keep accruing priority, so they are not starved. The order of the
+ * list is retained. Returns the number of entities kept.
+ */
+static uint16_t Sv_CullEntities(uint16_t *entities, const vec_t *priorities,
+		uint16_t num_entities, uint16_t client_num) {
+	vec_t sorted[MAX_EDICTS];
+	uint16_t i, j, num_sorted = 0;
+
+	for (i = 0; i < num_entities; i++) {
+		if (entities[i] != client_num)
+			sorted[num_sorted++] = priorities[i];
+	}
+
+	qsort(sorted, num_sorted, sizeof(vec_t), Sv_ComparePriorities);
+
+	const uint16_t slots = MAX_PACKET_ENTITIES - (num_sorted < num_entities ? 1 : 0);
+	const vec_t threshold = sorted[slots - 1];
+
+	// entities tied with the threshold fill whichever slots remain
+	uint16_t ties = slots;
+
+	for (i = 0; i < slots && sorted[i] > threshold; i++) {
+		ties--;
+	}
+
+	for (i = j = 0; i < num_entities; i++) {
+		const uint16_t e = entities[i];
+
+		if (e != client_num && priorities[i] <= threshold) {
+			if (priorities[i] < threshold || !ties)
+				continue;
+
+			ties--;
+		}
+
+		entities[j++] = e;
+	}
+
+	return j;
+}
+
 /*
  * @brief Decides which entities are going to be visible to the client, and
- * copies off the playerstat and area_bits.
+ * copies off the playerstat and area_bits. Each visible entity accrues
+ * priority for its next update, and only the most relevant are kept if there
+ * are more than a frame can hold. This is safe to call for several
+ * clients in parallel, as entity states are reserved atomically. The cluster
+ * index must be current; see Sv_BuildClusterIndex.
  */
 void Sv_BuildClientFrame(sv_client_t *client) {
+	uint32_t visible[MAX_EDICTS >> 5];
+	uint16_t entities[MAX_EDICTS];
+	vec_t priorities[MAX_EDICTS];
+	uint16_t num_entities;
 	uint32_t e;
 	vec3_t org;
 	g_edict_t *ent;
@@ -347,59 +834,85 @@ void Sv_BuildClientFrame(sv_client_t *client) {
 	vis = Sv_ClientPVS(org);
 	phs = Cm_ClusterPHS(cluster);
 
-	// build up the list of relevant entities
-	frame->num_entities = 0;
-	frame->first_entity = svs.next_entity_state;
+	// gather the entities touching visible clusters
+	memset(visible, 0, sizeof(visible));
 
-	for (e = 1; e < svs.game->num_edicts; e++) {
-		ent = EDICT_FOR_NUM(e);
+	Sv_MarkVisibleEntities(vis, phs, visible);
 
-		// ignore ents that are local to the server
-		if (ent->sv_flags & SVF_NO_CLIENT)
-			continue;
+	// we can always see ourselves
+	if (Sv_IsClientEntity(cent)) {
+		e = NUM_FOR_EDICT(cent);
+		visible[e >> 5] |= 1u << (e & 31);
+	}
 
-		// ignore ents without visible models unless they have an effect
-		if (!ent->s.model1 && !ent->s.effects && !ent->s.sound && !ent->s.event)
-			continue;
+	// build up the list of relevant entities, in order, if their areas are connected
+	num_entities = 0;
 
-		// ignore if not touching a PVS leaf
-		if (ent != cent) {
-			// check area
-			if (!Cm_AreasConnected(area, ent->area_num)) { // doors can occupy two areas, so
-				// we may need to check another one
-				if (!ent->area_num2 || !Cm_AreasConnected(area, ent->area_num2))
-					continue; // blocked by a door
-			}
+	for (i = 0; i < (MAX_EDICTS >> 5); i++) {
+		uint32_t bits = visible[i];
 
-			const byte *vis_data = ent->s.sound || ent->s.event ? phs : vis;
+		while (bits) {
+			e = (i << 5) + __builtin_ctz(bits);
+			bits &= bits - 1;
 
-			if (ent->num_clusters == -1) { // too many leafs for individual check, go by head_node
-				if (!Cm_HeadnodeVisible(ent->head_node, vis_data))
-					continue;
-			} else { // check individual leafs
-				for (i = 0; i < ent->num_clusters; i++) {
-					const int32_t c = ent->clusters[i];
-					if (vis_data[c >> 3] & (1 << (c & 7)))
-						break;
+			ent = EDICT_FOR_NUM(e);
+
+			if (ent != cent) {
+				if (!Cm_AreasConnected(area, ent->area_num)) { // doors can occupy two areas, so
+					// we may need to check another one
+					if (!ent->area_num2 || !Cm_AreasConnected(area, ent->area_num2))
+						continue; // blocked by a door
 				}
-				if (i == ent->num_clusters)
-					continue; // not visible
 			}
-		}
 
-		// add it to the circular entity_state_t array
-		state = &svs.entity_states[svs.next_entity_state % svs.num_entity_states];
-		if (ent->s.number != e) {
-			Com_Warn("Fixing entity number: %d -> %d\n", ent->s.number, e);
-			ent->s.number = e;
+			// accrue priority for the entity's next update
+			client->entity_priority[e] += Sv_EntityPriority(ent, org);
+			priorities[num_entities] = client->entity_priority[e];
+
+			entities[num_entities++] = e;
 		}
+	}
+
+	if (num_entities > MAX_PACKET_ENTITIES)
+		num_entities = Sv_CullEntities(entities, priorities, num_entities, NUM_FOR_EDICT(cent));
+
+	frame->num_entities = num_entities;
+
+	// reserve space in the circular entity_state_t array, and copy them in
+	frame->first_entity = __sync_fetch_and_add(&svs.next_entity_state, frame->num_entities);
+
+	for (i = 0; i < frame->num_entities; i++) {
+		ent = EDICT_FOR_NUM(entities[i]);
+
+		state = &svs.entity_states[(frame->first_entity + i) % svs.num_entity_states];
 		*state = ent->s;
 
 		// don't mark our own missiles as solid for prediction
 		if (ent->owner == client->edict)
 			state->solid = 0;
+	}
+}
+
+/*
+ * @brief Copies the state of every entity considered for client frames into
+ * the specified array, in order of entity number. Multi-view demos hold these,
+ * rather than the entities visible to any one client.
+ *
+ * @return The number of entities copied.
+ */
+uint16_t Sv_BuildWorldEntities(entity_state_t *states) {
+	uint16_t num_entities = 0;
+	uint32_t e;
 
-		svs.next_entity_state++;
-		frame->num_entities++;
+	for (e = 1; e < svs.game->num_edicts; e++) {
+		const g_edict_t *ent = EDICT_FOR_NUM(e);
+
+		if (!Sv_IsClientEntity(ent))
+			continue;
+
+		states[num_entities] = ent->s;
+		states[num_entities++].number = e;
 	}
+
+	return num_entities;
 }
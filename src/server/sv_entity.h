@@ -25,8 +25,14 @@
 #include "sv_types.h"
 
 #ifdef __SV_LOCAL_H__
+void Sv_ResetDeltaCache(void);
+void Sv_DeltaStats_f(void);
 void Sv_WriteFrame(sv_client_t *client, size_buf_t *msg);
+void Sv_BuildClusterIndex(void);
 void Sv_BuildClientFrame(sv_client_t *client);
+void Sv_WriteWorldEntities(entity_state_t *from, uint16_t from_num_entities, entity_state_t *to,
+		uint16_t to_num_entities, size_buf_t *msg);
+uint16_t Sv_BuildWorldEntities(entity_state_t *states);
 #endif /* __SV_LOCAL_H__ */
 
 #endif /* __SV_ENTITY_H__ */
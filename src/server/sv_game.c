@@ -235,8 +235,8 @@ void Sv_InitGame(void) {
 	import.Warn_ = Com_Warn_;
 	import.Error_ = Sv_GameError;
 
-	import.Malloc = Z_TagMalloc;
-	import.LinkMalloc = Z_LinkMalloc;
+	import.Malloc_ = Z_ModuleMalloc;
+	import.LinkMalloc_ = Z_ModuleLinkMalloc;
 	import.Free = Z_Free;
 	import.FreeTag = Z_FreeTag;
 
@@ -262,6 +262,7 @@ void Sv_InitGame(void) {
 	import.PositionedSound = Sv_PositionedSound;
 
 	import.Trace = Sv_Trace;
+	import.TraceBatch = Sv_TraceBatch;
 	import.PointContents = Sv_PointContents;
 	import.inPVS = Sv_InPVS;
 	import.inPHS = Sv_InPHS;
@@ -134,9 +134,19 @@ static void Sv_ClearState() {
 
 	if (svs.initialized) { // if we were intialized, cleanup
 
+		Sv_StopMultiView();
+
+		if (sv.demo_stream) {
+			Fs_CloseStream(sv.demo_stream);
+		}
+
 		if (sv.demo_file) {
 			Fs_Close(sv.demo_file);
 		}
+
+		if (sv.demo_keyframes) {
+			Z_Free(sv.demo_keyframes);
+		}
 	}
 
 	memset(&sv, 0, sizeof(sv));
@@ -172,11 +182,20 @@ static void Sv_ShutdownClients(void) {
 		if (cl->download.buffer) {
 			Fs_Free(cl->download.buffer);
 		}
+
+		Sv_ClearClientEvents(cl);
+	}
+
+	if (svs.event_buffer) {
+		Z_Free(svs.event_buffer);
+		svs.event_buffer = NULL;
 	}
 
 	Z_Free(svs.clients);
 	svs.clients = NULL;
 
+	memset(svs.client_hash, 0, sizeof(svs.client_hash));
+
 	Z_Free(svs.entity_states);
 	svs.entity_states = NULL;
 }
@@ -233,6 +252,165 @@ static void Sv_InitClients(void) {
 	}
 }
 
+/*
+ * @brief Closes the demo file, and aborts loading it with the specified error.
+ */
+static void Sv_DemoError(const char *fmt, ...) __attribute__((noreturn, format(printf, 1, 2)));
+static void Sv_DemoError(const char *fmt, ...) {
+	char msg[MAX_STRING_CHARS];
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, args);
+	va_end(args);
+
+	if (sv.demo_stream) {
+		Fs_CloseStream(sv.demo_stream);
+		sv.demo_stream = NULL;
+	}
+
+	Fs_Close(sv.demo_file);
+	sv.demo_file = NULL;
+
+	Com_Error(ERR_DROP, "%s", msg);
+}
+
+/*
+ * @return The protocol declared by the first message of the demo, or -1.
+ */
+static int32_t Sv_DemoProtocol(void) {
+	int32_t size, protocol;
+	byte cmd;
+
+	if (Fs_ReadStream(sv.demo_stream, &size, sizeof(size), 1) != 1)
+		return -1;
+
+	if ((LittleLong(size) & ~DEMO_KEYFRAME) < (int32_t) (sizeof(cmd) + sizeof(protocol)))
+		return -1;
+
+	if (Fs_ReadStream(sv.demo_stream, &cmd, sizeof(cmd), 1) != 1 || cmd != SV_CMD_SERVER_DATA)
+		return -1;
+
+	if (Fs_ReadStream(sv.demo_stream, &protocol, sizeof(protocol), 1) != 1)
+		return -1;
+
+	return LittleLong(protocol);
+}
+
+/*
+ * @brief Ensures that the demo was recorded with the current protocol, and
+ * rewinds it to its first message. Demos of protocol 1001 encode entities
+ * differently, and must first be upgraded with demo_index.
+ */
+static void Sv_CheckDemoProtocol(const int64_t offset) {
+
+	const int32_t protocol = Sv_DemoProtocol();
+
+	if (protocol == PROTOCOL_LEGACY) {
+		Sv_DemoError("Demo %s uses protocol %d, use demo_index to upgrade it\n", sv.name, protocol);
+	}
+
+	if (protocol != PROTOCOL) {
+		Sv_DemoError("Demo %s uses protocol %d, only protocol %d demos are supported\n", sv.name,
+				protocol, PROTOCOL);
+	}
+
+	if (!Fs_SeekStream(sv.demo_stream, offset)) {
+		Sv_DemoError("Failed to seek demo %s\n", sv.name);
+	}
+}
+
+/*
+ * @brief Opens the demo file, and loads its keyframe index, if any. Legacy demos
+ * have no header, and are read from the beginning. Legacy and version 1 demos
+ * play if they were recorded with the current protocol; older demos must first
+ * be upgraded with demo_index. The messages are read through a stream, which
+ * inflates them if the demo is compressed. Demos which can not be played abort
+ * the server with an error.
+ */
+static void Sv_LoadDemo(void) {
+	demo_header_t header;
+	demo_index_t index;
+
+	if (!(sv.demo_file = Fs_OpenRead(va("demos/%s.dem", sv.name))))
+		return;
+
+	memset(&header, 0, sizeof(header));
+
+	// version 1 headers end before the compression field
+	const size_t base = offsetof(demo_header_t, compression);
+
+	if (Fs_Read(sv.demo_file, &header, base, 1) != 1 || LittleLong(header.magic) != DEMO_MAGIC) {
+		Com_Debug("Legacy demo %s\n", sv.name);
+		Fs_Seek(sv.demo_file, 0);
+
+		sv.demo_stream = Fs_OpenStreamRead(sv.demo_file, false);
+
+		Sv_CheckDemoProtocol(0);
+		return;
+	}
+
+	const int32_t version = LittleLong(header.version);
+
+	if (version < 1 || version > DEMO_VERSION) {
+		Sv_DemoError("Unsupported demo version %d\n", version);
+	}
+
+	if (version > 1 && Fs_Read(sv.demo_file, &header.compression, sizeof(header.compression), 1)
+			!= 1) {
+		Sv_DemoError("Failed to read demo header\n");
+	}
+
+	const int32_t compression = LittleLong(header.compression);
+
+	if (compression != DEMO_COMPRESSION_NONE && compression != DEMO_COMPRESSION_DEFLATE) {
+		Sv_DemoError("Unsupported demo compression %d\n", compression);
+	}
+
+	const int64_t header_size = Fs_Tell(sv.demo_file);
+
+	sv.demo_stream = Fs_OpenStreamRead(sv.demo_file, compression == DEMO_COMPRESSION_DEFLATE);
+
+	Sv_CheckDemoProtocol(header_size);
+
+	const int64_t length = Fs_FileLength(sv.demo_file);
+
+	if (length < header_size + (int64_t) sizeof(index))
+		return;
+
+	Fs_Seek(sv.demo_file, length - sizeof(index));
+
+	if (Fs_Read(sv.demo_file, &index, sizeof(index), 1) == 1 && LittleLong(index.magic)
+			== DEMO_INDEX_MAGIC) {
+		const int32_t num_keyframes = LittleLong(index.num_keyframes);
+		const int64_t size = num_keyframes * sizeof(demo_keyframe_t);
+
+		if (num_keyframes > 0 && size <= length - header_size - (int64_t) sizeof(index)) {
+			uint32_t i;
+
+			sv.demo_keyframes = Z_Malloc(size);
+			Fs_Seek(sv.demo_file, length - sizeof(index) - size);
+
+			if (Fs_Read(sv.demo_file, sv.demo_keyframes, size, 1) == 1) {
+				sv.num_demo_keyframes = num_keyframes;
+				sv.demo_interval = LittleLong(header.interval) > 0 ? LittleLong(header.interval) : 1;
+
+				for (i = 0; i < sv.num_demo_keyframes; i++) {
+					sv.demo_keyframes[i].time = LittleLong(sv.demo_keyframes[i].time);
+					sv.demo_keyframes[i].offset = LittleLong(sv.demo_keyframes[i].offset);
+				}
+			} else {
+				Z_Free(sv.demo_keyframes);
+				sv.demo_keyframes = NULL;
+			}
+		}
+	} else {
+		Com_Warn("Demo %s is not indexed, it was likely not stopped\n", sv.name);
+	}
+
+	Fs_Seek(sv.demo_file, header_size);
+}
+
 /*
  * @brief Loads the map or demo file and populates the server-controlled "config
  * strings."  We hand off the entity string to the game module, which will
@@ -247,7 +425,7 @@ static void Sv_LoadMedia(const char *server, sv_state_t state) {
 	if (state == SV_ACTIVE_DEMO) { // loading a demo
 		sv.models[0] = Cm_LoadBsp(NULL, &map_size);
 
-		sv.demo_file = Fs_OpenRead(va("demos/%s.dem", sv.name));
+		Sv_LoadDemo();
 		svs.spawn_count = 0;
 
 		Com_Print("  Loaded demo %s.\n", sv.name);
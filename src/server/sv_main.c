@@ -30,6 +30,9 @@ g_edict_t *sv_player; // current client edict
 
 cvar_t *sv_rcon_password; // password for remote server commands
 
+cvar_t *sv_connectionless_rate;
+cvar_t *sv_demo_compress;
+cvar_t *sv_demo_keyframes;
 cvar_t *sv_download_url;
 cvar_t *sv_enforce_time;
 cvar_t *sv_hostname;
@@ -39,6 +42,64 @@ cvar_t *sv_public;
 cvar_t *sv_timeout;
 cvar_t *sv_udp_download;
 
+/*
+ * @return The svs.client_hash bucket for the specified address and qport. The
+ * port is not hashed, as it may be rewritten by address translating routers.
+ */
+static uint32_t Sv_ClientHash(const net_addr_t *addr, const byte qport) {
+	uint32_t hash = qport;
+
+	if (addr->type != NA_LOCAL) {
+		hash ^= (addr->ip[0] << 24) | (addr->ip[1] << 16) | (addr->ip[2] << 8) | addr->ip[3];
+	}
+
+	return (hash * 2654435761u) >> 16 & (CLIENT_HASH_SIZE - 1);
+}
+
+/*
+ * @brief Inserts the client into svs.client_hash by its netchan address.
+ */
+static void Sv_HashClient(sv_client_t *cl) {
+	const uint32_t hash = Sv_ClientHash(&cl->netchan.remote_address, cl->netchan.qport);
+
+	cl->hash_next = svs.client_hash[hash];
+	svs.client_hash[hash] = cl;
+}
+
+/*
+ * @brief Removes the client from svs.client_hash, if it is present.
+ */
+static void Sv_UnhashClient(sv_client_t *cl) {
+	const uint32_t hash = Sv_ClientHash(&cl->netchan.remote_address, cl->netchan.qport);
+	sv_client_t **c = &svs.client_hash[hash];
+
+	while (*c) {
+		if (*c == cl) {
+			*c = cl->hash_next;
+			break;
+		}
+		c = &(*c)->hash_next;
+	}
+
+	cl->hash_next = NULL;
+}
+
+/*
+ * @return The connected client with the specified address and qport, or NULL.
+ */
+static sv_client_t *Sv_FindClient(const net_addr_t *addr, const byte qport) {
+	sv_client_t *cl = svs.client_hash[Sv_ClientHash(addr, qport)];
+
+	while (cl) {
+		if (cl->netchan.qport == qport && Net_CompareClientNetaddr(*addr, cl->netchan.remote_address))
+			return cl;
+
+		cl = cl->hash_next;
+	}
+
+	return NULL;
+}
+
 /*
  * @brief Called when the player is totally leaving the server, either willingly
  * or unwillingly. This is NOT called if the entire server is quitting
@@ -61,6 +122,10 @@ void Sv_DropClient(sv_client_t *cl) {
 		Fs_Free(cl->download.buffer);
 	}
 
+	Sv_UnhashClient(cl);
+
+	Sv_ClearClientEvents(cl);
+
 	ent = cl->edict;
 
 	memset(cl, 0, sizeof(*cl));
@@ -321,10 +386,15 @@ static void Svc_Connect(void) {
 	// send the connect packet to the client
 	Netchan_OutOfBandPrint(NS_SERVER, addr, "client_connect %s", sv_download_url->string);
 
+	// a reconnecting client may have changed qport, so rehash it
+	if (client->state != SV_CLIENT_FREE)
+		Sv_UnhashClient(client);
+
 	Netchan_Setup(NS_SERVER, &client->netchan, addr, qport);
 
-	Sb_Init(&client->datagram, client->datagram_buf, sizeof(client->datagram_buf));
-	client->datagram.allow_overflow = true;
+	Sv_HashClient(client);
+
+	Sv_ClearClientEvents(client);
 
 	client->last_message = svs.real_time; // don't timeout
 
@@ -382,6 +452,36 @@ static void Svc_RemoteCommand(void) {
 	Com_EndRedirect();
 }
 
+/*
+ * @brief Connectionless packets are limited to sv_connectionless_rate per
+ * second from any one address, so that floods are shed before they are
+ * answered.
+ *
+ * @return True if the packet from the specified address should be dropped.
+ */
+static _Bool Sv_RateLimit(const net_addr_t *addr) {
+
+	if (addr->type == NA_LOCAL || sv_connectionless_rate->integer <= 0)
+		return false;
+
+	const uint32_t hash = ((addr->ip[0] << 24) | (addr->ip[1] << 16) | (addr->ip[2] << 8)
+			| addr->ip[3]) * 2654435761u;
+
+	sv_rate_limit_t *limit = &svs.rate_limits[(hash >> 16) & (MAX_RATE_LIMITS - 1)];
+
+	if (memcmp(limit->ip, addr->ip, sizeof(limit->ip)) || quake2world.time - limit->time >= 1000) {
+		memcpy(limit->ip, addr->ip, sizeof(limit->ip));
+		limit->time = quake2world.time;
+		limit->count = 0;
+	}
+
+	if (limit->count >= sv_connectionless_rate->integer || limit->count == UINT16_MAX)
+		return true;
+
+	limit->count++;
+	return false;
+}
+
 /*
  * @brief A connectionless packet has four leading 0xff bytes to distinguish it from
  * a game channel. Clients that are in the game can still send these, and they
@@ -397,6 +497,15 @@ static void Sv_ConnectionlessPacket(void) {
 	Cmd_TokenizeString(s);
 
 	const char *c = Cmd_Argv(0);
+
+	// authenticated rcon is exempt, so that a flood can not lock out administrators
+	const _Bool admin = !g_strcmp0(c, "rcon") && Sv_RconAuthenticate();
+
+	if (!admin && Sv_RateLimit(&net_from)) {
+		svs.connectionless_drops++;
+		return;
+	}
+
 	Com_Debug("Packet from %s: %s\n", Net_NetaddrToString(net_from), c);
 
 	if (!g_strcmp0(c, "ping"))
@@ -501,15 +610,19 @@ static void Sv_CheckCommandTimes(void) {
 }
 
 /*
- * @brief
+ * @brief Reads all pending packets, dispatching sequenced packets to their
+ * clients by address and qport.
  */
 static void Sv_ReadPackets(void) {
-	int32_t i;
 	sv_client_t * cl;
 	byte qport;
 
 	while (Net_GetPacket(NS_SERVER, &net_from, &net_message)) {
 
+		// drop runts, which can be neither connectionless nor sequenced
+		if (net_message.size < 4)
+			continue;
+
 		// check for connectionless packet (0xffffffff) first
 		if (*(uint32_t *) net_message.data == 0xffffffff) {
 			Sv_ConnectionlessPacket();
@@ -526,30 +639,22 @@ static void Sv_ReadPackets(void) {
 		qport = Msg_ReadByte(&net_message) & 0xff;
 
 		// check for packets from connected clients
-		for (i = 0, cl = svs.clients; i < sv_max_clients->integer; i++, cl++) {
-
-			if (cl->state == SV_CLIENT_FREE)
-				continue;
-
-			if (!Net_CompareClientNetaddr(net_from, cl->netchan.remote_address))
-				continue;
+		if (!(cl = Sv_FindClient(&net_from, qport)))
+			continue;
 
-			if (cl->netchan.qport != qport)
-				continue;
+		if (cl->netchan.remote_address.port != net_from.port) {
+			Com_Warn("Fixing up a translated port\n");
+			cl->netchan.remote_address.port = net_from.port;
+		}
 
-			if (cl->netchan.remote_address.port != net_from.port) {
-				Com_Warn("Fixing up a translated port\n");
-				cl->netchan.remote_address.port = net_from.port;
-			}
+		// this is a valid, sequenced packet, so process it
+		if (Netchan_Process(&cl->netchan, &net_message)) {
 
-			// this is a valid, sequenced packet, so process it
-			if (Netchan_Process(&cl->netchan, &net_message)) {
-				cl->last_message = svs.real_time; // nudge timeout
-				Sv_ParseClientMessage(cl);
-			}
+			// note when it actually arrived, which may have been mid-frame
+			const uint32_t age = Sys_Milliseconds() - net_packet_time;
+			cl->last_message = age < svs.real_time ? svs.real_time - age : 0; // nudge timeout
 
-			// we've processed the packet for the correct client, so break
-			break;
+			Sv_ParseClientMessage(cl);
 		}
 	}
 }
@@ -826,6 +931,9 @@ void Sv_Frame(uint32_t msec) {
 	// send messages back to the clients that had packets read this frame
 	Sv_SendClientMessages();
 
+	// record the frame for multi-view demos
+	Sv_WriteMultiViewFrame();
+
 	// send a heartbeat to the master if needed
 	Sv_HeartbeatMasters();
 
@@ -844,6 +952,14 @@ static void Sv_InitLocal(void) {
 
 	sv_rcon_password = Cvar_Get("rcon_password", "", 0, NULL);
 
+	sv_connectionless_rate = Cvar_Get("sv_connectionless_rate", va("%d", CONNECTIONLESS_RATE), 0,
+			"Connectionless packets accepted per address per second, or 0 for no limit");
+
+	sv_demo_compress = Cvar_Get("sv_demo_compress", "6", CVAR_ARCHIVE,
+			"The compression level of multi-view demos, 1 (fastest) to 9 (smallest), or 0 for none");
+	sv_demo_keyframes = Cvar_Get("sv_demo_keyframes", "10", CVAR_ARCHIVE,
+			"The interval, in seconds, between keyframes of multi-view demos");
+
 	sv_download_url = Cvar_Get("sv_download_url", "", CVAR_SERVER_INFO, NULL);
 	sv_enforce_time = Cvar_Get("sv_enforce_time", va("%d", CMD_MSEC_MAX_DRIFT_ERRORS), 0, NULL);
 
@@ -871,6 +987,8 @@ void Sv_Init(void) {
 
 	memset(&svs, 0, sizeof(svs));
 
+	Cm_Init();
+
 	Sv_InitLocal();
 
 	Sv_InitCommands();
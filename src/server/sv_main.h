@@ -31,6 +31,9 @@ void Sv_Frame(uint32_t msec);
 #ifdef __SV_LOCAL_H__
 // cvars
 extern cvar_t *sv_rcon_password;
+extern cvar_t *sv_connectionless_rate;
+extern cvar_t *sv_demo_compress;
+extern cvar_t *sv_demo_keyframes;
 extern cvar_t *sv_download_url;
 extern cvar_t *sv_enforce_time;
 extern cvar_t *sv_hostname;
@@ -105,6 +105,13 @@ void Sv_BroadcastPrint(int32_t level, const char *fmt, ...) {
 		Com_Print("%s", copy);
 	}
 
+	size_buf_t *mvd = Sv_MultiViewEvents();
+	if (mvd) {
+		Msg_WriteByte(mvd, SV_CMD_PRINT);
+		Msg_WriteByte(mvd, level);
+		Msg_WriteString(mvd, string);
+	}
+
 	for (i = 0, cl = svs.clients; i < sv_max_clients->integer; i++, cl++) {
 
 		if (level < cl->message_level)
@@ -137,6 +144,116 @@ void Sv_BroadcastCommand(const char *fmt, ...) {
 	Sv_Multicast(NULL, MULTICAST_ALL_R);
 }
 
+/*
+ * @brief Releases a reference to the specified event buffer. Buffers which
+ * have been rotated out are freed when their last reference is released.
+ */
+static void Sv_ReleaseEventBuffer(sv_event_buffer_t *buffer) {
+
+	if (--buffer->ref_count == 0 && buffer != svs.event_buffer) {
+		Z_Free(buffer);
+	}
+}
+
+/*
+ * @brief Rotates the current event buffer at the end of each frame. If no
+ * client refers to it, it is simply reused.
+ */
+static void Sv_RotateEventBuffer(void) {
+
+	if (svs.event_buffer) {
+		if (svs.event_buffer->ref_count)
+			svs.event_buffer = NULL;
+		else
+			svs.event_buffer->size = 0;
+	}
+}
+
+/*
+ * @brief Writes the contents of sv.multicast to the current event buffer,
+ * once, so that it may be referenced by any number of clients.
+ */
+static _Bool Sv_WriteEvent(sv_event_t *event) {
+
+	if (!sv.multicast.size)
+		return false;
+
+	if (svs.event_buffer && svs.event_buffer->size + sv.multicast.size > SV_EVENT_BUFFER_SIZE) {
+		Sv_RotateEventBuffer();
+	}
+
+	if (!svs.event_buffer) {
+		svs.event_buffer = Z_TagMalloc(sizeof(sv_event_buffer_t), Z_TAG_SERVER);
+	}
+
+	sv_event_buffer_t *buffer = svs.event_buffer;
+
+	event->buffer = buffer;
+	event->offset = buffer->size;
+	event->size = sv.multicast.size;
+
+	memcpy(buffer->data + buffer->size, sv.multicast.data, sv.multicast.size);
+	buffer->size += sv.multicast.size;
+
+	return true;
+}
+
+/*
+ * @brief Appends a reference to the specified event to the client's events.
+ */
+static void Sv_ClientEvent(sv_client_t *cl, const sv_event_t *event) {
+
+	if (cl->events_overflowed)
+		return;
+
+	if (cl->num_events == MAX_CLIENT_EVENTS || cl->events_size + event->size > MAX_MSG_SIZE) {
+		cl->events_overflowed = true;
+		return;
+	}
+
+	cl->events[cl->num_events++] = *event;
+	cl->events_size += event->size;
+
+	event->buffer->ref_count++;
+}
+
+/*
+ * @brief Releases all of the client's pending events.
+ */
+void Sv_ClearClientEvents(sv_client_t *cl) {
+	uint16_t i;
+
+	for (i = 0; i < cl->num_events; i++) {
+		Sv_ReleaseEventBuffer(cl->events[i].buffer);
+	}
+
+	cl->num_events = 0;
+	cl->events_size = 0;
+	cl->events_overflowed = false;
+}
+
+/*
+ * @brief Resolves the client's view cluster and area. These are used to
+ * filter every multicast in the frame, so they are resolved at most once.
+ */
+void Sv_ClientView(sv_client_t *cl) {
+
+	if (cl->view_frame == sv.frame_num + 1)
+		return;
+
+	const pm_state_t *pm = &cl->edict->client->ps.pm_state;
+	vec3_t org;
+
+	VectorAdd(pm->origin, pm->view_offset, org);
+	VectorScale(org, 0.125, org);
+
+	const int32_t leaf_num = Cm_PointLeafnum(org);
+
+	cl->view_cluster = Cm_LeafCluster(leaf_num);
+	cl->view_area = Cm_LeafArea(leaf_num);
+	cl->view_frame = sv.frame_num + 1;
+}
+
 /*
  * @brief Sends the contents of the mutlicast buffer to a single client
  */
@@ -155,15 +272,20 @@ void Sv_Unicast(const g_edict_t *ent, const _Bool reliable) {
 
 	if (reliable)
 		Sb_Write(&cl->netchan.message, sv.multicast.data, sv.multicast.size);
-	else
-		Sb_Write(&cl->datagram, sv.multicast.data, sv.multicast.size);
+	else {
+		sv_event_t event;
+
+		if (Sv_WriteEvent(&event))
+			Sv_ClientEvent(cl, &event);
+	}
 
 	Sb_Clear(&sv.multicast);
 }
 
 /*
  * @brief Sends the contents of sv.multicast to a subset of the clients,
- * then clears sv.multicast.
+ * then clears sv.multicast. Unreliable messages are written to the event
+ * buffer once, and referenced by each recipient.
  *
  * MULTICAST_ALL	same as broadcast (origin can be NULL)
  * MULTICAST_PVS	send to clients potentially visible from org
@@ -171,28 +293,21 @@ void Sv_Unicast(const g_edict_t *ent, const _Bool reliable) {
  */
 void Sv_Multicast(const vec3_t origin, multicast_t to) {
 	sv_client_t *client;
+	sv_event_t event;
 	byte *mask;
 	int32_t leaf_num, cluster;
 	int32_t j;
 	_Bool reliable;
-	int32_t area1, area2;
+	int32_t area;
 
 	reliable = false;
 
-	if (to != MULTICAST_ALL_R && to != MULTICAST_ALL) {
-		leaf_num = Cm_PointLeafnum(origin);
-		area1 = Cm_LeafArea(leaf_num);
-	} else {
-		leaf_num = 0; // just to avoid compiler warnings
-		area1 = 0;
-	}
-
 	switch (to) {
 	case MULTICAST_ALL_R:
 		reliable = true; // intentional fallthrough
 	case MULTICAST_ALL:
-		leaf_num = 0;
 		mask = NULL;
+		area = 0;
 		break;
 
 	case MULTICAST_PHS_R:
@@ -200,6 +315,7 @@ void Sv_Multicast(const vec3_t origin, multicast_t to) {
 	case MULTICAST_PHS:
 		leaf_num = Cm_PointLeafnum(origin);
 		cluster = Cm_LeafCluster(leaf_num);
+		area = Cm_LeafArea(leaf_num);
 		mask = Cm_ClusterPHS(cluster);
 		break;
 
@@ -208,6 +324,7 @@ void Sv_Multicast(const vec3_t origin, multicast_t to) {
 	case MULTICAST_PVS:
 		leaf_num = Cm_PointLeafnum(origin);
 		cluster = Cm_LeafCluster(leaf_num);
+		area = Cm_LeafArea(leaf_num);
 		mask = Cm_ClusterPVS(cluster);
 		break;
 
@@ -216,6 +333,16 @@ void Sv_Multicast(const vec3_t origin, multicast_t to) {
 		return;
 	}
 
+	// multi-view demos record every multicast, wherever it was heard
+	size_buf_t *mvd = Sv_MultiViewEvents();
+	if (mvd)
+		Sb_Write(mvd, sv.multicast.data, sv.multicast.size);
+
+	if (!reliable && !Sv_WriteEvent(&event)) {
+		Sb_Clear(&sv.multicast);
+		return;
+	}
+
 	// send the data to all relevent clients
 	for (j = 0, client = svs.clients; j < sv_max_clients->integer; j++, client++) {
 
@@ -229,26 +356,20 @@ void Sv_Multicast(const vec3_t origin, multicast_t to) {
 			continue;
 
 		if (mask) {
-			pm_state_t *pm = &client->edict->client->ps.pm_state;
-			vec3_t org;
-
-			VectorCopy(pm->origin, org);
-			VectorAdd(org, pm->view_offset, org);
-			VectorScale(org, 0.125, org);
+			Sv_ClientView(client);
 
-			leaf_num = Cm_PointLeafnum(org);
-			cluster = Cm_LeafCluster(leaf_num);
-			area2 = Cm_LeafArea(leaf_num);
-			if (!Cm_AreasConnected(area1, area2))
+			if (!Cm_AreasConnected(area, client->view_area))
 				continue;
-			if (mask && (!(mask[cluster >> 3] & (1 << (cluster & 7)))))
+
+			const int32_t c = client->view_cluster;
+			if (!(mask[c >> 3] & (1 << (c & 7))))
 				continue;
 		}
 
 		if (reliable)
 			Sb_Write(&client->netchan.message, sv.multicast.data, sv.multicast.size);
 		else
-			Sb_Write(&client->datagram, sv.multicast.data, sv.multicast.size);
+			Sv_ClientEvent(client, &event);
 	}
 
 	Sb_Clear(&sv.multicast);
@@ -325,42 +446,68 @@ void Sv_PositionedSound(const vec3_t origin, const g_edict_t *entity, const uint
  */
 
 /*
- * @brief
+ * @brief Builds and delta encodes the frame message for a range of clients.
+ * Clients are independent of one another, so this is run on the job pool.
  */
-static _Bool Sv_SendClientDatagram(sv_client_t *client) {
-	byte msg_buf[MAX_MSG_SIZE];
-	size_buf_t msg;
+static void Sv_BuildClientMessages(int32_t begin, int32_t end, void *data) {
+	int32_t i;
+
+	sv_client_t **clients = (sv_client_t **) data;
+
+	for (i = begin; i < end; i++) {
+		sv_client_t *client = clients[i];
 
-	Sv_BuildClientFrame(client);
+		const gint64 start = g_get_monotonic_time();
 
-	Sb_Init(&msg, msg_buf, sizeof(msg_buf));
-	msg.allow_overflow = true;
+		Sv_BuildClientFrame(client);
 
-	// send over all the relevant entity_state_t
-	// and the player_state_t
-	Sv_WriteFrame(client, &msg);
+		Sb_Init(&client->frame_message, client->frame_message_buf,
+				sizeof(client->frame_message_buf));
+		client->frame_message.allow_overflow = true;
 
-	// copy the accumulated multicast datagram
+		// send over all the relevant entity_state_t
+		// and the player_state_t
+		Sv_WriteFrame(client, &client->frame_message);
+
+		client->frame_build_time = g_get_monotonic_time() - start;
+	}
+}
+
+/*
+ * @brief Appends the client's multicast events to its frame message, and
+ * sends it.
+ */
+static _Bool Sv_SendClientDatagram(sv_client_t *client) {
+	size_buf_t *msg = &client->frame_message;
+	uint16_t i;
+
+	// copy the accumulated multicast events
 	// for this client out to the message
 	// it is necessary for this to be after the WriteEntities
 	// so that entity references will be current
-	if (client->datagram.overflowed)
+	if (client->events_overflowed)
 		Com_Warn("Datagram overflowed for %s\n", client->name);
-	else
-		Sb_Write(&msg, client->datagram.data, client->datagram.size);
-	Sb_Clear(&client->datagram);
+	else if (msg->size + client->events_size > msg->max_size)
+		Com_Warn("Dropped events for %s\n", client->name);
+	else {
+		for (i = 0; i < client->num_events; i++) {
+			const sv_event_t *e = &client->events[i];
+			Sb_Write(msg, e->buffer->data + e->offset, e->size);
+		}
+	}
+	Sv_ClearClientEvents(client);
 
-	if (msg.overflowed) { // must have room left for the packet header
+	if (msg->overflowed) { // must have room left for the packet header
 		Com_Warn("Message overflowed for %s\n", client->name);
 		Sv_DropClient(client);
 		return false;
 	}
 
 	// send the datagram
-	Netchan_Transmit(&client->netchan, msg.size, msg.data);
+	Netchan_Transmit(&client->netchan, msg->size, msg->data);
 
 	// record the size for rate estimation
-	client->message_size[sv.frame_num % CLIENT_RATE_MESSAGES] = msg.size;
+	client->message_size[sv.frame_num % CLIENT_RATE_MESSAGES] = msg->size;
 	return true;
 }
 
@@ -372,82 +519,189 @@ static void Sv_DemoCompleted(void) {
 }
 
 /*
- * @brief Returns true if the client is over its current
- * bandwidth estimation and should not be sent another packet
+ * @brief Returns the number of bytes available to the client's next frame
+ * message. A client over its current bandwidth estimation is still sent a
+ * frame of CLIENT_RATE_MIN_FRAME bytes. Entity updates which do not fit are
+ * deferred by Sv_WriteFrame, so that frames are thinned rather than dropped.
  */
-static _Bool Sv_RateDrop(sv_client_t *c) {
-	uint32_t total;
+static uint32_t Sv_FrameBudget(sv_client_t *c) {
+	uint32_t total, budget;
 	uint16_t i;
 
+	// at least one reliable fragment is sent ahead of the frame, if due
+	uint32_t reliable = 0;
+
+	if (Netchan_NeedReliable(&c->netchan))
+		reliable = NETCHAN_ACK_SIZE + NETCHAN_FRAGMENT_HEADER + NETCHAN_FRAGMENT_SIZE;
+
+	budget = MAX_MSG_SIZE - 8 - reliable;
+
 	// never drop over the loopback
 	if (c->netchan.remote_address.type == NA_LOCAL)
-		return false;
+		return budget;
+
+	const uint16_t current = sv.frame_num % CLIENT_RATE_MESSAGES;
 
 	total = 0;
 
 	for (i = 0; i < CLIENT_RATE_MESSAGES; i++) {
-		total += c->message_size[i];
+		if (i != current)
+			total += c->message_size[i];
 	}
 
-	if (total > c->rate) {
+	if (total + CLIENT_RATE_MIN_FRAME > c->rate) {
 		c->surpress_count++;
-		c->message_size[sv.frame_num % CLIENT_RATE_MESSAGES] = 0;
-		return true;
+		return CLIENT_RATE_MIN_FRAME < budget ? CLIENT_RATE_MIN_FRAME : budget;
 	}
 
-	return false;
+	return c->rate - total < budget ? c->rate - total : budget;
 }
 
 /*
  * @brief Reads the next frame from the current demo file into the specified buffer,
- * returning the size of the frame in bytes.
+ * returning the size of the frame in bytes. Keyframe messages are skipped,
+ * unless they follow a seek. Compressed demos are inflated as they are read.
  */
-static size_t Sv_GetDemoMessage(byte *buffer) {
+static size_t Sv_GetDemoMessage(byte *buffer, _Bool *keyframe) {
 	int32_t size;
-	size_t r;
+	int64_t r;
 
-	r = Fs_Read(sv.demo_file, &size, sizeof(size), 1);
-
-	if (r != 1) { // improperly terminated demo file
-		Com_Warn("Failed to read demo file\n");
+	if (!sv.demo_stream) { // missing or unsupported demo file
 		Sv_DemoCompleted();
 		return 0;
 	}
 
-	size = LittleLong(size);
+	while (true) {
+		r = Fs_ReadStream(sv.demo_stream, &size, sizeof(size), 1);
 
-	if (size == -1) { // properly terminated demo file
-		Sv_DemoCompleted();
-		return 0;
+		if (r != 1) { // improperly terminated demo file
+			Com_Warn("Failed to read demo file\n");
+			Sv_DemoCompleted();
+			return 0;
+		}
+
+		size = LittleLong(size);
+
+		if (size == -1) { // properly terminated demo file
+			Sv_DemoCompleted();
+			return 0;
+		}
+
+		*keyframe = (size & DEMO_KEYFRAME) ? true : false;
+		size &= ~DEMO_KEYFRAME;
+
+		if (size < 0 || size > MAX_NET_MESSAGE_SIZE) { // corrupt demo file
+			Com_Warn("Invalid message size %d\n", size);
+			Sv_DemoCompleted();
+			return 0;
+		}
+
+		if (size && Fs_ReadStream(sv.demo_stream, buffer, size, 1) != 1) {
+			Com_Warn("Incomplete or corrupt demo file\n");
+			Sv_DemoCompleted();
+			return 0;
+		}
+
+		if (*keyframe && !sv.demo_seek) // only needed when seeking
+			continue;
+
+		break;
 	}
 
-	if (size > MAX_MSG_SIZE) { // corrupt demo file
-		Com_Warn("%d > MAX_MSG_SIZE\n", size);
-		Sv_DemoCompleted();
-		return 0;
+	sv.demo_seek = *keyframe;
+
+	return size;
+}
+
+/*
+ * @brief Seeks the current demo to the last keyframe at or before the specified
+ * time, in milliseconds since its first frame. Keyframes are recorded at a
+ * fixed interval, so the keyframe is found directly from the time.
+ *
+ * @return The time of the keyframe, or -1 if the demo is not indexed.
+ */
+int32_t Sv_SeekDemo(int32_t time) {
+
+	if (sv.state != SV_ACTIVE_DEMO || !sv.num_demo_keyframes)
+		return -1;
+
+	const int32_t last = sv.num_demo_keyframes - 1;
+	int32_t i = Clamp(time / sv.demo_interval, 0, last);
+
+	// keyframes follow uncompressed frames, so they may drift from the interval
+	while (i > 0 && sv.demo_keyframes[i].time > time)
+		i--;
+
+	while (i < last && sv.demo_keyframes[i + 1].time <= time)
+		i++;
+
+	if (!Fs_SeekStream(sv.demo_stream, sv.demo_keyframes[i].offset)) {
+		Com_Warn("Failed to seek demo file\n");
+		return -1;
 	}
 
-	r = Fs_Read(sv.demo_file, buffer, size, 1);
+	sv.demo_seek = true;
+	sv.demo_pending = 0;
 
-	if (r != 1) {
-		Com_Warn("Incomplete or corrupt demo file\n");
-		Sv_DemoCompleted();
-		return 0;
+	return sv.demo_keyframes[i].time;
+}
+
+/*
+ * @brief Sends the next message of the demo to the client. Keyframes, and
+ * messages too large for a datagram, are sent reliably. They are held until
+ * the reliable stream has room for them, rather than overflowing it.
+ */
+static void Sv_SendDemoMessage(sv_client_t *c) {
+	static byte buffer[MAX_NET_MESSAGE_SIZE];
+	size_buf_t *reliable = &c->netchan.message;
+
+	if (!sv.demo_pending) {
+		_Bool keyframe;
+
+		const size_t size = Sv_GetDemoMessage(buffer, &keyframe);
+
+		if (!size)
+			return;
+
+		if (!keyframe && size <= MAX_MSG_SIZE - 16) {
+			Netchan_Transmit(&c->netchan, size, buffer);
+			return;
+		}
+
+		if (size > reliable->max_size) { // keyframes must not be lost, but this can't be sent
+			Com_Warn("Demo message of %zu bytes exceeds %zu\n", size, reliable->max_size);
+			return;
+		}
+
+		sv.demo_pending = size;
 	}
 
-	return size;
+	if (reliable->size + sv.demo_pending <= reliable->max_size) {
+		Sb_Write(reliable, buffer, sv.demo_pending);
+		sv.demo_pending = 0;
+	}
+
+	Netchan_Transmit(&c->netchan, 0, NULL);
 }
 
 /*
- * @brief
+ * @brief Sends a message to each connected client. Frames for active clients
+ * are built and encoded in parallel, and then transmitted together. All of the
+ * datagrams are queued, and flushed in as few system calls as possible.
  */
 void Sv_SendClientMessages(void) {
+	sv_client_t *clients[MAX_CLIENTS];
+	int32_t num_clients;
 	sv_client_t *c;
 	int32_t i;
 
 	if (!svs.initialized)
 		return;
 
+	Net_BeginBatch(NS_SERVER);
+
+	num_clients = 0;
+
 	// send a message to each connected client
 	for (i = 0, c = svs.clients; i < sv_max_clients->integer; i++, c++) {
 
@@ -456,28 +710,36 @@ void Sv_SendClientMessages(void) {
 
 		if (c->netchan.message.overflowed) { // drop the client
 			Sb_Clear(&c->netchan.message);
-			Sb_Clear(&c->datagram);
+			Sv_ClearClientEvents(c);
 			Sv_BroadcastPrint(PRINT_HIGH, "%s overflowed\n", c->name);
 			Sv_DropClient(c);
 		}
 
 		if (sv.state == SV_ACTIVE_DEMO) { // send the demo packet
-			byte buffer[MAX_MSG_SIZE];
-			size_t size;
-
-			if ((size = Sv_GetDemoMessage(buffer))) {
-				Netchan_Transmit(&c->netchan, size, buffer);
-			}
+			Sv_SendDemoMessage(c);
 		} else if (c->state == SV_CLIENT_ACTIVE) { // send the game packet
 
-			if (Sv_RateDrop(c)) // don't overrun bandwidth
-				continue;
+			c->frame_budget = Sv_FrameBudget(c);
 
-			Sv_SendClientDatagram(c);
+			clients[num_clients++] = c; // queue it for a frame
 		} else { // just update reliable if needed
-			if (c->netchan.message.size || quake2world.time - c->netchan.last_sent > 1000)
+			if (Netchan_NeedReliable(&c->netchan) || quake2world.time - c->netchan.last_sent > 1000)
 				Netchan_Transmit(&c->netchan, 0, NULL);
 		}
 	}
-}
 
+	if (num_clients) {
+		Sv_BuildClusterIndex();
+		Sv_ResetDeltaCache();
+
+		Thread_ParallelFor(num_clients, 1, Sv_BuildClientMessages, clients);
+
+		for (i = 0; i < num_clients; i++) {
+			Sv_SendClientDatagram(clients[i]);
+		}
+	}
+
+	Net_FlushBatch(NS_SERVER);
+
+	Sv_RotateEventBuffer();
+}
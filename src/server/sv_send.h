@@ -35,9 +35,12 @@ typedef enum {
 extern char sv_outputbuf[SV_OUTPUTBUF_LENGTH];
 
 void Sv_FlushRedirect(const int32_t target, char *outputbuf);
+void Sv_ClientView(sv_client_t *cl);
+int32_t Sv_SeekDemo(int32_t time);
 void Sv_SendClientMessages(void);
 void Sv_Unicast(const g_edict_t *ent, const _Bool reliable);
 void Sv_Multicast(const vec3_t origin, multicast_t to);
+void Sv_ClearClientEvents(sv_client_t *cl);
 void Sv_PositionedSound(const vec3_t origin, const g_edict_t *entity, const uint16_t index, const uint16_t atten);
 void Sv_ClientPrint(const g_edict_t *ent, const int32_t level, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
 void Sv_BroadcastPrint(const int32_t level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
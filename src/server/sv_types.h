@@ -50,6 +50,12 @@ typedef struct sv_server_s {
 
 	// demo server information
 	file_t *demo_file;
+	fs_stream_t *demo_stream; // the messages of the demo, inflated if compressed
+	int32_t demo_interval; // milliseconds between keyframes, if indexed
+	demo_keyframe_t *demo_keyframes;
+	uint32_t num_demo_keyframes;
+	_Bool demo_seek; // send keyframe messages until the next frame
+	size_t demo_pending; // a reliable message held until the client has room for it
 } sv_server_t;
 
 typedef enum {
@@ -69,6 +75,7 @@ typedef struct sv_frame_s {
 
 #define CLIENT_LATENCY_COUNTS 16  // frame latency, averaged to determine ping
 #define CLIENT_RATE_MESSAGES 10  // message size, used to enforce rate throttle
+#define CLIENT_RATE_MIN_FRAME 128 // frame message size for clients over their rate
 /*
  * We check users movement command duration every so often to ensure that
  * they are not cheating. If their movement is too far out of sync with the
@@ -79,6 +86,27 @@ typedef struct sv_frame_s {
 #define CMD_MSEC_ALLOWABLE_DRIFT  CMD_MSEC_CHECK_INTERVAL + 150
 #define CMD_MSEC_MAX_DRIFT_ERRORS  10
 
+/*
+ * Unreliable multicasts are written once to a shared event buffer, and each
+ * recipient holds a reference to its slice of that buffer. Buffers are
+ * rotated every frame, and freed when their last reference is released.
+ */
+#define SV_EVENT_BUFFER_SIZE 0x8000
+
+typedef struct sv_event_buffer_s {
+	byte data[SV_EVENT_BUFFER_SIZE];
+	size_t size;
+	uint32_t ref_count; // client events referring to this buffer
+} sv_event_buffer_t;
+
+typedef struct sv_event_s {
+	sv_event_buffer_t *buffer;
+	uint16_t offset;
+	uint16_t size;
+} sv_event_t;
+
+#define MAX_CLIENT_EVENTS 256
+
 typedef struct sv_download_s {
 	byte *buffer;
 	int32_t size;
@@ -100,23 +128,43 @@ typedef struct sv_client_s {
 
 	uint32_t message_size[CLIENT_RATE_MESSAGES]; // used to rate drop packets
 	uint32_t rate;
-	uint32_t surpress_count; // number of messages rate suppressed
+	uint32_t surpress_count; // number of messages thinned to the minimum under rate
+	uint32_t frame_budget; // bytes available to the next frame message
+
+	// entities accumulate priority every frame until an update is sent, so
+	// that entities deferred under rate or culled from frames are eventually sent
+	vec_t entity_priority[MAX_EDICTS];
 
 	g_edict_t *edict; // EDICT_FOR_NUM(client_num + 1)
 	char name[32]; // extracted from user_info, high bits masked
 	int32_t message_level; // for filtering printed messages
 
-	// the datagram is written to by sound calls, prints, temp ents, etc.
-	// it can be overflowed without consequence.
-	size_buf_t datagram;
-	byte datagram_buf[MAX_MSG_SIZE];
+	// the events are written to by sound calls, prints, temp ents, etc.
+	// they can be overflowed without consequence.
+	sv_event_t events[MAX_CLIENT_EVENTS];
+	uint16_t num_events;
+	uint32_t events_size; // total size of the referenced slices
+	_Bool events_overflowed;
+
+	// the view cluster and area are resolved at most once per frame
+	uint32_t view_frame; // sv.frame_num + 1 when resolved, so that zero is stale
+	int32_t view_cluster;
+	int32_t view_area;
 
 	sv_frame_t frames[UPDATE_BACKUP]; // updates can be delta'd from here
 
+	// the frame message is built in parallel with those of other clients,
+	// and then transmitted at the end of Sv_SendClientMessages
+	size_buf_t frame_message;
+	byte frame_message_buf[MAX_MSG_SIZE];
+	uint32_t frame_build_time; // microseconds to build and encode the last frame
+
 	sv_download_t download; // UDP file downloads
 
 	uint32_t last_message; // svs.real_time when packet was last received
 	net_chan_t netchan;
+
+	struct sv_client_s *hash_next; // next client in svs.client_hash bucket
 } sv_client_t;
 
 // the server runs fixed-interval frames at a configurable rate (Hz)
@@ -140,6 +188,19 @@ typedef struct sv_challenge_s {
 // could cycle all of them out before legitimate users connected.
 #define MAX_CHALLENGES 1024
 
+// connected clients are hashed by address and qport for packet dispatch
+#define CLIENT_HASH_SIZE (MAX_CLIENTS * 2)
+
+// connectionless packets are rate limited per address
+typedef struct {
+	byte ip[4];
+	uint32_t time; // quake2world.time at the start of the current period
+	uint16_t count; // packets received in the current period
+} sv_rate_limit_t;
+
+#define MAX_RATE_LIMITS 1024
+#define CONNECTIONLESS_RATE 10 // default packets per address per second
+
 typedef struct sv_static_s {
 	_Bool initialized; // sv_init has completed
 	uint32_t real_time; // always increasing, no clamping, etc
@@ -149,6 +210,7 @@ typedef struct sv_static_s {
 	uint16_t frame_rate; // configurable server frame rate
 
 	sv_client_t *clients; // server-side client structures
+	sv_client_t *client_hash[CLIENT_HASH_SIZE]; // connected clients by address and qport
 
 	// the server maintains an array of entity states it uses to calculate
 	// delta compression from frame to frame
@@ -164,6 +226,10 @@ typedef struct sv_static_s {
 	uint32_t next_heartbeat;
 
 	sv_challenge_t challenges[MAX_CHALLENGES]; // to prevent invalid IPs from connecting
+	sv_rate_limit_t rate_limits[MAX_RATE_LIMITS]; // to shed connectionless floods
+	uint32_t connectionless_drops; // packets shed by the rate limit
+
+	sv_event_buffer_t *event_buffer; // the current frame's multicast events
 
 	g_export_t *game;
 } sv_static_t;
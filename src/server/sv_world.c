@@ -24,35 +24,47 @@
 /*
  * ENTITY AREA CHECKING
  *
- * Note that this use of "area" is different from the BSP file use.
+ * Note that this use of "area" is different from the BSP file use. Linked
+ * edicts are held in dynamic bounding volume trees, one for solids and one
+ * for triggers. Each edict is a leaf whose bounds are enlarged slightly, and
+ * in the direction it is moving, so that most calls to Sv_LinkEdict leave
+ * the tree untouched. Leafs are otherwise removed and reinserted, and the
+ * tree is rebalanced with rotations as it changes.
  */
 
-#define	STRUCT_FROM_LINK(l, t ,m) ((t *)((byte *)l - (ptrdiff_t)&(((t *)0)->m)))
-#define EDICT_FROM_AREA(l) STRUCT_FROM_LINK(l, g_edict_t, area)
+#define AREA_NODES (MAX_EDICTS * 2)
+#define AREA_MARGIN 4.0 // leaf bounds are enlarged by this much on all sides
+#define AREA_PREDICT 2.0 // and by this many multiples of their last move
+#define AREA_PREDICT_MAX 128.0 // but not for teleports and respawns
+#define AREA_STACK 64
 
 typedef struct sv_area_node_s {
-	int32_t axis; // -1 = leaf node
-	vec_t dist;
-	struct sv_area_node_s *children[2];
-	link_t trigger_edicts;
-	link_t solid_edicts;
+	vec3_t mins, maxs;
+	int32_t parent; // or the next free node
+	int32_t children[2]; // -1 for leafs
+	int32_t height; // 0 for leafs
+	g_edict_t *ent; // NULL for interior nodes
 } sv_area_node_t;
 
-#define AREA_DEPTH	4
-#define AREA_NODES	32
+typedef struct sv_area_tree_s {
+	sv_area_node_t nodes[AREA_NODES];
+	int32_t root;
+	int32_t free_node;
+	link_t edicts; // all edicts linked into this tree
+} sv_area_tree_t;
+
+// the tree and leaf node for each linked edict
+typedef struct sv_area_leaf_s {
+	sv_area_tree_t *tree;
+	int32_t node;
+} sv_area_leaf_t;
 
 // the server's view of the world, by areas
 typedef struct sv_world_s {
+	sv_area_tree_t solid_edicts;
+	sv_area_tree_t trigger_edicts;
 
-	sv_area_node_t area_nodes[AREA_NODES];
-	int32_t num_area_nodes;
-
-	const vec_t *area_mins, *area_maxs;
-
-	g_edict_t **area_edicts;
-
-	int32_t num_area_edicts, max_area_edicts;
-	int32_t area_type;
+	sv_area_leaf_t leafs[MAX_EDICTS];
 } sv_world_t;
 
 sv_world_t sv_world;
@@ -83,54 +95,301 @@ static void Sv_InsertLink(link_t *l, link_t *before) {
 }
 
 /*
- * @brief Builds a uniformly subdivided tree for the given world size.
+ * @brief Sets the bounds of the specified node to enclose both children.
+ */
+static void Sv_UnionAreaBounds(sv_area_node_t *node, const sv_area_node_t *a, const sv_area_node_t *b) {
+	int32_t i;
+
+	for (i = 0; i < 3; i++) {
+		node->mins[i] = a->mins[i] < b->mins[i] ? a->mins[i] : b->mins[i];
+		node->maxs[i] = a->maxs[i] > b->maxs[i] ? a->maxs[i] : b->maxs[i];
+	}
+}
+
+/*
+ * @return The surface area of the box enclosing both nodes, which is the
+ * cost metric for insertion.
+ */
+static vec_t Sv_UnionAreaCost(const sv_area_node_t *a, const sv_area_node_t *b) {
+	sv_area_node_t node;
+
+	Sv_UnionAreaBounds(&node, a, b);
+
+	const vec_t x = node.maxs[0] - node.mins[0];
+	const vec_t y = node.maxs[1] - node.mins[1];
+	const vec_t z = node.maxs[2] - node.mins[2];
+
+	return 2.0 * (x * y + y * z + z * x);
+}
+
+/*
+ * @brief Recalculates the bounds and height of the specified interior node.
+ */
+static void Sv_UpdateAreaNode(sv_area_tree_t *tree, sv_area_node_t *node) {
+
+	const sv_area_node_t *a = &tree->nodes[node->children[0]];
+	const sv_area_node_t *b = &tree->nodes[node->children[1]];
+
+	Sv_UnionAreaBounds(node, a, b);
+	node->height = 1 + (a->height > b->height ? a->height : b->height);
+}
+
+/*
+ * @brief
+ */
+static int32_t Sv_AllocAreaNode(sv_area_tree_t *tree) {
+
+	const int32_t n = tree->free_node;
+
+	if (n == -1) {
+		Com_Error(ERR_DROP, "AREA_NODES\n");
+	}
+
+	sv_area_node_t *node = &tree->nodes[n];
+	tree->free_node = node->parent;
+
+	memset(node, 0, sizeof(*node));
+
+	node->parent = -1;
+	node->children[0] = node->children[1] = -1;
+
+	return n;
+}
+
+/*
+ * @brief
+ */
+static void Sv_FreeAreaNode(sv_area_tree_t *tree, int32_t n) {
+
+	tree->nodes[n].parent = tree->free_node;
+	tree->free_node = n;
+}
+
+/*
+ * @brief Replaces the child of the specified parent, or the root.
+ */
+static void Sv_ReplaceAreaChild(sv_area_tree_t *tree, int32_t parent, int32_t old_child, int32_t new_child) {
+
+	if (parent == -1) {
+		tree->root = new_child;
+	} else if (tree->nodes[parent].children[0] == old_child) {
+		tree->nodes[parent].children[0] = new_child;
+	} else {
+		tree->nodes[parent].children[1] = new_child;
+	}
+}
+
+/*
+ * @brief Performs a left or right rotation if node a is imbalanced.
+ *
+ * @return The index of the node which now occupies a's position.
+ */
+static int32_t Sv_BalanceAreaNode(sv_area_tree_t *tree, int32_t a) {
+	sv_area_node_t *A = &tree->nodes[a];
+
+	if (A->height < 2)
+		return a;
+
+	const int32_t b = A->children[0];
+	const int32_t c = A->children[1];
+
+	sv_area_node_t *B = &tree->nodes[b];
+	sv_area_node_t *C = &tree->nodes[c];
+
+	const int32_t balance = C->height - B->height;
+
+	if (balance > 1) { // rotate C up
+		const int32_t f = C->children[0];
+		const int32_t g = C->children[1];
+
+		sv_area_node_t *F = &tree->nodes[f];
+		sv_area_node_t *G = &tree->nodes[g];
+
+		C->children[0] = a;
+		C->parent = A->parent;
+		A->parent = c;
+
+		Sv_ReplaceAreaChild(tree, C->parent, a, c);
+
+		if (F->height > G->height) {
+			C->children[1] = f;
+			A->children[1] = g;
+			G->parent = a;
+		} else {
+			C->children[1] = g;
+			A->children[1] = f;
+			F->parent = a;
+		}
+
+		Sv_UpdateAreaNode(tree, A);
+		Sv_UpdateAreaNode(tree, C);
+
+		return c;
+	}
+
+	if (balance < -1) { // rotate B up
+		const int32_t d = B->children[0];
+		const int32_t e = B->children[1];
+
+		sv_area_node_t *D = &tree->nodes[d];
+		sv_area_node_t *E = &tree->nodes[e];
+
+		B->children[0] = a;
+		B->parent = A->parent;
+		A->parent = b;
+
+		Sv_ReplaceAreaChild(tree, B->parent, a, b);
+
+		if (D->height > E->height) {
+			B->children[1] = d;
+			A->children[0] = e;
+			E->parent = a;
+		} else {
+			B->children[1] = e;
+			A->children[0] = d;
+			D->parent = a;
+		}
+
+		Sv_UpdateAreaNode(tree, A);
+		Sv_UpdateAreaNode(tree, B);
+
+		return b;
+	}
+
+	return a;
+}
+
+/*
+ * @brief Walks from the specified node to the root, rebalancing and refitting.
  */
-static sv_area_node_t *Sv_CreateAreaNode(int32_t depth, vec3_t mins, vec3_t maxs) {
-	sv_area_node_t *anode;
-	vec3_t size;
-	vec3_t mins1, maxs1, mins2, maxs2;
+static void Sv_RefitAreaNodes(sv_area_tree_t *tree, int32_t n) {
+
+	while (n != -1) {
+		n = Sv_BalanceAreaNode(tree, n);
+
+		Sv_UpdateAreaNode(tree, &tree->nodes[n]);
+
+		n = tree->nodes[n].parent;
+	}
+}
+
+/*
+ * @brief Inserts the specified leaf, pairing it with the sibling which
+ * minimizes the growth in surface area of the tree.
+ */
+static void Sv_InsertAreaLeaf(sv_area_tree_t *tree, int32_t leaf) {
+	sv_area_node_t *l = &tree->nodes[leaf];
+
+	if (tree->root == -1) {
+		tree->root = leaf;
+		l->parent = -1;
+		return;
+	}
+
+	int32_t n = tree->root;
+
+	while (tree->nodes[n].children[0] != -1) {
+		const sv_area_node_t *node = &tree->nodes[n];
+
+		const vec_t area = Sv_UnionAreaCost(node, node);
+		const vec_t combined = Sv_UnionAreaCost(node, l);
+
+		// the cost of pairing the leaf with this node
+		const vec_t cost = 2.0 * combined;
+
+		// the minimum cost of pushing the leaf further down the tree
+		const vec_t inheritance = 2.0 * (combined - area);
+
+		vec_t child_cost[2];
+		int32_t i;
+
+		for (i = 0; i < 2; i++) {
+			const sv_area_node_t *child = &tree->nodes[node->children[i]];
+
+			child_cost[i] = Sv_UnionAreaCost(child, l) + inheritance;
+
+			if (child->children[0] != -1) {
+				child_cost[i] -= Sv_UnionAreaCost(child, child);
+			}
+		}
+
+		if (cost < child_cost[0] && cost < child_cost[1])
+			break;
 
-	anode = &sv_world.area_nodes[sv_world.num_area_nodes];
-	sv_world.num_area_nodes++;
+		n = node->children[child_cost[0] < child_cost[1] ? 0 : 1];
+	}
+
+	// create a new parent for the leaf and its sibling
+	const int32_t sibling = n;
+	const int32_t old_parent = tree->nodes[sibling].parent;
+	const int32_t new_parent = Sv_AllocAreaNode(tree);
+
+	sv_area_node_t *p = &tree->nodes[new_parent];
+
+	p->parent = old_parent;
+	p->children[0] = sibling;
+	p->children[1] = leaf;
 
-	Sv_ClearLink(&anode->trigger_edicts);
-	Sv_ClearLink(&anode->solid_edicts);
+	tree->nodes[sibling].parent = new_parent;
+	tree->nodes[leaf].parent = new_parent;
 
-	if (depth == AREA_DEPTH) {
-		anode->axis = -1;
-		anode->children[0] = anode->children[1] = NULL;
-		return anode;
+	Sv_ReplaceAreaChild(tree, old_parent, sibling, new_parent);
+
+	Sv_RefitAreaNodes(tree, new_parent);
+}
+
+/*
+ * @brief Removes the specified leaf, replacing its parent with its sibling.
+ */
+static void Sv_RemoveAreaLeaf(sv_area_tree_t *tree, int32_t leaf) {
+
+	if (leaf == tree->root) {
+		tree->root = -1;
+		return;
 	}
 
-	VectorSubtract(maxs, mins, size);
-	if (size[0] > size[1])
-		anode->axis = 0;
-	else
-		anode->axis = 1;
+	const int32_t parent = tree->nodes[leaf].parent;
+	const int32_t grandparent = tree->nodes[parent].parent;
 
-	anode->dist = 0.5 * (maxs[anode->axis] + mins[anode->axis]);
-	VectorCopy(mins, mins1);
-	VectorCopy(mins, mins2);
-	VectorCopy(maxs, maxs1);
-	VectorCopy(maxs, maxs2);
+	const sv_area_node_t *p = &tree->nodes[parent];
+	const int32_t sibling = p->children[0] == leaf ? p->children[1] : p->children[0];
 
-	maxs1[anode->axis] = mins2[anode->axis] = anode->dist;
+	Sv_ReplaceAreaChild(tree, grandparent, parent, sibling);
+	tree->nodes[sibling].parent = grandparent;
 
-	anode->children[0] = Sv_CreateAreaNode(depth + 1, mins2, maxs2);
-	anode->children[1] = Sv_CreateAreaNode(depth + 1, mins1, maxs1);
+	Sv_FreeAreaNode(tree, parent);
 
-	return anode;
+	Sv_RefitAreaNodes(tree, grandparent);
 }
 
 /*
- * @brief Resolve our area nodes for a newly loaded level. This is called prior to
- * linking any entities.
+ * @brief Initializes the specified tree to empty.
+ */
+static void Sv_InitAreaTree(sv_area_tree_t *tree) {
+	int32_t i;
+
+	for (i = 0; i < AREA_NODES - 1; i++) {
+		tree->nodes[i].parent = i + 1;
+	}
+
+	tree->nodes[AREA_NODES - 1].parent = -1;
+
+	tree->free_node = 0;
+	tree->root = -1;
+
+	Sv_ClearLink(&tree->edicts);
+}
+
+/*
+ * @brief Resolve our area trees for a newly loaded level. This is called
+ * prior to linking any entities.
  */
 void Sv_InitWorld(void) {
 
 	memset(&sv_world, 0, sizeof(sv_world));
 
-	Sv_CreateAreaNode(0, sv.models[0]->mins, sv.models[0]->maxs);
+	Sv_InitAreaTree(&sv_world.solid_edicts);
+	Sv_InitAreaTree(&sv_world.trigger_edicts);
 }
 
 /*
@@ -142,10 +401,71 @@ void Sv_UnlinkEdict(g_edict_t *ent) {
 	if (!ent->area.prev)
 		return; // not linked in anywhere
 
+	const sv_area_leaf_t *leaf = &sv_world.leafs[NUM_FOR_EDICT(ent)];
+
+	Sv_RemoveAreaLeaf(leaf->tree, leaf->node);
+	Sv_FreeAreaNode(leaf->tree, leaf->node);
+
 	Sv_RemoveLink(&ent->area);
 	ent->area.prev = ent->area.next = NULL;
 }
 
+/*
+ * @brief Links the entity into the area tree for its solidity. If it is
+ * already linked, and still fits within its enlarged bounds, nothing is done.
+ */
+static void Sv_LinkAreaLeaf(g_edict_t *ent, const vec3_t old_abs_mins) {
+	vec3_t move;
+	int32_t i;
+
+	sv_area_tree_t *tree = ent->solid == SOLID_TRIGGER ? &sv_world.trigger_edicts
+			: &sv_world.solid_edicts;
+
+	sv_area_leaf_t *leaf = &sv_world.leafs[NUM_FOR_EDICT(ent)];
+
+	if (ent->area.prev && leaf->tree == tree) {
+		const sv_area_node_t *node = &tree->nodes[leaf->node];
+
+		for (i = 0; i < 3; i++) {
+			if (ent->abs_mins[i] < node->mins[i] || ent->abs_maxs[i] > node->maxs[i])
+				break;
+		}
+
+		if (i == 3)
+			return; // still within its enlarged bounds
+
+		Sv_RemoveAreaLeaf(tree, leaf->node);
+
+		VectorSubtract(ent->abs_mins, old_abs_mins, move);
+	} else {
+		Sv_UnlinkEdict(ent);
+
+		leaf->tree = tree;
+		leaf->node = Sv_AllocAreaNode(tree);
+
+		tree->nodes[leaf->node].ent = ent;
+		Sv_InsertLink(&ent->area, &tree->edicts);
+
+		VectorClear(move);
+	}
+
+	sv_area_node_t *node = &tree->nodes[leaf->node];
+
+	for (i = 0; i < 3; i++) {
+		node->mins[i] = ent->abs_mins[i] - AREA_MARGIN;
+		node->maxs[i] = ent->abs_maxs[i] + AREA_MARGIN;
+
+		if (fabsf(move[i]) < AREA_PREDICT_MAX) { // anticipate continued movement
+			if (move[i] < 0.0)
+				node->mins[i] += move[i] * AREA_PREDICT;
+			else
+				node->maxs[i] += move[i] * AREA_PREDICT;
+		}
+	}
+
+	Sv_InsertAreaLeaf(tree, leaf->node);
+}
+
 #define MAX_TOTAL_ENT_LEAFS 128
 
 /*
@@ -153,7 +473,7 @@ void Sv_UnlinkEdict(g_edict_t *ent) {
  * the clipping hull.
  */
 void Sv_LinkEdict(g_edict_t *ent) {
-	sv_area_node_t *node;
+	vec3_t old_abs_mins;
 	int32_t leafs[MAX_TOTAL_ENT_LEAFS];
 	int32_t clusters[MAX_TOTAL_ENT_LEAFS];
 	int32_t num_leafs;
@@ -164,11 +484,12 @@ void Sv_LinkEdict(g_edict_t *ent) {
 	if (ent == svs.game->edicts) // never bother with the world
 		return;
 
-	if (ent->area.prev) // unlink from its previous area
+	if (!ent->in_use) { // if its free, unlink it and we're done
 		Sv_UnlinkEdict(ent);
-
-	if (!ent->in_use) // and if its free, we're done
 		return;
+	}
+
+	VectorCopy(ent->abs_mins, old_abs_mins);
 
 	// set the size
 	VectorSubtract(ent->maxs, ent->mins, ent->size);
@@ -290,97 +611,71 @@ void Sv_LinkEdict(g_edict_t *ent) {
 	}
 	ent->link_count++;
 
-	if (ent->solid == SOLID_NOT)
+	if (ent->solid == SOLID_NOT) {
+		Sv_UnlinkEdict(ent);
 		return;
-
-	// find the first node that the ent's box crosses
-	node = sv_world.area_nodes;
-	while (true) {
-
-		if (node->axis == -1)
-			break;
-
-		if (ent->abs_mins[node->axis] > node->dist)
-			node = node->children[0];
-		else if (ent->abs_maxs[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break; // crosses the node
 	}
 
-	// link it in
-	if (ent->solid == SOLID_TRIGGER)
-		Sv_InsertLink(&ent->area, &node->trigger_edicts);
-	else
-		Sv_InsertLink(&ent->area, &node->solid_edicts);
+	Sv_LinkAreaLeaf(ent, old_abs_mins);
 }
 
 /*
- * @brief
+ * @brief Fills in a table of edict pointers with those which have bounding boxes
+ * that intersect the given area. It is possible for a non-axial bsp model
+ * to be returned that doesn't actually intersect the area.
+ *
+ * Returns the number of entities found.
  */
-static void Sv_AreaEdicts_r(sv_area_node_t *node) {
-	link_t *l, *next, *start;
-	g_edict_t *check;
+int32_t Sv_AreaEdicts(const vec3_t mins, const vec3_t maxs, g_edict_t **area_edicts,
+		const int32_t max_area_edicts, const int32_t area_type) {
+	int32_t stack[AREA_STACK];
+	int32_t num_area_edicts = 0, depth = 0;
 
-	// touch linked edicts
-	if (sv_world.area_type == AREA_SOLID)
-		start = &node->solid_edicts;
-	else
-		start = &node->trigger_edicts;
+	const sv_area_tree_t *tree = area_type == AREA_SOLID ? &sv_world.solid_edicts
+			: &sv_world.trigger_edicts;
 
-	for (l = start->next; l != start; l = next) {
-		next = l->next;
-		check = EDICT_FROM_AREA(l);
+	if (tree->root != -1) {
+		stack[depth++] = tree->root;
+	}
 
-		if (check->solid == SOLID_NOT)
-			continue; // skip it
+	while (depth) {
+		const sv_area_node_t *node = &tree->nodes[stack[--depth]];
 
-		if (check->abs_mins[0] > sv_world.area_maxs[0] || check->abs_mins[1]
-				> sv_world.area_maxs[1] || check->abs_mins[2] > sv_world.area_maxs[2]
-				|| check->abs_maxs[0] < sv_world.area_mins[0] || check->abs_maxs[1]
-				< sv_world.area_mins[1] || check->abs_maxs[2] < sv_world.area_mins[2])
+		if (node->mins[0] > maxs[0] || node->mins[1] > maxs[1] || node->mins[2] > maxs[2]
+				|| node->maxs[0] < mins[0] || node->maxs[1] < mins[1] || node->maxs[2] < mins[2])
 			continue; // not touching
 
-		if (sv_world.num_area_edicts == sv_world.max_area_edicts) {
-			Com_Warn("sv_world.max_area_edicts reached\n");
-			return;
-		}
+		if (node->children[0] != -1) { // descend into both children
 
-		sv_world.area_edicts[sv_world.num_area_edicts] = check;
-		sv_world.num_area_edicts++;
-	}
+			if (depth + 2 > AREA_STACK) {
+				Com_Warn("AREA_STACK exceeded\n");
+				continue;
+			}
 
-	if (node->axis == -1)
-		return; // terminal node
+			stack[depth++] = node->children[0];
+			stack[depth++] = node->children[1];
+			continue;
+		}
 
-	// recurse down both sides
-	if (sv_world.area_maxs[node->axis] > node->dist)
-		Sv_AreaEdicts_r(node->children[0]);
+		g_edict_t *check = node->ent;
 
-	if (sv_world.area_mins[node->axis] < node->dist)
-		Sv_AreaEdicts_r(node->children[1]);
-}
+		if (check->solid == SOLID_NOT)
+			continue; // skip it
 
-/*
- * @brief Fills in a table of edict pointers with those which have bounding boxes
- * that intersect the given area. It is possible for a non-axial bsp model
- * to be returned that doesn't actually intersect the area.
- *
- * Returns the number of entities found.
- */
-int32_t Sv_AreaEdicts(const vec3_t mins, const vec3_t maxs, g_edict_t **area_edicts,
-		const int32_t max_area_edicts, const int32_t area_type) {
+		if (check->abs_mins[0] > maxs[0] || check->abs_mins[1] > maxs[1] || check->abs_mins[2]
+				> maxs[2] || check->abs_maxs[0] < mins[0] || check->abs_maxs[1] < mins[1]
+				|| check->abs_maxs[2] < mins[2])
+			continue; // not touching
 
-	sv_world.area_mins = mins;
-	sv_world.area_maxs = maxs;
-	sv_world.area_edicts = area_edicts;
-	sv_world.num_area_edicts = 0;
-	sv_world.max_area_edicts = max_area_edicts;
-	sv_world.area_type = area_type;
+		if (num_area_edicts == max_area_edicts) {
+			Com_Warn("max_area_edicts reached\n");
+			break;
+		}
 
-	Sv_AreaEdicts_r(sv_world.area_nodes);
+		area_edicts[num_area_edicts++] = check;
+	}
 
-	return sv_world.num_area_edicts;
+	return num_area_edicts;
 }
 
 /*
@@ -451,19 +746,15 @@ typedef struct sv_trace_s {
 } sv_trace_t;
 
 /*
- * @brief Clips the specified trace to other entities in its area. This is the basis
- * of ALL collision and interaction for the server. Tread carefully.
+ * @brief Clips the specified trace to the given candidate entities. This is
+ * the basis of ALL collision and interaction for the server. Tread carefully.
  */
-static void Sv_ClipTraceToEntities(sv_trace_t *trace) {
-	g_edict_t *touched[MAX_EDICTS];
+static void Sv_ClipTraceToEntities(sv_trace_t *trace, g_edict_t **touched, const int32_t num) {
 	vec_t *angles;
 	c_trace_t tr;
-	int32_t i, num, head_node;
-
-	// first resolve the entities found within our desired trace
-	num = Sv_AreaEdicts(trace->box_mins, trace->box_maxs, touched, MAX_EDICTS, AREA_SOLID);
+	int32_t i, head_node;
 
-	// then iterate them, determining if they have any bearing on our trace
+	// iterate the candidates, determining if they have any bearing on our trace
 	for (i = 0; i < num; i++) {
 
 		g_edict_t *touch = touched[i];
@@ -471,6 +762,12 @@ static void Sv_ClipTraceToEntities(sv_trace_t *trace) {
 		if (touch->solid == SOLID_NOT) // can't actually touch us
 			continue;
 
+		if (touch->abs_mins[0] > trace->box_maxs[0] || touch->abs_mins[1] > trace->box_maxs[1]
+				|| touch->abs_mins[2] > trace->box_maxs[2] || touch->abs_maxs[0]
+				< trace->box_mins[0] || touch->abs_maxs[1] < trace->box_mins[1]
+				|| touch->abs_maxs[2] < trace->box_mins[2])
+			continue; // not within our move, which is possible for batched traces
+
 		if (trace->skip) { // see if we can skip it
 
 			if (touch == trace->skip)
@@ -565,8 +862,101 @@ c_trace_t Sv_Trace(const vec3_t start, const vec3_t mins, const vec3_t maxs, con
 	// create the bounding box of the entire move
 	Sv_TraceBounds(&trace);
 
-	// clip to other solid entities
-	Sv_ClipTraceToEntities(&trace);
+	// resolve the entities found within our desired trace
+	g_edict_t *touched[MAX_EDICTS];
+	const int32_t num = Sv_AreaEdicts(trace.box_mins, trace.box_maxs, touched, MAX_EDICTS,
+			AREA_SOLID);
+
+	// and clip to them
+	Sv_ClipTraceToEntities(&trace, touched, num);
 
 	return trace.trace;
 }
+
+#define MAX_TRACE_BATCH 64
+
+/*
+ * @brief Clips a range of batched traces to the world. This only reads the
+ * collision model, and so is run on the job pool.
+ */
+static void Sv_TraceBatch_(int32_t begin, int32_t end, void *data) {
+	int32_t i;
+
+	sv_trace_t *trace = ((sv_trace_t *) data) + begin;
+
+	for (i = begin; i < end; i++, trace++) {
+
+		trace->trace = Cm_BoxTrace(trace->start, trace->end, trace->mins, trace->maxs, 0,
+				trace->mask);
+
+		trace->trace.ent = svs.game->edicts;
+
+		Sv_TraceBounds(trace);
+	}
+}
+
+/*
+ * @brief Performs a batch of traces, with results equivalent to calling
+ * Sv_Trace for each. The world traces are run in parallel, and candidate
+ * entities are gathered once for the whole batch, so batches should be of
+ * traces which are near to one another, such as shotgun pellets.
+ */
+void Sv_TraceBatch(g_trace_t *traces, const size_t count) {
+	sv_trace_t batch[MAX_TRACE_BATCH];
+	g_edict_t *touched[MAX_EDICTS];
+	size_t i, j;
+
+	for (i = 0; i < count; i += MAX_TRACE_BATCH) {
+		g_trace_t *in = traces + i;
+
+		const size_t num_traces = count - i < MAX_TRACE_BATCH ? count - i : MAX_TRACE_BATCH;
+
+		memset(batch, 0, sizeof(sv_trace_t) * num_traces);
+
+		for (j = 0; j < num_traces; j++) {
+			batch[j].start = in[j].start;
+			batch[j].end = in[j].end;
+			batch[j].mins = in[j].mins;
+			batch[j].maxs = in[j].maxs;
+			batch[j].skip = in[j].skip;
+			batch[j].mask = in[j].mask;
+		}
+
+		// clip to world
+		Thread_ParallelFor(num_traces, 0, Sv_TraceBatch_, batch);
+
+		// create the bounding box of all unobstructed moves
+		vec3_t box_mins, box_maxs;
+		_Bool clip = false;
+
+		ClearBounds(box_mins, box_maxs);
+
+		for (j = 0; j < num_traces; j++) {
+
+			if (batch[j].trace.fraction == 0)
+				continue; // blocked by the world
+
+			AddPointToBounds(batch[j].box_mins, box_mins, box_maxs);
+			AddPointToBounds(batch[j].box_maxs, box_mins, box_maxs);
+
+			clip = true;
+		}
+
+		// clip to other solid entities, which shares the box hull, so not in parallel
+		if (clip) {
+			const int32_t num = Sv_AreaEdicts(box_mins, box_maxs, touched, MAX_EDICTS, AREA_SOLID);
+
+			for (j = 0; j < num_traces; j++) {
+
+				if (batch[j].trace.fraction == 0)
+					continue;
+
+				Sv_ClipTraceToEntities(&batch[j], touched, num);
+			}
+		}
+
+		for (j = 0; j < num_traces; j++) {
+			in[j].trace = batch[j].trace;
+		}
+	}
+}
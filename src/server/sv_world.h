@@ -31,6 +31,7 @@ void Sv_UnlinkEdict(g_edict_t *ent);
 int32_t Sv_AreaEdicts(const vec3_t mins, const vec3_t maxs, g_edict_t **area_edicts, int32_t max_area_edicts, int32_t area_type);
 int32_t Sv_PointContents(const vec3_t p);
 c_trace_t Sv_Trace(const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, const g_edict_t *skip, const int32_t mask);
+void Sv_TraceBatch(g_trace_t *traces, const size_t count);
 
 #endif /* __SV_LOCAL_H__ */
 
@@ -0,0 +1,203 @@
+/*
+ * Copyright(c) 1997-2001 Id Software, Inc.
+ * Copyright(c) 2002 The Quakeforge Project.
+ * Copyright(c) 2006 Quake2World.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "tests.h"
+#include "cmd.h"
+#include "cmodel.h"
+
+#define BENCH_PASSES 10
+
+/*
+ * The benchmark replays traces recorded with c_trace_record against the map
+ * they were recorded on, once with the scalar brush clipping and once with
+ * the SIMD brush clipping, and reports traces per second for each. The
+ * results of the two are compared, as they must be identical.
+ */
+
+/*
+ * @brief Replays the recorded traces BENCH_PASSES times, returning the
+ * elapsed time in seconds. The results of the first pass are written to out.
+ */
+static vec_t Bench_Replay(const c_trace_record_t *records, size_t count, c_trace_t *out) {
+	size_t i, j;
+
+	const gint64 start = g_get_monotonic_time();
+
+	for (i = 0; i < BENCH_PASSES; i++) {
+		for (j = 0; j < count; j++) {
+			const c_trace_record_t *r = &records[j];
+
+			const c_trace_t trace = Cm_BoxTrace(r->start, r->end, r->mins, r->maxs, r->head_node,
+					r->brush_mask);
+
+			if (i == 0) {
+				out[j] = trace;
+			}
+		}
+	}
+
+	return (g_get_monotonic_time() - start) / 1000000.0;
+}
+
+/*
+ * @brief Returns the number of traces whose results differ.
+ */
+static uint32_t Bench_Compare(const c_trace_t *a, const c_trace_t *b, size_t count) {
+	uint32_t mismatches = 0;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if (a[i].fraction != b[i].fraction || a[i].all_solid != b[i].all_solid
+				|| a[i].start_solid != b[i].start_solid || a[i].contents != b[i].contents
+				|| a[i].surface != b[i].surface || a[i].leaf_num != b[i].leaf_num
+				|| !VectorCompare(a[i].plane.normal, b[i].plane.normal)
+				|| a[i].plane.dist != b[i].plane.dist || !VectorCompare(a[i].end, b[i].end)) {
+			mismatches++;
+		}
+	}
+
+	return mismatches;
+}
+
+/*
+ * @brief Loads the map the specified recording was made on, and replays its
+ * traces with each brush clipping path.
+ */
+static void Bench_Traces(const char *path) {
+	c_trace_header_t header;
+	gchar *data;
+	gsize length;
+	int32_t size;
+
+	if (!g_file_get_contents(path, &data, &length, NULL)) {
+		Com_Print("Failed to read %s\n", path);
+		return;
+	}
+
+	if (length < sizeof(header)) {
+		Com_Print("%s: not a trace recording\n", path);
+		g_free(data);
+		return;
+	}
+
+	memcpy(&header, data, sizeof(header));
+
+	if (header.magic != TRACE_RECORD_MAGIC) {
+		Com_Print("%s: not a trace recording\n", path);
+		g_free(data);
+		return;
+	}
+
+	header.map[sizeof(header.map) - 1] = '\0';
+
+	const size_t count = (length - sizeof(header)) / sizeof(c_trace_record_t);
+
+	if (!count) {
+		Com_Print("%s: no traces\n", path);
+		g_free(data);
+		return;
+	}
+
+	c_trace_record_t *records = g_new(c_trace_record_t, count);
+	memcpy(records, data + sizeof(header), count * sizeof(c_trace_record_t));
+
+	g_free(data);
+
+	Cm_LoadBsp(header.map, &size);
+
+	Com_Print("%s: %s, %u traces\n", path, header.map, (uint32_t) count);
+
+	c_trace_t *scalar = g_new(c_trace_t, count);
+	c_trace_t *simd = g_new(c_trace_t, count);
+
+	const char *paths[] = { "scalar", "simd" };
+	c_trace_t *results[] = { scalar, simd };
+	size_t i;
+
+	for (i = 0; i < G_N_ELEMENTS(paths); i++) {
+
+		Cvar_Set("c_simd", va("%u", (uint32_t) i));
+
+		c_trace_stats_t stats;
+		Cm_TraceStats(&stats);
+
+		const vec_t seconds = Bench_Replay(records, count, results[i]);
+		const vec_t traces = (vec_t) count * BENCH_PASSES;
+
+		Cm_TraceStats(&stats);
+
+		Com_Print("  %s: %.3fs (%.0f traces/s, %.1f brushes clipped, %.1f rejected per trace)\n",
+				paths[i], seconds, traces / seconds, stats.brush_traces / traces,
+				stats.brush_rejects / traces);
+	}
+
+	const uint32_t mismatches = Bench_Compare(scalar, simd, count);
+
+	if (mismatches) {
+		Com_Print("  %u traces differ between the scalar and simd paths\n", mismatches);
+	}
+
+	g_free(simd);
+	g_free(scalar);
+	g_free(records);
+}
+
+/*
+ * @brief Benchmark entry point. Replays each of the trace recordings
+ * specified on the command line. The maps they were recorded on are loaded
+ * from the search path.
+ */
+int32_t main(int32_t argc, char **argv) {
+	int32_t i;
+
+	Test_Init(argc, argv);
+
+	if (argc < 2) {
+		Com_Print("Usage: %s <recording> [recording ...]\n", argv[0]);
+		Test_Shutdown();
+		return 1;
+	}
+
+	Z_Init();
+
+	Fs_Init(false);
+
+	Cmd_Init();
+
+	Cvar_Init();
+
+	Cm_Init();
+
+	for (i = 1; i < argc; i++) {
+		Bench_Traces(argv[i]);
+	}
+
+	Cvar_Shutdown();
+
+	Cmd_Shutdown();
+
+	Fs_Shutdown();
+
+	Z_Shutdown();
+
+	Test_Shutdown();
+	return 0;
+}
@@ -0,0 +1,858 @@
+/*
+ * Copyright(c) 1997-2001 Id Software, Inc.
+ * Copyright(c) 2002 The Quakeforge Project.
+ * Copyright(c) 2006 Quake2World.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "tests.h"
+#include "filesystem.h"
+#include "net.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define BENCH_LEGACY_PROTOCOL 1001 // byte aligned entity deltas
+
+#define BENCH_STREAM_FILE "bench_demo.tmp"
+#define BENCH_STREAM_FLUSH 300 // messages between flushes, for demos without keyframes
+
+typedef struct {
+	int32_t server_frame;
+	_Bool valid;
+	uint16_t num_entities;
+	entity_state_t entities[MAX_PACKET_ENTITIES];
+	uint16_t bits[MAX_PACKET_ENTITIES]; // as recorded
+} bench_frame_t;
+
+typedef struct {
+	uint32_t snapshots;
+	uint32_t skipped;
+	uint32_t entities;
+	uint64_t frame_bytes; // frame headers, player state and entities, as recorded
+	uint64_t legacy_bytes; // entities, re-encoded in the legacy format
+	uint64_t packed_bytes; // entities, re-encoded in the bit-packed format
+} bench_stats_t;
+
+static int32_t bench_protocol;
+static entity_state_t bench_baselines[MAX_EDICTS];
+static bench_frame_t bench_frames[UPDATE_BACKUP];
+
+/*
+ * The benchmark replays recorded demos, decoding each snapshot's entities in
+ * whichever format the demo was recorded with. Every snapshot is then
+ * re-encoded against the same frame in both the legacy, byte aligned format
+ * and the bit-packed format, so that the two can be compared on real play.
+ */
+
+/*
+ * @brief Writes the delta between the specified entity states in the legacy
+ * format: a short number and short bits, followed by full precision fields.
+ */
+static void Bench_WriteLegacyDelta(entity_state_t *from, entity_state_t *to, size_buf_t *msg,
+		_Bool force, _Bool is_new) {
+
+	uint16_t bits = 0;
+
+	if (!VectorCompare(to->origin, from->origin))
+		bits |= U_ORIGIN;
+
+	if (is_new || !VectorCompare(from->old_origin, to->old_origin))
+		bits |= U_OLD_ORIGIN;
+
+	if (!VectorCompare(to->angles, from->angles))
+		bits |= U_ANGLES;
+
+	if (to->animation1 != from->animation1 || to->animation2 != from->animation2)
+		bits |= U_ANIMATIONS;
+
+	if (to->event)
+		bits |= U_EVENT;
+
+	if (to->effects != from->effects)
+		bits |= U_EFFECTS;
+
+	if (to->model1 != from->model1 || to->model2 != from->model2 || to->model3 != from->model3
+			|| to->model4 != from->model4)
+		bits |= U_MODELS;
+
+	if (to->client != from->client)
+		bits |= U_CLIENT;
+
+	if (to->sound != from->sound)
+		bits |= U_SOUND;
+
+	if (to->solid != from->solid)
+		bits |= U_SOLID;
+
+	if (!bits && !force)
+		return;
+
+	Msg_WriteShort(msg, to->number);
+	Msg_WriteShort(msg, bits);
+
+	if (bits & U_ORIGIN)
+		Msg_WritePos(msg, to->origin);
+
+	if (bits & U_OLD_ORIGIN)
+		Msg_WritePos(msg, to->old_origin);
+
+	if (bits & U_ANGLES)
+		Msg_WriteAngles(msg, to->angles);
+
+	if (bits & U_ANIMATIONS) {
+		Msg_WriteByte(msg, to->animation1);
+		Msg_WriteByte(msg, to->animation2);
+	}
+
+	if (bits & U_EVENT)
+		Msg_WriteByte(msg, to->event);
+
+	if (bits & U_EFFECTS)
+		Msg_WriteShort(msg, to->effects);
+
+	if (bits & U_MODELS) {
+		Msg_WriteByte(msg, to->model1);
+		Msg_WriteByte(msg, to->model2);
+		Msg_WriteByte(msg, to->model3);
+		Msg_WriteByte(msg, to->model4);
+	}
+
+	if (bits & U_CLIENT)
+		Msg_WriteByte(msg, to->client);
+
+	if (bits & U_SOUND)
+		Msg_WriteByte(msg, to->sound);
+
+	if (bits & U_SOLID)
+		Msg_WriteShort(msg, to->solid);
+}
+
+/*
+ * @brief Reads the fields of a legacy entity delta, whose number and bits
+ * have already been read.
+ */
+static void Bench_ReadLegacyDelta(entity_state_t *from, entity_state_t *to, size_buf_t *msg,
+		uint16_t number, uint16_t bits) {
+
+	*to = *from;
+
+	if (!(from->effects & EF_BEAM))
+		VectorCopy(from->origin, to->old_origin);
+
+	to->number = number;
+
+	if (bits & U_ORIGIN)
+		Msg_ReadPos(msg, to->origin);
+
+	if (bits & U_OLD_ORIGIN)
+		Msg_ReadPos(msg, to->old_origin);
+
+	if (bits & U_ANGLES)
+		Msg_ReadAngles(msg, to->angles);
+
+	if (bits & U_ANIMATIONS) {
+		to->animation1 = Msg_ReadByte(msg);
+		to->animation2 = Msg_ReadByte(msg);
+	}
+
+	if (bits & U_EVENT)
+		to->event = Msg_ReadByte(msg);
+	else
+		to->event = 0;
+
+	if (bits & U_EFFECTS)
+		to->effects = Msg_ReadShort(msg);
+
+	if (bits & U_MODELS) {
+		to->model1 = Msg_ReadByte(msg);
+		to->model2 = Msg_ReadByte(msg);
+		to->model3 = Msg_ReadByte(msg);
+		to->model4 = Msg_ReadByte(msg);
+	}
+
+	if (bits & U_CLIENT)
+		to->client = Msg_ReadByte(msg);
+
+	if (bits & U_SOUND)
+		to->sound = Msg_ReadByte(msg);
+
+	if (bits & U_SOLID)
+		to->solid = Msg_ReadShort(msg);
+}
+
+/*
+ * @brief Reads the fields of an entity delta in the demo's format.
+ */
+static void Bench_ReadDelta(entity_state_t *from, entity_state_t *to, size_buf_t *msg,
+		uint16_t number, uint16_t bits) {
+
+	if (bench_protocol == BENCH_LEGACY_PROTOCOL)
+		Bench_ReadLegacyDelta(from, to, msg, number, bits);
+	else
+		Msg_ReadDeltaEntity(from, to, msg, number, bits);
+}
+
+/*
+ * @brief Writes the delta between the specified entity states in either
+ * format, as Sv_WriteDeltaEntity would.
+ */
+static void Bench_WriteDelta(entity_state_t *from, entity_state_t *to, _Bool force,
+		_Bool is_new, size_buf_t *msg, uint16_t *last_number, _Bool legacy) {
+
+	if (legacy) {
+		Bench_WriteLegacyDelta(from, to, msg, force, is_new);
+		return;
+	}
+
+	byte buffer[64];
+	size_buf_t delta;
+	size_t i;
+
+	Sb_Init(&delta, buffer, sizeof(buffer));
+	Msg_WriteDeltaEntity(from, to, &delta, force, is_new);
+
+	if (!delta.size)
+		return;
+
+	Msg_WriteEntityNumber(msg, *last_number, to->number);
+
+	for (i = 0; i + 1 < delta.size; i++) {
+		Msg_WriteBits(msg, buffer[i], 8);
+	}
+
+	Msg_WriteBits(msg, buffer[i], delta.write_bit ? delta.write_bit : 8);
+
+	*last_number = to->number;
+}
+
+/*
+ * @brief Writes the entities of the specified frame, delta'd from the old
+ * frame (if any), in either format. Returns the size in bytes.
+ */
+static size_t Bench_WriteEntities(bench_frame_t *from, bench_frame_t *to, _Bool legacy) {
+	static byte buffer[MAX_PACKET_ENTITIES * 2 * 64]; // updates and removals
+	entity_state_t *old_ent = NULL, *new_ent = NULL;
+	uint16_t old_index = 0, new_index = 0;
+	uint16_t old_num, new_num;
+	uint16_t last_number = 0;
+	size_buf_t msg;
+
+	Sb_Init(&msg, buffer, sizeof(buffer));
+
+	const uint16_t from_num_entities = from ? from->num_entities : 0;
+
+	while (new_index < to->num_entities || old_index < from_num_entities) {
+		if (new_index >= to->num_entities)
+			new_num = 0xffff;
+		else {
+			new_ent = &to->entities[new_index];
+			new_num = new_ent->number;
+		}
+
+		if (old_index >= from_num_entities)
+			old_num = 0xffff;
+		else {
+			old_ent = &from->entities[old_index];
+			old_num = old_ent->number;
+		}
+
+		if (new_num == old_num) { // old_origin is sent whenever the recording sent it
+			const _Bool is_new = (to->bits[new_index] & U_OLD_ORIGIN) != 0;
+
+			Bench_WriteDelta(old_ent, new_ent, false, is_new, &msg, &last_number, legacy);
+			old_index++;
+			new_index++;
+			continue;
+		}
+
+		if (new_num < old_num) {
+			Bench_WriteDelta(&bench_baselines[new_num], new_ent, true, true, &msg, &last_number,
+					legacy);
+			new_index++;
+			continue;
+		}
+
+		if (legacy) {
+			Msg_WriteShort(&msg, old_num);
+			Msg_WriteShort(&msg, U_REMOVE);
+		} else {
+			Msg_WriteEntityNumber(&msg, last_number, old_num);
+			Msg_WriteBits(&msg, U_REMOVE, U_BITS);
+
+			last_number = old_num;
+		}
+
+		old_index++;
+	}
+
+	if (legacy)
+		Msg_WriteLong(&msg, 0);
+	else
+		Msg_WriteEntityNumber(&msg, last_number, 0);
+
+	return msg.size;
+}
+
+/*
+ * @brief Reads an entity delta into the next slot of the specified frame.
+ */
+static _Bool Bench_ParseEntity(size_buf_t *msg, entity_state_t *from, bench_frame_t *to,
+		uint16_t number, uint16_t bits) {
+
+	if (to->num_entities == MAX_PACKET_ENTITIES)
+		return false;
+
+	Bench_ReadDelta(from, &to->entities[to->num_entities], msg, number, bits);
+	to->bits[to->num_entities] = bits;
+
+	to->num_entities++;
+	return true;
+}
+
+/*
+ * @brief Reads the entities of a frame in the demo's format, as
+ * Cl_ParseEntities would.
+ */
+static _Bool Bench_ParseEntities(size_buf_t *msg, bench_frame_t *from, bench_frame_t *to) {
+	uint16_t old_index = 0, last_number = 0;
+
+	const uint16_t from_num_entities = from ? from->num_entities : 0;
+
+	to->num_entities = 0;
+
+	while (true) {
+		uint16_t number, bits;
+
+		if (bench_protocol == BENCH_LEGACY_PROTOCOL) {
+			number = Msg_ReadShort(msg);
+			bits = Msg_ReadShort(msg);
+		} else {
+			number = Msg_ReadEntityNumber(msg, last_number);
+			bits = number ? Msg_ReadBits(msg, U_BITS) : 0;
+		}
+
+		if (msg->read > msg->size || number >= MAX_EDICTS)
+			return false;
+
+		if (!number)
+			break;
+
+		last_number = number;
+
+		while (old_index < from_num_entities && from->entities[old_index].number < number) {
+			entity_state_t *old_ent = &from->entities[old_index++];
+
+			if (!Bench_ParseEntity(msg, old_ent, to, old_ent->number, 0))
+				return false;
+		}
+
+		entity_state_t *base = &bench_baselines[number];
+
+		if (old_index < from_num_entities && from->entities[old_index].number == number)
+			base = &from->entities[old_index++];
+
+		if (bits & U_REMOVE)
+			continue;
+
+		if (!Bench_ParseEntity(msg, base, to, number, bits))
+			return false;
+	}
+
+	while (old_index < from_num_entities) {
+		entity_state_t *old_ent = &from->entities[old_index++];
+
+		if (!Bench_ParseEntity(msg, old_ent, to, old_ent->number, 0))
+			return false;
+	}
+
+	return msg->read <= msg->size;
+}
+
+/*
+ * @brief Skips the player state, which is identical in both formats.
+ */
+static void Bench_SkipPlayerstate(size_buf_t *msg) {
+	size_t len = 0;
+	int32_t i;
+
+	const uint16_t pm_state_bits = Msg_ReadShort(msg);
+
+	if (pm_state_bits & PS_M_TYPE)
+		len += 1;
+
+	if (pm_state_bits & PS_M_ORIGIN)
+		len += 6;
+
+	if (pm_state_bits & PS_M_VELOCITY)
+		len += 6;
+
+	if (pm_state_bits & PS_M_FLAGS)
+		len += 2;
+
+	if (pm_state_bits & PS_M_TIME)
+		len += 1;
+
+	if (pm_state_bits & PS_M_GRAVITY)
+		len += 2;
+
+	if (pm_state_bits & PS_M_VIEW_OFFSET)
+		len += 6;
+
+	if (pm_state_bits & PS_M_VIEW_ANGLES)
+		len += 6;
+
+	if (pm_state_bits & PS_M_KICK_ANGLES)
+		len += 6;
+
+	if (pm_state_bits & PS_M_DELTA_ANGLES)
+		len += 6;
+
+	msg->read += len;
+
+	const uint32_t stat_bits = Msg_ReadLong(msg);
+
+	for (i = 0; i < MAX_STATS; i++) {
+		if (stat_bits & (1u << i))
+			msg->read += 2;
+	}
+}
+
+/*
+ * @brief Parses a frame and re-encodes its entities in both formats. Frames
+ * which can not be decoded, because their delta frame was not, are skipped.
+ */
+static _Bool Bench_ParseFrame(size_buf_t *msg, bench_stats_t *stats) {
+	bench_frame_t *from = NULL;
+
+	const size_t start = msg->read - 1;
+
+	const int32_t server_frame = Msg_ReadLong(msg);
+	const int32_t delta_frame = Msg_ReadLong(msg);
+
+	Msg_ReadByte(msg); // surpress count
+
+	const int32_t area_bytes = Msg_ReadByte(msg);
+
+	if (area_bytes > 0)
+		msg->read += area_bytes;
+
+	Bench_SkipPlayerstate(msg);
+
+	bench_frame_t *to = &bench_frames[server_frame & UPDATE_MASK];
+
+	if (delta_frame > 0) {
+		from = &bench_frames[delta_frame & UPDATE_MASK];
+
+		if (from == to || !from->valid || from->server_frame != delta_frame) {
+			to->valid = false;
+			stats->skipped++;
+			return false;
+		}
+	}
+
+	to->server_frame = server_frame;
+	to->valid = Bench_ParseEntities(msg, from, to);
+
+	if (!to->valid) {
+		stats->skipped++;
+		return false;
+	}
+
+	stats->snapshots++;
+	stats->entities += to->num_entities;
+	stats->frame_bytes += msg->read - start;
+
+	stats->legacy_bytes += Bench_WriteEntities(from, to, true);
+	stats->packed_bytes += Bench_WriteEntities(from, to, false);
+
+	return true;
+}
+
+/*
+ * @brief Parses the server commands of a demo message up to and including
+ * the frame. Returns false if the demo can not be parsed any further.
+ */
+static _Bool Bench_ParseMessage(size_buf_t *msg, bench_stats_t *stats) {
+
+	while (msg->read < msg->size) {
+		const int32_t cmd = Msg_ReadByte(msg);
+
+		switch (cmd) {
+
+			case SV_CMD_SERVER_DATA:
+				bench_protocol = Msg_ReadLong(msg);
+
+				if (bench_protocol != PROTOCOL && bench_protocol != BENCH_LEGACY_PROTOCOL) {
+					Com_Print("Unsupported protocol %d\n", bench_protocol);
+					return false;
+				}
+
+				Msg_ReadLong(msg); // server count
+				Msg_ReadLong(msg); // server hz
+				Msg_ReadByte(msg); // demo server
+				Msg_ReadString(msg); // game
+				Msg_ReadShort(msg); // player num
+				Msg_ReadString(msg); // level name
+
+				memset(bench_baselines, 0, sizeof(bench_baselines));
+				memset(bench_frames, 0, sizeof(bench_frames));
+				break;
+
+			case SV_CMD_CONFIG_STRING:
+				Msg_ReadShort(msg);
+				Msg_ReadString(msg);
+				break;
+
+			case SV_CMD_BASELINE: {
+				static entity_state_t null_state;
+
+				const uint16_t number = Msg_ReadShort(msg);
+				uint16_t bits;
+
+				if (bench_protocol == BENCH_LEGACY_PROTOCOL)
+					bits = Msg_ReadShort(msg);
+				else
+					bits = Msg_ReadBits(msg, U_BITS);
+
+				if (number >= MAX_EDICTS)
+					return false;
+
+				Bench_ReadDelta(&null_state, &bench_baselines[number], msg, number, bits);
+				break;
+			}
+
+			case SV_CMD_CBUF_TEXT:
+				Msg_ReadString(msg);
+				break;
+
+			case SV_CMD_PRINT:
+				Msg_ReadByte(msg);
+				Msg_ReadString(msg);
+				break;
+
+			case SV_CMD_SOUND: {
+				const int32_t flags = Msg_ReadByte(msg);
+				vec3_t origin;
+
+				Msg_ReadByte(msg);
+
+				if (flags & S_ATTEN)
+					Msg_ReadByte(msg);
+
+				if (flags & S_ENTNUM)
+					Msg_ReadShort(msg);
+
+				if (flags & S_ORIGIN)
+					Msg_ReadPos(msg, origin);
+				break;
+			}
+
+			case SV_CMD_FRAME: // the remainder is client game events
+				Bench_ParseFrame(msg, stats);
+				return true;
+
+			default:
+				return true;
+		}
+	}
+
+	return msg->read <= msg->size;
+}
+
+/*
+ * @brief Inflates the messages of a compressed demo, which follow the header at
+ * the specified offset, replacing the demo data with them.
+ */
+static _Bool Bench_Inflate(gchar **data, gsize *length, gsize offset) {
+#ifdef HAVE_ZLIB
+	byte buffer[1024 * 64];
+	z_stream z;
+	int32_t err;
+
+	memset(&z, 0, sizeof(z));
+
+	if (inflateInit2(&z, -MAX_WBITS) != Z_OK)
+		return false;
+
+	GByteArray *messages = g_byte_array_new();
+
+	z.next_in = (byte *) *data + offset;
+	z.avail_in = *length - offset;
+
+	do {
+		z.next_out = buffer;
+		z.avail_out = sizeof(buffer);
+
+		err = inflate(&z, Z_NO_FLUSH);
+
+		g_byte_array_append(messages, buffer, sizeof(buffer) - z.avail_out);
+	} while (err == Z_OK);
+
+	inflateEnd(&z);
+
+	g_free(*data);
+
+	*length = messages->len;
+	*data = (gchar *) g_byte_array_free(messages, false);
+
+	// demos which were not stopped simply end
+	return err == Z_STREAM_END || err == Z_BUF_ERROR;
+#else
+	Com_Print("Compressed demos require zlib\n");
+	return false;
+#endif
+}
+
+/*
+ * @brief Records the messages of a demo through a demo stream at the specified
+ * compression level, flushing it ahead of each keyframe as the client does, and
+ * then plays them back. Prints the compression ratio, and the cost of
+ * recording and of playing back each frame.
+ */
+static void Bench_Stream(const gchar *data, gsize length, int32_t level) {
+	static byte buffer[MAX_NET_MESSAGE_SIZE];
+	uint32_t frames = 0, since_flush = 0;
+	gsize offset = 0, in = 0;
+	_Bool keyframe = false;
+	file_t *file;
+
+	if (!(file = Fs_OpenWrite(BENCH_STREAM_FILE))) {
+		Com_Print("Failed to open %s: %s\n", BENCH_STREAM_FILE, Fs_LastError());
+		return;
+	}
+
+	fs_stream_t *stream = Fs_OpenStreamWrite(file, level);
+	const _Bool compressed = Fs_StreamCompressed(stream);
+
+	gint64 start = g_get_monotonic_time();
+
+	while (offset + sizeof(int32_t) <= length) {
+		int32_t len;
+
+		memcpy(&len, data + offset, sizeof(len));
+		len = LittleLong(len);
+
+		const size_t size = len < 0 ? 0 : len & ~DEMO_KEYFRAME;
+
+		if (offset + sizeof(len) + size > length)
+			break;
+
+		if (len >= 0 && (len & DEMO_KEYFRAME)) {
+			if (!keyframe)
+				Fs_FlushStream(stream);
+			since_flush = 0;
+		} else if (++since_flush == BENCH_STREAM_FLUSH) {
+			Fs_FlushStream(stream);
+			since_flush = 0;
+		}
+
+		keyframe = len >= 0 && (len & DEMO_KEYFRAME);
+
+		Fs_WriteStream(stream, (void *) (data + offset), sizeof(len) + size, 1);
+		offset += sizeof(len) + size;
+
+		if (len < 0)
+			break;
+
+		if (!keyframe)
+			frames++;
+	}
+
+	Fs_StreamStats(stream, &in, NULL);
+	Fs_CloseStream(stream);
+
+	const vec_t record = g_get_monotonic_time() - start;
+	const int64_t out = Fs_Tell(file);
+
+	Fs_Close(file);
+
+	if (!frames || !(file = Fs_OpenRead(BENCH_STREAM_FILE))) {
+		Fs_Unlink(BENCH_STREAM_FILE);
+		return;
+	}
+
+	stream = Fs_OpenStreamRead(file, compressed);
+	offset = 0;
+
+	start = g_get_monotonic_time();
+
+	while (offset < in) {
+		int32_t len;
+
+		if (Fs_ReadStream(stream, &len, sizeof(len), 1) != 1)
+			break;
+
+		const size_t size = LittleLong(len) < 0 ? 0 : LittleLong(len) & ~DEMO_KEYFRAME;
+
+		if (size && Fs_ReadStream(stream, buffer, size, 1) != 1)
+			break;
+
+		if (memcmp(data + offset + sizeof(len), buffer, size))
+			break;
+
+		offset += sizeof(len) + size;
+	}
+
+	const vec_t play = g_get_monotonic_time() - start;
+
+	Fs_CloseStream(stream);
+	Fs_Close(file);
+
+	Fs_Unlink(BENCH_STREAM_FILE);
+
+	if (offset != in) {
+		Com_Print("  level %d: playback does not match the recording\n", level);
+		return;
+	}
+
+	Com_Print("  level %d: %u KB (%.1f%%), recording %.2fus/frame, playback %.2fus/frame\n",
+			compressed ? level : 0, (uint32_t) (out >> 10), out * 100.0 / in, record / frames,
+			play / frames);
+}
+
+/*
+ * @brief Replays the specified demo file, printing the average size of its
+ * snapshots' entities in the legacy and the bit-packed format, and the cost
+ * of compressing it.
+ */
+static void Bench_Demo(const char *path) {
+	bench_stats_t stats;
+	gchar *data;
+	gsize length, offset = 0;
+
+	if (!g_file_get_contents(path, &data, &length, NULL)) {
+		Com_Print("Failed to read %s\n", path);
+		return;
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	bench_protocol = 0;
+
+	if (length >= sizeof(demo_header_t)) { // skip the header of indexed demos
+		demo_header_t header;
+
+		memcpy(&header, data, sizeof(header));
+
+		if (LittleLong(header.magic) == DEMO_MAGIC) {
+
+			if (LittleLong(header.version) > 1) {
+				offset = sizeof(demo_header_t);
+
+				if (LittleLong(header.compression) == DEMO_COMPRESSION_DEFLATE) {
+					if (!Bench_Inflate(&data, &length, offset)) {
+						Com_Print("Failed to inflate %s\n", path);
+						g_free(data);
+						return;
+					}
+					offset = 0;
+				}
+			} else { // version 1 headers have no compression field
+				offset = offsetof(demo_header_t, compression);
+			}
+		}
+	}
+
+	const gsize messages = offset;
+
+	while (offset + sizeof(int32_t) <= length) {
+		size_buf_t msg;
+		int32_t len;
+
+		memcpy(&len, data + offset, sizeof(len));
+		len = LittleLong(len);
+
+		offset += sizeof(len);
+
+		if (len < 0) // -1 marks the end of the demo
+			break;
+
+		if (len & DEMO_KEYFRAME) { // keyframes duplicate the state of the demo
+			offset += len & ~DEMO_KEYFRAME;
+			continue;
+		}
+
+		if (offset + len > length)
+			break;
+
+		memset(&msg, 0, sizeof(msg));
+		msg.data = (byte *) data + offset;
+		msg.size = msg.max_size = len;
+
+		if (!Bench_ParseMessage(&msg, &stats))
+			break;
+
+		offset += len;
+	}
+
+	if (!stats.snapshots) {
+		Com_Print("%s: no snapshots (%u skipped)\n", path, stats.skipped);
+		g_free(data);
+		return;
+	}
+
+	const vec_t snapshots = stats.snapshots;
+
+	Com_Print("%s: protocol %d, %u snapshots (%u skipped), %.1f entities/snapshot\n", path,
+			bench_protocol, stats.snapshots, stats.skipped, stats.entities / snapshots);
+	Com_Print("  recorded frames %.1f bytes/snapshot\n", stats.frame_bytes / snapshots);
+	Com_Print("  entities: legacy %.1f bytes/snapshot, bit-packed %.1f bytes/snapshot (%.1f%%)\n",
+			stats.legacy_bytes / snapshots, stats.packed_bytes / snapshots,
+			stats.legacy_bytes ? stats.packed_bytes * 100.0 / stats.legacy_bytes : 0.0);
+
+	const int32_t levels[] = { 0, 1, 6, 9 };
+	size_t i;
+
+	for (i = 0; i < G_N_ELEMENTS(levels); i++) {
+		Bench_Stream(data + messages, length - messages, levels[i]);
+	}
+
+	g_free(data);
+}
+
+/*
+ * @brief Benchmark entry point. Replays each of the demo files specified on
+ * the command line. Demo streams are written to, and read from, the user's
+ * write directory.
+ */
+int32_t main(int32_t argc, char **argv) {
+	int32_t i;
+
+	Test_Init(argc, argv);
+
+	if (argc < 2) {
+		Com_Print("Usage: %s <demo> [demo ...]\n", argv[0]);
+		Test_Shutdown();
+		return 1;
+	}
+
+	Z_Init();
+
+	Fs_Init(false);
+
+	for (i = 1; i < argc; i++) {
+		Bench_Demo(argv[i]);
+	}
+
+	Fs_Shutdown();
+
+	Z_Shutdown();
+
+	Test_Shutdown();
+	return 0;
+}
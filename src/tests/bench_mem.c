@@ -0,0 +1,145 @@
+/*
+ * Copyright(c) 1997-2001 Id Software, Inc.
+ * Copyright(c) 2002 The Quakeforge Project.
+ * Copyright(c) 2006 Quake2World.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "tests.h"
+#include "mem.h"
+
+#define BENCH_ALLOCATIONS 100000
+#define BENCH_ITERATIONS 10
+#define BENCH_MAX_THREADS 32
+#define BENCH_CHILDREN 10000
+
+/*
+ * @brief Performs a level's worth of small, tagged allocations.
+ */
+static int32_t Bench_Allocate(void *data __attribute__((unused))) {
+	uint32_t i;
+
+	for (i = 0; i < BENCH_ALLOCATIONS; i++) {
+		Z_TagMalloc(16 + (i & 255), Z_TAG_GAME_LEVEL);
+	}
+
+	return 0;
+}
+
+/*
+ * @brief Runs the allocation workload on the specified number of threads,
+ * followed by a single Z_FreeTag, and returns the elapsed time in seconds.
+ */
+static vec_t Bench_Run(uint16_t num_threads) {
+	SDL_Thread *threads[BENCH_MAX_THREADS];
+	uint16_t i, j;
+
+	const gint64 start = g_get_monotonic_time();
+
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+
+		for (j = 0; j < num_threads; j++) {
+			threads[j] = SDL_CreateThread(Bench_Allocate, NULL);
+		}
+
+		for (j = 0; j < num_threads; j++) {
+			SDL_WaitThread(threads[j], NULL);
+		}
+
+		Z_FreeTag(Z_TAG_GAME_LEVEL);
+	}
+
+	return (g_get_monotonic_time() - start) / 1000000.0;
+}
+
+/*
+ * @brief Links the specified number of children to a single parent, and frees
+ * them in random order, returning the elapsed time of the frees in seconds.
+ */
+static vec_t Bench_FreeChildren(uint32_t count) {
+	uint32_t i;
+
+	byte **children = Z_Malloc(count * sizeof(byte *));
+	byte *parent = Z_Malloc(1);
+
+	for (i = 0; i < count; i++) {
+		children[i] = Z_LinkMalloc(1, parent);
+	}
+
+	for (i = count - 1; i > 0; i--) {
+		const uint32_t j = g_random_int_range(0, i + 1);
+
+		byte *c = children[i];
+		children[i] = children[j];
+		children[j] = c;
+	}
+
+	const gint64 start = g_get_monotonic_time();
+
+	for (i = 0; i < count; i++) {
+		Z_Free(children[i]);
+	}
+
+	const gint64 elapsed = g_get_monotonic_time() - start;
+
+	Z_Free(parent);
+	Z_Free(children);
+
+	return elapsed / 1000000.0;
+}
+
+/*
+ * @brief Benchmark entry point. Compares the heap allocator with the tag
+ * arena for one thread and for N threads (the first argument, default 4).
+ * Then frees 10x as many children of a single parent, which should take 10x
+ * as long: unlinking a child does not walk its siblings.
+ */
+int32_t main(int32_t argc, char **argv) {
+
+	Test_Init(argc, argv);
+
+	uint16_t num_threads = argc > 1 ? Clamp(atoi(argv[1]), 1, BENCH_MAX_THREADS) : 4;
+
+	Z_Init();
+
+	const uint16_t counts[] = { 1, num_threads };
+	size_t i;
+
+	for (i = 0; i < G_N_ELEMENTS(counts); i++) {
+		const vec_t total = (vec_t) counts[i] * BENCH_ALLOCATIONS * BENCH_ITERATIONS;
+
+		Z_TagArena(Z_TAG_GAME_LEVEL, false);
+		const vec_t heap = Bench_Run(counts[i]);
+
+		Z_TagArena(Z_TAG_GAME_LEVEL, true);
+		const vec_t arena = Bench_Run(counts[i]);
+
+		Com_Print("%2u thread(s): heap %.3fs (%.0f allocs/s), arena %.3fs (%.0f allocs/s)\n",
+				counts[i], heap, total / heap, arena, total / arena);
+	}
+
+	const vec_t small = Bench_FreeChildren(BENCH_CHILDREN);
+	const vec_t large = Bench_FreeChildren(BENCH_CHILDREN * 10);
+
+	Com_Print("children: %u freed in %.3fms, %u freed in %.3fms (%.1fx)\n", BENCH_CHILDREN,
+			small * 1000.0, BENCH_CHILDREN * 10, large * 1000.0, small > 0.0 ? large / small : 0.0);
+
+	Z_Shutdown();
+
+	Test_Shutdown();
+	return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright(c) 1997-2001 Id Software, Inc.
+ * Copyright(c) 2002 The Quakeforge Project.
+ * Copyright(c) 2006 Quake2World.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <time.h>
+
+#include "tests.h"
+#include "cmd.h"
+#include "cvar.h"
+#include "net.h"
+
+#define BENCH_PORT 31998
+#define BENCH_FRAMES 2000
+#define BENCH_CLIENTS 64 // one datagram per client per frame
+#define BENCH_SIZE 512
+
+/*
+ * @brief Sends a frame's worth of datagrams from the client socket to the
+ * server socket, over the loopback interface, and receives them. Returns the
+ * number of datagrams received.
+ */
+static uint32_t Bench_Frame(net_addr_t to, _Bool batch) {
+	static byte data[BENCH_SIZE];
+	net_addr_t from;
+	uint32_t i, count = 0;
+
+	if (batch)
+		Net_BeginBatch(NS_CLIENT);
+
+	for (i = 0; i < BENCH_CLIENTS; i++) {
+		Net_SendPacket(NS_CLIENT, sizeof(data), data, to);
+	}
+
+	if (batch)
+		Net_FlushBatch(NS_CLIENT);
+
+	while (Net_GetPacket(NS_SERVER, &from, &net_message)) {
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * @brief Runs the specified number of frames, and prints the throughput and
+ * the processor time spent per datagram.
+ */
+static void Bench_Run(const char *name, net_addr_t to, _Bool batch) {
+	uint32_t i, count = 0;
+
+	const clock_t cpu = clock();
+	const gint64 start = g_get_monotonic_time();
+
+	for (i = 0; i < BENCH_FRAMES; i++) {
+		count += Bench_Frame(to, batch);
+	}
+
+	const vec_t elapsed = (g_get_monotonic_time() - start) / 1000000.0;
+	const vec_t cpu_time = (clock() - cpu) / (vec_t) CLOCKS_PER_SEC;
+
+	Com_Print("%s: %u of %u datagrams, %.0f datagrams/s, %.2fus cpu/datagram\n", name, count,
+			BENCH_FRAMES * BENCH_CLIENTS, count / elapsed, cpu_time * 1000000.0 / count);
+}
+
+/*
+ * @brief Benchmark entry point. Compares immediate and batched sends through
+ * the loopback interface. Datagrams are always received in batches.
+ */
+int32_t main(int32_t argc, char **argv) {
+	net_addr_t to;
+
+	Test_Init(argc, argv);
+
+	Z_Init();
+
+	Cmd_Init();
+
+	Cvar_Init();
+
+	Cvar_Get("net_port", va("%d", BENCH_PORT), CVAR_NO_SET, NULL);
+
+	Net_Init();
+
+	Sb_Init(&net_message, net_message_buffer, sizeof(net_message_buffer));
+
+	Net_Config(NS_SERVER, true);
+	Net_Config(NS_CLIENT, true);
+
+	if (!Net_StringToNetaddr(va("127.0.0.1:%d", BENCH_PORT), &to)) {
+		Com_Print("Failed to resolve loopback address\n");
+		return 1;
+	}
+
+	Bench_Run("immediate", to, false);
+	Bench_Run("  batched", to, true);
+
+	Net_Shutdown();
+
+	Cvar_Shutdown();
+
+	Cmd_Shutdown();
+
+	Z_Shutdown();
+
+	Test_Shutdown();
+	return 0;
+}
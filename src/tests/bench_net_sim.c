@@ -0,0 +1,345 @@
+/*
+ * Copyright(c) 1997-2001 Id Software, Inc.
+ * Copyright(c) 2002 The Quakeforge Project.
+ * Copyright(c) 2006 Quake2World.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <SDL/SDL.h>
+
+#include "tests.h"
+#include "cmd.h"
+#include "cvar.h"
+#include "net.h"
+#include "sys.h"
+
+#define BENCH_DURATION 5000 // milliseconds per profile
+#define BENCH_DRAIN 10000 // milliseconds allowed for the reliable stream to drain
+
+#define BENCH_CLIENT_INTERVAL 16 // the bot's frame interval
+#define BENCH_CLIENT_COMMAND 32 // the size of a movement command
+#define BENCH_CLIENT_RELIABLE 250 // milliseconds between client string commands
+
+#define BENCH_SERVER_INTERVAL 33 // the server's frame interval
+#define BENCH_SERVER_FRAME 400 // the size of a frame
+#define BENCH_SERVER_RELIABLE 1000 // milliseconds between server reliable bursts
+#define BENCH_SERVER_BURST 4096 // the size of a reliable burst, as on a level change
+
+/*
+ * Network conditions to replay, applied to the datagrams of both ends.
+ */
+typedef struct {
+	const char *name;
+	const char *latency, *jitter, *loss, *duplicate, *reorder;
+} bench_profile_t;
+
+static const bench_profile_t bench_profiles[] = {
+	{ "lan", "0", "0", "0", "0", "0" },
+	{ "broadband", "30", "5", "0.5", "0", "0" },
+	{ "wireless", "20", "30", "2", "0.5", "2" },
+	{ "mobile", "80", "40", "5", "1", "5" },
+	{ "congested", "150", "50", "10", "0", "10" }
+};
+
+/*
+ * Messages are written with a leading type and the time at which they were
+ * sent, so that the receiver can measure their delivery.
+ */
+typedef enum {
+	BENCH_UNRELIABLE = 1, BENCH_RELIABLE
+} bench_message_t;
+
+typedef struct {
+	uint32_t sent, received;
+	uint64_t latency;
+	uint32_t max_latency;
+} bench_stats_t;
+
+/*
+ * Each end of the connection. The client end is the headless bot: it sends a
+ * movement command every frame, and a string command periodically. The server
+ * end sends a frame every frame, and a burst of reliable data periodically.
+ */
+typedef struct {
+	net_chan_t chan;
+
+	uint32_t interval, next_frame;
+	uint32_t reliable_interval, next_reliable;
+	size_t unreliable_size, reliable_size;
+
+	bench_stats_t unreliable, reliable;
+	uint32_t dropped; // packets lost or discarded by the netchan
+} bench_endpoint_t;
+
+static bench_endpoint_t bench_endpoints[2]; // by net_src_t
+
+/*
+ * @brief Writes a message of the specified type and size, stamped with the
+ * current time.
+ */
+static void Bench_WriteMessage(size_buf_t *msg, bench_message_t type, size_t size) {
+
+	Msg_WriteByte(msg, type);
+	Msg_WriteLong(msg, quake2world.time);
+	Msg_WriteShort(msg, size);
+
+	while (size--) {
+		Msg_WriteByte(msg, 0);
+	}
+}
+
+/*
+ * @brief Reads the messages of the current packet, accumulating their delivery
+ * statistics on the sending end.
+ */
+static void Bench_ReadMessages(bench_endpoint_t *from) {
+
+	while (net_message.read < net_message.size) {
+		const bench_message_t type = Msg_ReadByte(&net_message);
+		const uint32_t time = Msg_ReadLong(&net_message);
+		const uint16_t size = Msg_ReadShort(&net_message);
+
+		bench_stats_t *stats = type == BENCH_RELIABLE ? &from->reliable : &from->unreliable;
+
+		const uint32_t latency = quake2world.time - time;
+
+		stats->received++;
+		stats->latency += latency;
+
+		if (latency > stats->max_latency)
+			stats->max_latency = latency;
+
+		net_message.read += size;
+	}
+}
+
+/*
+ * @brief Receives the packets which have arrived for the specified end.
+ */
+static void Bench_ReadPackets(net_src_t source) {
+	bench_endpoint_t *e = &bench_endpoints[source];
+	net_addr_t from;
+
+	while (Net_GetPacket(source, &from, &net_message)) {
+
+		if (!Netchan_Process(&e->chan, &net_message)) {
+			e->dropped++;
+			continue;
+		}
+
+		e->dropped += e->chan.dropped;
+
+		Bench_ReadMessages(&bench_endpoints[source ^ 1]);
+	}
+}
+
+/*
+ * @brief Runs a frame for the specified end, if one is due.
+ */
+static void Bench_Frame(net_src_t source, _Bool drain) {
+	bench_endpoint_t *e = &bench_endpoints[source];
+	size_buf_t msg;
+	byte buffer[MAX_MSG_SIZE];
+
+	if (quake2world.time < e->next_frame)
+		return;
+
+	e->next_frame += e->interval;
+
+	if (!drain && quake2world.time >= e->next_reliable) {
+		Bench_WriteMessage(&e->chan.message, BENCH_RELIABLE, e->reliable_size);
+		e->reliable.sent++;
+
+		e->next_reliable += e->reliable_interval;
+	}
+
+	Sb_Init(&msg, buffer, sizeof(buffer));
+
+	if (!drain) {
+		Bench_WriteMessage(&msg, BENCH_UNRELIABLE, e->unreliable_size);
+		e->unreliable.sent++;
+	}
+
+	Netchan_Transmit(&e->chan, msg.size, msg.data);
+}
+
+/*
+ * @brief Prints the delivery statistics of one direction of the connection.
+ */
+static void Bench_PrintStats(const char *name, net_src_t source) {
+	const bench_endpoint_t *e = &bench_endpoints[source];
+	const bench_stats_t *u = &e->unreliable, *r = &e->reliable;
+
+	const vec_t delivered = u->sent ? 100.0 * u->received / u->sent : 0.0;
+
+	const vec_t u_avg = u->received ? u->latency / (vec_t) u->received : 0.0;
+	const vec_t r_avg = r->received ? r->latency / (vec_t) r->received : 0.0;
+
+	Com_Print("  %s: %u packets dropped\n", name, bench_endpoints[source ^ 1].dropped);
+	Com_Print("    unreliable: %5.1f%% delivered, %6.1fms avg, %4ums max\n", delivered, u_avg,
+			u->max_latency);
+	Com_Print("    reliable: %u of %u delivered, %6.1fms avg, %5ums max\n", r->received, r->sent,
+			r_avg, r->max_latency);
+}
+
+/*
+ * @brief Clears the network conditions, and discards any datagrams still held
+ * by the simulator, so that they do not reach the next run.
+ */
+static void Bench_Flush(void) {
+	net_addr_t from;
+	uint16_t i;
+
+	Cvar_Set("net_sim_latency", "0");
+	Cvar_Set("net_sim_jitter", "0");
+	Cvar_Set("net_sim_loss", "0");
+	Cvar_Set("net_sim_duplicate", "0");
+	Cvar_Set("net_sim_reorder", "0");
+
+	const uint32_t start = Sys_Milliseconds();
+
+	while (Sys_Milliseconds() - start < 1000) {
+
+		for (i = NS_CLIENT; i <= NS_SERVER; i++) {
+			while (Net_GetPacket(i, &from, &net_message))
+				;
+		}
+
+		SDL_Delay(1);
+	}
+}
+
+/*
+ * @brief Runs the bot and the server over the loopback under the specified
+ * network conditions, and prints the results.
+ *
+ * @return True if every reliable message was delivered.
+ */
+static _Bool Bench_Run(const bench_profile_t *profile) {
+	net_addr_t addr;
+	uint16_t i;
+
+	Cvar_Set("net_sim_latency", profile->latency);
+	Cvar_Set("net_sim_jitter", profile->jitter);
+	Cvar_Set("net_sim_loss", profile->loss);
+	Cvar_Set("net_sim_duplicate", profile->duplicate);
+	Cvar_Set("net_sim_reorder", profile->reorder);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.type = NA_LOCAL;
+
+	quake2world.time = Sys_Milliseconds();
+
+	for (i = NS_CLIENT; i <= NS_SERVER; i++) {
+		bench_endpoint_t *e = &bench_endpoints[i];
+
+		memset(e, 0, sizeof(*e));
+		Netchan_Setup(i, &e->chan, addr, 1);
+
+		e->next_frame = e->next_reliable = quake2world.time;
+	}
+
+	bench_endpoints[NS_CLIENT].interval = BENCH_CLIENT_INTERVAL;
+	bench_endpoints[NS_CLIENT].unreliable_size = BENCH_CLIENT_COMMAND;
+	bench_endpoints[NS_CLIENT].reliable_interval = BENCH_CLIENT_RELIABLE;
+	bench_endpoints[NS_CLIENT].reliable_size = 32;
+
+	bench_endpoints[NS_SERVER].interval = BENCH_SERVER_INTERVAL;
+	bench_endpoints[NS_SERVER].unreliable_size = BENCH_SERVER_FRAME;
+	bench_endpoints[NS_SERVER].reliable_interval = BENCH_SERVER_RELIABLE;
+	bench_endpoints[NS_SERVER].reliable_size = BENCH_SERVER_BURST;
+
+	const uint32_t start = quake2world.time;
+	_Bool complete = false;
+
+	while (quake2world.time - start < BENCH_DURATION + BENCH_DRAIN) {
+		const _Bool drain = quake2world.time - start >= BENCH_DURATION;
+
+		for (i = NS_CLIENT; i <= NS_SERVER; i++) {
+			Bench_ReadPackets(i);
+			Bench_Frame(i, drain);
+		}
+
+		complete = true;
+
+		for (i = NS_CLIENT; i <= NS_SERVER; i++) {
+			const bench_endpoint_t *e = &bench_endpoints[i];
+
+			if (e->reliable.received < e->reliable.sent || !Netchan_CanReliable(&e->chan))
+				complete = false;
+		}
+
+		if (drain && complete)
+			break;
+
+		SDL_Delay(1);
+		quake2world.time = Sys_Milliseconds();
+	}
+
+	Com_Print("%s: %sms latency, %sms jitter, %s%% loss, %s%% duplicated, %s%% reordered\n",
+			profile->name, profile->latency, profile->jitter, profile->loss, profile->duplicate,
+			profile->reorder);
+
+	Bench_PrintStats("client to server", NS_CLIENT);
+	Bench_PrintStats("server to client", NS_SERVER);
+
+	Bench_Flush();
+
+	return complete;
+}
+
+/*
+ * @brief Benchmark entry point. Connects a headless bot to a minimal server
+ * over the loopback, under each of a series of simulated network conditions,
+ * and reports how the netchan delivers their traffic.
+ */
+int32_t main(int32_t argc, char **argv) {
+	int32_t failed = 0;
+	size_t i;
+
+	Test_Init(argc, argv);
+
+	Z_Init();
+
+	Cmd_Init();
+
+	Cvar_Init();
+
+	Netchan_Init();
+
+	Net_Init();
+
+	Sb_Init(&net_message, net_message_buffer, sizeof(net_message_buffer));
+
+	for (i = 0; i < G_N_ELEMENTS(bench_profiles); i++) {
+		if (!Bench_Run(&bench_profiles[i])) {
+			Com_Print("%s: reliable messages were not delivered\n", bench_profiles[i].name);
+			failed++;
+		}
+	}
+
+	Net_Shutdown();
+
+	Cvar_Shutdown();
+
+	Cmd_Shutdown();
+
+	Z_Shutdown();
+
+	Test_Shutdown();
+	return failed;
+}
@@ -0,0 +1,433 @@
+/*
+ * Copyright(c) 1997-2001 Id Software, Inc.
+ * Copyright(c) 2002 The Quakeforge Project.
+ * Copyright(c) 2006 Quake2World.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "tests.h"
+#include "server/sv_local.h"
+
+#define BENCH_EDICTS 1000
+#define BENCH_CLIENTS 32
+#define BENCH_CLUSTERS 2048
+#define BENCH_FRAMES 100
+
+sv_server_t sv;
+sv_static_t svs;
+
+cvar_t *sv_max_clients;
+
+static cvar_t bench_max_clients;
+static g_export_t bench_game;
+static g_edict_t bench_edicts[BENCH_EDICTS + 1];
+static g_client_t bench_clients[BENCH_CLIENTS];
+static sv_client_t bench_sv_clients[BENCH_CLIENTS];
+static entity_state_t bench_entity_states[BENCH_CLIENTS * UPDATE_BACKUP * MAX_PACKET_ENTITIES];
+
+static byte bench_pvs[BENCH_CLUSTERS][BENCH_CLUSTERS >> 3];
+static byte bench_phs[BENCH_CLUSTERS][BENCH_CLUSTERS >> 3];
+
+/*
+ * The benchmark replays a single recorded frame: a fixed set of edicts linked
+ * into clusters, and a fixed set of clients with their own PVS and PHS rows.
+ * The collision model is replaced with lookup tables, so that only entity
+ * visibility is measured. Leafs and clusters are one and the same, and each
+ * client's origin encodes its cluster.
+ */
+
+int32_t Cm_NumClusters(void) {
+	return BENCH_CLUSTERS;
+}
+
+int32_t Cm_PointLeafnum(const vec3_t p) {
+	return ((int32_t) p[0]) % BENCH_CLUSTERS;
+}
+
+int32_t Cm_BoxLeafnums(const vec3_t mins, const vec3_t maxs, int32_t *list,
+		size_t len __attribute__((unused)), int32_t *top_node __attribute__((unused))) {
+
+	vec3_t org;
+
+	VectorLerp(mins, maxs, 0.5, org);
+
+	*list = Cm_PointLeafnum(org);
+	return 1;
+}
+
+int32_t Cm_LeafCluster(const int32_t leaf_num) {
+	return leaf_num;
+}
+
+int32_t Cm_LeafArea(const int32_t leaf_num __attribute__((unused))) {
+	return 0;
+}
+
+byte *Cm_ClusterPVS(const int32_t cluster) {
+	return bench_pvs[cluster];
+}
+
+byte *Cm_ClusterPHS(const int32_t cluster) {
+	return bench_phs[cluster];
+}
+
+_Bool Cm_HeadnodeVisible(const int32_t head_node, const byte *vis __attribute__((unused))) {
+	return head_node & 1;
+}
+
+int32_t Cm_WriteAreaBits(byte *buffer, const int32_t area __attribute__((unused))) {
+
+	buffer[0] = 1;
+	return 1;
+}
+
+_Bool Cm_AreasConnected(const int32_t area1, const int32_t area2) {
+	return (area1 ^ area2) != 3;
+}
+
+/*
+ * @brief Records the frame. Roughly a tenth of the clusters are potentially
+ * visible from any given cluster, and a quarter are potentially hearable.
+ */
+static void Bench_Record(void) {
+	uint16_t i, j;
+
+	srand(1);
+
+	for (i = 0; i < BENCH_CLUSTERS; i++) {
+		for (j = 0; j < BENCH_CLUSTERS; j++) {
+			const int32_t r = rand() % 100;
+
+			if (r < 10 || i == j)
+				bench_pvs[i][j >> 3] |= 1 << (j & 7);
+
+			if (r < 25 || i == j)
+				bench_phs[i][j >> 3] |= 1 << (j & 7);
+		}
+	}
+
+	bench_game.edicts = bench_edicts;
+	bench_game.edict_size = sizeof(g_edict_t);
+	bench_game.num_edicts = bench_game.max_edicts = BENCH_EDICTS + 1;
+
+	svs.game = &bench_game;
+
+	bench_max_clients.integer = BENCH_CLIENTS;
+	sv_max_clients = &bench_max_clients;
+
+	for (i = 1; i <= BENCH_EDICTS; i++) {
+		g_edict_t *ent = &bench_edicts[i];
+
+		ent->in_use = true;
+		ent->s.number = i;
+		ent->s.model1 = i % 8 ? 1 : 0;
+		ent->s.sound = i % 16 == 0 ? 1 : 0;
+		ent->s.event = i % 32 == 1 ? 1 : 0;
+		ent->sv_flags = i % 20 == 0 ? SVF_NO_CLIENT : 0;
+		ent->area_num = rand() % 4;
+
+		if (i % 50 == 0) {
+			ent->num_clusters = -1;
+			ent->head_node = rand();
+		} else {
+			ent->num_clusters = 1 + rand() % 4;
+			for (j = 0; j < ent->num_clusters; j++) {
+				ent->clusters[j] = rand() % BENCH_CLUSTERS;
+			}
+		}
+	}
+
+	svs.clients = bench_sv_clients;
+	svs.entity_states = bench_entity_states;
+	svs.num_entity_states = G_N_ELEMENTS(bench_entity_states);
+
+	for (i = 0; i < BENCH_CLIENTS; i++) {
+		g_edict_t *ent = &bench_edicts[i + 1];
+
+		ent->client = &bench_clients[i];
+		ent->client->ps.pm_state.origin[0] = (rand() % BENCH_CLUSTERS) * 8;
+
+		svs.clients[i].edict = ent;
+	}
+}
+
+/*
+ * @brief The full scan which the cluster index replaces: every entity is
+ * tested against every client's visibility data. The frame is otherwise built
+ * just as Sv_BuildClientFrame builds it.
+ */
+static void Bench_LegacyClientFrame(const sv_client_t *client, sv_frame_t *frame) {
+	uint16_t visible[MAX_EDICTS];
+	const g_edict_t *cent = client->edict;
+	uint16_t e;
+	int32_t i;
+
+	const pm_state_t *pm = &cent->client->ps.pm_state;
+
+	vec3_t org;
+	VectorScale(pm->origin, 0.125, org);
+
+	const int32_t leaf = Cm_PointLeafnum(org);
+	const int32_t area = Cm_LeafArea(leaf);
+	const int32_t cluster = Cm_LeafCluster(leaf);
+
+	frame->area_bytes = Cm_WriteAreaBits(frame->area_bits, area);
+	frame->ps = cent->client->ps;
+
+	const byte *vis = Cm_ClusterPVS(cluster);
+	const byte *phs = Cm_ClusterPHS(cluster);
+
+	frame->num_entities = 0;
+
+	for (e = 1; e < svs.game->num_edicts; e++) {
+		const g_edict_t *ent = EDICT_FOR_NUM(e);
+
+		if (ent->sv_flags & SVF_NO_CLIENT)
+			continue;
+
+		if (!ent->s.model1 && !ent->s.effects && !ent->s.sound && !ent->s.event)
+			continue;
+
+		if (ent != cent) {
+			if (!Cm_AreasConnected(area, ent->area_num)) {
+				if (!ent->area_num2 || !Cm_AreasConnected(area, ent->area_num2))
+					continue;
+			}
+
+			const byte *vis_data = ent->s.sound || ent->s.event ? phs : vis;
+
+			if (ent->num_clusters == -1) {
+				if (!Cm_HeadnodeVisible(ent->head_node, vis_data))
+					continue;
+			} else {
+				for (i = 0; i < ent->num_clusters; i++) {
+					const int32_t c = ent->clusters[i];
+					if (vis_data[c >> 3] & (1 << (c & 7)))
+						break;
+				}
+				if (i == ent->num_clusters)
+					continue;
+			}
+		}
+
+		visible[frame->num_entities++] = e;
+	}
+
+	frame->first_entity = svs.next_entity_state;
+	svs.next_entity_state += frame->num_entities;
+
+	for (i = 0; i < frame->num_entities; i++) {
+		const g_edict_t *ent = EDICT_FOR_NUM(visible[i]);
+
+		entity_state_t *state = &svs.entity_states[(frame->first_entity + i) % svs.num_entity_states];
+		*state = ent->s;
+
+		if (ent->owner == client->edict)
+			state->solid = 0;
+	}
+}
+
+/*
+ * @brief Ensures that the indexed frames match the full scan, entity for entity,
+ * up to the number of entities a frame can hold.
+ */
+static _Bool Bench_Verify(void) {
+	sv_frame_t expected;
+	uint16_t i, j, k;
+
+	Sv_BuildClusterIndex();
+
+	for (i = 0; i < BENCH_CLIENTS; i++) {
+		sv_client_t *client = &svs.clients[i];
+		const sv_frame_t *frame = &client->frames[sv.frame_num & UPDATE_MASK];
+
+		svs.next_entity_state = 0;
+		Sv_BuildClientFrame(client);
+
+		svs.next_entity_state = MAX_EDICTS;
+		Bench_LegacyClientFrame(client, &expected);
+
+		// busy frames are culled to the most relevant entities, in order
+		const uint16_t num_entities = expected.num_entities < MAX_PACKET_ENTITIES ?
+				expected.num_entities : MAX_PACKET_ENTITIES;
+
+		if (frame->num_entities != num_entities) {
+			Com_Print("Client %u: %u entities, expected %u\n", i, frame->num_entities,
+					num_entities);
+			return false;
+		}
+
+		for (j = k = 0; j < frame->num_entities; j++) {
+			const entity_state_t *a = &svs.entity_states[frame->first_entity + j];
+
+			while (k < expected.num_entities
+					&& svs.entity_states[expected.first_entity + k].number != a->number) {
+				k++;
+			}
+
+			if (k == expected.num_entities) {
+				Com_Print("Client %u: entity %u (%u) is not visible\n", i, j, a->number);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/*
+ * @brief Writes the client frames for a run of frames in which a quarter of
+ * the entities move, with every client acknowledging the previous frame and
+ * limited to a single packet, so that some updates are deferred. If
+ * not shared, the delta cache is reset for every client, so that each frame
+ * is encoded in full. Returns the time spent writing frames, in seconds.
+ */
+static vec_t Bench_WriteFrames(_Bool shared, uint32_t *checksums) {
+	static byte messages[BENCH_CLIENTS][MAX_MSG_SIZE * 16];
+	uint16_t i, j, k;
+	gint64 elapsed = 0;
+
+	svs.next_entity_state = 0;
+
+	for (j = 0; j < BENCH_CLIENTS; j++) {
+		sv_client_t *client = &svs.clients[j];
+
+		memset(client->entity_priority, 0, sizeof(client->entity_priority));
+		client->frame_budget = MAX_MSG_SIZE - 8;
+	}
+
+	for (i = 0; i < BENCH_FRAMES; i++) {
+		sv.frame_num = i;
+
+		for (j = 1; j <= BENCH_EDICTS; j += 4) {
+			bench_edicts[j].s.origin[0] = i;
+		}
+
+		Sv_BuildClusterIndex();
+
+		for (j = 0; j < BENCH_CLIENTS; j++) {
+			Sv_BuildClientFrame(&svs.clients[j]);
+		}
+
+		const gint64 start = g_get_monotonic_time();
+
+		if (shared) {
+			Sv_ResetDeltaCache();
+		}
+
+		for (j = 0; j < BENCH_CLIENTS; j++) {
+			sv_client_t *client = &svs.clients[j];
+
+			if (!shared) {
+				Sv_ResetDeltaCache();
+			}
+
+			Sb_Init(&client->frame_message, messages[j], sizeof(messages[j]));
+
+			client->last_frame = i - 1;
+			Sv_WriteFrame(client, &client->frame_message);
+		}
+
+		elapsed += g_get_monotonic_time() - start;
+
+		for (j = 0; j < BENCH_CLIENTS; j++) {
+			const size_buf_t *msg = &svs.clients[j].frame_message;
+			uint32_t checksum = 2166136261u;
+
+			for (k = 0; k < msg->size; k++) {
+				checksum = (checksum ^ msg->data[k]) * 16777619u;
+			}
+
+			checksums[i * BENCH_CLIENTS + j] = checksum;
+		}
+	}
+
+	return elapsed / 1000000.0;
+}
+
+/*
+ * @brief Benchmark entry point. Replays the recorded frame with the full scan
+ * and with the cluster index, and reports the cost of each per client frame.
+ * Then writes a run of frames with and without the delta cache.
+ */
+int32_t main(int32_t argc, char **argv) {
+	sv_frame_t frame;
+	uint16_t i, j;
+
+	Test_Init(argc, argv);
+
+	Bench_Record();
+
+	if (!Bench_Verify()) {
+		Com_Print("Cluster index does not match full scan\n");
+		Test_Shutdown();
+		return 1;
+	}
+
+	const vec_t total = (vec_t) BENCH_FRAMES * BENCH_CLIENTS;
+
+	gint64 start = g_get_monotonic_time();
+
+	for (i = 0; i < BENCH_FRAMES; i++) {
+		for (j = 0; j < BENCH_CLIENTS; j++) {
+			Bench_LegacyClientFrame(&svs.clients[j], &frame);
+		}
+	}
+
+	const vec_t scan = (g_get_monotonic_time() - start) / 1000000.0;
+
+	start = g_get_monotonic_time();
+
+	for (i = 0; i < BENCH_FRAMES; i++) {
+		sv.frame_num = i;
+
+		Sv_BuildClusterIndex();
+
+		for (j = 0; j < BENCH_CLIENTS; j++) {
+			Sv_BuildClientFrame(&svs.clients[j]);
+		}
+	}
+
+	const vec_t indexed = (g_get_monotonic_time() - start) / 1000000.0;
+
+	Com_Print("%u edicts, %u clients: scan %.3fs (%.1fus/client), index %.3fs (%.1fus/client)\n",
+			BENCH_EDICTS, BENCH_CLIENTS, scan, scan * 1000000.0 / total, indexed,
+			indexed * 1000000.0 / total);
+
+	static uint32_t shared_checksums[BENCH_FRAMES * BENCH_CLIENTS];
+	static uint32_t encoded_checksums[BENCH_FRAMES * BENCH_CLIENTS];
+
+	const vec_t shared = Bench_WriteFrames(true, shared_checksums);
+
+	Sv_ResetDeltaCache();
+	Sv_DeltaStats_f();
+
+	const vec_t encoded = Bench_WriteFrames(false, encoded_checksums);
+
+	if (memcmp(shared_checksums, encoded_checksums, sizeof(shared_checksums))) {
+		Com_Print("Shared deltas do not match full encoding\n");
+		Test_Shutdown();
+		return 1;
+	}
+
+	Com_Print("%u edicts, %u clients: encoded %.3fs (%.1fus/client), shared %.3fs (%.1fus/client)\n",
+			BENCH_EDICTS, BENCH_CLIENTS, encoded, encoded * 1000000.0 / total, shared,
+			shared * 1000000.0 / total);
+
+	Test_Shutdown();
+	return 0;
+}
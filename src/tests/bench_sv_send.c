@@ -0,0 +1,352 @@
+/*
+ * Copyright(c) 1997-2001 Id Software, Inc.
+ * Copyright(c) 2002 The Quakeforge Project.
+ * Copyright(c) 2006 Quake2World.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "tests.h"
+#include "server/sv_local.h"
+
+#define BENCH_CLUSTERS 2048
+#define BENCH_DEPTH 11 // 2 ^ BENCH_DEPTH == BENCH_CLUSTERS
+#define BENCH_MULTICASTS 100 // temp entities and sounds per frame
+#define BENCH_FRAMES 100
+
+sv_server_t sv;
+sv_static_t svs;
+
+cvar_t *sv_max_clients;
+cvar_t *dedicated;
+sv_client_t *sv_client;
+
+static cvar_t bench_max_clients;
+static g_edict_t bench_edicts[MAX_CLIENTS + 1];
+static g_client_t bench_clients[MAX_CLIENTS];
+static sv_client_t bench_sv_clients[MAX_CLIENTS];
+
+static size_buf_t bench_datagrams[MAX_CLIENTS];
+static byte bench_datagram_bufs[MAX_CLIENTS][MAX_MSG_SIZE];
+
+static byte bench_pvs[BENCH_CLUSTERS][BENCH_CLUSTERS >> 3];
+static byte bench_phs[BENCH_CLUSTERS][BENCH_CLUSTERS >> 3];
+
+static vec3_t bench_origins[BENCH_MULTICASTS];
+
+/*
+ * The benchmark replays a frame's worth of positioned temp entities, sent to
+ * a varying number of clients. The collision model is replaced with a
+ * balanced tree of axis-aligned planes, so that point lookups cost roughly
+ * what they would on a real level. Leafs and clusters are one and the same.
+ */
+
+int32_t Cm_PointLeafnum(const vec3_t p) {
+	int32_t i, num = 0;
+
+	for (i = 0; i < BENCH_DEPTH; i++) {
+		const vec_t split = (num % 3 + 1) * 256.0;
+		num = (num << 1) | (p[i % 3] - split * (i + 1) >= 0.0 ? 1 : 0);
+	}
+
+	return num;
+}
+
+int32_t Cm_LeafCluster(const int32_t leaf_num) {
+	return leaf_num;
+}
+
+int32_t Cm_LeafArea(const int32_t leaf_num) {
+	return leaf_num & 3;
+}
+
+byte *Cm_ClusterPVS(const int32_t cluster) {
+	return bench_pvs[cluster];
+}
+
+byte *Cm_ClusterPHS(const int32_t cluster) {
+	return bench_phs[cluster];
+}
+
+_Bool Cm_AreasConnected(const int32_t area1, const int32_t area2) {
+	return (area1 ^ area2) != 3;
+}
+
+/*
+ * The frame building and demo facilities of the server are not exercised.
+ */
+
+void Sv_BuildClusterIndex(void) {
+}
+
+void Sv_BuildClientFrame(sv_client_t *client __attribute__((unused))) {
+}
+
+void Sv_WriteFrame(sv_client_t *client __attribute__((unused)), size_buf_t *msg __attribute__((unused))) {
+}
+
+size_buf_t *Sv_MultiViewEvents(void) {
+	return NULL;
+}
+
+void Sv_DropClient(sv_client_t *cl __attribute__((unused))) {
+}
+
+void Sv_ShutdownServer(const char *msg __attribute__((unused))) {
+}
+
+/*
+ * @brief Records the frame. Roughly a tenth of the clusters are potentially
+ * visible from any given cluster, and a quarter are potentially hearable.
+ */
+static void Bench_Record(void) {
+	uint16_t i, j;
+
+	srand(1);
+
+	for (i = 0; i < BENCH_CLUSTERS; i++) {
+		for (j = 0; j < BENCH_CLUSTERS; j++) {
+			const int32_t r = rand() % 100;
+
+			if (r < 10 || i == j)
+				bench_pvs[i][j >> 3] |= 1 << (j & 7);
+
+			if (r < 25 || i == j)
+				bench_phs[i][j >> 3] |= 1 << (j & 7);
+		}
+	}
+
+	for (i = 0; i < BENCH_MULTICASTS; i++) {
+		for (j = 0; j < 3; j++) {
+			bench_origins[i][j] = rand() % 8192;
+		}
+	}
+
+	svs.clients = bench_sv_clients;
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		g_edict_t *ent = &bench_edicts[i + 1];
+
+		ent->client = &bench_clients[i];
+
+		for (j = 0; j < 3; j++) {
+			ent->client->ps.pm_state.origin[j] = (rand() % 8192) * 8;
+		}
+
+		svs.clients[i].edict = ent;
+		svs.clients[i].state = SV_CLIENT_ACTIVE;
+
+		Sb_Init(&bench_datagrams[i], bench_datagram_bufs[i], sizeof(bench_datagram_bufs[i]));
+		bench_datagrams[i].allow_overflow = true;
+	}
+
+	bench_max_clients.integer = MAX_CLIENTS;
+	sv_max_clients = &bench_max_clients;
+
+	Sb_Init(&sv.multicast, sv.multicast_buffer, sizeof(sv.multicast_buffer));
+}
+
+/*
+ * @brief Writes a temp entity to the multicast buffer, as the game would.
+ */
+static void Bench_WriteTempEntity(const vec3_t origin) {
+
+	Msg_WriteByte(&sv.multicast, SV_CMD_CGAME);
+	Msg_WriteByte(&sv.multicast, 1);
+	Msg_WritePos(&sv.multicast, origin);
+	Msg_WritePos(&sv.multicast, origin);
+}
+
+/*
+ * @brief The per-client multicast which the shared event buffer replaces:
+ * each recipient's view is resolved and the payload is copied into its own
+ * datagram, for every multicast.
+ */
+static void Bench_LegacyMulticast(const vec3_t origin) {
+	sv_client_t *client;
+	int32_t j;
+
+	const int32_t leaf_num = Cm_PointLeafnum(origin);
+	const int32_t area1 = Cm_LeafArea(leaf_num);
+	const byte *mask = Cm_ClusterPHS(Cm_LeafCluster(leaf_num));
+
+	for (j = 0, client = svs.clients; j < sv_max_clients->integer; j++, client++) {
+		pm_state_t *pm = &client->edict->client->ps.pm_state;
+		vec3_t org;
+
+		VectorCopy(pm->origin, org);
+		VectorAdd(org, pm->view_offset, org);
+		VectorScale(org, 0.125, org);
+
+		const int32_t leaf = Cm_PointLeafnum(org);
+		const int32_t cluster = Cm_LeafCluster(leaf);
+		const int32_t area2 = Cm_LeafArea(leaf);
+
+		if (!Cm_AreasConnected(area1, area2))
+			continue;
+		if (!(mask[cluster >> 3] & (1 << (cluster & 7))))
+			continue;
+
+		Sb_Write(&bench_datagrams[j], sv.multicast.data, sv.multicast.size);
+	}
+
+	Sb_Clear(&sv.multicast);
+}
+
+/*
+ * @brief Runs the frames with the legacy multicast, copying each client's
+ * datagram to its frame message, and returns the elapsed time in seconds.
+ */
+static vec_t Bench_Legacy(void) {
+	uint16_t i, j;
+
+	const gint64 start = g_get_monotonic_time();
+
+	for (i = 0; i < BENCH_FRAMES; i++) {
+
+		for (j = 0; j < BENCH_MULTICASTS; j++) {
+			Bench_WriteTempEntity(bench_origins[j]);
+			Bench_LegacyMulticast(bench_origins[j]);
+		}
+
+		for (j = 0; j < sv_max_clients->integer; j++) {
+			sv_client_t *cl = &svs.clients[j];
+
+			Sb_Clear(&cl->frame_message);
+			Sb_Write(&cl->frame_message, bench_datagrams[j].data, bench_datagrams[j].size);
+			Sb_Clear(&bench_datagrams[j]);
+		}
+	}
+
+	return (g_get_monotonic_time() - start) / 1000000.0;
+}
+
+/*
+ * @brief Runs the frames with Sv_Multicast, copying each client's events to
+ * its frame message, and returns the elapsed time in seconds.
+ */
+static vec_t Bench_Events(void) {
+	uint16_t i, j, k;
+
+	const gint64 start = g_get_monotonic_time();
+
+	for (i = 0; i < BENCH_FRAMES; i++) {
+		sv.frame_num++;
+
+		for (j = 0; j < BENCH_MULTICASTS; j++) {
+			Bench_WriteTempEntity(bench_origins[j]);
+			Sv_Multicast(bench_origins[j], MULTICAST_PHS);
+		}
+
+		for (j = 0; j < sv_max_clients->integer; j++) {
+			sv_client_t *cl = &svs.clients[j];
+
+			Sb_Clear(&cl->frame_message);
+
+			for (k = 0; k < cl->num_events; k++) {
+				const sv_event_t *e = &cl->events[k];
+				Sb_Write(&cl->frame_message, e->buffer->data + e->offset, e->size);
+			}
+
+			Sv_ClearClientEvents(cl);
+		}
+	}
+
+	return (g_get_monotonic_time() - start) / 1000000.0;
+}
+
+/*
+ * @brief Ensures that both paths deliver identical frame messages.
+ */
+static _Bool Bench_Verify(void) {
+	static byte expected[MAX_CLIENTS][MAX_MSG_SIZE];
+	size_t sizes[MAX_CLIENTS];
+	uint16_t i;
+
+	sv_max_clients->integer = MAX_CLIENTS;
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		sv_client_t *cl = &svs.clients[i];
+
+		Sb_Init(&cl->frame_message, cl->frame_message_buf, sizeof(cl->frame_message_buf));
+		cl->frame_message.allow_overflow = true;
+	}
+
+	Bench_Legacy();
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		const size_buf_t *msg = &svs.clients[i].frame_message;
+
+		memcpy(expected[i], msg->data, msg->size);
+		sizes[i] = msg->size;
+	}
+
+	Bench_Events();
+
+	for (i = 0; i < MAX_CLIENTS; i++) {
+		const size_buf_t *msg = &svs.clients[i].frame_message;
+
+		if (msg->size != sizes[i] || memcmp(msg->data, expected[i], sizes[i])) {
+			Com_Print("Client %u: %u bytes, expected %u\n", i, (uint32_t) msg->size,
+					(uint32_t) sizes[i]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * @brief Benchmark entry point. Replays the frames with the legacy multicast
+ * and with the shared event buffer, for increasing numbers of clients, and
+ * reports the cost of each per multicast.
+ */
+int32_t main(int32_t argc, char **argv) {
+	uint16_t i;
+
+	Test_Init(argc, argv);
+
+	Z_Init();
+
+	Bench_Record();
+
+	if (!Bench_Verify()) {
+		Com_Print("Event buffer does not match per-client datagrams\n");
+		Test_Shutdown();
+		return 1;
+	}
+
+	const uint16_t counts[] = { 8, 16, 32, 64, 128, 256 };
+
+	for (i = 0; i < G_N_ELEMENTS(counts); i++) {
+		const vec_t total = (vec_t) BENCH_FRAMES * BENCH_MULTICASTS;
+
+		sv_max_clients->integer = counts[i];
+
+		const vec_t legacy = Bench_Legacy();
+		const vec_t events = Bench_Events();
+
+		Com_Print("%3u clients: legacy %.3fs (%.2fus/multicast), events %.3fs (%.2fus/multicast)\n",
+				counts[i], legacy, legacy * 1000000.0 / total, events, events * 1000000.0 / total);
+	}
+
+	Z_Free(svs.event_buffer);
+
+	Z_Shutdown();
+
+	Test_Shutdown();
+	return 0;
+}
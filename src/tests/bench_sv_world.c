@@ -0,0 +1,185 @@
+/*
+ * Copyright(c) 1997-2001 Id Software, Inc.
+ * Copyright(c) 2002 The Quakeforge Project.
+ * Copyright(c) 2006 Quake2World.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "tests.h"
+#include "server/sv_local.h"
+
+#define BENCH_EDICTS 1000
+#define BENCH_FRAMES 1000
+#define BENCH_WORLD 4096.0
+#define BENCH_SPEED 40.0 // units per frame, roughly that of a rocket
+
+sv_server_t sv;
+sv_static_t svs;
+
+static c_model_t bench_world;
+static g_export_t bench_game;
+static g_edict_t bench_edicts[BENCH_EDICTS + 1];
+static vec3_t bench_velocity[BENCH_EDICTS + 1];
+
+/*
+ * The benchmark measures the area broadphase in isolation, so the collision
+ * model is replaced with an empty world in which every entity is a box.
+ */
+
+int32_t Cm_BoxLeafnums(const vec3_t mins __attribute__((unused)),
+		const vec3_t maxs __attribute__((unused)), int32_t *list, size_t len __attribute__((unused)),
+		int32_t *top_node) {
+
+	*list = *top_node = 0;
+	return 1;
+}
+
+int32_t Cm_LeafCluster(const int32_t leaf_num __attribute__((unused))) {
+	return -1;
+}
+
+int32_t Cm_LeafArea(const int32_t leaf_num __attribute__((unused))) {
+	return 0;
+}
+
+int32_t Cm_HeadnodeForBox(const vec3_t mins __attribute__((unused)),
+		const vec3_t maxs __attribute__((unused))) {
+	return 0;
+}
+
+int32_t Cm_PointContents(const vec3_t p __attribute__((unused)),
+		int32_t head_node __attribute__((unused))) {
+	return 0;
+}
+
+int32_t Cm_TransformedPointContents(const vec3_t p __attribute__((unused)),
+		int32_t head_node __attribute__((unused)), const vec3_t origin __attribute__((unused)),
+		const vec3_t angles __attribute__((unused))) {
+	return 0;
+}
+
+c_trace_t Cm_BoxTrace(const vec3_t start __attribute__((unused)), const vec3_t end,
+		const vec3_t mins __attribute__((unused)), const vec3_t maxs __attribute__((unused)),
+		const int32_t head_node __attribute__((unused)), const int32_t brush_mask __attribute__((unused))) {
+
+	c_trace_t trace;
+
+	memset(&trace, 0, sizeof(trace));
+
+	trace.fraction = 1.0;
+	VectorCopy(end, trace.end);
+
+	return trace;
+}
+
+c_trace_t Cm_TransformedBoxTrace(const vec3_t start, const vec3_t end, const vec3_t mins,
+		const vec3_t maxs, const int32_t head_node, const int32_t brush_mask,
+		const vec3_t origin __attribute__((unused)), const vec3_t angles __attribute__((unused))) {
+
+	return Cm_BoxTrace(start, end, mins, maxs, head_node, brush_mask);
+}
+
+/*
+ * @brief Spawns the moving edicts at random positions, with random velocities.
+ */
+static void Bench_Spawn(void) {
+	uint16_t i, j;
+
+	bench_game.edicts = bench_edicts;
+	bench_game.edict_size = sizeof(g_edict_t);
+	bench_game.num_edicts = bench_game.max_edicts = BENCH_EDICTS + 1;
+
+	svs.game = &bench_game;
+
+	VectorSet(bench_world.mins, -BENCH_WORLD * 0.5, -BENCH_WORLD * 0.5, -BENCH_WORLD * 0.5);
+	VectorSet(bench_world.maxs, BENCH_WORLD * 0.5, BENCH_WORLD * 0.5, BENCH_WORLD * 0.5);
+
+	sv.models[0] = &bench_world;
+
+	Sv_InitWorld();
+
+	for (i = 1; i <= BENCH_EDICTS; i++) {
+		g_edict_t *ent = &bench_edicts[i];
+
+		ent->in_use = true;
+		ent->solid = i % 10 ? SOLID_BOX : SOLID_TRIGGER;
+
+		VectorSet(ent->mins, -16.0, -16.0, -24.0);
+		VectorSet(ent->maxs, 16.0, 16.0, 32.0);
+
+		for (j = 0; j < 3; j++) {
+			ent->s.origin[j] = Randomc() * BENCH_WORLD * 0.5;
+			bench_velocity[i][j] = Randomc() * BENCH_SPEED;
+		}
+
+		Sv_LinkEdict(ent);
+	}
+}
+
+/*
+ * @brief Moves every edict, relinking it, and traces its move against the
+ * others, as a projectile would.
+ */
+static void Bench_Frame(void) {
+	uint16_t i, j;
+
+	for (i = 1; i <= BENCH_EDICTS; i++) {
+		g_edict_t *ent = &bench_edicts[i];
+		vec3_t end;
+
+		VectorAdd(ent->s.origin, bench_velocity[i], end);
+
+		for (j = 0; j < 3; j++) { // bounce off of the edges of the world
+			if (fabsf(end[j]) > BENCH_WORLD * 0.5) {
+				bench_velocity[i][j] = -bench_velocity[i][j];
+				end[j] = ent->s.origin[j];
+			}
+		}
+
+		const c_trace_t tr = Sv_Trace(ent->s.origin, ent->mins, ent->maxs, end, ent, MASK_SHOT);
+
+		VectorCopy(tr.end, ent->s.origin);
+		Sv_LinkEdict(ent);
+	}
+}
+
+/*
+ * @brief Benchmark entry point. Moves and traces BENCH_EDICTS edicts for
+ * BENCH_FRAMES frames, and reports traces per second.
+ */
+int32_t main(int32_t argc, char **argv) {
+	uint32_t i;
+
+	Test_Init(argc, argv);
+
+	Bench_Spawn();
+
+	const gint64 start = g_get_monotonic_time();
+
+	for (i = 0; i < BENCH_FRAMES; i++) {
+		Bench_Frame();
+	}
+
+	const vec_t seconds = (g_get_monotonic_time() - start) / 1000000.0;
+	const vec_t traces = (vec_t) BENCH_EDICTS * BENCH_FRAMES;
+
+	Com_Print("%u edicts, %u frames: %.3fs (%.0f traces/s)\n", BENCH_EDICTS, BENCH_FRAMES,
+			seconds, traces / seconds);
+
+	Test_Shutdown();
+	return 0;
+}
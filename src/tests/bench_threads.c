@@ -0,0 +1,173 @@
+/*
+ * Copyright(c) 1997-2001 Id Software, Inc.
+ * Copyright(c) 2002 The Quakeforge Project.
+ * Copyright(c) 2006 Quake2World.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "tests.h"
+#include "cmd.h"
+#include "cvar.h"
+#include "threads.h"
+
+#define BENCH_ITEMS 200000
+#define BENCH_ITERATIONS 10
+#define BENCH_MAX_THREADS 32
+
+typedef struct {
+	SDL_mutex *lock;
+	int32_t index;
+	vec_t out[BENCH_ITEMS];
+} bench_work_t;
+
+static bench_work_t bench_work;
+
+/*
+ * @brief A small unit of floating point work, comparable to generating the
+ * primitives for a single particle.
+ */
+static void Bench_Item(int32_t i) {
+	vec3_t v = { i, i * 0.5, i * 0.25 };
+	uint16_t j;
+
+	for (j = 0; j < 16; j++) {
+		VectorScale(v, 0.99, v);
+		v[2] += DotProduct(v, v) * 0.0001;
+	}
+
+	bench_work.out[i] = v[2];
+}
+
+/*
+ * @brief The legacy pattern: each thread pulls one item at a time from a
+ * shared, mutex-protected index.
+ */
+static int32_t Bench_Legacy(void *data __attribute__((unused))) {
+
+	while (true) {
+		SDL_mutexP(bench_work.lock);
+		const int32_t i = bench_work.index++;
+		SDL_mutexV(bench_work.lock);
+
+		if (i >= BENCH_ITEMS)
+			break;
+
+		Bench_Item(i);
+	}
+
+	return 0;
+}
+
+/*
+ * @brief ThreadRangeFunc for the job system.
+ */
+static void Bench_Range(int32_t begin, int32_t end, void *data __attribute__((unused))) {
+	int32_t i;
+
+	for (i = begin; i < end; i++) {
+		Bench_Item(i);
+	}
+}
+
+/*
+ * @brief Runs the workload with dedicated threads and a shared work index,
+ * returning the elapsed time in seconds.
+ */
+static vec_t Bench_RunLegacy(uint16_t num_threads) {
+	SDL_Thread *threads[BENCH_MAX_THREADS];
+	uint16_t i, j;
+
+	const gint64 start = g_get_monotonic_time();
+
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		bench_work.index = 0;
+
+		for (j = 0; j < num_threads; j++) {
+			threads[j] = SDL_CreateThread(Bench_Legacy, NULL);
+		}
+
+		for (j = 0; j < num_threads; j++) {
+			SDL_WaitThread(threads[j], NULL);
+		}
+	}
+
+	return (g_get_monotonic_time() - start) / 1000000.0;
+}
+
+/*
+ * @brief Runs the workload through Thread_ParallelFor, returning the elapsed
+ * time in seconds.
+ */
+static vec_t Bench_RunJobs(void) {
+	uint16_t i;
+
+	const gint64 start = g_get_monotonic_time();
+
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		Thread_ParallelFor(BENCH_ITEMS, 0, Bench_Range, NULL);
+	}
+
+	return (g_get_monotonic_time() - start) / 1000000.0;
+}
+
+/*
+ * @brief Benchmark entry point. Compares the legacy threading pattern with
+ * the job system for N threads (the first argument, default 4).
+ */
+int32_t main(int32_t argc, char **argv) {
+
+	Test_Init(argc, argv);
+
+	const uint16_t num_threads = argc > 1 ? Clamp(atoi(argv[1]), 1, BENCH_MAX_THREADS) : 4;
+
+	Z_Init();
+
+	Fs_Init(false);
+
+	Cmd_Init();
+
+	Cvar_Init();
+
+	Cvar_Set("threads", va("%u", num_threads - 1)); // the caller runs jobs too
+
+	Thread_Init();
+
+	bench_work.lock = SDL_CreateMutex();
+
+	const vec_t total = (vec_t) BENCH_ITEMS * BENCH_ITERATIONS;
+
+	const vec_t legacy = Bench_RunLegacy(num_threads);
+	const vec_t jobs = Bench_RunJobs();
+
+	Com_Print("%2u thread(s): legacy %.3fs (%.0f items/s), jobs %.3fs (%.0f items/s)\n",
+			num_threads, legacy, total / legacy, jobs, total / jobs);
+
+	SDL_DestroyMutex(bench_work.lock);
+
+	Thread_Shutdown();
+
+	Cvar_Shutdown();
+
+	Cmd_Shutdown();
+
+	Fs_Shutdown();
+
+	Z_Shutdown();
+
+	Test_Shutdown();
+	return 0;
+}
@@ -72,6 +72,118 @@ START_TEST(check_Z_CopyString)
 		ck_assert(Z_Size() == 0);
 	}END_TEST
 
+START_TEST(check_Z_TagArena)
+	{
+		byte *a = Z_TagMalloc(1, Z_TAG_GAME_LEVEL);
+		byte *b = Z_TagMalloc(1024 * 1024, Z_TAG_GAME_LEVEL);
+
+		ck_assert(Z_Size() == 1 + 1024 * 1024);
+		ck_assert(((uintptr_t) a & 15) == 0 && ((uintptr_t) b & 15) == 0);
+
+		byte *child = Z_LinkMalloc(1, a);
+
+		ck_assert(Z_Size() == 2 + 1024 * 1024);
+
+		Z_Free(b);
+
+		ck_assert(Z_Size() == 2);
+
+		Z_FreeTag(Z_TAG_GAME_LEVEL);
+
+		ck_assert(Z_Size() == 0);
+
+		a = Z_TagMalloc(1, Z_TAG_GAME_LEVEL);
+		child = Z_LinkMalloc(1, a);
+
+		ck_assert(child[0] == 0);
+		ck_assert(Z_Size() == 2);
+
+		Z_FreeTag(Z_TAG_GAME_LEVEL);
+
+		ck_assert(Z_Size() == 0);
+
+	}END_TEST
+
+START_TEST(check_Z_Stats)
+	{
+		byte *a = Z_TagMalloc(10, Z_TAG_SERVER);
+		byte *b = Z_TagMalloc(20, Z_TAG_GAME_LEVEL);
+
+		Z_LinkMalloc(5, b);
+
+		ck_assert(Z_Size() == 35);
+
+		Z_Free(a);
+		Z_FreeTag(Z_TAG_GAME_LEVEL);
+
+		ck_assert(Z_Size() == 0);
+
+		Z_Stats(false);
+		Z_Stats(true);
+
+	}END_TEST
+
+/*
+ * @brief Allocates the specified number of children of a single parent, frees
+ * the specified number of them in random order, and then frees the parent
+ * with the rest.
+ */
+static void Z_FreeChildren(uint32_t count, uint32_t freed) {
+	uint32_t i;
+
+	const size_t baseline = Z_Size();
+
+	byte **children = Z_Malloc(count * sizeof(byte *));
+	byte *parent = Z_Malloc(1);
+
+	for (i = 0; i < count; i++) {
+		children[i] = Z_LinkMalloc(1, parent);
+	}
+
+	const size_t size = Z_Size();
+
+	ck_assert(size == baseline + count * sizeof(byte *) + 1 + count);
+
+	for (i = count - 1; i > 0; i--) {
+		const uint32_t j = g_random_int_range(0, i + 1);
+
+		byte *c = children[i];
+		children[i] = children[j];
+		children[j] = c;
+	}
+
+	for (i = 0; i < freed; i++) {
+		Z_Free(children[i]);
+
+		ck_assert_msg(Z_Size() == size - (i + 1), "%u of %u", i + 1, count);
+	}
+
+	Z_Free(parent);
+
+	ck_assert(Z_Size() == baseline + count * sizeof(byte *));
+
+	Z_Free(children);
+
+	ck_assert(Z_Size() == baseline);
+}
+
+START_TEST(check_Z_Free_children)
+	{
+		Z_FreeChildren(1, 1);
+		Z_FreeChildren(10000, 5000);
+
+		byte *other = Z_Malloc(1);
+
+		Z_FreeChildren(100000, 100000);
+
+		ck_assert(Z_Size() == 1);
+
+		Z_Free(other);
+
+		ck_assert(Z_Size() == 0);
+
+	}END_TEST
+
 /*
  * @brief Test entry point.
  */
@@ -84,6 +196,9 @@ int32_t main(int32_t argc, char **argv) {
 
 	tcase_add_test(tcase, check_Z_LinkMalloc);
 	tcase_add_test(tcase, check_Z_CopyString);
+	tcase_add_test(tcase, check_Z_TagArena);
+	tcase_add_test(tcase, check_Z_Free_children);
+	tcase_add_test(tcase, check_Z_Stats);
 
 	Suite *suite = suite_create("check_mem");
 	suite_add_tcase(suite, tcase);
@@ -0,0 +1,110 @@
+/*
+ * Copyright(c) 1997-2001 Id Software, Inc.
+ * Copyright(c) 2002 The Quakeforge Project.
+ * Copyright(c) 2006 Quake2World.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "tests.h"
+
+// the bits each entity angle is quantized to by Msg_WriteDeltaEntity
+static const uint16_t check_angle_bits[3] = { 8, 12, 6 };
+
+static byte check_buffer[256];
+static size_buf_t check_message;
+
+/*
+ * @brief Setup fixture.
+ */
+void setup(void) {
+	Sb_Init(&check_message, check_buffer, sizeof(check_buffer));
+}
+
+/*
+ * @brief Teardown fixture.
+ */
+void teardown(void) {
+
+}
+
+/*
+ * @brief Writes the entity as a delta from from, and reads it back into out.
+ */
+static void Check_DeltaEntity(entity_state_t *from, entity_state_t *to, entity_state_t *out) {
+
+	Sb_Clear(&check_message);
+
+	Msg_WriteDeltaEntity(from, to, &check_message, true, false);
+
+	Msg_BeginReading(&check_message);
+
+	const uint16_t bits = Msg_ReadBits(&check_message, U_BITS);
+	Msg_ReadDeltaEntity(from, out, &check_message, to->number, bits);
+
+	ck_assert(check_message.read == check_message.size);
+}
+
+START_TEST(check_Msg_DeltaEntity_angles)
+	{
+		entity_state_t from, to, out;
+		int32_t i, j;
+
+		memset(&from, 0, sizeof(from));
+		from.number = 1;
+
+		for (i = 0; i < 3; i++) {
+			const vec_t step = 360.0 / (1 << check_angle_bits[i]);
+
+			for (j = 0; j < 360; j++) {
+				to = from;
+				to.angles[i] = j;
+
+				Check_DeltaEntity(&from, &to, &out);
+
+				const vec_t a = out.angles[i];
+
+				ck_assert_msg(a >= -180.0 && a < 180.0, "%d: %d decoded to %f", i, j, a);
+
+				const vec_t error = fmod(a - j + 540.0, 360.0) - 180.0;
+
+				ck_assert_msg(fabs(error) <= step * 0.5 + 0.0001, "%d: %d decoded to %f", i, j,
+						a);
+			}
+		}
+
+	}END_TEST
+
+/*
+ * @brief Test entry point.
+ */
+int32_t main(int32_t argc, char **argv) {
+
+	Test_Init(argc, argv);
+
+	TCase *tcase = tcase_create("check_msg");
+	tcase_add_checked_fixture(tcase, setup, teardown);
+
+	tcase_add_test(tcase, check_Msg_DeltaEntity_angles);
+
+	Suite *suite = suite_create("check_msg");
+	suite_add_tcase(suite, tcase);
+
+	int32_t failed = Test_Run(suite);
+
+	Test_Shutdown();
+	return failed;
+}
@@ -0,0 +1,303 @@
+/*
+ * Copyright(c) 1997-2001 Id Software, Inc.
+ * Copyright(c) 2002 The Quakeforge Project.
+ * Copyright(c) 2006 Quake2World.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "tests.h"
+#include "cmd.h"
+#include "filesystem.h"
+#include "net.h"
+
+#define CHECK_LATENCY 100 // one way, in milliseconds
+#define CHECK_RTT (CHECK_LATENCY * 2)
+#define CHECK_JOIN_SIZE (40 * 1024) // config strings and baselines of a large level
+#define CHECK_MAX_PACKETS 1024
+#define CHECK_TIMEOUT 60000
+
+static const byte check_unreliable[] = { 'u', 'n', 'r', 'l' };
+
+/*
+ * A link between the client and the server, delivering packets in order after
+ * a fixed latency, and dropping a fraction of them.
+ */
+typedef struct {
+	uint32_t time; // when the packet arrives
+	size_t size;
+	byte data[MAX_MSG_SIZE];
+} check_packet_t;
+
+typedef struct {
+	check_packet_t packets[CHECK_MAX_PACKETS];
+	uint32_t head, tail;
+} check_link_t;
+
+/*
+ * Each end of the connection. The client requests the join data in chunks, as
+ * the config_strings and baselines commands do, and the server stages each
+ * chunk as one reliable message.
+ */
+typedef struct {
+	net_chan_t chan;
+	uint32_t interval; // milliseconds between frames
+	size_t requested; // join data requested by the client
+	size_t received; // join data received by the client, or staged by the server
+} check_endpoint_t;
+
+static check_link_t check_links[2]; // by destination
+static check_endpoint_t check_endpoints[2]; // by net_src_t
+
+static GRand *check_rand;
+static gdouble check_loss;
+
+/*
+ * @brief Sends the packet over the simulated link.
+ */
+void Net_SendPacket(net_src_t source, size_t length, void *data,
+		net_addr_t to __attribute__((unused))) {
+
+	if (g_rand_double(check_rand) < check_loss)
+		return;
+
+	check_link_t *link = &check_links[source == NS_CLIENT ? NS_SERVER : NS_CLIENT];
+
+	ck_assert(link->tail - link->head < CHECK_MAX_PACKETS);
+	ck_assert(length <= MAX_MSG_SIZE);
+
+	check_packet_t *p = &link->packets[link->tail++ % CHECK_MAX_PACKETS];
+
+	p->time = quake2world.time + CHECK_LATENCY;
+	p->size = length;
+
+	memcpy(p->data, data, length);
+}
+
+/*
+ * @brief
+ */
+char *Net_NetaddrToString(net_addr_t a __attribute__((unused))) {
+	return "loopback";
+}
+
+/*
+ * @brief Returns the join data byte at the specified offset. Successive bytes
+ * differ by 31 or 32, so the join data never contains check_unreliable.
+ */
+static byte Check_JoinData(size_t offset) {
+	return (byte) (offset * 31 + (offset >> 8));
+}
+
+/*
+ * @brief Handles the reliable data delivered to the specified endpoint.
+ */
+static void Check_Reliable(net_src_t source, const byte *data, size_t size) {
+	check_endpoint_t *e = &check_endpoints[source];
+	size_t i;
+
+	if (source == NS_SERVER) { // each byte is a request for the next chunk
+		for (i = 0; i < size; i++) {
+			size_buf_t *msg = &e->chan.message;
+
+			while (msg->size < msg->max_size / 2 && e->received < CHECK_JOIN_SIZE) {
+				Msg_WriteByte(msg, Check_JoinData(e->received++));
+			}
+		}
+	} else {
+		for (i = 0; i < size; i++) {
+			ck_assert_msg(data[i] == Check_JoinData(e->received), "Corrupt at %u",
+					(uint32_t) e->received);
+			e->received++;
+		}
+
+		ck_assert(e->received <= CHECK_JOIN_SIZE);
+
+		// request the next chunk once the current one has arrived
+		if (e->received == e->requested && e->received < CHECK_JOIN_SIZE) {
+			e->requested += check_endpoints[NS_SERVER].chan.message.max_size / 2;
+			e->requested = e->requested > CHECK_JOIN_SIZE ? CHECK_JOIN_SIZE : e->requested;
+
+			Msg_WriteByte(&e->chan.message, 1);
+		}
+	}
+}
+
+/*
+ * @brief Delivers the packets which have arrived at the specified endpoint.
+ */
+static void Check_ReadPackets(net_src_t source) {
+	check_link_t *link = &check_links[source];
+	check_endpoint_t *e = &check_endpoints[source];
+
+	while (link->head != link->tail) {
+		const check_packet_t *p = &link->packets[link->head % CHECK_MAX_PACKETS];
+
+		if (p->time > quake2world.time)
+			break;
+
+		Sb_Clear(&net_message);
+		Sb_Write(&net_message, p->data, p->size);
+
+		link->head++;
+
+		if (!Netchan_Process(&e->chan, &net_message))
+			continue;
+
+		// the unreliable message, if any, follows the delivered reliable messages
+		size_t size = net_message.size;
+		const size_t n = sizeof(check_unreliable);
+
+		if (size >= n && !memcmp(net_message.data + size - n, check_unreliable, n))
+			size -= n;
+		else
+			ck_assert(source == NS_CLIENT); // only the server sends bursts
+
+		Check_Reliable(source, net_message.data, size);
+	}
+}
+
+/*
+ * @brief Runs a connection to completion with the specified packet loss,
+ * returning the elapsed time in milliseconds.
+ */
+static uint32_t Check_Join(gdouble loss) {
+	net_addr_t addr;
+	uint16_t i;
+
+	memset(&addr, 0, sizeof(addr));
+	memset(check_links, 0, sizeof(check_links));
+
+	check_loss = loss;
+	quake2world.time = 0;
+
+	for (i = NS_CLIENT; i <= NS_SERVER; i++) {
+		check_endpoint_t *e = &check_endpoints[i];
+
+		memset(e, 0, sizeof(*e));
+		Netchan_Setup(i, &e->chan, addr, 1);
+	}
+
+	check_endpoints[NS_CLIENT].interval = 16;
+	check_endpoints[NS_SERVER].interval = 33;
+
+	// the initial request, as in response to the server data
+	Check_Reliable(NS_CLIENT, NULL, 0);
+
+	while (check_endpoints[NS_CLIENT].received < CHECK_JOIN_SIZE) {
+
+		ck_assert(quake2world.time < CHECK_TIMEOUT);
+
+		for (i = NS_CLIENT; i <= NS_SERVER; i++) {
+			check_endpoint_t *e = &check_endpoints[i];
+
+			Check_ReadPackets(i);
+
+			if (quake2world.time % e->interval)
+				continue;
+
+			// connecting endpoints only send when reliable data requires it
+			if (Netchan_NeedReliable(&e->chan) || quake2world.time - e->chan.last_sent > 1000)
+				Netchan_Transmit(&e->chan, sizeof(check_unreliable), (byte *) check_unreliable);
+
+			ck_assert(!e->chan.fatal_error);
+		}
+
+		quake2world.time++;
+	}
+
+	return quake2world.time;
+}
+
+/*
+ * @brief Setup fixture.
+ */
+void setup(void) {
+
+	Z_Init();
+
+	Fs_Init(false);
+
+	Cmd_Init();
+
+	Cvar_Init();
+
+	Netchan_Init();
+
+	Sb_Init(&net_message, net_message_buffer, sizeof(net_message_buffer));
+
+	check_rand = g_rand_new_with_seed(1);
+}
+
+/*
+ * @brief Teardown fixture.
+ */
+void teardown(void) {
+
+	g_rand_free(check_rand);
+
+	Cvar_Shutdown();
+
+	Cmd_Shutdown();
+
+	Fs_Shutdown();
+
+	Z_Shutdown();
+}
+
+START_TEST(check_Netchan_Join)
+	{
+		const uint32_t elapsed = Check_Join(0.0);
+
+		Com_Print("Joined in %ums (%.1f round trips)\n", elapsed, elapsed / (vec_t) CHECK_RTT);
+
+		// a round trip for each chunk, and a little more for frame intervals
+		ck_assert_msg(elapsed < 6 * CHECK_RTT, "%ums", elapsed);
+
+	}END_TEST
+
+START_TEST(check_Netchan_Join_loss)
+	{
+		const uint32_t elapsed = Check_Join(0.1);
+
+		Com_Print("Joined in %ums (%.1f round trips) with 10%% loss\n", elapsed,
+				elapsed / (vec_t) CHECK_RTT);
+
+		ck_assert_msg(elapsed < 20 * CHECK_RTT, "%ums", elapsed);
+
+	}END_TEST
+
+/*
+ * @brief Test entry point.
+ */
+int32_t main(int32_t argc, char **argv) {
+
+	Test_Init(argc, argv);
+
+	TCase *tcase = tcase_create("check_netchan");
+	tcase_add_checked_fixture(tcase, setup, teardown);
+
+	tcase_add_test(tcase, check_Netchan_Join);
+	tcase_add_test(tcase, check_Netchan_Join_loss);
+
+	Suite *suite = suite_create("check_netchan");
+	suite_add_tcase(suite, tcase);
+
+	int32_t failed = Test_Run(suite);
+
+	Test_Shutdown();
+	return failed;
+}
@@ -0,0 +1,398 @@
+/*
+ * Copyright(c) 1997-2001 Id Software, Inc.
+ * Copyright(c) 2002 The Quakeforge Project.
+ * Copyright(c) 2006 Quake2World.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include "tests.h"
+#include "cmd.h"
+#include "threads.h"
+#include "server/sv_local.h"
+
+#define CHECK_EDICTS 200
+#define CHECK_BATCHES 500
+#define CHECK_PELLETS 12
+#define CHECK_WORLD 1024.0
+#define CHECK_RANGE 2048.0
+
+#define CHECK_BOX_HEAD_NODE 1
+
+sv_server_t sv;
+sv_static_t svs;
+
+static c_model_t check_world;
+static g_export_t check_game;
+static g_edict_t check_edicts[CHECK_EDICTS + 1];
+
+static GRand *check_rand;
+
+/*
+ * The collision model is replaced with a world of a few boxes: a floor and
+ * two pillars. Entities are boxes too. Every trace is clipped to boxes
+ * analytically, and world traces are safe to run in parallel.
+ */
+
+static const vec3_t check_world_boxes[][2] = {
+	{ { -CHECK_WORLD * 2.0, -CHECK_WORLD * 2.0, -64.0 }, { CHECK_WORLD * 2.0, CHECK_WORLD * 2.0, 0.0 } },
+	{ { -256.0, -256.0, 0.0 }, { -128.0, -128.0, 512.0 } },
+	{ { 128.0, 64.0, 0.0 }, { 192.0, 320.0, 256.0 } }
+};
+
+static vec3_t check_box_mins, check_box_maxs; // of the last Cm_HeadnodeForBox
+
+/*
+ * @brief Clips the box moving from start to end against the specified box,
+ * as Cm_ClipBoxToBrush would against a brush of its six sides.
+ */
+static void Check_ClipBox(const vec3_t start, const vec3_t end, const vec3_t mins,
+		const vec3_t maxs, const vec3_t box_mins, const vec3_t box_maxs, c_trace_t *trace) {
+	vec_t enter_fraction = -1.0, leave_fraction = 1.0;
+	_Bool start_outside = false, end_outside = false;
+	vec3_t normal;
+	int32_t i, j;
+
+	VectorClear(normal);
+
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 2; j++) {
+			const vec_t sign = j ? 1.0 : -1.0;
+			const vec_t dist = j ? box_maxs[i] - mins[i] : -(box_mins[i] - maxs[i]);
+
+			const vec_t d1 = sign * start[i] - dist;
+			const vec_t d2 = sign * end[i] - dist;
+
+			if (d1 > 0.0)
+				start_outside = true;
+			if (d2 > 0.0)
+				end_outside = true;
+
+			if (d1 > 0.0 && d2 >= d1)
+				return; // completely in front of this side
+
+			if (d1 <= 0.0 && d2 <= 0.0)
+				continue;
+
+			const vec_t f = d1 / (d1 - d2);
+
+			if (d1 > d2) {
+				if (f > enter_fraction) {
+					enter_fraction = f;
+					VectorClear(normal);
+					normal[i] = sign;
+				}
+			} else if (f < leave_fraction) {
+				leave_fraction = f;
+			}
+		}
+	}
+
+	if (!start_outside) {
+		trace->start_solid = true;
+		if (!end_outside) {
+			trace->all_solid = true;
+			trace->fraction = 0.0;
+		}
+		return;
+	}
+
+	if (enter_fraction < leave_fraction && enter_fraction > -1.0
+			&& enter_fraction < trace->fraction) {
+		trace->fraction = enter_fraction < 0.0 ? 0.0 : enter_fraction;
+		VectorCopy(normal, trace->plane.normal);
+		trace->contents = CONTENTS_SOLID;
+	}
+}
+
+/*
+ * @brief Sets the end point of the trace from its fraction.
+ */
+static void Check_TraceEnd(const vec3_t start, const vec3_t end, c_trace_t *trace) {
+	int32_t i;
+
+	for (i = 0; i < 3; i++) {
+		trace->end[i] = start[i] + trace->fraction * (end[i] - start[i]);
+	}
+}
+
+int32_t Cm_BoxLeafnums(const vec3_t mins __attribute__((unused)),
+		const vec3_t maxs __attribute__((unused)), int32_t *list, size_t len __attribute__((unused)),
+		int32_t *top_node) {
+
+	*list = *top_node = 0;
+	return 1;
+}
+
+int32_t Cm_LeafCluster(const int32_t leaf_num __attribute__((unused))) {
+	return -1;
+}
+
+int32_t Cm_LeafArea(const int32_t leaf_num __attribute__((unused))) {
+	return 0;
+}
+
+int32_t Cm_HeadnodeForBox(const vec3_t mins, const vec3_t maxs) {
+
+	VectorCopy(mins, check_box_mins);
+	VectorCopy(maxs, check_box_maxs);
+
+	return CHECK_BOX_HEAD_NODE;
+}
+
+int32_t Cm_PointContents(const vec3_t p __attribute__((unused)),
+		int32_t head_node __attribute__((unused))) {
+	return 0;
+}
+
+int32_t Cm_TransformedPointContents(const vec3_t p __attribute__((unused)),
+		int32_t head_node __attribute__((unused)), const vec3_t origin __attribute__((unused)),
+		const vec3_t angles __attribute__((unused))) {
+	return 0;
+}
+
+c_trace_t Cm_BoxTrace(const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs,
+		const int32_t head_node, const int32_t brush_mask __attribute__((unused))) {
+	c_trace_t trace;
+	size_t i;
+
+	ck_assert(head_node == 0);
+
+	memset(&trace, 0, sizeof(trace));
+	trace.fraction = 1.0;
+
+	for (i = 0; i < lengthof(check_world_boxes) && !trace.all_solid; i++) {
+		Check_ClipBox(start, end, mins, maxs, check_world_boxes[i][0], check_world_boxes[i][1],
+				&trace);
+	}
+
+	Check_TraceEnd(start, end, &trace);
+
+	return trace;
+}
+
+c_trace_t Cm_TransformedBoxTrace(const vec3_t start, const vec3_t end, const vec3_t mins,
+		const vec3_t maxs, const int32_t head_node, const int32_t brush_mask __attribute__((unused)),
+		const vec3_t origin, const vec3_t angles __attribute__((unused))) {
+	vec3_t box_mins, box_maxs;
+	c_trace_t trace;
+
+	ck_assert(head_node == CHECK_BOX_HEAD_NODE);
+
+	VectorAdd(origin, check_box_mins, box_mins);
+	VectorAdd(origin, check_box_maxs, box_maxs);
+
+	memset(&trace, 0, sizeof(trace));
+	trace.fraction = 1.0;
+
+	Check_ClipBox(start, end, mins, maxs, box_mins, box_maxs, &trace);
+
+	Check_TraceEnd(start, end, &trace);
+
+	return trace;
+}
+
+/*
+ * @brief Returns a random number in [-1.0, 1.0).
+ */
+static vec_t Check_Random(void) {
+	return g_rand_double_range(check_rand, -1.0, 1.0);
+}
+
+/*
+ * @brief Setup fixture. Spawns the edicts at random positions above the floor.
+ * Some are triggers or not solid, and some own others, as projectiles are.
+ */
+void setup(void) {
+	uint16_t i, j;
+
+	Z_Init();
+
+	Fs_Init(false);
+
+	Cmd_Init();
+
+	Cvar_Init();
+
+	Thread_Init();
+
+	check_rand = g_rand_new_with_seed(1);
+
+	memset(&sv, 0, sizeof(sv));
+	memset(&svs, 0, sizeof(svs));
+	memset(check_edicts, 0, sizeof(check_edicts));
+
+	check_game.edicts = check_edicts;
+	check_game.edict_size = sizeof(g_edict_t);
+	check_game.num_edicts = check_game.max_edicts = CHECK_EDICTS + 1;
+
+	svs.game = &check_game;
+
+	VectorSet(check_world.mins, -CHECK_WORLD * 2.0, -CHECK_WORLD * 2.0, -64.0);
+	VectorSet(check_world.maxs, CHECK_WORLD * 2.0, CHECK_WORLD * 2.0, CHECK_WORLD * 2.0);
+
+	sv.models[0] = &check_world;
+
+	Sv_InitWorld();
+
+	for (i = 1; i <= CHECK_EDICTS; i++) {
+		g_edict_t *ent = &check_edicts[i];
+
+		ent->in_use = true;
+		ent->solid = i % 10 == 0 ? SOLID_TRIGGER : i % 17 == 0 ? SOLID_NOT : SOLID_BOX;
+
+		if (i > 1 && i % 5 == 0) {
+			ent->owner = &check_edicts[1 + g_rand_int_range(check_rand, 0, i - 1)];
+		}
+
+		const vec_t size = 8.0 + 24.0 * (Check_Random() + 1.0);
+
+		VectorSet(ent->mins, -size, -size, -size);
+		VectorSet(ent->maxs, size, size, size * 1.5);
+
+		for (j = 0; j < 2; j++) {
+			ent->s.origin[j] = Check_Random() * CHECK_WORLD;
+		}
+		ent->s.origin[2] = size + (Check_Random() + 1.0) * CHECK_WORLD * 0.25;
+
+		Sv_LinkEdict(ent);
+	}
+}
+
+/*
+ * @brief Teardown fixture.
+ */
+void teardown(void) {
+
+	g_rand_free(check_rand);
+
+	Thread_Shutdown();
+
+	Cvar_Shutdown();
+
+	Cmd_Shutdown();
+
+	Fs_Shutdown();
+
+	Z_Shutdown();
+}
+
+/*
+ * @brief Fills in a batch of pellets fired from a random point, some of which
+ * are boxes rather than points, and some of which are fired by an edict.
+ */
+static void Check_Batch(g_trace_t *traces, size_t count, uint32_t batch) {
+	vec3_t org, dir;
+	size_t i;
+	int32_t j;
+
+	for (j = 0; j < 3; j++) {
+		org[j] = Check_Random() * CHECK_WORLD;
+		dir[j] = Check_Random();
+	}
+
+	org[2] = (batch % 8) ? fabs(org[2]) * 0.5 : -8.0; // some start in the floor
+
+	VectorNormalize(dir);
+
+	const g_edict_t *skip = NULL;
+
+	if (batch % 3) { // fired by an edict, from its origin
+		skip = &check_edicts[1 + g_rand_int_range(check_rand, 0, CHECK_EDICTS)];
+		VectorCopy(skip->s.origin, org);
+	}
+
+	memset(traces, 0, sizeof(g_trace_t) * count);
+
+	for (i = 0; i < count; i++) {
+		g_trace_t *t = &traces[i];
+
+		VectorCopy(org, t->start);
+
+		for (j = 0; j < 3; j++) {
+			t->end[j] = org[j] + (dir[j] + Check_Random() * 0.1) * CHECK_RANGE;
+		}
+
+		if (batch % 4 == 0) {
+			VectorSet(t->mins, -4.0, -4.0, -4.0);
+			VectorSet(t->maxs, 4.0, 4.0, 4.0);
+		}
+
+		t->skip = skip;
+		t->mask = MASK_SHOT;
+	}
+}
+
+START_TEST(check_Sv_TraceBatch)
+	{
+		g_trace_t traces[CHECK_PELLETS];
+		uint32_t i, hits = 0;
+		size_t j;
+
+		for (i = 0; i < CHECK_BATCHES; i++) {
+
+			Check_Batch(traces, lengthof(traces), i);
+
+			Sv_TraceBatch(traces, lengthof(traces));
+
+			for (j = 0; j < lengthof(traces); j++) {
+				const g_trace_t *t = &traces[j];
+
+				const c_trace_t tr = Sv_Trace(t->start, t->mins, t->maxs, t->end, t->skip, t->mask);
+
+				ck_assert_msg(tr.fraction == t->trace.fraction, "batch %u, trace %u: %f != %f", i,
+						(uint32_t) j, tr.fraction, t->trace.fraction);
+
+				ck_assert_msg(tr.ent == t->trace.ent, "batch %u, trace %u: edict %d != %d", i,
+						(uint32_t) j, (int32_t) (tr.ent - check_edicts),
+						(int32_t) (t->trace.ent - check_edicts));
+
+				ck_assert(tr.start_solid == t->trace.start_solid);
+				ck_assert(tr.all_solid == t->trace.all_solid);
+				ck_assert(tr.contents == t->trace.contents);
+				ck_assert(VectorCompare(tr.end, t->trace.end));
+				ck_assert(VectorCompare(tr.plane.normal, t->trace.plane.normal));
+
+				if (tr.ent != check_edicts)
+					hits++;
+			}
+		}
+
+		// the traces must have hit enough edicts to be meaningful
+		ck_assert_msg(hits > CHECK_BATCHES, "%u edicts hit", hits);
+
+	}END_TEST
+
+/*
+ * @brief Test entry point.
+ */
+int32_t main(int32_t argc, char **argv) {
+
+	Test_Init(argc, argv);
+
+	TCase *tcase = tcase_create("check_sv_world");
+	tcase_add_checked_fixture(tcase, setup, teardown);
+
+	tcase_add_test(tcase, check_Sv_TraceBatch);
+
+	Suite *suite = suite_create("check_sv_world");
+	suite_add_tcase(suite, tcase);
+
+	int32_t failed = Test_Run(suite);
+
+	Test_Shutdown();
+	return failed;
+}
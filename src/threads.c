@@ -22,93 +22,356 @@
 #include "cvar.h"
 #include "threads.h"
 
+#define THREAD_JOBS 4096 // per thread, must be a power of two
+#define THREAD_HANDLES 64 // concurrent Thread_Create jobs
+#define THREAD_SPINS 64 // failed steals before a worker blocks
+#define THREAD_INHERITS 4 // thread-local states which jobs inherit
+
+typedef struct {
+	ThreadRunFunc Run;
+	ThreadRangeFunc RunRange;
+	void *data;
+	int32_t begin, end;
+	thread_counter_t *counter;
+
+	void *inherited[THREAD_INHERITS]; // the state of the submitting thread
+	uint16_t num_inherited;
+} thread_job_t;
+
+typedef struct {
+	ThreadInheritGetFunc Get;
+	ThreadInheritSetFunc Set;
+} thread_inherit_t;
+
+/*
+ * @brief A Chase-Lev work-stealing deque. The owning thread pushes and pops
+ * jobs at the bottom, while idle threads steal from the top. Indexes wrap,
+ * so they are only ever compared by their signed difference.
+ */
+typedef struct {
+	volatile uint32_t top;
+	byte pad[60]; // keep thieves and the owner on separate cache lines
+	volatile uint32_t bottom;
+
+	thread_job_t jobs[THREAD_JOBS];
+
+	SDL_Thread *thread;
+	uint32_t seed; // for victim selection
+} thread_deque_t;
+
 typedef struct thread_pool_s {
 	SDL_mutex *mutex;
+	SDL_cond *cond; // signaled when jobs are queued, for idle workers
+	SDL_cond *done; // signaled when a counter reaches zero, for Thread_Sync
 
-	thread_t *threads;
-	uint16_t num_threads;
+	volatile int32_t idle; // workers blocked on cond
+	volatile int32_t waiting; // threads blocked on done
+	volatile _Bool shutdown;
+
+	thread_deque_t *deques; // the first belongs to the thread calling Thread_Init
+	uint16_t num_deques;
+
+	thread_t handles[THREAD_HANDLES];
 } thread_pool_t;
 
 static thread_pool_t thread_pool;
 
+// registered by Thread_Inherit, and kept when the pool is resized
+static thread_inherit_t thread_inherits[THREAD_INHERITS];
+static uint16_t thread_num_inherits;
+
+static __thread thread_deque_t *thread_deque;
+
 cvar_t *threads;
 
 /*
- * @brief Wrap the user's function in our own for introspection.
+ * @brief Pushes a job onto the bottom of the owner's deque.
+ *
+ * @return False if the deque is full.
+ */
+static _Bool Thread_Push(thread_deque_t *d, const thread_job_t *job) {
+
+	const uint32_t b = d->bottom;
+
+	if ((int32_t) (b - d->top) >= THREAD_JOBS - 1)
+		return false;
+
+	d->jobs[b & (THREAD_JOBS - 1)] = *job;
+
+	__sync_synchronize();
+
+	d->bottom = b + 1;
+	return true;
+}
+
+/*
+ * @brief Pops the most recently pushed job from the owner's deque.
+ */
+static _Bool Thread_Pop(thread_deque_t *d, thread_job_t *job) {
+
+	const uint32_t b = d->bottom - 1;
+	d->bottom = b;
+
+	__sync_synchronize();
+
+	const uint32_t t = d->top;
+
+	if ((int32_t) (b - t) < 0) { // empty
+		d->bottom = t;
+		return false;
+	}
+
+	*job = d->jobs[b & (THREAD_JOBS - 1)];
+
+	if (b != t)
+		return true;
+
+	// this is the last job, so race any thieves for it
+	const _Bool won = __sync_bool_compare_and_swap(&d->top, t, t + 1);
+
+	d->bottom = t + 1;
+	return won;
+}
+
+/*
+ * @brief Steals the oldest job from another thread's deque.
+ */
+static _Bool Thread_Steal(thread_deque_t *d, thread_job_t *job) {
+
+	const uint32_t t = d->top;
+
+	__sync_synchronize();
+
+	const uint32_t b = d->bottom;
+
+	if ((int32_t) (b - t) <= 0)
+		return false;
+
+	*job = d->jobs[t & (THREAD_JOBS - 1)];
+
+	// the copy is only valid if no other thread claimed it first
+	return __sync_bool_compare_and_swap(&d->top, t, t + 1);
+}
+
+/*
+ * @return True if any deque holds a job which could be stolen.
+ */
+static _Bool Thread_Queued(void) {
+	uint16_t i;
+
+	for (i = 0; i < thread_pool.num_deques; i++) {
+		const thread_deque_t *d = &thread_pool.deques[i];
+
+		if ((int32_t) (d->bottom - d->top) > 0)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * @brief Runs the specified job and signals its counter. The last job of a
+ * group wakes any threads blocked in Thread_Sync.
+ */
+static void Thread_Execute(const thread_job_t *job) {
+	void *restore[THREAD_INHERITS];
+	uint16_t i;
+
+	for (i = 0; i < job->num_inherited; i++) {
+		restore[i] = thread_inherits[i].Get();
+		thread_inherits[i].Set(job->inherited[i]);
+	}
+
+	if (job->RunRange) {
+		job->RunRange(job->begin, job->end, job->data);
+	} else {
+		job->Run(job->data);
+	}
+
+	for (i = 0; i < job->num_inherited; i++) {
+		thread_inherits[i].Set(restore[i]);
+	}
+
+	if (job->counter) {
+		if (__sync_sub_and_fetch(&job->counter->pending, 1) == 0 && thread_pool.waiting) {
+			SDL_mutexP(thread_pool.mutex);
+			SDL_CondBroadcast(thread_pool.done);
+			SDL_mutexV(thread_pool.mutex);
+		}
+	}
+}
+
+/*
+ * @brief Runs a single job, preferring the calling thread's own deque, and
+ * otherwise stealing from a random victim.
+ *
+ * @return True if a job was run, false if no work was found.
+ */
+static _Bool Thread_RunJob(thread_deque_t *self) {
+	thread_job_t job;
+	uint16_t i;
+
+	if (self && Thread_Pop(self, &job)) {
+		Thread_Execute(&job);
+		return true;
+	}
+
+	if (!thread_pool.num_deques)
+		return false;
+
+	uint32_t victim = 0;
+	if (self) {
+		self->seed = self->seed * 1664525 + 1013904223;
+		victim = self->seed >> 16;
+	}
+
+	for (i = 0; i < thread_pool.num_deques; i++) {
+		thread_deque_t *d = &thread_pool.deques[(victim + i) % thread_pool.num_deques];
+
+		if (d != self && Thread_Steal(d, &job)) {
+			Thread_Execute(&job);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * @brief Queues the job on the calling thread's deque, waking a sleeping
+ * worker if there is one. If there are no workers, if the calling thread is
+ * not part of the pool, or if its deque is full, the job is run immediately.
+ */
+static void Thread_Dispatch(thread_job_t *job) {
+	uint16_t i;
+
+	for (i = 0; i < thread_num_inherits; i++) {
+		job->inherited[i] = thread_inherits[i].Get();
+	}
+
+	job->num_inherited = thread_num_inherits;
+
+	if (job->counter) {
+		__sync_fetch_and_add(&job->counter->pending, 1);
+	}
+
+	if (thread_pool.num_deques > 1 && thread_deque && Thread_Push(thread_deque, job)) {
+
+		__sync_synchronize(); // publish the job before checking for idle workers
+
+		if (thread_pool.idle) {
+			SDL_mutexP(thread_pool.mutex);
+			SDL_CondSignal(thread_pool.cond);
+			SDL_mutexV(thread_pool.mutex);
+		}
+	} else {
+		Thread_Execute(job);
+	}
+}
+
+/*
+ * @brief The worker thread main loop: run jobs until shutdown. A worker which
+ * finds nothing to steal for a while blocks until Thread_Dispatch queues a job.
  */
 static int32_t Thread_Run(void *data) {
-	thread_t *t = (thread_t *) data;
+	uint32_t spins = 0;
+
+	thread_deque = (thread_deque_t *) data;
+
+	while (!thread_pool.shutdown) {
+
+		if (Thread_RunJob(thread_deque)) {
+			spins = 0;
+			continue;
+		}
+
+		if (++spins < THREAD_SPINS)
+			continue;
+
+		SDL_mutexP(thread_pool.mutex);
 
-	while (thread_pool.mutex) {
-		SDL_mutexP(t->mutex);
-		if (t->status == THREAD_RUNNING) {
-			t->Run(t->data);
+		thread_pool.idle++;
 
-			t->Run = NULL;
-			t->data = NULL;
+		__sync_synchronize(); // announce idleness before checking for jobs
 
-			t->status = THREAD_WAIT;
-		} else {
-			SDL_CondWait(t->cond, t->mutex);
+		while (!thread_pool.shutdown && !Thread_Queued()) {
+			SDL_CondWait(thread_pool.cond, thread_pool.mutex);
 		}
-		SDL_mutexV(t->mutex);
+
+		thread_pool.idle--;
+
+		SDL_mutexV(thread_pool.mutex);
+
+		spins = 0;
 	}
 
 	return 0;
 }
 
 /*
- * @brief Initializes the threads backing the thread pool.
+ * @brief Initializes the worker threads and their deques. The calling thread
+ * owns the first deque, and participates in work while it waits.
  */
 static void Thread_Init_(void) {
 	int32_t desired_threads;
 
 	desired_threads = threads->integer;
-	if (desired_threads > (uint16_t) (-1))
-		desired_threads = (uint16_t) (-1);
+	if (desired_threads > THREAD_HANDLES)
+		desired_threads = THREAD_HANDLES;
 	else if (desired_threads < 0)
 		desired_threads = 0;
 
-	thread_pool.num_threads = desired_threads;
+	thread_pool.num_deques = desired_threads + 1;
+	thread_pool.deques = Z_Malloc(sizeof(thread_deque_t) * thread_pool.num_deques);
+
+	thread_deque = thread_pool.deques;
 
-	if (thread_pool.num_threads) {
-		thread_pool.threads = Z_Malloc(sizeof(thread_t) * thread_pool.num_threads);
+	thread_deque_t *d = thread_pool.deques;
+	uint16_t i;
 
-		thread_t *t = thread_pool.threads;
-		uint16_t i = 0;
+	for (i = 0; i < thread_pool.num_deques; i++, d++) {
+		d->seed = i + 1;
 
-		for (i = 0; i < thread_pool.num_threads; i++, t++) {
-			t->cond = SDL_CreateCond();
-			t->mutex = SDL_CreateMutex();
-			t->thread = SDL_CreateThread(Thread_Run, t);
+		if (i > 0) {
+			d->thread = SDL_CreateThread(Thread_Run, d);
 		}
 	}
 }
 
-/**
- * Thread_Shutdown_
+/*
+ * @brief Stops the worker threads, and then runs any jobs left behind.
  */
 static void Thread_Shutdown_(void) {
 
-	if (thread_pool.num_threads) {
-		thread_t *t = thread_pool.threads;
-		uint16_t i = 0;
+	if (!thread_pool.deques)
+		return;
 
-		for (i = 0; i < thread_pool.num_threads; i++, t++) {
-			Thread_Wait(&t);
-			SDL_CondSignal(t->cond);
-			SDL_WaitThread(t->thread, NULL);
-			SDL_DestroyCond(t->cond);
-			SDL_DestroyMutex(t->mutex);
-		}
+	SDL_mutexP(thread_pool.mutex);
+
+	thread_pool.shutdown = true;
+	SDL_CondBroadcast(thread_pool.cond);
+
+	SDL_mutexV(thread_pool.mutex);
 
-		Z_Free(thread_pool.threads);
+	thread_deque_t *d = thread_pool.deques;
+	uint16_t i;
+
+	for (i = 0; i < thread_pool.num_deques; i++, d++) {
+		if (d->thread) {
+			SDL_WaitThread(d->thread, NULL);
+		}
 	}
+
+	while (Thread_RunJob(thread_pool.deques))
+		;
+
+	Z_Free(thread_pool.deques);
+	thread_deque = NULL;
 }
 
 /*
- * @brief Creates a new thread to run the specified function. Callers must use
- * Thread_Wait on the returned handle to release the thread when finished.
+ * @brief Creates a new job to run the specified function. Callers must use
+ * Thread_Wait on the returned handle to release it when finished.
  */
 thread_t *Thread_Create_(const char *name, ThreadRunFunc run, void *data) {
 
@@ -120,55 +383,147 @@ thread_t *Thread_Create_(const char *name, ThreadRunFunc run, void *data) {
 		Thread_Init();
 	}
 
-	thread_t *t = thread_pool.threads;
-	uint16_t i = 0;
-
-	// if threads are available, find an idle one and dispatch it
-	if (thread_pool.num_threads) {
-		SDL_mutexP(thread_pool.mutex);
+	thread_t *t = thread_pool.handles;
+	uint16_t i;
 
-		for (i = 0; i < thread_pool.num_threads; i++, t++) {
-			if (t->status == THREAD_IDLE) {
-				SDL_mutexP(t->mutex);
-				g_strlcpy(t->name, name, sizeof(t->name));
-
-				t->Run = run;
-				t->data = data;
-
-				t->status = THREAD_RUNNING;
-				SDL_mutexV(t->mutex);
-				SDL_CondSignal(t->cond);
-				break;
-			}
+	for (i = 0; i < THREAD_HANDLES; i++, t++) {
+		if (__sync_bool_compare_and_swap(&t->status, THREAD_IDLE, THREAD_RUNNING)) {
+			break;
 		}
-
-		SDL_mutexV(thread_pool.mutex);
 	}
 
-	// if we failed to allocate a thread, run the function in this thread
-	if (i == thread_pool.num_threads) {
-		if (thread_pool.num_threads) {
-			Com_Debug("Thread_Create_: No threads available for %s\n", name);
-		}
+	// if we failed to allocate a handle, run the function in this thread
+	if (i == THREAD_HANDLES) {
+		Com_Debug("Thread_Create_: No handles available for %s\n", name);
 		run(data);
+		return NULL;
 	}
 
+	g_strlcpy(t->name, name, sizeof(t->name));
+
+	Thread_Submit(run, data, &t->counter);
+
 	return t;
 }
 
 /*
- * @brief Wait for the specified thread to complete.
+ * @brief Wait for the specified job to complete, running other jobs in the
+ * meantime. The handle is released and cleared.
  */
 void Thread_Wait(thread_t **t) {
 
 	if (!*t || (*t)->status == THREAD_IDLE)
 		return;
 
-	while ((*t)->status != THREAD_WAIT) {
-		usleep(0);
-	}
+	Thread_Sync(&(*t)->counter);
 
 	(*t)->status = THREAD_IDLE;
+	*t = NULL;
+}
+
+/*
+ * @brief Submits a job to the pool. If counter is not NULL, it is incremented
+ * now and decremented once the job completes; see Thread_Sync.
+ */
+void Thread_Submit(ThreadRunFunc run, void *data, thread_counter_t *counter) {
+
+	thread_job_t job = {
+		.Run = run,
+		.data = data,
+		.counter = counter
+	};
+
+	Thread_Dispatch(&job);
+}
+
+/*
+ * @brief Runs the specified function over [0, count) in parallel, in ranges
+ * of grain items, and waits for all of them to complete. If grain is not
+ * positive, a size which yields a few ranges per thread is chosen.
+ */
+void Thread_ParallelFor(int32_t count, int32_t grain, ThreadRangeFunc run, void *data) {
+	thread_counter_t counter = { 0 };
+	int32_t begin;
+
+	if (grain <= 0) {
+		grain = Clamp(count / (Thread_Count() * 4), 1, count);
+	}
+
+	for (begin = 0; begin < count; begin += grain) {
+
+		thread_job_t job = {
+			.RunRange = run,
+			.data = data,
+			.begin = begin,
+			.end = begin + grain < count ? begin + grain : count,
+			.counter = &counter
+		};
+
+		Thread_Dispatch(&job);
+	}
+
+	Thread_Sync(&counter);
+}
+
+/*
+ * @brief Waits for all jobs associated with the counter to complete. The
+ * calling thread runs queued jobs while it waits. Once there are none left to
+ * run, it blocks until the last of the jobs running elsewhere completes.
+ */
+void Thread_Sync(thread_counter_t *counter) {
+
+	while (counter->pending > 0) {
+
+		if (Thread_RunJob(thread_deque))
+			continue;
+
+		SDL_mutexP(thread_pool.mutex);
+
+		thread_pool.waiting++;
+
+		__sync_synchronize(); // announce waiting before checking the counter
+
+		while (counter->pending > 0 && !Thread_Queued()) {
+			SDL_CondWait(thread_pool.done, thread_pool.mutex);
+		}
+
+		thread_pool.waiting--;
+
+		SDL_mutexV(thread_pool.mutex);
+	}
+
+	__sync_synchronize();
+}
+
+/*
+ * @brief Registers thread-local state which jobs inherit from the thread that
+ * submits them, such as the selected collision model. Get returns the calling
+ * thread's state, and Set replaces it. This is called at initialization, before
+ * any jobs which depend on the state are submitted.
+ */
+void Thread_Inherit(ThreadInheritGetFunc get, ThreadInheritSetFunc set) {
+	uint16_t i;
+
+	for (i = 0; i < thread_num_inherits; i++) {
+		if (thread_inherits[i].Get == get)
+			return;
+	}
+
+	if (thread_num_inherits == THREAD_INHERITS) {
+		Com_Error(ERR_FATAL, "Too many inherited states\n");
+	}
+
+	thread_inherits[thread_num_inherits].Get = get;
+	thread_inherits[thread_num_inherits].Set = set;
+
+	thread_num_inherits++;
+}
+
+/*
+ * @return The number of threads which run jobs, including the calling thread.
+ */
+uint16_t Thread_Count(void) {
+	return thread_pool.num_deques ? thread_pool.num_deques : 1;
 }
 
 /*
@@ -176,12 +531,14 @@ void Thread_Wait(thread_t **t) {
  */
 void Thread_Init(void) {
 
-	threads = Cvar_Get("threads", "4", CVAR_ARCHIVE, "Enable or disable multicore processing.");
+	threads = Cvar_Get("threads", "4", CVAR_ARCHIVE, "Number of worker threads for multicore processing.");
 	threads->modified = false;
 
 	memset(&thread_pool, 0, sizeof(thread_pool));
 
 	thread_pool.mutex = SDL_CreateMutex();
+	thread_pool.cond = SDL_CreateCond();
+	thread_pool.done = SDL_CreateCond();
 
 	Thread_Init_();
 }
@@ -191,10 +548,11 @@ void Thread_Init(void) {
  */
 void Thread_Shutdown(void) {
 
-	SDL_DestroyMutex(thread_pool.mutex);
-	thread_pool.mutex = NULL;
-
 	Thread_Shutdown_();
 
+	SDL_DestroyCond(thread_pool.done);
+	SDL_DestroyCond(thread_pool.cond);
+	SDL_DestroyMutex(thread_pool.mutex);
+
 	memset(&thread_pool, 0, sizeof(thread_pool));
 }
@@ -28,20 +28,29 @@
 
 typedef enum thread_status_e {
 	THREAD_IDLE,
-	THREAD_RUNNING,
-	THREAD_WAIT
+	THREAD_RUNNING
 } thread_status_t;
 
 typedef void (*ThreadRunFunc)(void *data);
+typedef void (*ThreadRangeFunc)(int32_t begin, int32_t end, void *data);
+typedef void *(*ThreadInheritGetFunc)(void);
+typedef void (*ThreadInheritSetFunc)(void *state);
 
+/*
+ * @brief Counts the outstanding jobs of a group. Zero-initialize, pass to
+ * Thread_Submit, and then Thread_Sync to wait for the group to complete.
+ */
+typedef struct thread_counter_s {
+	volatile int32_t pending;
+} thread_counter_t;
+
+/*
+ * @brief A handle for a single job dispatched through Thread_Create.
+ */
 typedef struct thread_s {
-	SDL_Thread *thread;
-	SDL_cond *cond;
-	SDL_mutex *mutex;
 	char name[64];
-	thread_status_t status;
-	ThreadRunFunc Run;
-	void *data;
+	volatile thread_status_t status;
+	thread_counter_t counter;
 } thread_t;
 
 extern cvar_t *threads;
@@ -49,6 +58,11 @@ extern cvar_t *threads;
 thread_t *Thread_Create_(const char *name, ThreadRunFunc run, void *data);
 #define Thread_Create(f, d) Thread_Create_(#f, f, d)
 void Thread_Wait(thread_t **t);
+void Thread_Submit(ThreadRunFunc run, void *data, thread_counter_t *counter);
+void Thread_ParallelFor(int32_t count, int32_t grain, ThreadRangeFunc run, void *data);
+void Thread_Sync(thread_counter_t *counter);
+void Thread_Inherit(ThreadInheritGetFunc get, ThreadInheritSetFunc set);
+uint16_t Thread_Count(void);
 void Thread_Init(void);
 void Thread_Shutdown(void);
 
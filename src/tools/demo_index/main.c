@@ -0,0 +1,1175 @@
+/*
+ * Copyright(c) 1997-2001 Id Software, Inc.
+ * Copyright(c) 2002 The Quakeforge Project.
+ * Copyright(c) 2006 Quake2World.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <unistd.h>
+
+#include "common.h"
+#include "files.h"
+#include "net.h"
+#include "swap.h"
+
+#define DEFAULT_INTERVAL 10 // seconds between keyframes
+#define MAX_KEYFRAME_FRAMES 32 // frames restored by a single keyframe
+#define MAX_KEYFRAME_MESSAGE 0x4000 // an uncompressed frame, and then some
+
+quake2world_t quake2world;
+
+/*
+ * Legacy demos contain only the first uncompressed frame. To seek into them,
+ * every frame is decoded, and keyframes are synthesized from the decoded
+ * state: the config_strings, and uncompressed copies of the frames which the
+ * messages following the keyframe are delta compressed from. Messages are
+ * copied through unchanged, so they must be of the current protocol.
+ *
+ * Demos of protocol 1001 are first upgraded to the current protocol. Their
+ * entities, which were sent as a short number and short bits followed by full
+ * precision fields, are decoded and written again as bit-packed deltas from
+ * the frame the client will have decoded. All other commands are copied.
+ */
+
+typedef struct {
+	uint32_t offset; // of the message's data, in the legacy demo
+	uint32_t size;
+	int32_t server_frame; // the frame in the message, or -1
+	int32_t delta_frame;
+	uint32_t level; // the number of server_data messages preceding the message
+} message_t;
+
+typedef struct {
+	int32_t server_frame;
+	_Bool valid; // the frame, and the frame it was delta compressed from, were decoded
+	int32_t area_bytes;
+	byte area_bits[MAX_BSP_AREAS >> 3];
+	player_state_t ps;
+	uint16_t num_entities;
+	entity_state_t entities[MAX_PACKET_ENTITIES];
+} frame_t;
+
+typedef struct {
+	int32_t server_hz;
+	uint32_t level;
+	int32_t last_frame;
+	char config_strings[MAX_CONFIG_STRINGS][MAX_STRING_CHARS];
+	entity_state_t baselines[MAX_EDICTS];
+	frame_t frames[UPDATE_BACKUP];
+} state_t;
+
+static state_t state;
+
+typedef struct {
+	int32_t server_frame;
+	_Bool valid;
+	uint16_t num_entities;
+	entity_state_t entities[MAX_PACKET_ENTITIES];
+	uint16_t bits[MAX_PACKET_ENTITIES]; // as recorded
+} legacy_frame_t;
+
+typedef struct {
+	entity_state_t baselines[MAX_EDICTS];
+	legacy_frame_t frames[UPDATE_BACKUP];
+	uint32_t dropped; // messages whose frame could not be decoded
+} legacy_state_t;
+
+static legacy_state_t legacy;
+
+static GArray *messages; // message_t
+static GHashTable *valid_frames; // server frames which were decoded
+
+static int32_t interval = DEFAULT_INTERVAL * 1000;
+
+/*
+ * @brief
+ */
+static void Error(err_t err, const char *msg) __attribute__((noreturn));
+static void Error(err_t err, const char *msg) {
+
+	fprintf(stderr, "ERROR: %s", msg);
+
+	exit(err);
+}
+
+/*
+ * @brief Decodes the entities of a frame, as Cl_ParseEntities would.
+ */
+static _Bool ParseEntities(size_buf_t *msg, const frame_t *from, frame_t *to) {
+	uint16_t old_index = 0, last_number = 0;
+
+	const uint16_t from_num_entities = from ? from->num_entities : 0;
+
+	to->num_entities = 0;
+
+	while (true) {
+		const uint16_t number = Msg_ReadEntityNumber(msg, last_number);
+
+		if (msg->read > msg->size || number >= MAX_EDICTS)
+			return false;
+
+		if (!number)
+			break;
+
+		const uint16_t bits = Msg_ReadBits(msg, U_BITS);
+		last_number = number;
+
+		// entities present in the old frame, and unchanged
+		while (old_index < from_num_entities && from->entities[old_index].number < number) {
+			entity_state_t *old_ent = (entity_state_t *) &from->entities[old_index++];
+
+			if (to->num_entities == MAX_PACKET_ENTITIES)
+				return false;
+
+			Msg_ReadDeltaEntity(old_ent, &to->entities[to->num_entities++], msg, old_ent->number, 0);
+		}
+
+		entity_state_t *base = &state.baselines[number];
+
+		if (old_index < from_num_entities && from->entities[old_index].number == number)
+			base = (entity_state_t *) &from->entities[old_index++];
+
+		if (bits & U_REMOVE)
+			continue;
+
+		if (to->num_entities == MAX_PACKET_ENTITIES)
+			return false;
+
+		Msg_ReadDeltaEntity(base, &to->entities[to->num_entities++], msg, number, bits);
+	}
+
+	while (old_index < from_num_entities) {
+		entity_state_t *old_ent = (entity_state_t *) &from->entities[old_index++];
+
+		if (to->num_entities == MAX_PACKET_ENTITIES)
+			return false;
+
+		Msg_ReadDeltaEntity(old_ent, &to->entities[to->num_entities++], msg, old_ent->number, 0);
+	}
+
+	return msg->read <= msg->size;
+}
+
+/*
+ * @brief Decodes a frame, as Cl_ParseFrame would.
+ */
+static void ParseFrame(size_buf_t *msg, message_t *m) {
+	const frame_t *from = NULL;
+
+	m->server_frame = Msg_ReadLong(msg);
+	m->delta_frame = Msg_ReadLong(msg);
+
+	Msg_ReadByte(msg); // surpress count
+
+	frame_t *to = &state.frames[m->server_frame & UPDATE_MASK];
+
+	to->server_frame = m->server_frame;
+	to->valid = false;
+
+	state.last_frame = m->server_frame;
+
+	to->area_bytes = Msg_ReadByte(msg);
+
+	if (to->area_bytes > (int32_t) sizeof(to->area_bits))
+		return;
+
+	Msg_ReadData(msg, to->area_bits, to->area_bytes);
+
+	if (m->delta_frame > 0) {
+		from = &state.frames[m->delta_frame & UPDATE_MASK];
+
+		if (from == to || !from->valid || from->server_frame != m->delta_frame)
+			return;
+	}
+
+	Msg_ReadDeltaPlayerState(from ? &from->ps : NULL, &to->ps, msg);
+
+	to->valid = ParseEntities(msg, from, to);
+}
+
+/*
+ * @brief Locates the frame following a command which can not be parsed, such
+ * as a reliable client game command. The frame is recognized by its number,
+ * which follows the last frame, and its delta frame, which was decoded.
+ *
+ * @return True if the frame was found, and the message positioned at it.
+ */
+static _Bool LocateFrame(size_buf_t *msg) {
+	size_t i;
+
+	for (i = msg->read; i + 9 <= msg->size; i++) {
+		int32_t server_frame, delta_frame;
+
+		if (msg->data[i] != SV_CMD_FRAME)
+			continue;
+
+		memcpy(&server_frame, msg->data + i + 1, sizeof(server_frame));
+		memcpy(&delta_frame, msg->data + i + 5, sizeof(delta_frame));
+
+		server_frame = LittleLong(server_frame);
+		delta_frame = LittleLong(delta_frame);
+
+		if (server_frame <= state.last_frame || server_frame - state.last_frame >= UPDATE_BACKUP)
+			continue;
+
+		if (delta_frame > 0) {
+			const frame_t *from = &state.frames[delta_frame & UPDATE_MASK];
+
+			if (delta_frame >= server_frame || !from->valid || from->server_frame != delta_frame)
+				continue;
+		} else if (delta_frame != -1) {
+			continue;
+		}
+
+		msg->read = i + 1;
+		msg->read_bit = 0;
+
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * @brief Locates and decodes the frame following a command which can not be
+ * parsed.
+ */
+static void FindFrame(size_buf_t *msg, message_t *m) {
+
+	if (LocateFrame(msg))
+		ParseFrame(msg, m);
+}
+
+/*
+ * @brief Parses the server commands of a message up to and including the
+ * frame. Client game commands can not be parsed, so the frame following them
+ * is searched for.
+ *
+ * @return False if the demo can not be indexed.
+ */
+static _Bool ParseMessage(size_buf_t *msg, message_t *m) {
+	static entity_state_t null_state;
+
+	while (msg->read < msg->size) {
+		const int32_t cmd = Msg_ReadByte(msg);
+
+		switch (cmd) {
+
+			case SV_CMD_SERVER_DATA: {
+				const int32_t protocol = Msg_ReadLong(msg);
+
+				if (protocol != PROTOCOL) {
+					Com_Print("Unsupported protocol %d\n", protocol);
+					return false;
+				}
+
+				Msg_ReadLong(msg); // server count
+				state.server_hz = Msg_ReadLong(msg);
+				Msg_ReadByte(msg); // demo server
+				Msg_ReadString(msg); // game
+				Msg_ReadShort(msg); // player num
+				Msg_ReadString(msg); // level name
+
+				memset(state.config_strings, 0, sizeof(state.config_strings));
+				memset(state.baselines, 0, sizeof(state.baselines));
+				memset(state.frames, 0, sizeof(state.frames));
+				state.last_frame = 0;
+
+				m->level = ++state.level;
+				break;
+			}
+
+			case SV_CMD_CONFIG_STRING: {
+				const uint16_t i = Msg_ReadShort(msg);
+				const char *s = Msg_ReadString(msg);
+
+				if (i < MAX_CONFIG_STRINGS)
+					g_strlcpy(state.config_strings[i], s, MAX_STRING_CHARS);
+				break;
+			}
+
+			case SV_CMD_BASELINE: {
+				const uint16_t number = Msg_ReadShort(msg);
+				const uint16_t bits = Msg_ReadBits(msg, U_BITS);
+
+				if (number >= MAX_EDICTS)
+					return false;
+
+				Msg_ReadDeltaEntity(&null_state, &state.baselines[number], msg, number, bits);
+				break;
+			}
+
+			case SV_CMD_CBUF_TEXT:
+				Msg_ReadString(msg);
+				break;
+
+			case SV_CMD_PRINT:
+				Msg_ReadByte(msg);
+				Msg_ReadString(msg);
+				break;
+
+			case SV_CMD_SOUND: {
+				const int32_t flags = Msg_ReadByte(msg);
+				vec3_t origin;
+
+				Msg_ReadByte(msg);
+
+				if (flags & S_ATTEN)
+					Msg_ReadByte(msg);
+
+				if (flags & S_ENTNUM)
+					Msg_ReadShort(msg);
+
+				if (flags & S_ORIGIN)
+					Msg_ReadPos(msg, origin);
+				break;
+			}
+
+			case SV_CMD_FRAME: // the remainder is client game events
+				ParseFrame(msg, m);
+				return true;
+
+			default:
+				FindFrame(msg, m);
+				return true;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * @brief Reads the next message of the legacy demo at the specified offset.
+ *
+ * @return The message, or NULL at the end of the demo.
+ */
+static const byte *ReadMessage(const byte *data, size_t length, size_t *offset, size_buf_t *msg) {
+	int32_t len;
+
+	if (*offset + sizeof(len) > length)
+		return NULL;
+
+	memcpy(&len, data + *offset, sizeof(len));
+	len = LittleLong(len);
+
+	*offset += sizeof(len);
+
+	if (len < 0 || *offset + len > length) // -1 marks the end of the demo
+		return NULL;
+
+	memset(msg, 0, sizeof(*msg));
+	msg->data = (byte *) data + *offset;
+	msg->size = msg->max_size = len;
+
+	*offset += len;
+	return msg->data;
+}
+
+/*
+ * @return The time of the specified message's frame, in milliseconds.
+ */
+static int32_t MessageTime(const message_t *m) {
+	return state.server_hz ? (int64_t) m->server_frame * 1000 / state.server_hz : 0;
+}
+
+/*
+ * @brief Resolves the frames which must be restored for playback to resume at
+ * the specified message: those which it, or any message after it, is delta
+ * compressed from, and which precede it.
+ *
+ * @return The number of frames, or -1 if they can not all be restored.
+ */
+static int32_t KeyframeFrames(guint index, int32_t *frames) {
+	const message_t *m = &g_array_index(messages, message_t, index);
+	int32_t i, j, num_frames = 0;
+	guint k;
+
+	for (k = index; k < messages->len; k++) {
+		const message_t *n = &g_array_index(messages, message_t, k);
+
+		if (n->level != m->level || n->server_frame - m->server_frame >= UPDATE_BACKUP)
+			break;
+
+		if (n->server_frame == -1 || n->delta_frame <= 0 || n->delta_frame >= m->server_frame)
+			continue;
+
+		if (m->server_frame - n->delta_frame >= UPDATE_BACKUP)
+			return -1;
+
+		if (!g_hash_table_contains(valid_frames, GINT_TO_POINTER(n->delta_frame)))
+			return -1;
+
+		for (i = 0; i < num_frames; i++) {
+			if (frames[i] == n->delta_frame)
+				break;
+		}
+
+		if (i < num_frames)
+			continue;
+
+		if (num_frames == MAX_KEYFRAME_FRAMES)
+			return -1;
+
+		// insert it in order, so that they are restored in order
+		for (j = num_frames++; j > 0 && frames[j - 1] > n->delta_frame; j--)
+			frames[j] = frames[j - 1];
+
+		frames[j] = n->delta_frame;
+	}
+
+	return num_frames;
+}
+
+/*
+ * @brief Writes the specified message to the indexed demo, prefixed by its
+ * length.
+ */
+static void WriteMessage(FILE *f, const size_buf_t *msg, _Bool keyframe) {
+	const int32_t len = LittleLong(msg->size | (keyframe ? DEMO_KEYFRAME : 0));
+
+	fwrite(&len, sizeof(len), 1, f);
+	fwrite(msg->data, msg->size, 1, f);
+}
+
+/*
+ * @brief Writes an uncompressed copy of the specified frame. Entity events are
+ * cleared, as they have already happened.
+ */
+static void WriteFrame(size_buf_t *msg, const frame_t *frame) {
+	uint16_t i, last_number = 0;
+
+	Msg_WriteByte(msg, SV_CMD_FRAME);
+	Msg_WriteLong(msg, frame->server_frame);
+	Msg_WriteLong(msg, -1);
+	Msg_WriteByte(msg, 0); // surpress count
+
+	Msg_WriteByte(msg, frame->area_bytes);
+	Msg_WriteData(msg, frame->area_bits, frame->area_bytes);
+
+	Msg_WriteDeltaPlayerState(NULL, (player_state_t *) &frame->ps, msg);
+
+	for (i = 0; i < frame->num_entities; i++) {
+		entity_state_t ent = frame->entities[i];
+		ent.event = 0;
+
+		Msg_WriteEntityNumber(msg, last_number, ent.number);
+		Msg_WriteDeltaEntity(&state.baselines[ent.number], &ent, msg, true, true);
+
+		last_number = ent.number;
+	}
+
+	Msg_WriteEntityNumber(msg, last_number, 0);
+}
+
+/*
+ * @brief Writes a keyframe, restoring the config_strings and the specified
+ * frames, as Cl_WriteDemoKeyframe would.
+ */
+static void WriteKeyframe(FILE *f, const int32_t *frames, int32_t num_frames) {
+	static byte buffer[MAX_KEYFRAME_MESSAGE];
+	size_buf_t msg;
+	int32_t i;
+
+	Sb_Init(&msg, buffer, MAX_MSG_SIZE);
+
+	for (i = 0; i < MAX_CONFIG_STRINGS; i++) {
+		if (*state.config_strings[i] != '\0' || i >= CS_CLIENTS) {
+			if (msg.size + strlen(state.config_strings[i]) + 32 > msg.max_size) {
+				WriteMessage(f, &msg, true);
+				msg.size = 0;
+			}
+
+			Msg_WriteByte(&msg, SV_CMD_CONFIG_STRING);
+			Msg_WriteShort(&msg, i);
+			Msg_WriteString(&msg, state.config_strings[i]);
+		}
+	}
+
+	WriteMessage(f, &msg, true);
+
+	for (i = 0; i < num_frames; i++) {
+		Sb_Init(&msg, buffer, sizeof(buffer));
+
+		WriteFrame(&msg, &state.frames[frames[i] & UPDATE_MASK]);
+		WriteMessage(f, &msg, true);
+	}
+}
+
+/*
+ * @return The protocol declared by the first message of the legacy demo, or -1.
+ */
+static int32_t DemoProtocol(const byte *data, size_t length) {
+	size_t offset = 0;
+	size_buf_t msg;
+
+	if (!ReadMessage(data, length, &offset, &msg))
+		return -1;
+
+	if (msg.size < 5 || Msg_ReadByte(&msg) != SV_CMD_SERVER_DATA)
+		return -1;
+
+	return Msg_ReadLong(&msg);
+}
+
+/*
+ * @brief Reads the fields of a protocol 1001 entity delta, whose number and
+ * bits have already been read, as Msg_ReadDeltaEntity did.
+ */
+static void ReadLegacyDelta(const entity_state_t *from, entity_state_t *to, size_buf_t *msg,
+		uint16_t number, uint16_t bits) {
+
+	*to = *from;
+
+	if (!(from->effects & EF_BEAM))
+		VectorCopy(from->origin, to->old_origin);
+
+	to->number = number;
+
+	if (bits & U_ORIGIN)
+		Msg_ReadPos(msg, to->origin);
+
+	if (bits & U_OLD_ORIGIN)
+		Msg_ReadPos(msg, to->old_origin);
+
+	if (bits & U_ANGLES)
+		Msg_ReadAngles(msg, to->angles);
+
+	if (bits & U_ANIMATIONS) {
+		to->animation1 = Msg_ReadByte(msg);
+		to->animation2 = Msg_ReadByte(msg);
+	}
+
+	if (bits & U_EVENT)
+		to->event = Msg_ReadByte(msg);
+	else
+		to->event = 0;
+
+	if (bits & U_EFFECTS)
+		to->effects = Msg_ReadShort(msg);
+
+	if (bits & U_MODELS) {
+		to->model1 = Msg_ReadByte(msg);
+		to->model2 = Msg_ReadByte(msg);
+		to->model3 = Msg_ReadByte(msg);
+		to->model4 = Msg_ReadByte(msg);
+	}
+
+	if (bits & U_CLIENT)
+		to->client = Msg_ReadByte(msg);
+
+	if (bits & U_SOUND)
+		to->sound = Msg_ReadByte(msg);
+
+	if (bits & U_SOLID)
+		to->solid = Msg_ReadShort(msg);
+}
+
+/*
+ * @brief Reads a protocol 1001 entity delta into the next slot of the frame.
+ */
+static _Bool ParseLegacyEntity(size_buf_t *msg, const entity_state_t *from, legacy_frame_t *to,
+		uint16_t number, uint16_t bits) {
+
+	if (to->num_entities == MAX_PACKET_ENTITIES)
+		return false;
+
+	ReadLegacyDelta(from, &to->entities[to->num_entities], msg, number, bits);
+	to->bits[to->num_entities] = bits;
+
+	to->num_entities++;
+	return true;
+}
+
+/*
+ * @brief Decodes the protocol 1001 entities of a frame, as Cl_ParseEntities did.
+ */
+static _Bool ParseLegacyEntities(size_buf_t *msg, const legacy_frame_t *from, legacy_frame_t *to) {
+	uint16_t old_index = 0;
+
+	const uint16_t from_num_entities = from ? from->num_entities : 0;
+
+	to->num_entities = 0;
+
+	while (true) {
+		const uint16_t number = Msg_ReadShort(msg);
+		const uint16_t bits = Msg_ReadShort(msg);
+
+		if (msg->read > msg->size || number >= MAX_EDICTS)
+			return false;
+
+		if (!number)
+			break;
+
+		// entities present in the old frame, and unchanged
+		while (old_index < from_num_entities && from->entities[old_index].number < number) {
+			const entity_state_t *old_ent = &from->entities[old_index++];
+
+			if (!ParseLegacyEntity(msg, old_ent, to, old_ent->number, 0))
+				return false;
+		}
+
+		const entity_state_t *base = &legacy.baselines[number];
+
+		if (old_index < from_num_entities && from->entities[old_index].number == number)
+			base = &from->entities[old_index++];
+
+		if (bits & U_REMOVE)
+			continue;
+
+		if (!ParseLegacyEntity(msg, base, to, number, bits))
+			return false;
+	}
+
+	while (old_index < from_num_entities) {
+		const entity_state_t *old_ent = &from->entities[old_index++];
+
+		if (!ParseLegacyEntity(msg, old_ent, to, old_ent->number, 0))
+			return false;
+	}
+
+	return msg->read <= msg->size;
+}
+
+/*
+ * @brief Writes the delta between the specified entity states, preceded by
+ * the entity's number, as Sv_WriteDeltaEntity would.
+ */
+static void WriteDelta(entity_state_t *from, entity_state_t *to, _Bool force, _Bool is_new,
+		size_buf_t *msg, uint16_t *last_number) {
+	byte buffer[64];
+	size_buf_t delta;
+	size_t i;
+
+	Sb_Init(&delta, buffer, sizeof(buffer));
+	Msg_WriteDeltaEntity(from, to, &delta, force, is_new);
+
+	if (!delta.size)
+		return;
+
+	Msg_WriteEntityNumber(msg, *last_number, to->number);
+
+	for (i = 0; i + 1 < delta.size; i++) {
+		Msg_WriteBits(msg, buffer[i], 8);
+	}
+
+	Msg_WriteBits(msg, buffer[i], delta.write_bit ? delta.write_bit : 8);
+
+	*last_number = to->number;
+}
+
+/*
+ * @brief Writes the entities of the legacy frame as deltas from the frame the
+ * client will have decoded, as Sv_WriteEntities would.
+ */
+static void WriteEntities(size_buf_t *msg, frame_t *from, legacy_frame_t *to) {
+	entity_state_t *old_ent = NULL, *new_ent = NULL;
+	uint16_t old_index = 0, new_index = 0;
+	uint16_t old_num, new_num;
+	uint16_t last_number = 0;
+
+	const uint16_t from_num_entities = from ? from->num_entities : 0;
+
+	while (new_index < to->num_entities || old_index < from_num_entities) {
+		if (new_index >= to->num_entities)
+			new_num = 0xffff;
+		else {
+			new_ent = &to->entities[new_index];
+			new_num = new_ent->number;
+		}
+
+		if (old_index >= from_num_entities)
+			old_num = 0xffff;
+		else {
+			old_ent = &from->entities[old_index];
+			old_num = old_ent->number;
+		}
+
+		if (new_num == old_num) { // old_origin is sent whenever the recording sent it
+			const _Bool is_new = (to->bits[new_index] & U_OLD_ORIGIN) != 0;
+
+			WriteDelta(old_ent, new_ent, false, is_new, msg, &last_number);
+			old_index++;
+			new_index++;
+			continue;
+		}
+
+		if (new_num < old_num) {
+			WriteDelta(&state.baselines[new_num], new_ent, true, true, msg, &last_number);
+			new_index++;
+			continue;
+		}
+
+		Msg_WriteEntityNumber(msg, last_number, old_num);
+		Msg_WriteBits(msg, U_REMOVE, U_BITS);
+
+		last_number = old_num;
+		old_index++;
+	}
+
+	Msg_WriteEntityNumber(msg, last_number, 0);
+}
+
+/*
+ * @brief Decodes a protocol 1001 frame, whose command begins at the specified
+ * offset, and writes it in the current protocol. The frame header and player
+ * state are copied, and the entities are written again.
+ *
+ * @return False if the frame can not be decoded.
+ */
+static _Bool UpgradeFrame(size_buf_t *msg, size_t start, size_buf_t *out) {
+	byte area_bits[MAX_BSP_AREAS >> 3];
+	const legacy_frame_t *from = NULL;
+	frame_t *delta = NULL;
+	player_state_t ps;
+
+	const int32_t server_frame = Msg_ReadLong(msg);
+	const int32_t delta_frame = Msg_ReadLong(msg);
+
+	Msg_ReadByte(msg); // surpress count
+
+	const int32_t area_bytes = Msg_ReadByte(msg);
+
+	if (area_bytes > (int32_t) sizeof(area_bits))
+		return false;
+
+	Msg_ReadData(msg, area_bits, area_bytes);
+	Msg_ReadDeltaPlayerState(NULL, &ps, msg);
+
+	const size_t end = msg->read;
+
+	legacy_frame_t *to = &legacy.frames[server_frame & UPDATE_MASK];
+
+	to->server_frame = server_frame;
+	to->valid = false;
+
+	if (delta_frame > 0) {
+		from = &legacy.frames[delta_frame & UPDATE_MASK];
+		delta = &state.frames[delta_frame & UPDATE_MASK];
+
+		if (from == to || !from->valid || from->server_frame != delta_frame)
+			return false;
+
+		if (!delta->valid || delta->server_frame != delta_frame)
+			return false;
+	}
+
+	if (!(to->valid = ParseLegacyEntities(msg, from, to)))
+		return false;
+
+	Msg_WriteData(out, msg->data + start, end - start);
+	WriteEntities(out, delta, to);
+
+	return true;
+}
+
+/*
+ * @brief Writes the protocol 1001 message in the current protocol. If its
+ * frame can not be decoded, the frame and the commands following it are
+ * dropped.
+ *
+ * @return False if the demo can not be upgraded.
+ */
+static _Bool UpgradeMessage(size_buf_t *msg, size_buf_t *out) {
+	static entity_state_t null_state;
+
+	while (msg->read < msg->size) {
+		const size_t start = msg->read;
+		const int32_t cmd = Msg_ReadByte(msg);
+
+		switch (cmd) {
+
+			case SV_CMD_SERVER_DATA: {
+				const int32_t protocol = Msg_ReadLong(msg);
+
+				if (protocol != PROTOCOL_LEGACY) {
+					Com_Print("Unsupported protocol %d\n", protocol);
+					return false;
+				}
+
+				const size_t offset = msg->read;
+
+				Msg_ReadLong(msg); // server count
+				Msg_ReadLong(msg); // server hz
+				Msg_ReadByte(msg); // demo server
+				Msg_ReadString(msg); // game
+				Msg_ReadShort(msg); // player num
+				Msg_ReadString(msg); // level name
+
+				Msg_WriteByte(out, SV_CMD_SERVER_DATA);
+				Msg_WriteLong(out, PROTOCOL);
+				Msg_WriteData(out, msg->data + offset, msg->read - offset);
+
+				memset(legacy.baselines, 0, sizeof(legacy.baselines));
+				memset(legacy.frames, 0, sizeof(legacy.frames));
+				continue;
+			}
+
+			case SV_CMD_CONFIG_STRING:
+				Msg_ReadShort(msg);
+				Msg_ReadString(msg);
+				break;
+
+			case SV_CMD_BASELINE: {
+				const uint16_t number = Msg_ReadShort(msg);
+				const uint16_t bits = Msg_ReadShort(msg);
+
+				if (!number || number >= MAX_EDICTS)
+					return false;
+
+				entity_state_t *base = &legacy.baselines[number];
+				ReadLegacyDelta(&null_state, base, msg, number, bits);
+
+				Msg_WriteByte(out, SV_CMD_BASELINE);
+				Msg_WriteShort(out, number);
+				Msg_WriteDeltaEntity(&null_state, base, out, true, true);
+				continue;
+			}
+
+			case SV_CMD_CBUF_TEXT:
+				Msg_ReadString(msg);
+				break;
+
+			case SV_CMD_PRINT:
+				Msg_ReadByte(msg);
+				Msg_ReadString(msg);
+				break;
+
+			case SV_CMD_SOUND: {
+				const int32_t flags = Msg_ReadByte(msg);
+				vec3_t origin;
+
+				Msg_ReadByte(msg);
+
+				if (flags & S_ATTEN)
+					Msg_ReadByte(msg);
+
+				if (flags & S_ENTNUM)
+					Msg_ReadShort(msg);
+
+				if (flags & S_ORIGIN)
+					Msg_ReadPos(msg, origin);
+				break;
+			}
+
+			case SV_CMD_FRAME: // the remainder is client game events
+				if (UpgradeFrame(msg, start, out))
+					Msg_WriteData(out, msg->data + msg->read, msg->size - msg->read);
+				else
+					legacy.dropped++;
+				return true;
+
+			default:
+				if (LocateFrame(msg)) {
+					const size_t frame = msg->read - 1;
+
+					Msg_WriteData(out, msg->data + start, frame - start);
+
+					if (UpgradeFrame(msg, frame, out))
+						Msg_WriteData(out, msg->data + msg->read, msg->size - msg->read);
+					else
+						legacy.dropped++;
+				} else {
+					Msg_WriteData(out, msg->data + start, msg->size - start);
+				}
+				return true;
+		}
+
+		if (msg->read > msg->size)
+			return false;
+
+		Msg_WriteData(out, msg->data + start, msg->read - start);
+	}
+
+	return msg->read <= msg->size;
+}
+
+/*
+ * @brief Upgrades the protocol 1001 demo to the current protocol. Each message
+ * written is decoded as the client would decode it, so that the next frame may
+ * be written as a delta from it.
+ *
+ * @return The upgraded demo, without a header, or NULL on error.
+ */
+static GByteArray *UpgradeDemo(const byte *data, size_t length) {
+	static byte buffer[MAX_KEYFRAME_MESSAGE];
+	GByteArray *demo = g_byte_array_new();
+	size_t offset = 0;
+	size_buf_t msg;
+
+	memset(&state, 0, sizeof(state));
+	memset(&legacy, 0, sizeof(legacy));
+
+	while (ReadMessage(data, length, &offset, &msg)) {
+		size_buf_t out;
+
+		Sb_Init(&out, buffer, sizeof(buffer));
+
+		if (!UpgradeMessage(&msg, &out)) {
+			g_byte_array_free(demo, true);
+			return NULL;
+		}
+
+		if (!out.size)
+			continue;
+
+		const int32_t len = LittleLong(out.size);
+
+		g_byte_array_append(demo, (guint8 *) &len, sizeof(len));
+		g_byte_array_append(demo, out.data, out.size);
+
+		message_t m;
+
+		memset(&m, 0, sizeof(m));
+		m.server_frame = -1;
+
+		ParseMessage(&out, &m);
+	}
+
+	const int32_t len = -1;
+	g_byte_array_append(demo, (guint8 *) &len, sizeof(len));
+
+	return demo;
+}
+
+/*
+ * @brief Decodes every message of the legacy demo, recording its frame.
+ *
+ * @return False if the demo can not be indexed.
+ */
+static _Bool ScanDemo(const byte *data, size_t length) {
+	size_t offset = 0;
+	size_buf_t msg;
+
+	memset(&state, 0, sizeof(state));
+
+	while (ReadMessage(data, length, &offset, &msg)) {
+		message_t m;
+
+		memset(&m, 0, sizeof(m));
+
+		m.offset = offset - msg.size;
+		m.size = msg.size;
+		m.server_frame = -1;
+
+		if (!ParseMessage(&msg, &m))
+			return false;
+
+		if (!m.level)
+			m.level = state.level;
+
+		if (m.server_frame != -1 && state.frames[m.server_frame & UPDATE_MASK].valid)
+			g_hash_table_insert(valid_frames, GINT_TO_POINTER(m.server_frame), GINT_TO_POINTER(true));
+
+		g_array_append_val(messages, m);
+	}
+
+	return true;
+}
+
+/*
+ * @brief Writes the indexed demo, inserting a keyframe ahead of the first
+ * message of each interval which can be restored. Keyframes are only written
+ * for the first level of the demo, as the level is not reloaded when seeking.
+ *
+ * @return The number of keyframes written.
+ */
+static uint32_t WriteDemo(FILE *f, const byte *data) {
+	int32_t frames[MAX_KEYFRAME_FRAMES];
+	GArray *keyframes = g_array_new(false, false, sizeof(demo_keyframe_t));
+	demo_header_t header;
+	demo_index_t index;
+	int32_t start = -1, next = 0;
+	guint i;
+
+	header.magic = LittleLong(DEMO_MAGIC);
+	header.version = LittleLong(DEMO_VERSION);
+	header.interval = LittleLong(interval);
+	header.compression = LittleLong(DEMO_COMPRESSION_NONE);
+
+	fwrite(&header, sizeof(header), 1, f);
+
+	memset(&state, 0, sizeof(state));
+
+	for (i = 0; i < messages->len; i++) {
+		message_t *m = &g_array_index(messages, message_t, i);
+		size_buf_t msg;
+
+		if (m->level == 1 && g_hash_table_contains(valid_frames, GINT_TO_POINTER(m->server_frame))) {
+
+			if (start == -1)
+				start = MessageTime(m);
+
+			const int32_t time = MessageTime(m) - start;
+
+			if (time >= next) {
+				const int32_t num_frames = KeyframeFrames(i, frames);
+
+				if (num_frames != -1) {
+					demo_keyframe_t keyframe;
+
+					keyframe.time = LittleLong(time);
+					keyframe.offset = LittleLong(ftell(f));
+
+					g_array_append_val(keyframes, keyframe);
+
+					WriteKeyframe(f, frames, num_frames);
+					next = time + interval;
+				}
+			}
+		}
+
+		memset(&msg, 0, sizeof(msg));
+		msg.data = (byte *) data + m->offset;
+		msg.size = msg.max_size = m->size;
+
+		WriteMessage(f, &msg, false);
+
+		// decode the message, so that the following keyframes may be written
+		message_t copy = *m;
+		ParseMessage(&msg, &copy);
+	}
+
+	const int32_t len = -1;
+	fwrite(&len, sizeof(len), 1, f);
+
+	if (keyframes->len)
+		fwrite(keyframes->data, sizeof(demo_keyframe_t), keyframes->len, f);
+
+	index.num_keyframes = LittleLong(keyframes->len);
+	index.magic = LittleLong(DEMO_INDEX_MAGIC);
+
+	fwrite(&index, sizeof(index), 1, f);
+
+	const uint32_t num_keyframes = keyframes->len;
+	g_array_free(keyframes, true);
+
+	return num_keyframes;
+}
+
+/*
+ * @brief Upgrades the specified legacy demo to the indexed format, in place.
+ */
+static _Bool IndexDemo(const char *path) {
+	gchar *data;
+	gsize length;
+	_Bool indexed = false;
+
+	if (!g_file_get_contents(path, &data, &length, NULL)) {
+		Com_Warn("Failed to read %s\n", path);
+		return false;
+	}
+
+	int32_t magic = 0;
+
+	if (length >= sizeof(magic))
+		memcpy(&magic, data, sizeof(magic));
+
+	if (LittleLong(magic) == DEMO_MAGIC) {
+		Com_Print("%s is already indexed\n", path);
+		g_free(data);
+		return true;
+	}
+
+	const int32_t protocol = DemoProtocol((byte *) data, length);
+
+	if (protocol == PROTOCOL_LEGACY) {
+		GByteArray *demo = UpgradeDemo((byte *) data, length);
+
+		g_free(data);
+
+		if (!demo) {
+			Com_Warn("Failed to upgrade %s from protocol %d\n", path, protocol);
+			return false;
+		}
+
+		if (legacy.dropped)
+			Com_Print("%s: %u frames could not be decoded, and were dropped\n", path, legacy.dropped);
+
+		length = demo->len;
+		data = (gchar *) g_byte_array_free(demo, false);
+	} else if (protocol > 0 && protocol != PROTOCOL) {
+		Com_Warn("%s is protocol %d, which can not be upgraded\n", path, protocol);
+		g_free(data);
+		return false;
+	}
+
+	messages = g_array_new(false, false, sizeof(message_t));
+	valid_frames = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	if (ScanDemo((byte *) data, length)) {
+		char temp[MAX_OSPATH];
+		FILE *f;
+
+		g_snprintf(temp, sizeof(temp), "%s.tmp", path);
+
+		if ((f = fopen(temp, "wb"))) {
+			const uint32_t num_keyframes = WriteDemo(f, (byte *) data);
+
+			if (!ferror(f) && !fclose(f) && !rename(temp, path)) {
+				Com_Print("%s: %u messages, %u keyframes\n", path, messages->len, num_keyframes);
+				indexed = true;
+			} else {
+				Com_Warn("Failed to write %s\n", path);
+				unlink(temp);
+			}
+		} else {
+			Com_Warn("Failed to open %s\n", temp);
+		}
+	} else {
+		Com_Warn("Failed to parse %s\n", path);
+	}
+
+	g_hash_table_destroy(valid_frames);
+	g_array_free(messages, true);
+
+	g_free(data);
+
+	return indexed;
+}
+
+/*
+ * @brief Upgrades each of the legacy demos specified on the command line to
+ * the indexed format, so that they may be seeked with demo_seek.
+ */
+int32_t main(int32_t argc, char **argv) {
+	int32_t i, failed = 0;
+
+	memset(&quake2world, 0, sizeof(quake2world));
+
+	quake2world.Error = Error;
+
+	Com_Init(argc, argv);
+
+	if (Com_Argc() < 2) {
+		Com_Print("Usage: %s [-i seconds] <demo> [demo ...]\n", Com_Argv(0));
+		return 1;
+	}
+
+	for (i = 1; i < Com_Argc(); i++) {
+
+		if (!g_strcmp0(Com_Argv(i), "-i") || !g_strcmp0(Com_Argv(i), "-interval")) {
+			interval = Clamp(atoi(Com_Argv(i + 1)), 1, 600) * 1000;
+			i++;
+			continue;
+		}
+
+		if (!IndexDemo(Com_Argv(i)))
+			failed++;
+	}
+
+	return failed;
+}
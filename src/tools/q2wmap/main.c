@@ -21,6 +21,7 @@
 
 #include <SDL/SDL.h>
 #include "q2wmap.h"
+#include "cmodel.h"
 
 quake2world_t quake2world;
 
@@ -125,6 +126,8 @@ static void Init(void) {
 
 	Thread_Init();
 
+	Cm_Init();
+
 	Sem_Init();
 }
 
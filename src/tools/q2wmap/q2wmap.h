@@ -58,9 +58,11 @@ void Sem_Init(void);
 void Sem_Shutdown(void);
 
 typedef struct thread_work_s {
-	int32_t index; // current work cycle
+	volatile int32_t index; // next work cycle to be claimed
 	int32_t count; // total work cycles
+	volatile int32_t completed; // work cycles completed
 	int32_t fraction; // last fraction of work completed (tenths)
+	volatile uint64_t cost; // microseconds spent in work cycles, across all threads
 	_Bool progress; // are we reporting progress
 } thread_work_t;
 
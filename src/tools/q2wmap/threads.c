@@ -55,37 +55,67 @@ void Sem_Shutdown(void) {
 
 }
 
+#define THREAD_WORK_USEC 500 // target duration of a chunk of work
+
 /*
- * @brief Return an iteration of work, updating progress when appropriate.
+ * @brief Claims the next chunk of work, sizing it to take roughly
+ * THREAD_WORK_USEC based on the cost measured so far. Chunks shrink as work
+ * runs out, so that the last of it is spread across all threads.
+ *
+ * @return The first work cycle of the chunk, or -1 if no work remains.
  */
-static int32_t GetThreadWork(void) {
-	int r;
-	int f;
+static int32_t GetThreadWork(int32_t *end) {
+	uint64_t chunk = 1;
 
-	ThreadLock();
+	const int32_t completed = thread_work.completed;
+	if (completed) {
+		const uint64_t cost = thread_work.cost;
+		chunk = cost ? (THREAD_WORK_USEC * (uint64_t) completed) / cost : thread_work.count;
+	}
 
-	if (thread_work.index == thread_work.count) { // done
-		ThreadUnlock();
+	const int32_t balance = (thread_work.count - thread_work.index) / (Thread_Count() * 2);
+	if (chunk > (uint64_t) balance)
+		chunk = balance > 1 ? balance : 1;
+	else if (chunk < 1)
+		chunk = 1;
+
+	const int32_t begin = __sync_fetch_and_add(&thread_work.index, (int32_t) chunk);
+
+	if (begin >= thread_work.count) // done
 		return -1;
-	}
+
+	*end = begin + chunk < thread_work.count ? begin + chunk : thread_work.count;
+	return begin;
+}
+
+/*
+ * @brief Accounts for a completed chunk of work, outputting progress when
+ * appropriate.
+ */
+static void ThreadWorkDone(int32_t count, uint64_t cost) {
+
+	__sync_fetch_and_add(&thread_work.cost, cost);
+
+	const int32_t completed = __sync_add_and_fetch(&thread_work.completed, count);
+
+	if (!thread_work.progress || verbose || debug)
+		return;
 
 	// update work fraction and output progress if desired
-	f = 10 * thread_work.index / thread_work.count;
-	if (f != thread_work.fraction) {
-		thread_work.fraction = f;
-		if (thread_work.progress && !(verbose || debug)) {
-			Com_Print("%i...", f);
-			fflush(stdout);
-		}
-	}
+	int32_t f = 10 * (int64_t) completed / thread_work.count;
+	if (f > 9)
+		f = 9;
 
-	// assign the next work iteration
-	r = thread_work.index;
-	thread_work.index++;
+	if (f > thread_work.fraction) {
+		ThreadLock();
 
-	ThreadUnlock();
+		while (thread_work.fraction < f) {
+			Com_Print("%i...", ++thread_work.fraction);
+		}
+		fflush(stdout);
 
-	return r;
+		ThreadUnlock();
+	}
 }
 
 // generic function pointer to actual work to be done
@@ -96,13 +126,18 @@ static ThreadWorkFunc WorkFunction;
  * chunks of work iteratively until work is finished.
  */
 static void ThreadWork(void *p __attribute__((unused))) {
-	int32_t work;
+	int32_t begin, end;
+
+	while ((begin = GetThreadWork(&end)) != -1) {
+
+		const gint64 start = g_get_monotonic_time();
+
+		int32_t i;
+		for (i = begin; i < end; i++) {
+			WorkFunction(i);
+		}
 
-	while (true) {
-		work = GetThreadWork();
-		if (work == -1)
-			break;
-		WorkFunction(work);
+		ThreadWorkDone(end - begin, g_get_monotonic_time() - start);
 	}
 }
 
@@ -131,49 +166,57 @@ void ThreadUnlock(void) {
 }
 
 /*
- * @brief
+ * @brief Submits one worker loop per thread to the job system, and waits for
+ * them to finish. Idle threads steal loops which have not yet started.
  */
 static void RunThreads(void) {
-	thread_t *t[64];
-	int32_t i;
+	thread_counter_t counter = { 0 };
+	uint16_t i;
 
-	if (!threads->integer) {
-		ThreadWork(0);
-		return;
-	}
+	const uint16_t count = Thread_Count();
 
-	lock = SDL_CreateMutex();
+	if (count > 1) {
+		lock = SDL_CreateMutex();
+	}
 
-	for (i = 0; i < threads->integer; i++)
-		t[i] = Thread_Create(ThreadWork, NULL);
+	for (i = 0; i < count; i++) {
+		Thread_Submit(ThreadWork, NULL, &counter);
+	}
 
-	for (i = 0; i < threads->integer; i++)
-		Thread_Wait(&t[i]);
+	Thread_Sync(&counter);
 
-	SDL_DestroyMutex(lock);
-	lock = NULL;
+	if (lock) {
+		SDL_DestroyMutex(lock);
+		lock = NULL;
+	}
 }
 
 /*
- * @brief Entry point for all thread work requests.
+ * @brief Entry point for all thread work requests. The wall time of the
+ * stage, and the fraction of the available threads it kept busy, are
+ * reported on completion.
  */
 void RunThreadsOn(int32_t workcount, _Bool progress, ThreadWorkFunc func) {
-	time_t start, end;
 
-	thread_work.index = 0;
+	memset(&thread_work, 0, sizeof(thread_work));
+
 	thread_work.count = workcount;
 	thread_work.fraction = -1;
 	thread_work.progress = progress;
 
 	WorkFunction = func;
 
-	start = time(NULL);
+	const gint64 start = g_get_monotonic_time();
 
 	RunThreads();
 
-	end = time(NULL);
+	const vec_t seconds = (g_get_monotonic_time() - start) / 1000000.0;
+	const vec_t utilization = seconds > 0.0 ?
+			thread_work.cost / (seconds * 1000000.0 * Thread_Count()) : 1.0;
 
 	if (thread_work.progress)
-		Com_Print(" (%i seconds)\n", (int32_t) (end - start));
+		Com_Print(" (%.2f seconds, %.0f%% of %u threads)\n", seconds, utilization * 100.0, Thread_Count());
+	else
+		Com_Verbose("%d work cycles in %.2f seconds, %.0f%% of %u threads\n", workcount, seconds,
+				utilization * 100.0, Thread_Count());
 }
-